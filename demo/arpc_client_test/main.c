@@ -22,6 +22,7 @@
 #include <sched.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <mcheck.h>
 #include <pthread.h>
 
@@ -158,6 +159,89 @@ static struct arpc_session_ops ops ={
 
 static const char *g_filepath = NULL;
 static uint64_t g_file_size = 1024;
+static uint32_t g_cq_depth = 0;
+
+// 通过完成队列异步发送请求，最多depth个在途
+static int session_submit_msg(arpc_session_handle_t session_fd, const struct arpc_vmsg *send, int32_t req_num)
+{
+	uint32_t i;
+	int ret, cnt;
+	int32_t submit = 0, done = 0, free_num = 0;
+	arpc_cq_t cq = NULL;
+	struct arpc_msg **req = NULL;
+	struct arpc_msg **free_req = NULL;
+	struct arpc_cq_event events[16];
+
+	cq = arpc_cq_create(g_cq_depth);
+	if (!cq){
+		printf("arpc_cq_create fail\n");
+		return -1;
+	}
+	req = calloc(g_cq_depth, sizeof(struct arpc_msg *));
+	free_req = calloc(g_cq_depth, sizeof(struct arpc_msg *));
+	if (!req || !free_req){
+		ret = -1;
+		goto end;
+	}
+	for (i = 0; i < g_cq_depth; i++) {
+		req[i] = arpc_new_msg(NULL);
+		if (!req[i]){
+			ret = -1;
+			goto end;
+		}
+		req[i]->send = *send;	// 共用发送缓存，只读
+		free_req[free_num++] = req[i];
+	}
+	while (done < req_num) {
+		while (submit < req_num && free_num) {
+			ret = arpc_submit_request(session_fd, free_req[free_num - 1], cq, NULL);
+			if (ret == -EAGAIN){
+				break;
+			}
+			if (ret){
+				printf("arpc_submit_request fail\n");
+				done++;		// 不计入在途
+			}else{
+				free_num--;
+			}
+			submit++;
+		}
+		if (done >= req_num){
+			break;
+		}
+		cnt = arpc_cq_poll(cq, events, sizeof(events)/sizeof(events[0]), 30*1000);
+		if (cnt <= 0){
+			printf("arpc_cq_poll fail or timeout, ret[%d]\n", cnt);
+			ret = -1;
+			goto end;
+		}
+		for (i = 0; i < (uint32_t)cnt; i++) {
+			if (events[i].status){
+				printf("async request fail, status[%d]\n", events[i].status);
+			}
+			arpc_reset_msg(events[i].msg);
+			free_req[free_num++] = events[i].msg;
+			done++;
+		}
+	}
+	ret = 0;
+end:
+	for (i = 0; req && i < g_cq_depth; i++) {
+		if (req[i]){
+			memset(&req[i]->send, 0, sizeof(req[i]->send));
+			arpc_delete_msg(&req[i]);	// 超时仍在途的消息删除会失败
+		}
+	}
+	if (req)
+		free(req);
+	if (free_req)
+		free(free_req);
+	if (arpc_cq_destroy(&cq)){
+		printf("arpc_cq_destroy fail\n");
+	}
+	return ret;
+}
+
 int session_send_msg(arpc_session_handle_t session_fd, int32_t loop_time)
 {
 	uint32_t				i = 0;
@@ -173,6 +257,7 @@ int session_send_msg(arpc_session_handle_t session_fd, int32_t loop_time)
 	SHA256_CTX ctx;
 	struct timeval start_now;
 	struct timeval end_now;
+	int32_t req_num = loop_time/10 + 1;
 
 	file_len = g_file_size;
 	request = arpc_new_msg(NULL);
@@ -213,7 +298,7 @@ int session_send_msg(arpc_session_handle_t session_fd, int32_t loop_time)
 			if (ret != 0){
 				printf("arpc_send_oneway_msg fail\n");
 			}
-			if (loop_time%10 != 0){
+			if (loop_time%10 != 0 || g_cq_depth){
 				continue;
 			}
 			ret = arpc_do_request(session_fd, request, 30*1000);
@@ -222,6 +307,12 @@ int session_send_msg(arpc_session_handle_t session_fd, int32_t loop_time)
 			}
 		}
 
+		if (g_cq_depth){
+			ret = session_submit_msg(session_fd, &request->send, req_num);
+			if (ret){
+				printf("session_submit_msg fail\n");
+			}
+		}
 		free(request->send.vec);
 		request->send.vec = NULL;
 		break;
@@ -267,6 +358,7 @@ int main(int argc, char *argv[])
 	FILE *fp = NULL;
 	struct aprc_option opt = {0};
 	struct timeval start_now;
+	struct arpc_stats stats;
 	struct timeval end_now;
 
 	if (argc < 7) {
@@ -284,6 +376,7 @@ int main(int argc, char *argv[])
 	thread_num = atoi(argv[4]);
 	loop_times = atol(argv[5]);
 	g_file_size = atol(argv[6]) * 1024;
+	g_cq_depth = getenv("ARPC_CQ_DEPTH") ? atoi(getenv("ARPC_CQ_DEPTH")) : 0;	//完成队列异步请求
 
 	if (thread_num > 256) {
 		printf("thread num: %u over 256\n", thread_num);
@@ -292,6 +385,12 @@ int main(int argc, char *argv[])
 	//SET_FLAG(opt.control, ARPC_E_CTRL_CRC); //开启通信CRC检查
 	opt.msg_iov_max_len = 4*1024;
 	opt.thread_max_num = 32;
+	opt.trace_sample = getenv("ARPC_TRACE_SAMPLE") ? atoi(getenv("ARPC_TRACE_SAMPLE")) : 0;	//链路追踪采样
+	if (getenv("ARPC_STAT_SHM")) {
+		SET_FLAG(opt.control, ARPC_E_CTRL_STAT_SHM);	//共享内存统计，arpc_top查看
+	}
+	opt.metrics_port = getenv("ARPC_METRICS_PORT") ? atoi(getenv("ARPC_METRICS_PORT")) : 0;	//Prometheus指标导出
+	snprintf(opt.metrics_path, sizeof(opt.metrics_path), "%s", getenv("ARPC_METRICS_PATH") ? getenv("ARPC_METRICS_PATH") : "");
 	arpc_init_r(&opt);
 	// 创建session
 	memset(&param, 0, sizeof(param));
@@ -330,7 +429,20 @@ int main(int argc, char *argv[])
 	printf("##### send total QPS:[%lu q/s].\n", (thread_num*loop_times)/end_now.tv_sec);
 	printf("##### send total v:[%lu KB/s].\n", (g_file_size*loop_times*thread_num)/1024/end_now.tv_sec);
 	printf("##### send total times:[%lu.%05lu s] .\n\n", end_now.tv_sec, end_now.tv_usec);
+	if (!arpc_get_session_stats(session_fd, &stats)) {
+		printf("##### req latency p50/p99/p999/max:[%.1f/%.1f/%.1f/%.1f us].\n",
+				stats.lat[ARPC_STAT_LAT_REQ].p50_ns / 1000.0, stats.lat[ARPC_STAT_LAT_REQ].p99_ns / 1000.0,
+				stats.lat[ARPC_STAT_LAT_REQ].p999_ns / 1000.0, stats.lat[ARPC_STAT_LAT_REQ].max_ns / 1000.0);
+		printf("##### oneway latency p50/p99/p999/max:[%.1f/%.1f/%.1f/%.1f us].\n",
+				stats.lat[ARPC_STAT_LAT_OW].p50_ns / 1000.0, stats.lat[ARPC_STAT_LAT_OW].p99_ns / 1000.0,
+				stats.lat[ARPC_STAT_LAT_OW].p999_ns / 1000.0, stats.lat[ARPC_STAT_LAT_OW].max_ns / 1000.0);
+		printf("##### tx/rx bytes:[%lu/%lu].\n", stats.tx_bytes, stats.rx_bytes);
+		printf("##### rx release err:[%lu].\n", stats.rx_release_err);
+	}
 	printf("\n\n################################################\n");
+	if (opt.trace_sample) {
+		arpc_trace_dump("client.trace");
+	}
 	arpc_client_destroy_session(&session_fd);
 
 end:
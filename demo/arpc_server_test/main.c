@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <mcheck.h>
+#include <signal.h>
 
 #include "arpc_com.h"
 #include "arpc_api.h"
@@ -313,6 +314,18 @@ static struct arpc_session_ops cli_ops ={
 /*---------------------------------------------------------------------------*/
 /* main									     */
 /*---------------------------------------------------------------------------*/
+// 收到SIGUSR2时输出追踪记录
+static void *trace_dump_thread(void *arg)
+{
+	sigset_t *set = (sigset_t *)arg;
+	int sig;
+
+	while (!sigwait(set, &sig)) {
+		arpc_trace_dump("server.trace");
+	}
+	return NULL;
+}
+
 int main(int argc, char *argv[])
 {
 	struct arpc_server_param param;
@@ -322,6 +335,8 @@ int main(int argc, char *argv[])
 	arpc_server_t server_fd = NULL;
 	char file_name[256] = "file_rx";
 	struct aprc_option opt = {0};
+	static sigset_t trace_sig;
+	pthread_t trace_thread;
 	
 	SERVER_LOG("null inputn------------------");
 	if (argc < 2) {
@@ -330,6 +345,18 @@ int main(int argc, char *argv[])
 	}
 	//SET_FLAG(opt.control, ARPC_E_CTRL_CRC); //开启通信CRC检查
 	opt.thread_max_num = 32;
+	opt.trace_sample = getenv("ARPC_TRACE_SAMPLE") ? atoi(getenv("ARPC_TRACE_SAMPLE")) : 0;	//链路追踪采样
+	if (getenv("ARPC_STAT_SHM")) {
+		SET_FLAG(opt.control, ARPC_E_CTRL_STAT_SHM);	//共享内存统计，arpc_top查看
+	}
+	opt.metrics_port = getenv("ARPC_METRICS_PORT") ? atoi(getenv("ARPC_METRICS_PORT")) : 0;	//Prometheus指标导出
+	snprintf(opt.metrics_path, sizeof(opt.metrics_path), "%s", getenv("ARPC_METRICS_PATH") ? getenv("ARPC_METRICS_PATH") : "");
+	if (opt.trace_sample) {
+		sigemptyset(&trace_sig);
+		sigaddset(&trace_sig, SIGUSR2);
+		pthread_sigmask(SIG_BLOCK, &trace_sig, NULL);	// 先于其它线程创建屏蔽，信号只由dump线程接收
+		pthread_create(&trace_thread, NULL, trace_dump_thread, &trace_sig);
+	}
 	arpc_init_r(&opt);
 	if (argc > 2) {
 		memset(&cli_param, 0, sizeof(cli_param));
@@ -361,6 +388,8 @@ int main(int argc, char *argv[])
 	param.new_session_start = &new_session_start;
 	param.new_session_end = &new_session_end;
 	param.default_ops_usr_ctx = target_fd;
+	param.accept_mode = getenv("ARPC_ACCEPT_MODE") ? atoi(getenv("ARPC_ACCEPT_MODE")) : ARPC_E_ACCEPT_PORTAL;	//1:SO_REUSEPORT,2:再按CPU分流
+	param.rebalance_pct = getenv("ARPC_REBALANCE_PCT") ? atoi(getenv("ARPC_REBALANCE_PCT")) : 0;	//工作线程负载超出均值该百分比时迁移连接
 
 	server_fd = arpc_server_create(&param);
 	if(!server_fd){
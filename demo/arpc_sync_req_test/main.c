@@ -0,0 +1,268 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file main.c
+* \brief 同步请求回归测试
+*
+* 多线程背靠背发起同步请求，校验回复完整且回复资源全部归还传输层。
+* 回复的xio_msg内嵌在请求描述符中，描述符在唤醒请求方后可能被立即复用，
+* 若先完成请求再归还回复，归还会失败并泄漏接收资源。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "arpc_api.h"
+
+#define TEST_LOG(format, arg...) fprintf(stderr, "[ SYNC_REQ ]"format"\n",##arg)
+
+#define TEST_DEFAULT_PORT		20200
+#define TEST_CON_NUM			4
+#define TEST_THREAD_NUM			4
+#define TEST_LOOP_TIMES			2000
+#define TEST_DATA_LEN			1024
+
+static char req_header[] = "<sync:req>";
+static char rsp_body[] = "<sync:rsp>.....................";
+
+static void *mem_alloc(uint32_t size, void *usr_context)
+{
+	return malloc(size);
+}
+static int mem_free(void *buf_ptr, void *usr_context)
+{
+	if(buf_ptr)
+		free(buf_ptr);
+	return 0;
+}
+
+static int process_rx_header(struct arpc_header_msg *header, void* usr_context, uint32_t *flag)
+{
+	SET_METHOD(*flag, METHOD_ALLOC_DATA_BUF);
+	return 0;
+}
+
+static int process_rx_data(const struct arpc_vmsg *req_iov, struct arpc_rsp *rsp, void *usr_context)
+{
+	struct arpc_vmsg *rsp_data;
+
+	if (!req_iov){
+		return 0;
+	}
+	rsp_data = calloc(1, sizeof(struct arpc_vmsg));
+	if (!rsp_data){
+		return -1;
+	}
+	rsp_data->head_len = req_iov->head_len;
+	rsp_data->head = mem_alloc(rsp_data->head_len, NULL);
+	memcpy(rsp_data->head, req_iov->head, req_iov->head_len);
+	rsp_data->vec_num = 1;
+	rsp_data->vec = mem_alloc(sizeof(struct arpc_iov), NULL);
+	rsp_data->vec[0].data = mem_alloc(sizeof(rsp_body), NULL);
+	memcpy(rsp_data->vec[0].data, rsp_body, sizeof(rsp_body));
+	rsp_data->vec[0].len = sizeof(rsp_body);
+	rsp_data->total_data = sizeof(rsp_body);
+	rsp->rsp_iov = rsp_data;
+	rsp->flags = 0;
+	return 0;
+}
+
+static int release_rsp(struct arpc_vmsg *rsp_iov, void *usr_context)
+{
+	if(!rsp_iov){
+		return -1;
+	}
+	mem_free(rsp_iov->head, NULL);
+	if(rsp_iov->vec){
+		mem_free(rsp_iov->vec[0].data, NULL);
+		mem_free(rsp_iov->vec, NULL);
+	}
+	mem_free(rsp_iov, NULL);
+	return 0;
+}
+
+static int process_rx_oneway_data(const struct arpc_vmsg *req_iov, uint32_t *flags, void *usr_context)
+{
+	return 0;
+}
+
+static int new_session_start(const struct arpc_new_session_req *client, struct arpc_new_session_rsp *param, void* usr_context)
+{
+	return 0;
+}
+
+static int new_session_end(arpc_session_handle_t fd, struct arpc_new_session_rsp *param, void* usr_context)
+{
+	return 0;
+}
+
+static struct arpc_session_ops ops ={
+	.req_ops = {
+		.alloc_cb = &mem_alloc,
+		.free_cb = &mem_free,
+		.proc_head_cb = &process_rx_header,
+		.proc_data_cb = &process_rx_data,
+		.proc_async_cb = &process_rx_data,
+		.release_rsp_cb = &release_rsp,
+	},
+	.oneway_ops = {
+		.alloc_cb = &mem_alloc,
+		.free_cb = &mem_free,
+		.proc_head_cb = &process_rx_header,
+		.proc_data_cb = &process_rx_oneway_data,
+		.proc_async_cb = &process_rx_oneway_data,
+	}
+};
+
+static int run_server(int port)
+{
+	struct arpc_server_param param;
+	struct aprc_option opt = {0};
+	arpc_server_t server_fd = NULL;
+
+	opt.thread_max_num = 8;
+	arpc_init_r(&opt);
+	memset(&param, 0, sizeof(param));
+	param.con.type = ARPC_E_TRANS_TCP;
+	memcpy(param.con.ipv4.ip, "127.0.0.1", sizeof("127.0.0.1"));
+	param.con.ipv4.port = port;
+	param.work_num = 2;
+	param.default_ops = ops;
+	param.new_session_start = &new_session_start;
+	param.new_session_end = &new_session_end;
+	server_fd = arpc_server_create(&param);
+	if(!server_fd){
+		TEST_LOG("arpc_server_create fail");
+		return -1;
+	}
+	arpc_server_loop(server_fd, -1);
+	arpc_server_destroy(&server_fd);
+	arpc_finish();
+	return 0;
+}
+
+static int64_t g_fail_num = 0;
+
+static void *worker_thread(void *data)
+{
+	arpc_session_handle_t session_fd = (arpc_session_handle_t)data;
+	struct arpc_msg *request = NULL;
+	struct arpc_iov vec;
+	int32_t i;
+	int ret;
+
+	request = arpc_new_msg(NULL);
+	if (!request){
+		__atomic_add_fetch(&g_fail_num, TEST_LOOP_TIMES, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	vec.data = calloc(1, TEST_DATA_LEN);
+	vec.len = TEST_DATA_LEN;
+	for (i = 0; i < TEST_LOOP_TIMES; i++) {
+		request->send.head = req_header;
+		request->send.head_len = sizeof(req_header);
+		request->send.vec = &vec;
+		request->send.vec_num = 1;
+		request->send.total_data = vec.len;
+		ret = arpc_do_request(session_fd, request, 10*1000);
+		if (ret || request->receive.total_data != sizeof(rsp_body)){
+			TEST_LOG("arpc_do_request fail, ret[%d], rsp len[%lu]", ret, request->receive.total_data);
+			__atomic_add_fetch(&g_fail_num, 1, __ATOMIC_RELAXED);
+		}
+		arpc_reset_msg(request);
+	}
+	memset(&request->send, 0, sizeof(request->send));
+	arpc_delete_msg(&request);
+	free(vec.data);
+	return NULL;
+}
+
+static int run_client(int port)
+{
+	struct arpc_client_session_param param;
+	struct aprc_option opt = {0};
+	struct arpc_stats stats;
+	arpc_session_handle_t session_fd = NULL;
+	pthread_t thread_id[TEST_THREAD_NUM];
+	uint32_t i;
+	int ret = -1;
+
+	opt.msg_iov_max_len = 4*1024;
+	opt.thread_max_num = 8;
+	arpc_init_r(&opt);
+	memset(&param, 0, sizeof(param));
+	param.con.type = ARPC_E_TRANS_TCP;
+	memcpy(param.con.ipv4.ip, "127.0.0.1", sizeof("127.0.0.1"));
+	param.con.ipv4.port = port;
+	param.con_num = TEST_CON_NUM;
+	param.ops = &ops;
+	for (i = 0; i < 10 && !session_fd; i++) {
+		sleep(1);		// 等服务端监听
+		session_fd = arpc_client_create_session(&param);
+	}
+	if (!session_fd){
+		TEST_LOG("arpc_client_create_session fail");
+		goto end;
+	}
+	for (i = 0; i < TEST_THREAD_NUM; i++) {
+		pthread_create(&thread_id[i], NULL, worker_thread, session_fd);
+	}
+	for (i = 0; i < TEST_THREAD_NUM; i++) {
+		pthread_join(thread_id[i], NULL);
+	}
+	if (arpc_get_session_stats(session_fd, &stats)){
+		TEST_LOG("arpc_get_session_stats fail");
+		goto end;
+	}
+	TEST_LOG("requests[%u], fail[%ld], rx rsp[%lu], rx release err[%lu].",
+			TEST_THREAD_NUM * TEST_LOOP_TIMES, g_fail_num, stats.rx_rsp, stats.rx_release_err);
+	if (g_fail_num || stats.rx_release_err || stats.rx_rsp != TEST_THREAD_NUM * TEST_LOOP_TIMES){
+		goto end;
+	}
+	ret = 0;
+end:
+	if (session_fd)
+		arpc_client_destroy_session(&session_fd);
+	arpc_finish();
+	return ret;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	int port = (argc > 1) ? atoi(argv[1]) : TEST_DEFAULT_PORT;
+	int status = 0;
+	pid_t server_pid;
+	int ret;
+
+	// 服务端放在子进程，避免与客户端共用库的全局资源
+	server_pid = fork();
+	if (server_pid < 0){
+		TEST_LOG("fork fail");
+		return 1;
+	}
+	if (server_pid == 0){
+		_exit(run_server(port) ? 1 : 0);
+	}
+	ret = run_client(port);
+	kill(server_pid, SIGKILL);
+	waitpid(server_pid, &status, 0);
+	TEST_LOG("%s", ret ? "FAIL" : "PASS");
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file main.c
+* \brief arpc统计查看
+*
+* 只读映射各进程的/dev/shm/arpc_stat.<pid>，按采样间隔取两次快照之差，显示各session/server的
+* 消息速率、吞吐与区间内的时延分位数。读取只靠序号锁校验，不给被观测进程加任何负担。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arpc_stat_shm.h"
+
+#define TOP_LOG(format, arg...) fprintf(stderr, "[ TOP ]"format"\n",##arg)
+
+#define TOP_PROC_MAX	64
+
+struct top_proc {
+	int32_t						pid;
+	size_t						size;
+	const struct arpc_stat_shm_head	*head;
+	const struct arpc_stat_shm_slot	*slots;
+	struct arpc_stat_shm_slot	*prev;			/* 上一次的快照，gen为0表示无 */
+};
+
+static struct top_proc g_procs[TOP_PROC_MAX];
+static uint32_t g_proc_num = 0;
+static int g_verbose = 0;
+
+static const char *g_lat_name[ARPC_STAT_LAT_MAX] = {
+	"req", "req_queue", "rsp", "rsp_queue", "oneway", "ow_queue",
+	"rx_req", "rx_rsp", "rx_ow", "rx_req_wire", "rx_rsp_wire", "rx_ow_wire",
+};
+
+static int proc_attach(int32_t pid)
+{
+	struct top_proc *proc;
+	const struct arpc_stat_shm_head *head;
+	struct stat st;
+	char path[128];
+	int fd;
+
+	if (g_proc_num >= TOP_PROC_MAX) {
+		TOP_LOG("too many processes, skip pid[%d].", pid);
+		return -1;
+	}
+	snprintf(path, sizeof(path), "%s/%s%d", ARPC_STAT_SHM_DIR, ARPC_STAT_SHM_PREFIX, pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		TOP_LOG("open [%s] fail, errno[%d].", path, errno);
+		return -1;
+	}
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct arpc_stat_shm_head)) {
+		TOP_LOG("[%s] too small.", path);
+		close(fd);
+		return -1;
+	}
+	head = (const struct arpc_stat_shm_head *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (head == MAP_FAILED) {
+		TOP_LOG("mmap [%s] fail, errno[%d].", path, errno);
+		return -1;
+	}
+	if (__atomic_load_n(&head->magic, __ATOMIC_ACQUIRE) != ARPC_STAT_SHM_MAGIC ||
+		head->version != ARPC_STAT_SHM_VERSION || head->slot_size != sizeof(struct arpc_stat_shm_slot) ||
+		sizeof(struct arpc_stat_shm_head) + (size_t)head->slot_num * head->slot_size > (size_t)st.st_size) {
+		TOP_LOG("[%s] is not a stat region of this version.", path);
+		munmap((void *)head, st.st_size);
+		return -1;
+	}
+	proc = &g_procs[g_proc_num];
+	proc->prev = (struct arpc_stat_shm_slot *)calloc(head->slot_num, sizeof(struct arpc_stat_shm_slot));
+	if (!proc->prev) {
+		TOP_LOG("calloc snapshot for pid[%d] fail.", pid);
+		munmap((void *)head, st.st_size);
+		return -1;
+	}
+	proc->pid = pid;
+	proc->size = st.st_size;
+	proc->head = head;
+	proc->slots = (const struct arpc_stat_shm_slot *)(head + 1);
+	g_proc_num++;
+	return 0;
+}
+
+static void proc_scan(void)
+{
+	DIR *dir;
+	struct dirent *ent;
+	size_t len = strlen(ARPC_STAT_SHM_PREFIX);
+
+	dir = opendir(ARPC_STAT_SHM_DIR);
+	if (!dir) {
+		TOP_LOG("opendir [%s] fail, errno[%d].", ARPC_STAT_SHM_DIR, errno);
+		return;
+	}
+	while ((ent = readdir(dir)) != NULL) {
+		if (strncmp(ent->d_name, ARPC_STAT_SHM_PREFIX, len)) {
+			continue;
+		}
+		proc_attach(atoi(ent->d_name + len));
+	}
+	closedir(dir);
+}
+
+// 区间直方图：逐桶相减；最大值只能取累计值，分位数不会超过它
+static void hist_delta(const struct lat_hist *cur, const struct lat_hist *prev, struct lat_hist *out)
+{
+	uint32_t i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		out->bucket[i] = cur->bucket[i] - prev->bucket[i];
+	}
+	out->count = cur->count - prev->count;
+	out->sum_ns = cur->sum_ns - prev->sum_ns;
+	out->max_ns = cur->max_ns;
+}
+
+static void print_head(double interval)
+{
+	char tbuf[32];
+	time_t now = time(NULL);
+	struct tm tm;
+
+	localtime_r(&now, &tm);
+	strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm);
+	if (isatty(STDOUT_FILENO)) {
+		printf("\033[H\033[2J");
+	}
+	printf("arpc_top  %s  interval %.1fs  processes %u\n\n", tbuf, interval, g_proc_num);
+	printf("%-7s %-4s %-6s %4s %10s %10s %10s %10s %9s %9s %9s %9s %9s  %s\n",
+			"PID", "SLOT", "TYPE", "CONN", "TX_MSG/s", "RX_MSG/s", "TX_MB/s", "RX_MB/s",
+			"LAT", "P50(us)", "P99(us)", "P999(us)", "AVG(us)", "NAME");
+}
+
+static void print_slot(const struct top_proc *proc, uint32_t index, const struct arpc_stat_shm_slot *cur,
+						const struct arpc_stat_shm_slot *prev)
+{
+	const struct arpc_stat_set *c = &cur->data.set;
+	const struct arpc_stat_set *p = &prev->data.set;
+	struct lat_hist d;
+	double dt = (double)(cur->update_ns - prev->update_ns) / 1e9;
+	uint64_t tx, rx;
+	uint32_t main_lat = (cur->type == ARPC_STAT_SHM_SERVER) ? ARPC_STAT_LAT_RSP : ARPC_STAT_LAT_REQ;
+	uint32_t i;
+
+	tx = (c->tx_req + c->tx_rsp + c->tx_ow) - (p->tx_req + p->tx_rsp + p->tx_ow);
+	rx = (c->rx_req + c->rx_rsp + c->rx_ow) - (p->rx_req + p->rx_rsp + p->rx_ow);
+	hist_delta(&c->lat[main_lat], &p->lat[main_lat], &d);
+	printf("%-7d %-4u %-6s %4u %10.0f %10.0f %10.2f %10.2f %9s %9.1f %9.1f %9.1f %9.1f  %s%s\n",
+			proc->pid, index, (cur->type == ARPC_STAT_SHM_SERVER) ? "server" : "client", cur->data.conn_num,
+			tx / dt, rx / dt, (c->tx_bytes - p->tx_bytes) / dt / 1048576.0, (c->rx_bytes - p->rx_bytes) / dt / 1048576.0,
+			g_lat_name[main_lat], lat_hist_percentile(&d, 5000) / 1000.0, lat_hist_percentile(&d, 9900) / 1000.0,
+			lat_hist_percentile(&d, 9990) / 1000.0, d.count ? (double)d.sum_ns / d.count / 1000.0 : 0.0,
+			cur->name, (cur->type == ARPC_STAT_SHM_FREE) ? " (closed)" : "");
+	if (!g_verbose) {
+		return;
+	}
+	for (i = 0; i < ARPC_STAT_LAT_MAX; i++) {
+		hist_delta(&c->lat[i], &p->lat[i], &d);
+		if (!d.count) {
+			continue;
+		}
+		printf("%-7s %-4s %-6s %4s %10.0f %10s %10s %10s %9s %9.1f %9.1f %9.1f %9.1f\n",
+				"", "", "", "", d.count / dt, "", "", "", g_lat_name[i],
+				lat_hist_percentile(&d, 5000) / 1000.0, lat_hist_percentile(&d, 9900) / 1000.0,
+				lat_hist_percentile(&d, 9990) / 1000.0, (double)d.sum_ns / d.count / 1000.0);
+	}
+}
+
+// 取本轮快照，与上轮同一对象(gen相同)且有新发布时才输出
+static void sample(int output)
+{
+	struct arpc_stat_shm_slot *cur;
+	struct top_proc *proc;
+	uint32_t p, i;
+
+	cur = (struct arpc_stat_shm_slot *)malloc(sizeof(struct arpc_stat_shm_slot));
+	if (!cur) {
+		TOP_LOG("malloc snapshot fail.");
+		return;
+	}
+	for (p = 0; p < g_proc_num; p++) {
+		proc = &g_procs[p];
+		if (output && kill(proc->pid, 0) && errno == ESRCH) {
+			printf("%-7d (exited, stale %s%s%d)\n", proc->pid, ARPC_STAT_SHM_DIR "/", ARPC_STAT_SHM_PREFIX, proc->pid);
+			continue;
+		}
+		for (i = 0; i < proc->head->slot_num; i++) {
+			if (!__atomic_load_n(&proc->slots[i].gen, __ATOMIC_RELAXED)) {
+				continue;
+			}
+			if (arpc_stat_shm_read_slot(&proc->slots[i], cur)) {
+				if (output) {
+					printf("%-7d %-4u (slot busy)\n", proc->pid, i);
+				}
+				continue;
+			}
+			if (output && proc->prev[i].gen == cur->gen && cur->update_ns > proc->prev[i].update_ns &&
+				(cur->type != ARPC_STAT_SHM_FREE || proc->prev[i].type != ARPC_STAT_SHM_FREE)) {
+				print_slot(proc, i, cur, &proc->prev[i]);
+			}
+			memcpy(&proc->prev[i], cur, sizeof(struct arpc_stat_shm_slot));
+		}
+	}
+	free(cur);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-d interval_s] [-n count] [-v] [pid ...]\n", name);
+	printf("  without pid, watch every %s/%s* region\n", ARPC_STAT_SHM_DIR, ARPC_STAT_SHM_PREFIX);
+	printf("  -v  show every latency type\n");
+}
+
+int main(int argc, char *argv[])
+{
+	double interval = 1.0;
+	int count = -1;
+	int opt;
+	uint32_t i;
+
+	while ((opt = getopt(argc, argv, "d:n:vh")) != -1) {
+		switch (opt) {
+		case 'd':
+			interval = atof(optarg);
+			interval = (interval < 0.1) ? 0.1 : interval;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'v':
+			g_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 0;
+		}
+	}
+	if (optind < argc) {
+		for (; optind < argc; optind++) {
+			proc_attach(atoi(argv[optind]));
+		}
+	} else {
+		proc_scan();
+	}
+	if (!g_proc_num) {
+		TOP_LOG("no arpc stat region found, enable ARPC_E_CTRL_STAT_SHM in the target process.");
+		return -1;
+	}
+
+	sample(0);
+	while (count < 0 || count-- > 0) {
+		usleep((useconds_t)(interval * 1000000));
+		print_head(interval);
+		sample(1);
+		fflush(stdout);
+	}
+	for (i = 0; i < g_proc_num; i++) {
+		munmap((void *)g_procs[i].head, g_procs[i].size);
+		free(g_procs[i].prev);
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file main.c
+* \brief 报文校验吞吐测试
+*
+* 对比查表与硬件加速实现在不同报文长度下的吞吐，并校验两者结果一致。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "csum.h"
+
+#define BENCH_LOG(format, arg...) fprintf(stderr, "[ BENCH ]"format"\n",##arg)
+
+#define BENCH_DEFAULT_TOTAL_MB	1024
+#define BENCH_MAX_LEN			(1024 * 1024)
+
+static const uint32_t g_len[] = {64, 512, 4096, 65536, BENCH_MAX_LEN};
+static const char *g_type_name[CSUM_TYPE_MAX] = {"crc64", "crc32c"};
+static const char *g_impl_name[CSUM_IMPL_MAX] = {"table", "hw"};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double bench_one(enum csum_type type, enum csum_impl impl, const unsigned char *buf, uint32_t len,
+						uint64_t total, uint64_t *out)
+{
+	uint64_t loops = total / len;
+	uint64_t i;
+	uint64_t crc = 0;
+	uint64_t start;
+	uint64_t cost;
+
+	loops = loops ? loops : 1;
+	start = now_ns();
+	for (i = 0; i < loops; i++) {
+		crc = csum_calc_impl(type, impl, crc, buf, len);
+	}
+	cost = now_ns() - start;
+	*out = crc;
+	return cost ? (double)(loops * len) / (double)cost : 0.0;	// GB/s
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned char *buf;
+	uint64_t total;
+	uint64_t crc[CSUM_IMPL_MAX];
+	double gbps[CSUM_IMPL_MAX];
+	uint32_t i;
+	int type, impl;
+	int ret = 0;
+
+	total = (uint64_t)((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_TOTAL_MB) * 1024 * 1024;
+	buf = (unsigned char *)malloc(BENCH_MAX_LEN);
+	if (!buf) {
+		BENCH_LOG("malloc fail.");
+		return -1;
+	}
+	srand(1);
+	for (i = 0; i < BENCH_MAX_LEN; i++) {
+		buf[i] = (unsigned char)rand();
+	}
+
+	csum_init();
+	BENCH_LOG("hw mask[0x%x], crc64 uses[%s], crc32c uses[%s], total[%lu MB] per case.",
+				csum_hw_mask(), csum_impl_name(CSUM_TYPE_CRC64), csum_impl_name(CSUM_TYPE_CRC32C),
+				total >> 20);
+	BENCH_LOG("%-8s %10s %12s %12s %8s", "type", "len", "table GB/s", "hw GB/s", "speedup");
+	for (type = 0; type < CSUM_TYPE_MAX; type++) {
+		for (i = 0; i < sizeof(g_len) / sizeof(g_len[0]); i++) {
+			for (impl = 0; impl < CSUM_IMPL_MAX; impl++) {
+				gbps[impl] = bench_one((enum csum_type)type, (enum csum_impl)impl, buf, g_len[i], total, &crc[impl]);
+			}
+			if (crc[CSUM_IMPL_TABLE] != crc[CSUM_IMPL_HW]) {
+				BENCH_LOG("%s len[%u] result mismatch: %s[0x%lx] %s[0x%lx].", g_type_name[type], g_len[i],
+							g_impl_name[CSUM_IMPL_TABLE], crc[CSUM_IMPL_TABLE],
+							g_impl_name[CSUM_IMPL_HW], crc[CSUM_IMPL_HW]);
+				ret = -1;
+			}
+			BENCH_LOG("%-8s %10u %12.2f %12.2f %7.2fx", g_type_name[type], g_len[i],
+						gbps[CSUM_IMPL_TABLE], gbps[CSUM_IMPL_HW],
+						gbps[CSUM_IMPL_TABLE] > 0 ? gbps[CSUM_IMPL_HW] / gbps[CSUM_IMPL_TABLE] : 0.0);
+		}
+	}
+	free(buf);
+	return ret;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file main.c
+* \brief 线程池伸缩回归测试
+*
+* 轻负载下任务随投随取，排队时延远低于阈值，线程数须保持在thread_min_num；
+* 长任务占满线程、任务积压时须扩容。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "threadpool.h"
+
+#define TEST_LOG(format, arg...) fprintf(stderr, "[ TP_SCALE ]"format"\n",##arg)
+
+#define LIGHT_WORK_NUM		2000
+#define HEAVY_WORK_NUM		40
+#define HEAVY_WORK_US		5000
+
+static uint32_t g_done = 0;
+
+static int light_work(void *usr_ctx)
+{
+	__atomic_add_fetch(&g_done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int heavy_work(void *usr_ctx)
+{
+	usleep(HEAVY_WORK_US);
+	__atomic_add_fetch(&g_done, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int wait_done(uint32_t num)
+{
+	uint32_t i;
+	for (i = 0; i < 10*1000; i++) {
+		if (__atomic_load_n(&g_done, __ATOMIC_ACQUIRE) >= num) {
+			return 0;
+		}
+		usleep(1000);
+	}
+	return -1;
+}
+
+static int run_case(const char *name, uint32_t min_num, uint32_t max_num, uint32_t work_num,
+					int (*loop)(void *usr_ctx), uint32_t burst, uint32_t gap_us, uint32_t gap_spread, uint32_t *max_seen)
+{
+	struct tp_param param;
+	struct tp_thread_work w;
+	tp_handle pool;
+	uint32_t thread_num;
+	uint32_t i;
+	int ret = 0;
+
+	memset(&param, 0, sizeof(param));
+	param.name = name;
+	param.thread_min_num = min_num;
+	param.thread_max_num = max_num;
+	pool = tp_create_thread_pool(&param);
+	if (!pool) {
+		TEST_LOG("[%s] tp_create_thread_pool fail", name);
+		return -1;
+	}
+	__atomic_store_n(&g_done, 0, __ATOMIC_RELEASE);
+	*max_seen = tp_get_pool_thread_num(pool);
+	memset(&w, 0, sizeof(w));
+	w.loop = loop;
+	for (i = 0; i < work_num; i++) {
+		if (!tp_post_one_work(pool, &w, WORK_DONE_AUTO_FREE)) {
+			TEST_LOG("[%s] tp_post_one_work fail", name);
+			ret = -1;
+			break;
+		}
+		if (i % burst == burst - 1) {
+			usleep(gap_us * (i / burst % gap_spread + 1));	// 每批之后间隔不等，覆盖线程刚休眠和长时间空闲后的投递
+		}
+		thread_num = tp_get_pool_thread_num(pool);
+		*max_seen = (thread_num > *max_seen) ? thread_num : *max_seen;
+	}
+	if (!ret && wait_done(i)) {
+		TEST_LOG("[%s] wait work done timeout, done[%u]", name, __atomic_load_n(&g_done, __ATOMIC_ACQUIRE));
+		ret = -1;
+	}
+	thread_num = tp_get_pool_thread_num(pool);
+	*max_seen = (thread_num > *max_seen) ? thread_num : *max_seen;
+	tp_destroy_thread_pool(&pool);
+	return ret;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	uint32_t max_seen = 0;
+	int fail = 0;
+
+	// 轻负载：每批投递比线程数多一个的空任务，批间隔100us~1ms，后投的任务找不到空闲线程，但排队时延很小，不应扩容
+	if (run_case("tp_light", 2, 8, LIGHT_WORK_NUM, light_work, 3, 100, 10, &max_seen) || max_seen != 2) {
+		TEST_LOG("light load: max thread num[%u], expect[2], FAIL", max_seen);
+		fail = 1;
+	}else{
+		TEST_LOG("light load: max thread num[%u], PASS", max_seen);
+	}
+
+	// 重负载：每1ms投递一个5ms长任务，单线程处理不过来，排队时延超过阈值须扩容
+	if (run_case("tp_heavy", 1, 4, HEAVY_WORK_NUM, heavy_work, 1, 1000, 1, &max_seen) || max_seen <= 1) {
+		TEST_LOG("heavy load: max thread num[%u], expect > 1, FAIL", max_seen);
+		fail = 1;
+	}else{
+		TEST_LOG("heavy load: max thread num[%u], PASS", max_seen);
+	}
+	return fail;
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file main.c
+* \brief 消息追踪dump解析
+*
+* 读入一个或多个进程的arpc_trace_dump输出，按trace id还原每个请求经过的各阶段，
+* 输出阶段耗时统计、逐请求时间线、Chrome trace(chrome://tracing、Perfetto)或flamegraph折叠栈。
+* 多个进程的时间按各自文件头的墙上时间基准对齐，跨主机时受两机时钟偏差影响。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "msg_trace.h"
+
+#define DECODE_LOG(format, arg...) fprintf(stderr, "[ DECODE ]"format"\n",##arg)
+
+#define DECODE_STAGE_MAX	(MSG_TRACE_POINT_MAX * MSG_TRACE_POINT_MAX)
+#define DECODE_TYPE_MAX		3
+
+struct decode_event {
+	int64_t		ns;
+	uint64_t	trace_id;
+	uint32_t	pid;
+	uint32_t	tid;
+	uint32_t	conn_id;
+	uint16_t	point;
+	uint16_t	msg_type;
+	uint32_t	arg;
+};
+
+struct decode_stage {
+	uint64_t	cnt;
+	uint64_t	total_ns;
+	uint64_t	max_ns;
+	uint64_t	*samples;
+	uint64_t	cap;
+};
+
+static const char *g_type_name[DECODE_TYPE_MAX] = {"req", "rsp", "oneway"};	/* 与arpc_msg_type一致 */
+
+static struct decode_event *g_events = NULL;
+static uint64_t g_event_num = 0;
+static uint64_t g_event_cap = 0;
+
+static const char *type_name(uint32_t type)
+{
+	return (type < DECODE_TYPE_MAX) ? g_type_name[type] : "unknown";
+}
+
+static int load_file(const char *path)
+{
+	struct msg_trace_file_head head;
+	struct msg_trace_event ev;
+	struct decode_event *out;
+	FILE *fp;
+	uint64_t i;
+	int ret = -1;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		DECODE_LOG("open [%s] fail.", path);
+		return -1;
+	}
+	if (fread(&head, sizeof(head), 1, fp) != 1 || head.magic != MSG_TRACE_FILE_MAGIC ||
+		head.version != MSG_TRACE_FILE_VERSION || head.event_size != sizeof(struct msg_trace_event) || !head.tsc_hz) {
+		DECODE_LOG("[%s] is not a trace dump of this version.", path);
+		goto end;
+	}
+	if (g_event_num + head.event_num > g_event_cap) {
+		g_event_cap = (g_event_num + head.event_num) * 2;
+		out = (struct decode_event *)realloc(g_events, g_event_cap * sizeof(struct decode_event));
+		if (!out) {
+			DECODE_LOG("realloc [%lu] events fail.", g_event_cap);
+			goto end;
+		}
+		g_events = out;
+	}
+	for (i = 0; i < head.event_num; i++) {
+		if (fread(&ev, sizeof(ev), 1, fp) != 1) {
+			DECODE_LOG("[%s] truncated at event[%lu], expect[%lu].", path, i, head.event_num);
+			break;
+		}
+		if (!ev.trace_id) {
+			continue;
+		}
+		out = &g_events[g_event_num++];
+		out->ns = (int64_t)head.base_ns - (int64_t)((double)(int64_t)(head.base_tsc - ev.tsc) * 1e9 / (double)head.tsc_hz);
+		out->trace_id = ev.trace_id;
+		out->pid = head.pid;
+		out->tid = ev.tid;
+		out->conn_id = ev.conn_id;
+		out->point = ev.point;
+		out->msg_type = ev.msg_type;
+		out->arg = ev.arg;
+	}
+	DECODE_LOG("load [%s]: pid[%u], tsc[%lu hz], events[%lu].", path, head.pid, head.tsc_hz, head.event_num);
+	ret = 0;
+end:
+	fclose(fp);
+	return ret;
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+	const struct decode_event *x = (const struct decode_event *)a;
+	const struct decode_event *y = (const struct decode_event *)b;
+
+	if (x->trace_id != y->trace_id) {
+		return (x->trace_id < y->trace_id) ? -1 : 1;
+	}
+	if (x->ns != y->ns) {
+		return (x->ns < y->ns) ? -1 : 1;
+	}
+	return (x->point < y->point) ? -1 : (x->point > y->point);
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+// 相邻两个事件构成一个阶段，按"前一点->后一点"归类
+static void output_summary(void)
+{
+	struct decode_stage stage[DECODE_STAGE_MAX];
+	struct decode_stage *st;
+	const struct decode_event *prev, *cur;
+	uint64_t traces = 0;
+	uint64_t i, d;
+	uint64_t *tmp;
+
+	memset(stage, 0, sizeof(stage));
+	for (i = 0; i < g_event_num; i++) {
+		cur = &g_events[i];
+		if (!i || g_events[i - 1].trace_id != cur->trace_id) {
+			traces++;
+			continue;
+		}
+		prev = &g_events[i - 1];
+		st = &stage[(prev->point % MSG_TRACE_POINT_MAX) * MSG_TRACE_POINT_MAX + (cur->point % MSG_TRACE_POINT_MAX)];
+		d = (uint64_t)(cur->ns - prev->ns);
+		if (st->cnt == st->cap) {
+			st->cap = st->cap ? st->cap * 2 : 256;
+			tmp = (uint64_t *)realloc(st->samples, st->cap * sizeof(uint64_t));
+			if (!tmp) {
+				DECODE_LOG("realloc samples fail.");
+				return;
+			}
+			st->samples = tmp;
+		}
+		st->samples[st->cnt++] = d;
+		st->total_ns += d;
+		st->max_ns = (d > st->max_ns) ? d : st->max_ns;
+	}
+
+	printf("traces: %lu, events: %lu\n", traces, g_event_num);
+	printf("%-26s %10s %12s %12s %12s %12s\n", "stage", "count", "avg(us)", "p50(us)", "p99(us)", "max(us)");
+	for (i = 0; i < DECODE_STAGE_MAX; i++) {
+		st = &stage[i];
+		if (!st->cnt) {
+			continue;
+		}
+		qsort(st->samples, st->cnt, sizeof(uint64_t), u64_cmp);
+		printf("%-12s->%-12s %10lu %12.2f %12.2f %12.2f %12.2f\n",
+				msg_trace_point_name(i / MSG_TRACE_POINT_MAX), msg_trace_point_name(i % MSG_TRACE_POINT_MAX),
+				st->cnt, (double)st->total_ns / st->cnt / 1000.0,
+				st->samples[st->cnt / 2] / 1000.0, st->samples[(st->cnt * 99) / 100] / 1000.0,
+				st->max_ns / 1000.0);
+		free(st->samples);
+	}
+}
+
+static void output_text(void)
+{
+	const struct decode_event *ev;
+	int64_t first = 0;
+	int64_t last = 0;
+	uint64_t i;
+
+	for (i = 0; i < g_event_num; i++) {
+		ev = &g_events[i];
+		if (!i || g_events[i - 1].trace_id != ev->trace_id) {
+			printf("\ntrace[0x%016lx]\n", ev->trace_id);
+			first = ev->ns;
+			last = ev->ns;
+		}
+		printf("  +%10.2fus (+%9.2fus) %-10s %-6s pid[%u] tid[%u] conn[%u] arg[%u]\n",
+				(ev->ns - first) / 1000.0, (ev->ns - last) / 1000.0,
+				msg_trace_point_name(ev->point), type_name(ev->msg_type),
+				ev->pid, ev->tid, ev->conn_id, ev->arg);
+		last = ev->ns;
+	}
+}
+
+// 每个阶段输出一个完整事件，落在阶段结束点所在线程上
+static void output_chrome(void)
+{
+	const struct decode_event *prev, *cur;
+	int64_t base = g_event_num ? g_events[0].ns : 0;
+	int first = 1;
+	uint64_t i;
+
+	for (i = 0; i < g_event_num; i++) {
+		base = (g_events[i].ns < base) ? g_events[i].ns : base;
+	}
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (i = 1; i < g_event_num; i++) {
+		prev = &g_events[i - 1];
+		cur = &g_events[i];
+		if (prev->trace_id != cur->trace_id) {
+			continue;
+		}
+		printf("%s{\"name\":\"%s->%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":%u,\"tid\":%u,\"args\":{\"trace_id\":\"0x%016lx\",\"conn\":%u,\"arg\":%u}}",
+				first ? "" : ",\n",
+				msg_trace_point_name(prev->point), msg_trace_point_name(cur->point), type_name(cur->msg_type),
+				(prev->ns - base) / 1000.0, (cur->ns - prev->ns) / 1000.0,
+				cur->pid, cur->tid, cur->trace_id, cur->conn_id, cur->arg);
+		first = 0;
+	}
+	printf("\n]}\n");
+}
+
+// flamegraph.pl的折叠格式，值为纳秒
+static void output_folded(void)
+{
+	uint64_t total[DECODE_TYPE_MAX + 1][DECODE_STAGE_MAX];
+	const struct decode_event *prev, *cur;
+	uint32_t type, idx;
+	uint64_t i;
+
+	memset(total, 0, sizeof(total));
+	for (i = 1; i < g_event_num; i++) {
+		prev = &g_events[i - 1];
+		cur = &g_events[i];
+		if (prev->trace_id != cur->trace_id) {
+			continue;
+		}
+		type = (prev->msg_type < DECODE_TYPE_MAX) ? prev->msg_type : DECODE_TYPE_MAX;
+		idx = (prev->point % MSG_TRACE_POINT_MAX) * MSG_TRACE_POINT_MAX + (cur->point % MSG_TRACE_POINT_MAX);
+		total[type][idx] += (uint64_t)(cur->ns - prev->ns);
+	}
+	for (type = 0; type <= DECODE_TYPE_MAX; type++) {
+		for (idx = 0; idx < DECODE_STAGE_MAX; idx++) {
+			if (total[type][idx]) {
+				printf("%s;%s->%s %lu\n", type_name(type), msg_trace_point_name(idx / MSG_TRACE_POINT_MAX),
+						msg_trace_point_name(idx % MSG_TRACE_POINT_MAX), total[type][idx]);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *format = "summary";
+	int i = 1;
+
+	if (argc > 2 && !strcmp(argv[1], "-f")) {
+		format = argv[2];
+		i = 3;
+	}
+	if (i >= argc) {
+		printf("Usage: %s [-f summary|text|chrome|folded] <trace file> [trace file ...]\n", argv[0]);
+		return 0;
+	}
+	for (; i < argc; i++) {
+		if (load_file(argv[i])) {
+			free(g_events);
+			return -1;
+		}
+	}
+	qsort(g_events, g_event_num, sizeof(struct decode_event), event_cmp);
+
+	if (!strcmp(format, "summary")) {
+		output_summary();
+	} else if (!strcmp(format, "text")) {
+		output_text();
+	} else if (!strcmp(format, "chrome")) {
+		output_chrome();
+	} else if (!strcmp(format, "folded")) {
+		output_folded();
+	} else {
+		DECODE_LOG("unknown format[%s].", format);
+	}
+	free(g_events);
+	return 0;
+}
@@ -34,9 +34,25 @@ typedef void* arpc_server_t;						/*! @brief server */
 #define _DEF_SESSION_SERVER
 #define _DEF_SESSION_CLIENT
 
+#define ARPC_CPU_LIST_MAX_LEN	128
+#define ARPC_METRICS_PATH_MAX_LEN	108
+
+/*!
+ *  @brief  线程绑核策略，作用于xio loop线程与工作线程
+ *
+ */
+enum arpc_cpu_bind_policy{
+	ARPC_CPU_BIND_NONE = 0, 		/*! @brief 不绑定，默认*/
+	ARPC_CPU_BIND_COMPACT, 			/*! @brief 紧凑：优先占满同一物理核的超线程和同一节点*/
+	ARPC_CPU_BIND_SCATTER, 			/*! @brief 分散：每个物理核一个线程，跨CPU插槽轮转*/
+	ARPC_CPU_BIND_NUMA, 			/*! @brief NUMA节点轮转，线程绑定到节点内全部CPU*/
+	ARPC_CPU_BIND_LIST, 			/*! @brief 按cpu_list指定的CPU依次绑定*/
+	ARPC_CPU_BIND_MAX,
+};
+
 struct aprc_option{
 	uint32_t  thread_max_num;		/*! @brief 最大工作线程数，同一个线程池管理 */
-	uint32_t  cpu_max_num;			/*! @brief cpu核心数，用于线程绑定 */
+	uint32_t  cpu_max_num;			/*! @brief cpu核心数，用于线程绑定，绑核时只使用策略排列中的前cpu_max_num个CPU */
 	uint32_t  msg_head_max_len; 	/*! @brief 每条消息的head最大长度，[128, 1024]，默认256 */
 	uint64_t  msg_data_max_len; 	/*! @brief 每条消息的数据最大长度 ，[1k, 2*1024k] 默认1k，samba读写至少需要1M*/
 	uint32_t  msg_iov_max_len;		/*! @brief IOV最大长度 ，[1024, 8*1024k] 默认1k，pfile需要设置为4k*/
@@ -45,6 +61,15 @@ struct aprc_option{
 	uint32_t  rx_queue_max_depth;  	/*! @brief  接收消息缓冲队列深度度[64, 1024], 默认512*/
 	uint64_t  rx_queue_max_size;    /*! @brief 接收消息缓冲队列buf大小，单位B， 默认64M, 消息长度越大，该值也越大*/
 	uint32_t  control;				/*! @brief 控制属性,按位标识，属性详细见如下定义*/
+	uint32_t  cpu_bind_policy;		/*! @brief 线程绑核策略，见enum arpc_cpu_bind_policy，默认不绑定*/
+	char      cpu_list[ARPC_CPU_LIST_MAX_LEN];	/*! @brief ARPC_CPU_BIND_LIST策略使用的CPU列表，如"0-3,8,10"*/
+	uint32_t  thread_min_num;		/*! @brief 最小工作线程数，[1, thread_max_num]，默认4，等于thread_max_num时线程数固定*/
+	uint32_t  thread_scale_delay_us;	/*! @brief 消息排队时延超过该值时扩容工作线程，单位us，[50, 1000000]，默认500*/
+	uint32_t  thread_idle_timeout_ms;	/*! @brief 工作线程连续空闲超过该值时缩容，单位ms，[100, 3600000]，默认30s*/
+	uint32_t  trace_sample;			/*! @brief 消息链路追踪采样，0关闭(默认)，N表示每N个请求追踪一个，见arpc_trace_set_sample*/
+	uint32_t  metrics_port;			/*! @brief 内嵌Prometheus指标导出的TCP端口，只监听127.0.0.1，0关闭(默认)*/
+	char      metrics_path[ARPC_METRICS_PATH_MAX_LEN];	/*! @brief 指标导出的unix socket路径，非空时优先于metrics_port；*/
+												/*         导出线程以最低优先级运行，只读统计快照，GET /metrics返回文本格式*/
 };
 
 /*!
@@ -55,6 +80,13 @@ struct aprc_option{
 enum arpc_ctrl_attr{
 	ARPC_E_CTRL_NONE = 0,
 	ARPC_E_CTRL_CRC = (1<<0), 		/*! @brief 开启通信crc校验，默认关闭*/
+	ARPC_E_CTRL_RX_ZERO_COPY = (1<<1),	/*! @brief 接收零拷贝，默认关闭。开启后head尽量直接指向传输层缓冲，vec数组取自内部缓存；*/
+										/*         请求/单向消息的head和vec只在处理回调期间有效，回复消息在arpc_msg释放前有效；*/
+										/*         劫持(HIJACK)只转移数据buf的所有权*/
+	ARPC_E_CTRL_ZIP = (1<<2),		/*! @brief 消息数据压缩，默认关闭。两端都开启时会话协商使用内置LZ压缩，数据不足4KB或压缩率不足时原样发送；*/
+										/*         对用户透明，接收方收到的vec与未压缩时一样由alloc_cb分配*/
+	ARPC_E_CTRL_STAT_SHM = (1<<3),	/*! @brief 共享内存统计，默认关闭。开启后每秒把各session/server的计数与时延直方图发布到 */
+									/*         /dev/shm/arpc_stat.<pid>，供arpc_top等外部工具无锁读取，arpc_finish时删除*/
 	ARPC_E_CTRL_MAX = (1<<31), 		/*! @brief 最大标记位*/
 };
 
@@ -94,6 +126,27 @@ int arpc_init();
  */
 void arpc_finish();
 
+/*! 
+ * @brief 设置消息链路追踪采样
+ * 
+ * 被采样的请求在发起端、对端loop线程、工作线程各阶段记录二进制事件到线程本地环，
+ * 每个事件开销几十纳秒。id随消息带到对端，对端也需开启追踪才会记录。
+ * 
+ * @param[in] sample 0关闭；N表示每N个请求/单向消息追踪一个
+ * @return  void; 
+ */
+void arpc_trace_set_sample(uint32_t sample);
+
+/*! 
+ * @brief 把已记录的追踪事件写到文件
+ * 
+ * 每个线程保留最近的事件，不影响正在记录的线程。输出文件用demo/trace_decode解析。
+ * 
+ * @param[in] path 输出文件路径
+ * @return  int; (<em>-1</em>: fail ; ( <em>0</em>: succeed
+ */
+int arpc_trace_dump(const char *path);
+
 enum arpc_trans_type {
 	ARPC_E_TRANS_TCP = 0,
 };
@@ -370,6 +423,65 @@ int arpc_reset_msg(struct arpc_msg *msg);
  */
 int arpc_do_request(const arpc_session_handle_t fd, struct arpc_msg *msg, int32_t timeout_ms);
 
+typedef void* arpc_cq_t;							/*! @brief 完成队列句柄 */
+
+/**
+ * @brief  完成队列事件
+ */
+struct arpc_cq_event{
+	void 				*tag;		/*! @brief 提交请求时的tag */
+	struct arpc_msg		*msg;		/*! @brief 请求消息，回复数据在msg->receive，处理完后需reset/delete释放 */
+	int32_t				status;		/*! @brief 0 成功；-ENODATA 回复数据校验失败；-ECONNRESET 链路异常，请求未得到回复 */
+};
+
+/*! 
+ * @brief 创建完成队列
+ * 
+ * 完成队列用于异步请求：一个线程可以提交多个请求，再由该线程批量收取回复，
+ * 回复处理不在xio loop线程内执行，可以阻塞。
+ * 
+ * @param[in] depth ,队列深度，即同时在途的最大请求数，向上取整为2的幂
+ * @return  arpc_cq_t; (<em>NULL</em>: fail ; ( <em>非NULL</em>: succeed
+ */
+arpc_cq_t arpc_cq_create(uint32_t depth);
+
+/*! 
+ * @brief 销毁完成队列
+ * 
+ * 仍有在途请求或未收取的事件时销毁失败
+ * 
+ * @param[inout] cq ,成功后句柄被置空
+ * @return  int; (<em>-1</em>: fail ; ( <em>0</em>: succeed
+ */
+int arpc_cq_destroy(arpc_cq_t *cq);
+
+/*! 
+ * @brief 异步发送请求
+ * 
+ * 发送请求后立即返回，收到回复（或失败）时向cq投递一个事件，msg->proc_rsp_cb不生效；
+ * 事件收取前msg处于框架锁定状态，不能reset/delete
+ * 
+ * @param[in] fd ,a session handle
+ * @param[in] msg ,a data that will send
+ * @param[in] cq ,完成队列
+ * @param[in] tag ,用户标识，原样在事件中返回
+ * @return int .0,表示发送成功；-EAGAIN 完成队列在途请求已满；其它小于0则失败
+ */
+int arpc_submit_request(const arpc_session_handle_t fd, struct arpc_msg *msg, arpc_cq_t cq, void *tag);
+
+/*! 
+ * @brief 收取完成事件
+ * 
+ * 同一个cq只能由一个线程收取
+ * 
+ * @param[in] cq ,完成队列
+ * @param[out] events ,事件数组
+ * @param[in] max ,事件数组长度
+ * @param[in] timeout_ms ,无事件时的等待时间，0不等待，-1一直等待
+ * @return int .收取的事件数，0表示超时，小于0则失败
+ */
+int arpc_cq_poll(arpc_cq_t cq, struct arpc_cq_event *events, uint32_t max, int32_t timeout_ms);
+
 typedef int (*clean_send_cb_t)(struct arpc_vmsg *send, void* usr_ctx);
 /*! 
  * @brief 发送单向消息
@@ -385,6 +497,28 @@ int arpc_send_oneway_msg(const arpc_session_handle_t fd,
 						clean_send_cb_t clean_send, 
 						void* send_ctx);
 
+/*! @brief 批量单向消息释放回调，整批发送完毕后调用一次，num为成功提交的消息数(send[0]~send[num-1]) */
+typedef int (*clean_sendv_cb_t)(struct arpc_vmsg **send, uint32_t num, void* usr_ctx);
+
+/*! 
+ * @brief 批量发送单向消息
+ * 
+ * 整批只选择一次链路、批量申请描述符、一次唤醒发送线程，按序提交；
+ * 中途失败则停止，未提交的消息仍归调用者所有
+ * 
+ * @param[in] fd ,a session handle
+ * @param[in] send ,消息数组
+ * @param[in] num ,消息个数
+ * @param[in] clean_send ,整批完成回调，为NULL时同步等待整批发送完毕
+ * @param[in] send_ctx ,回调上下文
+ * @return int .成功提交的消息数，小于0则失败(一个也未提交，或同步等待超时)
+ */
+int arpc_send_oneway_msgv(const arpc_session_handle_t fd, 
+						struct arpc_vmsg **send, 
+						uint32_t num,
+						clean_sendv_cb_t clean_send, 
+						void* send_ctx);
+
 /*! @brief 调用者回复消息资源释放回调函数，用于回复消息发送完毕后执行资源释放 */
 typedef int (*rsp_cb_t)(struct arpc_vmsg *rsp_iov, void* rsp_cb_ctx);
 
@@ -435,6 +569,7 @@ int arpc_get_session_opt(const arpc_session_handle_t *ses, struct aprc_session_o
 #define MAX_SESSION_REQ_DATA_LEN  1024								/*! @brief 申请session的数据长度 */
 
 #define ARPC_SESSION_ARRT_CLIENT_CONNECT_ON_USE (1<<0)				/*! @brief 只创建不连接，使用时在建立链接 */
+#define ARPC_SESSION_ARRT_CLIENT_THREAD_AFFINITY (1<<1)			/*! @brief 调用线程固定使用同一连接(按线程id散列)，该连接繁忙或断开时才换用其它连接 */
 /**
  * @brief  客户端session实例化参数
  *
@@ -497,6 +632,74 @@ enum arpc_session_status arpc_get_session_status(const arpc_session_handle_t fd)
  *
  */
 void arpc_session_info(const arpc_session_handle_t fd);
+
+/*!
+ *  @brief  时延统计项
+ *
+ */
+enum arpc_stat_lat_type{
+	ARPC_STAT_LAT_REQ = 0,			/*! @brief 请求从提交到回复处理完、描述符回收 */
+	ARPC_STAT_LAT_REQ_QUEUE,		/*! @brief 请求从提交到交给传输层 */
+	ARPC_STAT_LAT_RSP,				/*! @brief 从收到请求(生成回复描述符)到回复发送完成 */
+	ARPC_STAT_LAT_RSP_QUEUE,		/*! @brief 从收到请求到回复交给传输层 */
+	ARPC_STAT_LAT_OW,				/*! @brief 单向消息从提交到发送完成 */
+	ARPC_STAT_LAT_OW_QUEUE,			/*! @brief 单向消息从提交到交给传输层 */
+	ARPC_STAT_LAT_RX_REQ,			/*! @brief 收到请求头到数据处理完(同步处理时含用户回调) */
+	ARPC_STAT_LAT_RX_RSP,			/*! @brief 收到回复头到交付请求方 */
+	ARPC_STAT_LAT_RX_OW,			/*! @brief 收到单向消息头到数据处理完 */
+	ARPC_STAT_LAT_RX_REQ_WIRE,		/*! @brief 对端提交请求到本端收到头部，依赖两端时钟同步 */
+	ARPC_STAT_LAT_RX_RSP_WIRE,		/*! @brief 对端生成回复到本端收到头部，依赖两端时钟同步 */
+	ARPC_STAT_LAT_RX_OW_WIRE,		/*! @brief 对端提交单向消息到本端收到头部，依赖两端时钟同步 */
+	ARPC_STAT_LAT_MAX,
+};
+
+struct arpc_lat_stats{
+	uint64_t	count;
+	uint64_t	avg_ns;
+	uint64_t	p50_ns;
+	uint64_t	p99_ns;
+	uint64_t	p999_ns;
+	uint64_t	max_ns;
+};
+
+/*!
+ *  @brief  连接/会话/服务端的累计统计，会话与服务端包含已断开连接的历史数据
+ *
+ */
+struct arpc_stats{
+	uint32_t	conn_num;				/*! @brief 当前连接数 */
+	uint64_t	tx_req;					/*! @brief 发送消息数 */
+	uint64_t	tx_rsp;
+	uint64_t	tx_ow;
+	uint64_t	rx_req;					/*! @brief 接收消息数 */
+	uint64_t	rx_rsp;
+	uint64_t	rx_ow;
+	uint64_t	tx_bytes;				/*! @brief 交给传输层的字节数，含头部 */
+	uint64_t	rx_bytes;				/*! @brief 收到的字节数，含头部 */
+	uint64_t	rx_release_err;			/*! @brief 向传输层归还接收资源失败的次数，正常应为0 */
+	struct arpc_lat_stats	lat[ARPC_STAT_LAT_MAX];
+};
+
+/*!
+ *  @brief  获取session的统计
+ *
+ *  @param[in] fd  session句柄
+ *  @param[out] stats  所有连接合并后的统计
+ *  @return  int; (<em>-1</em>: fail ; ( <em>0</em>: succeed
+ *
+ */
+int arpc_get_session_stats(const arpc_session_handle_t fd, struct arpc_stats *stats);
+
+/*!
+ *  @brief  获取session中单个连接的统计
+ *
+ *  @param[in] fd  session句柄
+ *  @param[in] index  连接序号，从0开始，不超过当前连接数
+ *  @param[out] stats  该连接的统计，conn_num为1
+ *  @return  int; (<em>-1</em>: fail或序号越界 ; ( <em>0</em>: succeed
+ *
+ */
+int arpc_get_conn_stats(const arpc_session_handle_t fd, uint32_t index, struct arpc_stats *stats);
 #endif
 
 
@@ -551,6 +754,41 @@ struct arpc_new_session_rsp{
 	#endif
 };
 
+/*!
+ *  @brief  服务端接受session的方式
+ *
+ */
+enum arpc_accept_mode{
+	ARPC_E_ACCEPT_PORTAL = 0,		/*! @brief 默认。主线程在port上握手，工作线程依次监听port+1...port+work_num*/
+	ARPC_E_ACCEPT_REUSEPORT,		/*! @brief 工作线程以SO_REUSEPORT共同监听port，各自完成握手，不再占用额外端口*/
+	ARPC_E_ACCEPT_REUSEPORT_CPU,	/*! @brief 同上，且按收包CPU选择工作线程，宜配合网卡队列中断绑核使用*/
+	ARPC_E_ACCEPT_MAX,
+};
+
+/*!
+ *  @brief  工作线程的负载快照，用于新session的放置
+ *
+ */
+struct arpc_work_load {
+	/*! @brief 工作线程序号，与arpc_work_N的N一致 */
+	uint32_t						index;
+
+	/*! @brief 绑定的CPU，-1不绑定 */
+	int32_t							cpu;
+
+	/*! @brief 所在NUMA节点，-1未知 */
+	int32_t							numa_node;
+
+	/*! @brief 连接数，含已分配给新session、尚未建立的连接 */
+	uint32_t						conn_num;
+
+	/*! @brief 最近一次采样时的在途消息数 */
+	uint64_t						inflight;
+
+	/*! @brief 最近一个采样周期的收发字节速率，B/s */
+	uint64_t						bytes_rate;
+};
+
 /*!
  *  @brief session服务端实例化参数
  *
@@ -588,6 +826,21 @@ struct arpc_server_param {
 
 	/*! @brief session 配置参数，可选，用于资源和性能优化*/
 	struct aprc_session_opt		opt;
+
+	/*! @brief 接受session的方式，见enum arpc_accept_mode，默认ARPC_E_ACCEPT_PORTAL。
+	 *         SO_REUSEPORT方式下new_session_start/new_session_end会在各工作线程并发回调 */
+	uint32_t						accept_mode;
+
+	/*! @brief 新session的放置策略，可选。按优先顺序把works的下标写入order(共work_num个)，
+	 *         客户端的第i条连接落在order[i % work_num]上；返回非0或order不是有效排列时按默认策略，
+	 *         即综合连接数、在途消息数和字节速率的最小负载优先。只对ARPC_E_ACCEPT_PORTAL生效 */
+	int (*placement)(const struct arpc_work_load *works, uint32_t work_num, uint32_t conn_num,
+					uint32_t *order, void *server_ctx);
+
+	/*! @brief 在线负载均衡，可选，0关闭(默认)。某工作线程的负载超出各线程均值的该百分比时，
+	 *         提示客户端把其上的一条连接迁到最空闲的工作线程；客户端先建新连接，旧连接上的在途消息处理完再断开。
+	 *         只对ARPC_E_ACCEPT_PORTAL生效，提示随回复捎带，没有回复流量的连接不会被迁移 */
+	uint32_t						rebalance_pct;
 };
 
 /*!
@@ -618,6 +871,16 @@ int arpc_server_loop(arpc_server_t fd, int32_t timeout_ms);
  */
 int arpc_server_destroy(arpc_server_t *fd);
 
+/*!
+ *  @brief  获取服务端的统计
+ *
+ *  @param[in] fd  服务端句柄
+ *  @param[out] stats  所有session合并后的统计，包括已关闭的session
+ *  @return  int; (<em>-1</em>: fail ; ( <em>0</em>: succeed
+ *
+ */
+int arpc_get_server_stats(const arpc_server_t fd, struct arpc_stats *stats);
+
 #endif
 
 #ifdef __cplusplus
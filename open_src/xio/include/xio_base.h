@@ -828,6 +828,10 @@ struct xio_connection_params {
 
 	/**< Private data pointer to pass to each connection callback         */
 	void			*conn_user_context;
+
+	/**< 1 to allow another connection of an online session on ctx,      */
+	/**< the connections must target different portals                    */
+	uint32_t		share_ctx;
 };
 
 /**
@@ -895,8 +899,11 @@ enum xio_connection_optname {
 		/**< in send queue */
 	XIO_CONNECTION_FIONWRITE_MSGS,  /**< int: the number of msgs in */
 		/**< send queue */
-	XIO_CONNECTION_LEADING_CONN /**< int: check if connection is leading: */
+	XIO_CONNECTION_LEADING_CONN, /**< int: check if connection is leading: */
 		/**<1 for leading conn, 0 otherwise */
+	XIO_CONNECTION_IDLE /**< int: 1 if no message is queued or in */
+		/**< flight and no received request waits for the */
+		/**< application's response, 0 otherwise */
 };
 
 /**
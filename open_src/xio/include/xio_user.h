@@ -267,6 +267,17 @@ struct xio_context_params {
 
 	/**< define msg data  inline buffers for send/recv	*/
 	uint64_t		max_inline_xio_data;
+
+	/**< 监听套接字设置SO_REUSEPORT，多个context可绑定同一端口	*/
+	int			reuse_port;
+
+	/**< 大于0时给同端口监听组挂载按收包CPU取模选择监听者的BPF，	*/
+	/**< 取值为组内监听者数，仅reuse_port开启时有效		*/
+	uint32_t		reuse_port_steer_num;
+
+	/**< 事件循环每轮epoll返回后的回调，可为NULL		*/
+	void			(*loop_tick)(void *loop_tick_ctx);
+	void			*loop_tick_ctx;
 };
 
 
@@ -3078,6 +3078,29 @@ const struct xio_transport_base *xio_req_to_transport_base(
 	return task->connection->nexus->transport_hndl;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_connection_is_idle						     */
+/*---------------------------------------------------------------------------*/
+static int xio_connection_is_idle(struct xio_connection *connection)
+{
+	struct xio_task *ptask;
+
+	if (!xio_msg_list_empty(&connection->reqs_msgq) ||
+	    !xio_msg_list_empty(&connection->rsps_msgq) ||
+	    !xio_msg_list_empty(&connection->in_flight_reqs_msgq) ||
+	    !xio_msg_list_empty(&connection->in_flight_rsps_msgq))
+		return 0;
+
+	/* received one way messages need no answer on this connection */
+	list_for_each_entry(ptask, &connection->io_tasks_list,
+			    tasks_list_entry) {
+		if (ptask->tlv_type == XIO_MSG_TYPE_REQ)
+			return 0;
+	}
+
+	return 1;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_connection_ioctl						     */
 /*---------------------------------------------------------------------------*/
@@ -3108,6 +3131,10 @@ int xio_connection_ioctl(struct xio_connection *connection, int con_optname,
 		else
 			*((int *)optval) = 0;
 		return 0;
+	case XIO_CONNECTION_IDLE:
+		*optlen = sizeof(int);
+		*((int *)optval) = xio_connection_is_idle(connection);
+		return 0;
 	default:
 		break;
 	}
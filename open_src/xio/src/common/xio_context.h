@@ -129,6 +129,8 @@ struct xio_context {
 	int				pad;
 	uint32_t		max_inline_xio_hdr;
 	uint64_t		max_inline_xio_data;
+	int				reuse_port;				/* 监听套接字设置SO_REUSEPORT */
+	uint32_t		reuse_port_steer_num;	/* 按收包CPU分流的监听组大小，0不分流 */
 	void			*private_context;
 #ifdef XIO_THREAD_SAFE_DEBUG
 	int                             nptrs;
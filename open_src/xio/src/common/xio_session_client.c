@@ -930,9 +930,12 @@ struct xio_connection *xio_connect(struct xio_connection_params *cparams)
 
 	mutex_lock(&session->lock);
 
-	/* only one connection per context allowed */
+	/* only one connection per context allowed, unless the caller
+	 * explicitly shares it with a connection to another portal
+	 */
 	connection = xio_session_find_connection_by_ctx(session, ctx);
-	if (connection) {
+	if (connection && !(cparams->share_ctx &&
+			    session->state == XIO_SESSION_STATE_ONLINE)) {
 		ERROR_LOG("context:%p, already assigned connection:%p\n",
 			  ctx, connection);
 		goto cleanup2;
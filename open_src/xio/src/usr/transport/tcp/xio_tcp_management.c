@@ -39,6 +39,7 @@
 #include <xio_predefs.h>
 #include <xio_env.h>
 #include <xio_os.h>
+#include <linux/filter.h>
 #include "libxio.h"
 #include "xio_log.h"
 #include "xio_common.h"
@@ -904,6 +905,84 @@ cleanup:
 	return NULL;
 }
 
+/*---------------------------------------------------------------------------*/
+/* SO_REUSEPORT监听组的双socket配对					     */
+/*---------------------------------------------------------------------------*/
+/* 双socket模式下一对socket由内核各自挑选监听者，可能落在组内不同的context；
+ * 配不上的一半移出本监听者暂存到全局表，由另一半所在的监听者取走后在自己
+ * 的context里建链。超时仍未配对的暂存项在下次查找时关闭
+ */
+#define XIO_TCP_ORPHAN_TIMEOUT_MS	10000
+
+static LIST_HEAD(orphan_conns);
+static pthread_mutex_t orphan_conns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t xio_tcp_orphan_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int xio_tcp_is_conn_pair(const struct xio_tcp_pending_conn *a,
+				const struct xio_tcp_pending_conn *b)
+{
+	if (a->sa.sa.sa_family != b->sa.sa.sa_family)
+		return 0;
+	if (a->sa.sa.sa_family == AF_INET)
+		return a->msg.second_port == ntohs(b->sa.sa_in.sin_port) &&
+		       b->msg.second_port == ntohs(a->sa.sa_in.sin_port) &&
+		       a->sa.sa_in.sin_addr.s_addr ==
+		       b->sa.sa_in.sin_addr.s_addr;
+	if (a->sa.sa.sa_family == AF_INET6)
+		return a->msg.second_port == ntohs(b->sa.sa_in6.sin6_port) &&
+		       b->msg.second_port == ntohs(a->sa.sa_in6.sin6_port) &&
+		       !memcmp(&a->sa.sa_in6.sin6_addr,
+			       &b->sa.sa_in6.sin6_addr,
+			       sizeof(a->sa.sa_in6.sin6_addr));
+	return 0;
+}
+
+/* 取到另一半时返回它，它已不在任何监听者的列表和epoll里；
+ * 否则暂存pending_conn并返回NULL
+ */
+static struct xio_tcp_pending_conn *xio_tcp_orphan_match(
+				struct xio_tcp_transport *parent_hndl,
+				struct xio_tcp_pending_conn *pending_conn)
+{
+	struct xio_tcp_pending_conn *pconn, *next_pconn, *found = NULL;
+	uint64_t now = xio_tcp_orphan_now_ms();
+
+	pthread_mutex_lock(&orphan_conns_lock);
+	list_for_each_entry_safe(pconn, next_pconn, &orphan_conns,
+				 conns_list_entry) {
+		if (!found && xio_tcp_is_conn_pair(pconn, pending_conn)) {
+			list_del_init(&pconn->conns_list_entry);
+			found = pconn;
+			continue;
+		}
+		if (now - pconn->park_ms > XIO_TCP_ORPHAN_TIMEOUT_MS) {
+			ERROR_LOG("drop unpaired tcp socket fd:%d\n", pconn->fd);
+			list_del(&pconn->conns_list_entry);
+			xio_closesocket(pconn->fd);
+			ufree(pconn);
+		}
+	}
+	if (!found) {
+		if (xio_context_del_ev_handler(parent_hndl->base.ctx,
+					       pending_conn->fd))
+			ERROR_LOG("removing connection handler failed.(errno=%d %m)\n",
+				  xio_get_last_socket_error());
+		list_del(&pending_conn->conns_list_entry);
+		pending_conn->park_ms = now;
+		list_add_tail(&pending_conn->conns_list_entry, &orphan_conns);
+	}
+	pthread_mutex_unlock(&orphan_conns_lock);
+
+	return found;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_handle_pending_conn						     */
 /*---------------------------------------------------------------------------*/
@@ -915,6 +994,7 @@ void xio_tcp_handle_pending_conn(int fd,
 	struct xio_tcp_pending_conn *pconn, *next_pconn;
 	struct xio_tcp_pending_conn *pending_conn = NULL, *matching_conn = NULL;
 	struct xio_tcp_pending_conn *ctl_conn = NULL, *data_conn = NULL;
+	struct xio_tcp_pending_conn *orphan = NULL;
 	void *buf;
 	int cfd = 0, dfd = 0, is_single = 1;
 	socklen_t len = 0;
@@ -1014,8 +1094,15 @@ void xio_tcp_handle_pending_conn(int fd,
 		}
 	}
 
-	if (!matching_conn)
-		return;
+	if (!matching_conn) {
+		if (!parent_hndl->base.ctx->reuse_port)
+			return;
+		/* 另一半可能被同端口的其它监听者接收 */
+		orphan = xio_tcp_orphan_match(parent_hndl, pending_conn);
+		if (!orphan)
+			return;
+		matching_conn = orphan;
+	}
 
 	if (pending_conn->msg.sock_type == XIO_TCP_CTL_SOCK) {
 		ctl_conn = pending_conn;
@@ -1027,7 +1114,8 @@ void xio_tcp_handle_pending_conn(int fd,
 	cfd = ctl_conn->fd;
 	dfd = data_conn->fd;
 
-	retval = xio_context_del_ev_handler(parent_hndl->base.ctx,
+	retval = (data_conn == orphan) ? 0 :
+		 xio_context_del_ev_handler(parent_hndl->base.ctx,
 					    data_conn->fd);
 	list_del(&data_conn->conns_list_entry);
 	if (retval) {
@@ -1039,7 +1127,8 @@ void xio_tcp_handle_pending_conn(int fd,
 single_sock:
 
 	list_del(&ctl_conn->conns_list_entry);
-	retval = xio_context_del_ev_handler(parent_hndl->base.ctx,
+	retval = (ctl_conn == orphan) ? 0 :
+		 xio_context_del_ev_handler(parent_hndl->base.ctx,
 					    ctl_conn->fd);
 	if (retval) {
 		ERROR_LOG("removing connection handler failed.(errno=%d %m)\n",
@@ -1209,6 +1298,34 @@ void xio_tcp_listener_ev_handler(int fd, int events, void *user_context)
 	}
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuse_port_steer						     */
+/*---------------------------------------------------------------------------*/
+/* 同端口的监听组按收包CPU取模选择监听者，下标即各套接字加入组的顺序；
+ * 结果越界或内核不支持时退回内核默认的四元组哈希
+ */
+static void xio_tcp_reuse_port_steer(int fd, uint32_t num)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	struct sock_filter code[] = {
+		{ BPF_LD  | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, num },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       &prog, sizeof(prog)))
+		WARN_LOG("attach reuseport cpu steering failed. (errno=%d %m)\n",
+			 xio_get_last_socket_error());
+#else
+	WARN_LOG("reuseport cpu steering not supported, num:%u\n", num);
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_listen							     */
 /*---------------------------------------------------------------------------*/
@@ -1232,6 +1349,20 @@ static int xio_tcp_listen(struct xio_transport_base *transport,
 	}
 	tcp_hndl->base.is_client = 0;
 
+	if (tcp_hndl->base.ctx->reuse_port) {
+		int optval = 1;
+
+		retval = setsockopt(tcp_hndl->sock.cfd, SOL_SOCKET,
+				    SO_REUSEPORT, (char *)&optval,
+				    sizeof(optval));
+		if (retval) {
+			xio_set_error(xio_get_last_socket_error());
+			ERROR_LOG("setsockopt SO_REUSEPORT failed. (errno=%d %m)\n",
+				  xio_get_last_socket_error());
+			goto exit1;
+		}
+	}
+
 	/* bind */
 	retval = bind(tcp_hndl->sock.cfd,
 		      (struct sockaddr *)&sa.sa_stor,
@@ -1253,6 +1384,9 @@ static int xio_tcp_listen(struct xio_transport_base *transport,
 			  xio_get_last_socket_error());
 		goto exit1;
 	}
+	if (tcp_hndl->base.ctx->reuse_port_steer_num > 1)
+		xio_tcp_reuse_port_steer(tcp_hndl->sock.cfd,
+					 tcp_hndl->base.ctx->reuse_port_steer_num);
 
 	/* add to epoll */
 	retval = xio_context_add_ev_handler(
@@ -260,6 +260,7 @@ struct xio_tcp_pending_conn {
 	struct xio_tcp_connect_msg	msg;
 	union xio_sockaddr		sa;
 	struct list_head		conns_list_entry;
+	uint64_t			park_ms;	/* 暂存待跨监听者配对的时刻 */
 };
 
 struct xio_tcp_socket_ops {
@@ -154,6 +154,9 @@ struct xio_context *xio_context_create(struct xio_context_params *ctx_params,
 		ctx->max_inline_xio_hdr = ctx_params->max_inline_xio_hdr?
 								  ctx_params->max_inline_xio_hdr:
 								  g_options.max_inline_xio_hdr;
+		ctx->reuse_port = !!ctx_params->reuse_port;
+		ctx->reuse_port_steer_num = ctx->reuse_port ? ctx_params->reuse_port_steer_num : 0;
+		xio_ev_loop_set_tick(ctx->ev_loop, ctx_params->loop_tick, ctx_params->loop_tick_ctx);
 	}
 	if (!ctx->max_conns_per_ctx)
 		ctx->max_conns_per_ctx = 100;
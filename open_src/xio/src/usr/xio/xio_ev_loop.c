@@ -64,6 +64,8 @@ struct xio_ev_loop {
 	struct list_head		poll_events_list;
 	struct list_head		events_list;
 	struct xio_ev_data		*deleted_events[MAX_DELETED_EVENTS];
+	void				(*tick)(void *data);	/* 每轮epoll返回后回调 */
+	void				*tick_data;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -418,6 +420,8 @@ retry:
 			ufree(loop->deleted_events[--loop->deleted_events_nr]);
 
 	nevent = epoll_wait(loop->efd, events, ARRAY_SIZE(events), tmout);
+	if (loop->tick)
+		loop->tick(loop->tick_data);
 	if (unlikely(nevent < 0)) {
 		if (errno != EINTR) {
 			xio_set_error(errno);
@@ -600,6 +604,19 @@ int xio_ev_loop_get_poll_fd(void *loop_hndl)
 	return loop->efd;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ev_loop_set_tick							     */
+/*---------------------------------------------------------------------------*/
+void xio_ev_loop_set_tick(void *loop_hndl, void (*tick)(void *data), void *data)
+{
+	struct xio_ev_loop  *loop = (struct xio_ev_loop *)loop_hndl;
+
+	if (!loop_hndl)
+		return;
+	loop->tick_data = data;
+	loop->tick = tick;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_ev_loop_is_stopping						     */
 /*---------------------------------------------------------------------------*/
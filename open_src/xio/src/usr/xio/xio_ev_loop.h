@@ -150,6 +150,15 @@ int xio_ev_loop_del(void *loop, int fd);
  */
 int xio_ev_loop_get_poll_fd(void *loop);
 
+/**
+ * 设置每轮回调，epoll_wait返回后、分发事件前调用
+ *
+ * @param[in] loop	the dispatcher context
+ * @param[in] tick	回调函数，NULL表示取消
+ * @param[in] data	回调参数
+ */
+void xio_ev_loop_set_tick(void *loop, void (*tick)(void *data), void *data);
+
 /**
  * poll for events for a specified (possibly infinite) amount of time;
  *
@@ -5,22 +5,26 @@
 /*!
 * \file xxx.x
 * \brief xxx
-* 
+*
 * 包含..
 *
 * \copyright 2020 Ruijie Network. All rights reserved.
 * \author hongchunhua@ruijie.com.cn
 * \version v1.0.0
 * \date 2020.08.05
-* \note none 
+* \note none
 */
 
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
+#include <linux/futex.h>
 
 #include "base_log.h"
 
@@ -50,8 +54,35 @@ extern "C" {
 #define LOG_FILE_ENABLE (1<<(ARPC_LOG_LEVEL_E_MAX + 3))
 #define LOG_FILE_SWICH_FILE  "on_filelog"
 #define LOG_FILE_NAME        "messages.log"
+#define LOG_FILE_OLD_NAME    "messages.log.old"
 #define LOG_FILE_MAX_SIZE    (512*1024)
 
+/*
+ * 异步输出：每个线程一个单生产者环，日志直接格式化进环里，后台线程批量写出。
+ * 环满时丢弃并计数，调用线程不会因为IO阻塞。
+ */
+#define LOG_MSG_MAX_LEN			2048				/* 用户消息部分上限，与原先的栈缓冲一致 */
+#define LOG_LINE_MAX_LEN		(LOG_MSG_MAX_LEN + 320)
+#define LOG_RING_SIZE			(64*1024)			/* 2的幂 */
+#define LOG_RING_MASK			(LOG_RING_SIZE - 1)
+#define LOG_REC_HEAD			sizeof(uint32_t)
+#define LOG_REC_WRAP			0xffffffffU			/* 环尾剩余空间不足一条时的跳转标记 */
+#define LOG_REC_ALIGN(len)		(((len) + LOG_REC_HEAD + 7) & ~7U)
+#define LOG_BATCH_SIZE			(64*1024)
+#define LOG_FLUSH_PARK_MS		1000				/* 后台线程无日志时的休眠兜底，用于丢弃统计与回收退出线程的环 */
+#define LOG_DROP_REPORT_S		1
+#define LOG_CACHE_LINE			64
+
+struct log_ring {
+	uint64_t			head;		/* 生产者写位置 */
+	char				pad0[LOG_CACHE_LINE - sizeof(uint64_t)];
+	uint64_t			tail;		/* 后台线程读位置 */
+	char				pad1[LOG_CACHE_LINE - sizeof(uint64_t)];
+	uint64_t			drops;
+	int32_t				exited;		/* 所属线程已退出，读空后由后台线程释放 */
+	struct log_ring		*next;
+	char				buf[LOG_RING_SIZE];
+};
 
 static void set_log_switch(const char *module, int32_t *log_enabale)
 {
@@ -102,136 +133,422 @@ static void set_log_switch(const char *module, int32_t *log_enabale)
     *log_enabale = (*log_enabale)|LOG_SWITCH_INIT;
 }
 
-static pid_t gettid()
+static __thread pid_t tls_tid = 0;
+static __thread struct log_ring *tls_ring = NULL;
+static __thread time_t tls_sec = 0;			/* 同一秒内复用localtime结果，避免每行进时区锁 */
+static __thread struct tm tls_tm;
+
+static pid_t log_gettid(void)
 {
-	return syscall(SYS_gettid);
+	if (!tls_tid) {
+		tls_tid = syscall(SYS_gettid);
+	}
+	return tls_tid;
 }
 
-static long get_file_size(char* filename)
+static int32_t log_enabale = 0;
+
+static pthread_once_t g_log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_log_key;
+static pthread_mutex_t g_log_flush_lock = PTHREAD_MUTEX_INITIALIZER;	/* 环的唯一消费者 */
+static struct log_ring *g_log_rings = NULL;
+static int32_t g_log_sync = 0;				/* 后台线程起不来时退化为同步输出 */
+static uint64_t g_log_drops = 0;			/* 已释放环及申请环失败的丢弃数 */
+static char g_log_module[32] = "ARPC";		/* 日志文件所在目录 */
+static uint32_t g_log_futex = 0;			/* 后台线程的唤醒序号 */
+static int32_t g_log_parked = 0;			/* 后台线程已休眠，生产者需要唤醒 */
+
+/* 以下只在持有g_log_flush_lock时访问 */
+static int g_log_fd = -1;
+static uint64_t g_log_file_size = 0;
+static uint64_t g_log_drops_reported = 0;
+static time_t g_log_drop_report_sec = 0;
+static char g_log_batch[LOG_BATCH_SIZE];
+static uint32_t g_log_batch_len = 0;
+
+static void log_file_open(void)
 {
-	long length = 0;
-	FILE *fp = NULL;
+	char path[64];
+	struct stat st;
 
-	fp = fopen(filename, "rb");
-	if (fp != NULL){
-		fseek(fp, 0, SEEK_END);
-		length = ftell(fp);
-        fclose(fp);
+	snprintf(path, sizeof(path), "/run/%s/%s", g_log_module, LOG_FILE_NAME);
+	g_log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	g_log_file_size = (g_log_fd >= 0 && !fstat(g_log_fd, &st)) ? (uint64_t)st.st_size : 0;
+}
+
+// 超过上限后保留一份旧文件，重新打开
+static void log_file_rotate(void)
+{
+	char path[64];
+	char old_path[64];
+
+	close(g_log_fd);
+	g_log_fd = -1;
+	snprintf(path, sizeof(path), "/run/%s/%s", g_log_module, LOG_FILE_NAME);
+	snprintf(old_path, sizeof(old_path), "/run/%s/%s", g_log_module, LOG_FILE_OLD_NAME);
+	if (rename(path, old_path)) {
+		unlink(path);
 	}
-	return length;
+	log_file_open();
 }
 
-static void write_log_file(char* filename, long max_size, const char *fmt, ...)
+static void log_write_all(int fd, const char *data, uint32_t len)
 {
-	FILE *fp;
-    long length;
-    va_list			args;
-	char			buf[2048];
-    if (filename != NULL){
-		length = get_file_size(filename);
-		if (length > max_size){
-			unlink(filename); // 删除文件
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, data, len);
+		if (ret <= 0) {
+			return;
 		}
-		fp = fopen(filename, "at+");
-        if (fp != NULL){
-            va_start(args, fmt);
-            length = vsnprintf(buf, sizeof(buf), fmt, args);
-            va_end(args);
-            buf[length] = 0;
-            fwrite(buf, length, 1, fp);
-            fclose(fp);
-            fp = NULL;
-        }
+		data += ret;
+		len -= (uint32_t)ret;
 	}
 }
 
-static int32_t log_enabale = 0;
+static void log_batch_flush(void)
+{
+	int32_t sinks = log_enabale;
+
+	if (!g_log_batch_len) {
+		return;
+	}
+	if (sinks & FPRINTF_SWICH_ENABLE) {
+		log_write_all(STDERR_FILENO, g_log_batch, g_log_batch_len);
+	}
+	if (sinks & LOG_FILE_ENABLE) {
+		if (g_log_fd < 0) {
+			log_file_open();
+		}
+		if (g_log_fd >= 0) {
+			log_write_all(g_log_fd, g_log_batch, g_log_batch_len);
+			g_log_file_size += g_log_batch_len;
+			if (g_log_file_size > LOG_FILE_MAX_SIZE) {
+				log_file_rotate();
+			}
+		}
+	} else if (g_log_fd >= 0) {
+		close(g_log_fd);
+		g_log_fd = -1;
+	}
+	g_log_batch_len = 0;
+}
+
+// 一行输出到各目标，stderr与文件攒批写出
+static void log_emit(const char *line, uint32_t len)
+{
+	if ((log_enabale & SYSLOG_SWICH_ENABLE) && len) {
+		syslog(LOG_ERR, "%.*s", (int)((line[len - 1] == '\n') ? len - 1 : len), line);
+	}
+	if (!(log_enabale & (FPRINTF_SWICH_ENABLE | LOG_FILE_ENABLE))) {
+		return;
+	}
+	if (g_log_batch_len + len > LOG_BATCH_SIZE) {
+		log_batch_flush();
+	}
+	memcpy(g_log_batch + g_log_batch_len, line, len);
+	g_log_batch_len += len;
+}
+
+static uint32_t log_ring_drain(struct log_ring *ring)
+{
+	uint64_t tail = ring->tail;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint32_t off, len;
+	uint32_t cnt = 0;
+
+	while (tail != head) {
+		off = tail & LOG_RING_MASK;
+		memcpy(&len, ring->buf + off, sizeof(len));
+		if (len == LOG_REC_WRAP) {
+			tail += LOG_RING_SIZE - off;
+			continue;
+		}
+		log_emit(ring->buf + off + LOG_REC_HEAD, len);
+		tail += LOG_REC_ALIGN(len);
+		cnt++;
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	return cnt;
+}
+
+static void log_report_drops(uint64_t drops)
+{
+	char line[128];
+	int len;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	if (drops <= g_log_drops_reported || tv.tv_sec < g_log_drop_report_sec + LOG_DROP_REPORT_S) {
+		return;
+	}
+	len = snprintf(line, sizeof(line), "[%-5s][%-5x][%-5s] log ring full, dropped %lu lines, total %lu.\n",
+					g_log_module, log_gettid(), "WARN", drops - g_log_drops_reported, drops);
+	g_log_drops_reported = drops;
+	g_log_drop_report_sec = tv.tv_sec;
+	log_emit(line, (uint32_t)len);
+}
+
+// 只有持锁的一方消费，生产者只在链表头插入，摘除已退出线程的环不需要与之互斥
+static uint32_t log_drain_all(void)
+{
+	struct log_ring *ring;
+	struct log_ring *prev = NULL;
+	struct log_ring *next;
+	struct log_ring *head;
+	uint64_t drops;
+	uint32_t cnt = 0;
+
+	drops = __atomic_load_n(&g_log_drops, __ATOMIC_RELAXED);
+	for (ring = __atomic_load_n(&g_log_rings, __ATOMIC_ACQUIRE); ring; ring = next) {
+		next = ring->next;
+		cnt += log_ring_drain(ring);
+		drops += __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+		if (!__atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE) ||
+			ring->tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+			prev = ring;
+			continue;
+		}
+		head = ring;
+		if (prev || !__atomic_compare_exchange_n(&g_log_rings, &head, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			// 不在链表头，或刚有新环插到了前面：此时前驱只可能在本节点之前，重新找一次
+			for (prev = __atomic_load_n(&g_log_rings, __ATOMIC_ACQUIRE); prev->next != ring; prev = prev->next);
+			prev->next = next;
+		}
+		__atomic_add_fetch(&g_log_drops, ring->drops, __ATOMIC_RELAXED);
+		free(ring);
+	}
+	log_report_drops(drops);
+	log_batch_flush();
+	return cnt;
+}
+
+void arpc_log_flush(void)
+{
+	pthread_mutex_lock(&g_log_flush_lock);
+	log_drain_all();
+	pthread_mutex_unlock(&g_log_flush_lock);
+}
+
+static int log_rings_empty(void)
+{
+	struct log_ring *ring;
+
+	for (ring = __atomic_load_n(&g_log_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// 环由空变为非空时由生产者调用，只有后台线程休眠时才进内核
+static void log_flush_kick(void)
+{
+	if (!__atomic_exchange_n(&g_log_parked, 0, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+	__atomic_add_fetch(&g_log_futex, 1, __ATOMIC_SEQ_CST);
+	(void)syscall(SYS_futex, &g_log_futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void *log_flush_thread(void *arg)
+{
+	uint32_t cnt;
+	uint32_t seq;
+	struct timespec ts = {LOG_FLUSH_PARK_MS / 1000, (LOG_FLUSH_PARK_MS % 1000) * 1000000};
+
+	for (;;) {
+		pthread_mutex_lock(&g_log_flush_lock);
+		cnt = log_drain_all();
+		pthread_mutex_unlock(&g_log_flush_lock);
+		if (cnt) {
+			continue;
+		}
+		// 先声明休眠再复查，与生产者先发布再检查配对，不会漏掉唤醒
+		seq = __atomic_load_n(&g_log_futex, __ATOMIC_ACQUIRE);
+		__atomic_store_n(&g_log_parked, 1, __ATOMIC_SEQ_CST);
+		if (log_rings_empty()) {
+			(void)syscall(SYS_futex, &g_log_futex, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+		}
+		__atomic_store_n(&g_log_parked, 0, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static void log_ring_exit(void *arg)
+{
+	struct log_ring *ring = (struct log_ring *)arg;
+
+	tls_ring = NULL;
+	__atomic_store_n(&ring->exited, 1, __ATOMIC_RELEASE);
+}
+
+static void log_init_once(void)
+{
+	pthread_t thread;
+	pthread_attr_t attr;
+
+	if (pthread_key_create(&g_log_key, &log_ring_exit)) {
+		g_log_sync = 1;
+		return;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, &log_flush_thread, NULL)) {
+		g_log_sync = 1;
+	} else {
+		atexit(&arpc_log_flush);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring = tls_ring;
+
+	if (ring) {
+		return ring;
+	}
+	pthread_once(&g_log_once, &log_init_once);
+	if (g_log_sync) {
+		return NULL;
+	}
+	ring = (struct log_ring *)calloc(1, sizeof(struct log_ring));
+	if (!ring) {
+		return NULL;
+	}
+	ring->next = __atomic_load_n(&g_log_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&g_log_rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	pthread_setspecific(g_log_key, ring);
+	tls_ring = ring;
+	return ring;
+}
+
+// 预留一段连续空间，放不下时丢弃；返回写位置
+static char *log_ring_reserve(struct log_ring *ring, uint32_t len, uint64_t *pos)
+{
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint32_t off = head & LOG_RING_MASK;
+	uint32_t skip = 0;
+	uint32_t wrap = LOG_REC_WRAP;
+
+	if (LOG_RING_SIZE - off < LOG_REC_ALIGN(len)) {
+		skip = LOG_RING_SIZE - off;
+	}
+	if (head + skip + LOG_REC_ALIGN(len) - tail > LOG_RING_SIZE) {
+		__atomic_add_fetch(&ring->drops, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	if (skip) {
+		memcpy(ring->buf + off, &wrap, sizeof(wrap));	// 与本条一起发布
+		head += skip;
+	}
+	*pos = head;
+	return ring->buf + (head & LOG_RING_MASK) + LOG_REC_HEAD;
+}
+
+static void log_ring_commit(struct log_ring *ring, uint64_t pos, uint32_t len)
+{
+	uint64_t head = ring->head;
+
+	memcpy(ring->buf + (pos & LOG_RING_MASK), &len, sizeof(len));
+	__atomic_store_n(&ring->head, pos + LOG_REC_ALIGN(len), __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head) {
+		log_flush_kick();	// 环由空变为非空
+	}
+}
 
 void arpc_vlog(enum arpc_log_level level, const char *module, const char *file,unsigned line, const char *function, const char *fmt, ...)
 {
 	va_list			args;
 	const char		*short_file;
 	struct timeval		tv;
-	struct tm		t;
-	char			buf[2048];
+	struct tm		*t = &tls_tm;
+	char			sync_buf[LOG_LINE_MAX_LEN];
 	char			buf2[256];
-	char            log_file_path[64];
+	char			*buf;
 	int			length = 0;
+	int			msg_len = 0;
+	uint64_t		pos = 0;
+	struct log_ring	*ring;
 	static const char * const level_str[ARPC_LOG_LEVEL_E_MAX] = {
 		"FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"
 	};
 	time_t time1;
 
+	// 先按级别过滤，被过滤的日志不做任何格式化
 	if (log_enabale&LOG_SWITCH_INIT) {
         if(!(log_enabale&(1<<level))){
             return;
         }
     }else{
+		snprintf(g_log_module, sizeof(g_log_module), "%s", module);
         set_log_switch(module, &log_enabale);
 		if(!(log_enabale&(1<<level))){
             return;
         }
     }
+	if (!(log_enabale & (FPRINTF_SWICH_ENABLE | SYSLOG_SWICH_ENABLE | LOG_FILE_ENABLE))) {
+		return;
+	}
 
-	va_start(args, fmt);
-	length = vsnprintf(buf, sizeof(buf), fmt, args);
-	va_end(args);
-	buf[length] = 0;
-
-	if(level ==ARPC_LOG_LEVEL_E_STATUS){
-		if (log_enabale&FPRINTF_SWICH_ENABLE) {
-			fprintf(stderr,"%s", buf);
-		}
-		if (log_enabale&SYSLOG_SWICH_ENABLE) {
-			syslog(LOG_ERR,"%s", buf);
-		}
-
-		if (log_enabale&LOG_FILE_ENABLE) {
-			snprintf(log_file_path, sizeof(log_file_path), "/run/%s/%s", module, LOG_FILE_NAME);
-        	write_log_file(log_file_path, LOG_FILE_MAX_SIZE,"%s",buf);
+	ring = log_ring_get();
+	if (ring) {
+		buf = log_ring_reserve(ring, LOG_LINE_MAX_LEN, &pos);
+		if (!buf) {
+			return;
 		}
+	} else if (g_log_sync) {
+		buf = sync_buf;
+	} else {
+		__atomic_add_fetch(&g_log_drops, 1, __ATOMIC_RELAXED);
 		return;
 	}
 
-	gettimeofday(&tv, NULL);
-	time1 = (time_t)tv.tv_sec;
-	localtime_r(&time1, &t);
+	if(level ==ARPC_LOG_LEVEL_E_STATUS){
+		va_start(args, fmt);
+		length = vsnprintf(buf, LOG_MSG_MAX_LEN, fmt, args);
+		va_end(args);
+		length = (length < 0) ? 0 : ((length >= LOG_MSG_MAX_LEN) ? LOG_MSG_MAX_LEN - 1 : length);
+	} else {
+		gettimeofday(&tv, NULL);
+		time1 = (time_t)tv.tv_sec;
+		if (time1 != tls_sec) {
+			localtime_r(&time1, t);
+			tls_sec = time1;
+		}
 
-	short_file = strrchr(file, '/');
-	short_file = (!short_file) ? file : short_file + 1;
-	if(level <= ARPC_LOG_LEVEL_E_ERROR) {
-		snprintf(buf2, sizeof(buf2), "%s:%u|%s", short_file, line, function);
-	}else{
-		snprintf(buf2, sizeof(buf2), "%s:%u", short_file, line);
+		short_file = strrchr(file, '/');
+		short_file = (!short_file) ? file : short_file + 1;
+		if(level <= ARPC_LOG_LEVEL_E_ERROR) {
+			snprintf(buf2, sizeof(buf2), "%s:%u|%s", short_file, line, function);
+		}else{
+			snprintf(buf2, sizeof(buf2), "%s:%u", short_file, line);
+		}
+		length = snprintf(buf, LOG_LINE_MAX_LEN - LOG_MSG_MAX_LEN, "[%-5s][%-5x][%-5s] [" LOG_TIME_FMT "] %-24s - ",
+			module, log_gettid(),
+			level_str[level],
+			t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+			t->tm_hour, t->tm_min, t->tm_sec, tv.tv_usec,
+			buf2);
+		length = (length < 0) ? 0 : ((length >= LOG_LINE_MAX_LEN - LOG_MSG_MAX_LEN) ? LOG_LINE_MAX_LEN - LOG_MSG_MAX_LEN - 1 : length);
+		va_start(args, fmt);
+		msg_len = vsnprintf(buf + length, LOG_MSG_MAX_LEN, fmt, args);
+		va_end(args);
+		length += (msg_len < 0) ? 0 : ((msg_len >= LOG_MSG_MAX_LEN) ? LOG_MSG_MAX_LEN - 1 : msg_len);
+		buf[length++] = '\n';
 	}
 
-	if (log_enabale&FPRINTF_SWICH_ENABLE) {
-		fprintf(stderr, "[%-5s][%-5x][%-5s] [" LOG_TIME_FMT "] %-24s - %s\n", module, gettid(),
-			level_str[level],
-			t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-			t.tm_hour, t.tm_min, t.tm_sec, tv.tv_usec,
-			buf2,
-			buf);
+	if (ring) {
+		log_ring_commit(ring, pos, (uint32_t)length);
+		return;
 	}
-	if (log_enabale&SYSLOG_SWICH_ENABLE) {
-		syslog(LOG_ERR, "[%-5s][%-5x][%-5s] [" LOG_TIME_FMT "] %-24s - %s", module, gettid(),
-			level_str[level],
-			t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-			t.tm_hour, t.tm_min, t.tm_sec, tv.tv_usec,
-			buf2,
-			buf);
-	}
-
-	if (log_enabale&LOG_FILE_ENABLE) {
-        snprintf(log_file_path, sizeof(log_file_path), "/run/%s/%s", module, LOG_FILE_NAME);
-        write_log_file(log_file_path, LOG_FILE_MAX_SIZE, "[%-5s][%-5x][%-5s] [" LOG_TIME_FMT "] %-24s - %s\n", module, gettid(),
-		level_str[level],
-		t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-		t.tm_hour, t.tm_min, t.tm_sec, tv.tv_usec,
-		buf2,
-		buf);
-    }
-	//fflush(stderr);
+	pthread_mutex_lock(&g_log_flush_lock);
+	log_emit(buf, (uint32_t)length);
+	log_batch_flush();
+	pthread_mutex_unlock(&g_log_flush_lock);
 }
 
 int32_t get_log_status()
@@ -246,7 +563,17 @@ void update_log_status(const char *module)
 	log_enabale = log_status;
 }
 
+uint64_t get_log_drop_count()
+{
+	uint64_t drops = __atomic_load_n(&g_log_drops, __ATOMIC_RELAXED);
+	struct log_ring *ring;
+
+	for (ring = __atomic_load_n(&g_log_rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		drops += __atomic_load_n(&ring->drops, __ATOMIC_RELAXED);
+	}
+	return drops;
+}
+
 #ifdef __cplusplus
 }
 #endif
-
@@ -25,6 +25,8 @@
 #include <sys/time.h>
 #include <inttypes.h>
 
+#include "fast_clock.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,6 +48,21 @@ void arpc_vlog(enum arpc_log_level level, const char *module, const char *file,u
 int32_t get_log_status();
 void update_log_status(const char *module);
 
+/*!
+ * @brief  把各线程日志环中尚未输出的内容立即写出
+ *
+ * @details
+ *  	日志由后台线程异步输出，进程退出或断言前调用以免丢失最后几行。
+ */
+void arpc_log_flush(void);
+
+/*!
+ * @brief  因日志环满而被丢弃的日志行数
+ *
+ * @return  累计丢弃行数
+ */
+uint64_t get_log_drop_count();
+
 #define BASE_LOG_ERROR(format, arg...) \
 		arpc_vlog(ARPC_LOG_LEVEL_E_ERROR, "ARPC", __FILE__, __LINE__, __FUNCTION__, format, ##arg);
 
@@ -91,6 +108,7 @@ do{\
 do{\
 	if(unlikely(!(condition))){\
 		BASE_LOG_ERROR(format, ##arg);\
+		arpc_log_flush();\
 	}\
 	assert(condition);\
 }while(0);
@@ -113,19 +131,22 @@ struct statistics_data{
 };
 
 
-static inline void statistics_per_time(const struct timeval *old, struct statistics_data *data, uint32_t interval_s) 
+static inline void statistics_per_time(uint64_t old_us, struct statistics_data *data, uint32_t interval_s) 
 {
 	struct timeval now;
 	uint64_t tmp;
+	uint64_t now_us;
 	struct timeval *total = &(data->total);
 	struct timeval *cur = &(data->cur);
 
-	if (!old->tv_sec) {
+	if (!old_us) {
 		return;
 	}
-	gettimeofday(&now, NULL);	// 线程安全
+	now_us = fast_clock_coarse_ns() / 1000;
+	now.tv_sec = now_us / 1000000;
+	now.tv_usec = now_us % 1000000;
 
-	tmp = (now.tv_sec - old->tv_sec)*1000000 + now.tv_usec - old->tv_usec;
+	tmp = (now_us > old_us) ? now_us - old_us : 0;
 	cur->tv_sec  = tmp/1000000;
 	cur->tv_usec = tmp%1000000;
 
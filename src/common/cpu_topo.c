@@ -0,0 +1,365 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file cpu_topo.c
+* \brief CPU拓扑与线程绑核策略
+*
+* 包含..
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/sysinfo.h>
+
+#include "base_log.h"
+#include "cpu_topo.h"
+
+#define CT_LOG_ERROR(format, arg...) BASE_LOG_ERROR(format, ##arg)
+#define CT_LOG_NOTICE(format, arg...) BASE_LOG_NOTICE(format, ##arg)
+#define CT_LOG_DEBUG(format, arg...) 	BASE_LOG_DEBUG(format,  ##arg)
+
+#define CT_SYS_CPU_PATH		"/sys/devices/system/cpu"
+#define CT_SYS_NODE_PATH	"/sys/devices/system/node"
+#define CT_LINE_MAX_LEN		4096
+
+struct _cpu_info {
+	int		cpu;
+	int		core;				/* core_id */
+	int		package;			/* physical_package_id */
+	int		node;				/* NUMA节点 */
+	int		smt;				/* 在同一物理核中的超线程序号 */
+	int		core_rank;			/* 物理核在所属package中的序号 */
+};
+
+struct _cpu_topo {
+	uint32_t			num;
+	uint32_t			node_num;
+	int					node_of[CPU_TOPO_MAX_CPU];
+	struct _cpu_info	cpu[CPU_TOPO_MAX_CPU];
+};
+
+static struct _cpu_topo g_topo;
+static pthread_once_t g_topo_once = PTHREAD_ONCE_INIT;
+
+static int read_line(const char *path, char *buf, uint32_t len)
+{
+	FILE *fp;
+	char *p;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		return CPU_TOPO_ERROR;
+	}
+	p = fgets(buf, len, fp);
+	fclose(fp);
+	return p ? CPU_TOPO_SUCCESS : CPU_TOPO_ERROR;
+}
+
+static int read_int(const char *path, int def)
+{
+	char buf[32];
+	if (read_line(path, buf, sizeof(buf))) {
+		return def;
+	}
+	return atoi(buf);
+}
+
+int cpu_topo_parse_list(const char *str, int *cpus, uint32_t max_num)
+{
+	const char *p = str;
+	char *end;
+	long first, last, i;
+	uint32_t num = 0;
+
+	if (!str || !cpus) {
+		return CPU_TOPO_ERROR;
+	}
+	while (*p) {
+		while (*p == ',' || isspace((unsigned char)*p)) {
+			p++;
+		}
+		if (!*p) {
+			break;
+		}
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= CPU_TOPO_MAX_CPU) {
+			return CPU_TOPO_ERROR;
+		}
+		last = first;
+		p = end;
+		if (*p == '-') {
+			p++;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first || last >= CPU_TOPO_MAX_CPU) {
+				return CPU_TOPO_ERROR;
+			}
+			p = end;
+		}
+		for (i = first; i <= last && num < max_num; i++) {
+			cpus[num++] = (int)i;
+		}
+	}
+	return (int)num;
+}
+
+static void cpu_topo_load(void)
+{
+	static int cpus[CPU_TOPO_MAX_CPU];
+	char path[128];
+	char line[CT_LINE_MAX_LEN];
+	cpu_set_t allowed;
+	int num, i, j, n, node;
+	struct _cpu_info *info;
+
+	memset(&g_topo, 0, sizeof(g_topo));
+	for (i = 0; i < CPU_TOPO_MAX_CPU; i++) {
+		g_topo.node_of[i] = 0;
+	}
+
+	num = -1;
+	if (!read_line(CT_SYS_CPU_PATH"/online", line, sizeof(line))) {
+		num = cpu_topo_parse_list(line, cpus, CPU_TOPO_MAX_CPU);
+	}
+	if (num <= 0) {
+		num = get_nprocs();
+		for (i = 0; i < num && i < CPU_TOPO_MAX_CPU; i++) {
+			cpus[i] = i;
+		}
+	}
+
+	// 节点信息
+	g_topo.node_num = 1;
+	for (node = 0; node < CPU_TOPO_MAX_NODE; node++) {
+		static int node_cpus[CPU_TOPO_MAX_CPU];
+		snprintf(path, sizeof(path), CT_SYS_NODE_PATH"/node%d/cpulist", node);
+		if (read_line(path, line, sizeof(line))) {
+			continue;
+		}
+		n = cpu_topo_parse_list(line, node_cpus, CPU_TOPO_MAX_CPU);
+		for (j = 0; j < n; j++) {
+			g_topo.node_of[node_cpus[j]] = node;
+		}
+		if (n > 0 && (uint32_t)node + 1 > g_topo.node_num) {
+			g_topo.node_num = node + 1;
+		}
+	}
+
+	// 只使用进程允许运行的CPU
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		for (i = 0; i < num; i++) {
+			CPU_SET(cpus[i], &allowed);
+		}
+	}
+	for (i = 0; i < num; i++) {
+		if (!CPU_ISSET(cpus[i], &allowed)) {
+			continue;
+		}
+		info = &g_topo.cpu[g_topo.num];
+		info->cpu = cpus[i];
+		snprintf(path, sizeof(path), CT_SYS_CPU_PATH"/cpu%d/topology/core_id", cpus[i]);
+		info->core = read_int(path, cpus[i]);
+		snprintf(path, sizeof(path), CT_SYS_CPU_PATH"/cpu%d/topology/physical_package_id", cpus[i]);
+		info->package = read_int(path, 0);
+		info->node = g_topo.node_of[cpus[i]];
+		info->smt = 0;
+		info->core_rank = 0;
+		for (j = 0; j < (int)g_topo.num; j++) {
+			if (g_topo.cpu[j].package != info->package) {
+				continue;
+			}
+			if (g_topo.cpu[j].core == info->core) {
+				info->smt++;
+				info->core_rank = g_topo.cpu[j].core_rank;
+			} else if (!info->smt && g_topo.cpu[j].smt == 0) {
+				info->core_rank++;
+			}
+		}
+		g_topo.num++;
+	}
+	CT_LOG_NOTICE("cpu topology: cpu num[%u], numa node num[%u].", g_topo.num, g_topo.node_num);
+}
+
+static int cmp_compact(const void *a, const void *b)
+{
+	const struct _cpu_info *x = (const struct _cpu_info *)a;
+	const struct _cpu_info *y = (const struct _cpu_info *)b;
+	if (x->node != y->node) return x->node - y->node;
+	if (x->package != y->package) return x->package - y->package;
+	if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+	return x->smt - y->smt;
+}
+
+static int cmp_scatter(const void *a, const void *b)
+{
+	const struct _cpu_info *x = (const struct _cpu_info *)a;
+	const struct _cpu_info *y = (const struct _cpu_info *)b;
+	if (x->smt != y->smt) return x->smt - y->smt;
+	if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+	if (x->package != y->package) return x->package - y->package;
+	return x->cpu - y->cpu;
+}
+
+static int cmp_numa(const void *a, const void *b)
+{
+	const struct _cpu_info *x = (const struct _cpu_info *)a;
+	const struct _cpu_info *y = (const struct _cpu_info *)b;
+	if (x->smt != y->smt) return x->smt - y->smt;
+	if (x->core_rank != y->core_rank) return x->core_rank - y->core_rank;
+	if (x->node != y->node) return x->node - y->node;
+	return x->cpu - y->cpu;
+}
+
+static int cpu_topo_online(int cpu)
+{
+	uint32_t i;
+	for (i = 0; i < g_topo.num; i++) {
+		if (g_topo.cpu[i].cpu == cpu) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int cpu_topo_plan_init(struct cpu_topo_plan *plan, enum cpu_topo_policy policy,
+						const char *cpu_list, uint32_t cpu_max_num)
+{
+	static struct _cpu_info sorted[CPU_TOPO_MAX_CPU];
+	static int list[CPU_TOPO_MAX_CPU];
+	int (*cmp)(const void *, const void *) = NULL;
+	int num;
+	uint32_t i;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!plan, CPU_TOPO_ERROR, "plan is null.");
+	memset(plan, 0, sizeof(*plan));
+	CPU_ZERO(&plan->mask);
+	plan->policy = CPU_TOPO_POLICY_NONE;
+	if (policy == CPU_TOPO_POLICY_NONE) {
+		return CPU_TOPO_SUCCESS;
+	}
+	LOG_THEN_RETURN_VAL_IF_TRUE(policy >= CPU_TOPO_POLICY_MAX, CPU_TOPO_ERROR, "unkown cpu policy[%d].", policy);
+
+	pthread_once(&g_topo_once, cpu_topo_load);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!g_topo.num, CPU_TOPO_ERROR, "no cpu found.");
+
+	switch (policy)
+	{
+	case CPU_TOPO_POLICY_COMPACT:
+		cmp = cmp_compact;
+		break;
+	case CPU_TOPO_POLICY_SCATTER:
+		cmp = cmp_scatter;
+		break;
+	case CPU_TOPO_POLICY_NUMA:
+		cmp = cmp_numa;
+		break;
+	case CPU_TOPO_POLICY_LIST:
+		num = cpu_topo_parse_list(cpu_list, list, CPU_TOPO_MAX_CPU);
+		LOG_THEN_RETURN_VAL_IF_TRUE(num <= 0, CPU_TOPO_ERROR, "invalid cpu list[%s].", cpu_list ? cpu_list : "");
+		for (i = 0; i < (uint32_t)num; i++) {
+			if (!cpu_topo_online(list[i])) {
+				CT_LOG_NOTICE("cpu[%d] in list is not available, skip it.", list[i]);
+				continue;
+			}
+			plan->order[plan->num++] = list[i];
+		}
+		break;
+	default:
+		break;
+	}
+	if (cmp) {
+		memcpy(sorted, g_topo.cpu, g_topo.num * sizeof(struct _cpu_info));
+		qsort(sorted, g_topo.num, sizeof(struct _cpu_info), cmp);
+		for (i = 0; i < g_topo.num; i++) {
+			plan->order[plan->num++] = sorted[i].cpu;
+		}
+	}
+	LOG_THEN_RETURN_VAL_IF_TRUE(!plan->num, CPU_TOPO_ERROR, "cpu plan is empty.");
+
+	if (cpu_max_num && cpu_max_num < plan->num) {
+		plan->num = cpu_max_num;
+	}
+	for (i = 0; i < plan->num; i++) {
+		CPU_SET(plan->order[i], &plan->mask);
+	}
+	plan->policy = policy;
+	CT_LOG_NOTICE("cpu plan: policy[%d], cpu num[%u], first cpu[%d].", policy, plan->num, plan->order[0]);
+	return CPU_TOPO_SUCCESS;
+}
+
+int cpu_topo_plan_cpu(const struct cpu_topo_plan *plan, uint32_t index)
+{
+	if (!plan || plan->policy == CPU_TOPO_POLICY_NONE || !plan->num) {
+		return -1;
+	}
+	return plan->order[index % plan->num];
+}
+
+int cpu_topo_cpu_node(int cpu)
+{
+	pthread_once(&g_topo_once, cpu_topo_load);
+	if (cpu < 0 || cpu >= CPU_TOPO_MAX_CPU) {
+		return 0;
+	}
+	return g_topo.node_of[cpu];
+}
+
+uint32_t cpu_topo_node_num(void)
+{
+	pthread_once(&g_topo_once, cpu_topo_load);
+	return g_topo.node_num;
+}
+
+static int cpu_topo_bind_mask(cpu_set_t *mask)
+{
+	int ret;
+	if (!CPU_COUNT(mask)) {
+		return CPU_TOPO_ERROR;
+	}
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), mask);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, CPU_TOPO_ERROR, "pthread_setaffinity_np fail, ret[%d].", ret);
+	return CPU_TOPO_SUCCESS;
+}
+
+int cpu_topo_bind_cpu(int cpu)
+{
+	cpu_set_t mask;
+	LOG_THEN_RETURN_VAL_IF_TRUE(cpu < 0 || cpu >= CPU_TOPO_MAX_CPU, CPU_TOPO_ERROR, "invalid cpu[%d].", cpu);
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	return cpu_topo_bind_mask(&mask);
+}
+
+int cpu_topo_bind_node(const struct cpu_topo_plan *plan, int node)
+{
+	cpu_set_t mask;
+	uint32_t i;
+	LOG_THEN_RETURN_VAL_IF_TRUE(!plan, CPU_TOPO_ERROR, "plan is null.");
+	CPU_ZERO(&mask);
+	for (i = 0; i < plan->num; i++) {
+		if (cpu_topo_cpu_node(plan->order[i]) == node) {
+			CPU_SET(plan->order[i], &mask);
+		}
+	}
+	return cpu_topo_bind_mask(&mask);
+}
+
+int cpu_topo_bind_plan(const struct cpu_topo_plan *plan)
+{
+	cpu_set_t mask;
+	LOG_THEN_RETURN_VAL_IF_TRUE(!plan, CPU_TOPO_ERROR, "plan is null.");
+	mask = plan->mask;
+	return cpu_topo_bind_mask(&mask);
+}
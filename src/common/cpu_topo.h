@@ -0,0 +1,107 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file cpu_topo.h
+* \brief CPU拓扑与线程绑核策略
+*
+* 从sysfs读取在线CPU的core/package/NUMA节点信息，按策略生成CPU排列(plan)，
+* 线程按序号从plan中取CPU绑定；NUMA策略下绑定到节点内全部CPU，由内核在节点内调度。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _CPU_TOPO_H_
+#define _CPU_TOPO_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <sched.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CPU_TOPO_ERROR		-1
+#define CPU_TOPO_SUCCESS	 0
+
+#define CPU_TOPO_MAX_CPU	CPU_SETSIZE
+#define CPU_TOPO_MAX_NODE	64
+
+enum cpu_topo_policy {
+	CPU_TOPO_POLICY_NONE = 0,		/* 不绑定 */
+	CPU_TOPO_POLICY_COMPACT,		/* 紧凑：先占满一个核的超线程，再占同节点的下一个核 */
+	CPU_TOPO_POLICY_SCATTER,		/* 分散：每个物理核一个线程，跨package轮转 */
+	CPU_TOPO_POLICY_NUMA,			/* NUMA节点轮转，绑定到节点内全部CPU */
+	CPU_TOPO_POLICY_LIST,			/* 用户指定的CPU列表，按序轮转 */
+	CPU_TOPO_POLICY_MAX,
+};
+
+struct cpu_topo_plan {
+	enum cpu_topo_policy	policy;
+	uint32_t				num;						/* order中有效CPU数 */
+	int						order[CPU_TOPO_MAX_CPU];	/* 线程序号到CPU的映射顺序 */
+	cpu_set_t				mask;						/* plan内全部CPU */
+};
+
+/*!
+ * @brief  按策略生成绑核计划
+ *
+ * @param[out] plan
+ * @param[in] policy
+ * @param[in] cpu_list 策略为LIST时使用，如"0-3,8,10"，其它策略忽略
+ * @param[in] cpu_max_num 大于0时只使用排列中的前cpu_max_num个CPU
+ * @return  0 成功；-1 失败(plan被置为不绑定)
+ */
+int cpu_topo_plan_init(struct cpu_topo_plan *plan, enum cpu_topo_policy policy,
+						const char *cpu_list, uint32_t cpu_max_num);
+
+/*!
+ * @brief  第index个线程应使用的CPU
+ *
+ * @return  CPU号；不绑定时返回-1
+ */
+int cpu_topo_plan_cpu(const struct cpu_topo_plan *plan, uint32_t index);
+
+/*!
+ * @brief  CPU所属的NUMA节点，未知时返回0
+ */
+int cpu_topo_cpu_node(int cpu);
+
+/*!
+ * @brief  机器上有CPU的NUMA节点数
+ */
+uint32_t cpu_topo_node_num(void);
+
+/*!
+ * @brief  当前线程绑定到单个CPU
+ */
+int cpu_topo_bind_cpu(int cpu);
+
+/*!
+ * @brief  当前线程绑定到plan中属于node的全部CPU
+ */
+int cpu_topo_bind_node(const struct cpu_topo_plan *plan, int node);
+
+/*!
+ * @brief  当前线程绑定到plan中的全部CPU
+ */
+int cpu_topo_bind_plan(const struct cpu_topo_plan *plan);
+
+/*!
+ * @brief  解析CPU列表字符串，如"0-3,8,10"
+ *
+ * @return  解析出的CPU数；格式错误返回-1
+ */
+int cpu_topo_parse_list(const char *str, int *cpus, uint32_t max_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_CPU_TOPO_H_ */
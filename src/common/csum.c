@@ -0,0 +1,294 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file csum.c
+* \brief 报文校验引擎，按CPU能力运行时选择实现
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "base_log.h"
+#include "crc64.h"
+#include "csum.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CSUM_HAVE_X86	1
+#endif
+
+#define CSUM_LOG_ERROR(format, arg...) BASE_LOG_ERROR(format, ##arg)
+#define CSUM_LOG_NOTICE(format, arg...) BASE_LOG_NOTICE(format, ##arg)
+
+#define CRC64_POLY_REFL		UINT64_C(0x95ac9329ac4bc9b5)	/* crc64.c中POLY(0xad93d23594c935a9)的位反转 */
+#define CRC32C_POLY_REFL	0x82f63b78U
+
+#define CSUM_CLMUL_MIN_LEN	128			/* 短数据折叠收益不足，直接查表 */
+#define CSUM_SELFTEST_LEN	4099
+
+typedef uint64_t (*csum_fn_t)(uint64_t crc, const unsigned char *data, uint64_t len);
+
+static pthread_once_t g_csum_once = PTHREAD_ONCE_INIT;
+static csum_fn_t g_csum_fn[CSUM_TYPE_MAX][CSUM_IMPL_MAX];
+static csum_fn_t g_csum_best[CSUM_TYPE_MAX];
+static const char *g_csum_best_name[CSUM_TYPE_MAX];
+static uint32_t g_csum_hw_mask = 0;
+static uint32_t g_crc32c_table[256];
+static uint64_t g_clmul_k[4];			/* 折叠常数：[0][1]跨512bit，[2][3]跨128bit */
+
+static uint64_t crc64_table_calc(uint64_t crc, const unsigned char *data, uint64_t len)
+{
+	return crc64(crc, data, len);
+}
+
+static uint64_t crc32c_table_calc(uint64_t crc, const unsigned char *data, uint64_t len)
+{
+	uint32_t c = ~(uint32_t)crc;
+
+	while (len--) {
+		c = g_crc32c_table[(c ^ *data++) & 0xff] ^ (c >> 8);
+	}
+	return (uint64_t)(uint32_t)~c;
+}
+
+/* 反射表示下的x^n mod P：bit(63-i)对应x^i */
+static uint64_t crc64_xpow_refl(uint32_t n)
+{
+	uint64_t r = UINT64_C(1) << 63;
+
+	while (n--) {
+		r = (r & 1) ? ((r >> 1) ^ CRC64_POLY_REFL) : (r >> 1);
+	}
+	return r;
+}
+
+#ifdef CSUM_HAVE_X86
+
+__attribute__((target("sse4.2")))
+static uint64_t crc32c_sse42_calc(uint64_t crc, const unsigned char *data, uint64_t len)
+{
+	uint64_t c = (uint32_t)~(uint32_t)crc;
+	uint64_t v;
+
+	while (len && ((uintptr_t)data & 7)) {
+		c = _mm_crc32_u8((uint32_t)c, *data++);
+		len--;
+	}
+	while (len >= 8) {
+		memcpy(&v, data, sizeof(v));
+		c = _mm_crc32_u64(c, v);
+		data += 8;
+		len -= 8;
+	}
+	while (len--) {
+		c = _mm_crc32_u8((uint32_t)c, *data++);
+	}
+	return (uint64_t)(uint32_t)~(uint32_t)c;
+}
+
+/*
+ * 反射域内clmul(a, b)的bit i对应x^(126-i)，当作128bit块(bit i对应x^(127-i))解释时相当于再乘x，
+ * 故跨d bit折叠时低64位用x^(d+63) mod P，高64位用x^(d-1) mod P。
+ */
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i crc64_clmul_fold(__m128i x, __m128i k, __m128i next)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+									   _mm_clmulepi64_si128(x, k, 0x11)),
+						 next);
+}
+
+__attribute__((target("pclmul,sse4.1")))
+static uint64_t crc64_clmul_calc(uint64_t crc, const unsigned char *data, uint64_t len)
+{
+	__m128i x0, x1, x2, x3, k;
+	unsigned char tail[16];
+
+	if (len < CSUM_CLMUL_MIN_LEN) {
+		return crc64(crc, data, len);
+	}
+	x0 = _mm_loadu_si128((const __m128i *)data);
+	x1 = _mm_loadu_si128((const __m128i *)(data + 16));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 32));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 48));
+	x0 = _mm_xor_si128(x0, _mm_cvtsi64_si128((long long)crc));	// 初值等价于异或到前8字节
+	data += 64;
+	len -= 64;
+
+	k = _mm_set_epi64x((long long)g_clmul_k[1], (long long)g_clmul_k[0]);
+	while (len >= 64) {
+		x0 = crc64_clmul_fold(x0, k, _mm_loadu_si128((const __m128i *)data));
+		x1 = crc64_clmul_fold(x1, k, _mm_loadu_si128((const __m128i *)(data + 16)));
+		x2 = crc64_clmul_fold(x2, k, _mm_loadu_si128((const __m128i *)(data + 32)));
+		x3 = crc64_clmul_fold(x3, k, _mm_loadu_si128((const __m128i *)(data + 48)));
+		data += 64;
+		len -= 64;
+	}
+
+	k = _mm_set_epi64x((long long)g_clmul_k[3], (long long)g_clmul_k[2]);
+	x1 = crc64_clmul_fold(x0, k, x1);
+	x2 = crc64_clmul_fold(x1, k, x2);
+	x3 = crc64_clmul_fold(x2, k, x3);
+	while (len >= 16) {
+		x3 = crc64_clmul_fold(x3, k, _mm_loadu_si128((const __m128i *)data));
+		data += 16;
+		len -= 16;
+	}
+
+	// 剩余的128bit与尾部与原消息模P同余，查表收尾即可，不需要Barrett约减
+	_mm_storeu_si128((__m128i *)tail, x3);
+	crc = crc64(0, tail, sizeof(tail));
+	return crc64(crc, data, len);
+}
+
+static void csum_detect_hw(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return;
+	}
+	if (ecx & bit_SSE4_2) {
+		g_csum_fn[CSUM_TYPE_CRC32C][CSUM_IMPL_HW] = &crc32c_sse42_calc;
+	}
+	if ((ecx & bit_PCLMUL) && (ecx & bit_SSE4_1)) {
+		g_csum_fn[CSUM_TYPE_CRC64][CSUM_IMPL_HW] = &crc64_clmul_calc;
+	}
+}
+#else
+static void csum_detect_hw(void)
+{
+	return;
+}
+#endif
+
+// 硬件实现与查表实现逐一比对，不一致则弃用，保证线上结果不依赖CPU
+static int csum_selftest(enum csum_type type)
+{
+	unsigned char *buf;
+	uint64_t seed = UINT64_C(0x9e3779b97f4a7c15);
+	uint64_t len, a, b;
+	uint32_t i;
+	int ret = 0;
+
+	buf = (unsigned char *)malloc(CSUM_SELFTEST_LEN);
+	if (!buf) {
+		return -1;
+	}
+	for (i = 0; i < CSUM_SELFTEST_LEN; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		buf[i] = (unsigned char)(seed >> 56);
+	}
+	for (len = 0; len <= CSUM_SELFTEST_LEN && !ret; len += (len < 300) ? 1 : 97) {
+		a = g_csum_fn[type][CSUM_IMPL_TABLE](len, buf + (len & 7), len - (len & 7));
+		b = g_csum_fn[type][CSUM_IMPL_HW](len, buf + (len & 7), len - (len & 7));
+		ret = (a != b) ? -1 : 0;
+	}
+	free(buf);
+	return ret;
+}
+
+static void csum_init_once(void)
+{
+	uint32_t i, j, c;
+	int type;
+
+	crc64_init();
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++) {
+			c = (c & 1) ? ((c >> 1) ^ CRC32C_POLY_REFL) : (c >> 1);
+		}
+		g_crc32c_table[i] = c;
+	}
+	g_clmul_k[0] = crc64_xpow_refl(512 + 63);
+	g_clmul_k[1] = crc64_xpow_refl(512 - 1);
+	g_clmul_k[2] = crc64_xpow_refl(128 + 63);
+	g_clmul_k[3] = crc64_xpow_refl(128 - 1);
+
+	g_csum_fn[CSUM_TYPE_CRC64][CSUM_IMPL_TABLE] = &crc64_table_calc;
+	g_csum_fn[CSUM_TYPE_CRC32C][CSUM_IMPL_TABLE] = &crc32c_table_calc;
+	csum_detect_hw();
+
+	for (type = 0; type < CSUM_TYPE_MAX; type++) {
+		g_csum_best[type] = g_csum_fn[type][CSUM_IMPL_TABLE];
+		g_csum_best_name[type] = "table";
+		if (!g_csum_fn[type][CSUM_IMPL_HW]) {
+			continue;
+		}
+		if (csum_selftest((enum csum_type)type)) {
+			CSUM_LOG_ERROR("csum type[%d] hw selftest fail, use table.", type);
+			g_csum_fn[type][CSUM_IMPL_HW] = NULL;
+			continue;
+		}
+		g_csum_best[type] = g_csum_fn[type][CSUM_IMPL_HW];
+		g_csum_best_name[type] = (type == CSUM_TYPE_CRC64) ? "clmul" : "sse4.2";
+		g_csum_hw_mask |= CSUM_TYPE_BIT(type);
+	}
+	CSUM_LOG_NOTICE("csum crc64[%s], crc32c[%s].", g_csum_best_name[CSUM_TYPE_CRC64], g_csum_best_name[CSUM_TYPE_CRC32C]);
+}
+
+void csum_init(void)
+{
+	pthread_once(&g_csum_once, &csum_init_once);
+}
+
+uint32_t csum_hw_mask(void)
+{
+	csum_init();
+	return g_csum_hw_mask;
+}
+
+enum csum_type csum_select(uint32_t peer_hw_mask)
+{
+	uint32_t both = csum_hw_mask() & peer_hw_mask;
+
+	if (both & CSUM_TYPE_BIT(CSUM_TYPE_CRC32C)) {
+		return CSUM_TYPE_CRC32C;
+	}
+	return CSUM_TYPE_CRC64;
+}
+
+uint64_t csum_calc(enum csum_type type, uint64_t crc, const void *data, uint64_t len)
+{
+	if ((uint32_t)type >= CSUM_TYPE_MAX) {
+		type = CSUM_TYPE_CRC64;
+	}
+	if (!g_csum_best[type]) {
+		csum_init();
+	}
+	return g_csum_best[type](crc, (const unsigned char *)data, len);
+}
+
+uint64_t csum_calc_impl(enum csum_type type, enum csum_impl impl, uint64_t crc, const void *data, uint64_t len)
+{
+	csum_init();
+	if ((uint32_t)type >= CSUM_TYPE_MAX) {
+		type = CSUM_TYPE_CRC64;
+	}
+	if ((uint32_t)impl >= CSUM_IMPL_MAX || !g_csum_fn[type][impl]) {
+		impl = CSUM_IMPL_TABLE;
+	}
+	return g_csum_fn[type][impl](crc, (const unsigned char *)data, len);
+}
+
+const char *csum_impl_name(enum csum_type type)
+{
+	csum_init();
+	if ((uint32_t)type >= CSUM_TYPE_MAX) {
+		return "unknown";
+	}
+	return g_csum_best_name[type];
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file csum.h
+* \brief 报文校验引擎，按CPU能力运行时选择实现
+*
+* 线上算法只有两种：CRC64(Jones，与crc64.c一致)和CRC32C；同一算法的各实现结果完全一致，
+* 因此对端没有硬件加速时仍能用查表实现校验，只是更慢。
+* CRC64硬件实现基于PCLMULQDQ折叠，CRC32C硬件实现基于SSE4.2 crc32指令。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _CSUM_H_
+#define _CSUM_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum csum_type {
+	CSUM_TYPE_CRC64 = 0,		/* 默认算法，旧版本对端只认识它 */
+	CSUM_TYPE_CRC32C,
+	CSUM_TYPE_MAX,
+};
+
+enum csum_impl {
+	CSUM_IMPL_TABLE = 0,		/* 查表实现，任何CPU可用 */
+	CSUM_IMPL_HW,				/* 硬件加速实现，CPU不支持时退回查表 */
+	CSUM_IMPL_MAX,
+};
+
+#define CSUM_TYPE_BIT(type)	(1U << (type))
+
+/*!
+ * @brief  初始化：探测CPU能力、生成表并自检，可重复调用
+ */
+void csum_init(void);
+
+/*!
+ * @brief  本机有硬件加速的算法集合，按CSUM_TYPE_BIT置位
+ */
+uint32_t csum_hw_mask(void);
+
+/*!
+ * @brief  根据对端的硬件加速集合选择会话使用的算法
+ *
+ * 两端都能加速CRC32C时选CRC32C，其余情况保持CRC64以兼容旧版本
+ */
+enum csum_type csum_select(uint32_t peer_hw_mask);
+
+/*!
+ * @brief  以本机最快的实现计算校验，可在上次结果上续算
+ *
+ * @param[in] type 算法，非法值按CRC64处理
+ * @param[in] crc 上次结果，首次为0
+ * @return  校验值
+ */
+uint64_t csum_calc(enum csum_type type, uint64_t crc, const void *data, uint64_t len);
+
+/*!
+ * @brief  指定实现计算校验，用于性能对比和自检
+ */
+uint64_t csum_calc_impl(enum csum_type type, enum csum_impl impl, uint64_t crc, const void *data, uint64_t len);
+
+/*!
+ * @brief  算法当前使用的实现名
+ */
+const char *csum_impl_name(enum csum_type type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_CSUM_H_ */
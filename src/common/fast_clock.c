@@ -0,0 +1,162 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file fast_clock.c
+* \brief 热路径时间源标定
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "base_log.h"
+#include "fast_clock.h"
+
+#define FAST_CLOCK_LOG_ERROR(format, arg...) BASE_LOG_ERROR(format, ##arg)
+#define FAST_CLOCK_LOG_NOTICE(format, arg...) BASE_LOG_NOTICE(format, ##arg)
+
+#define FAST_CLOCK_CALIB_NS			(10*1000*1000ULL)	/* 标定窗口 */
+#define FAST_CLOCK_CALIB_ROUND		5					/* 取读数区间最窄的一次 */
+#define FAST_CLOCK_CHECK_ERR_NS		(50*1000ULL)		/* 标定后与clock_gettime的允许偏差 */
+#define FAST_CLOCK_SRC_PATH			"/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+struct fast_clock g_fast_clock = {0};
+__thread uint64_t tls_fast_clock_now = 0;
+
+static pthread_once_t g_fast_clock_once = PTHREAD_ONCE_INIT;
+
+#if defined(__x86_64__)
+// 内核认定tsc可靠才会选它做时钟源；虚拟机未透传invariant标记时也以此为准
+static int fast_clock_tsc_usable(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	char src[32] = {0};
+	FILE *fp;
+
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1U << 8))) {
+		return 0;
+	}
+	fp = fopen(FAST_CLOCK_SRC_PATH, "r");
+	if (!fp) {
+		return 0;
+	}
+	if (!fgets(src, sizeof(src), fp)) {
+		src[0] = '\0';
+	}
+	fclose(fp);
+	return !strncmp(src, "tsc", 3);
+}
+
+// 读一对(tsc, ns)，ns夹在两次rdtsc之间，返回区间宽度
+static uint64_t fast_clock_sample(uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t t0, t1;
+
+	t0 = fast_clock_cycles();
+	*ns = fast_clock_mono_ns();
+	t1 = fast_clock_cycles();
+	*tsc = t0 + (t1 - t0) / 2;
+	return t1 - t0;
+}
+
+static void fast_clock_sample_best(uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t best = UINT64_MAX;
+	uint64_t width, t, n;
+	uint32_t i;
+
+	for (i = 0; i < FAST_CLOCK_CALIB_ROUND; i++) {
+		width = fast_clock_sample(&t, &n);
+		if (width < best) {
+			best = width;
+			*tsc = t;
+			*ns = n;
+		}
+	}
+}
+
+// 按标定参数换算，标定通过前不发布，其它线程始终只看到一种时钟源
+static uint64_t fast_clock_calc_ns(uint64_t tsc, uint64_t base_tsc, uint64_t base_ns, uint64_t mult)
+{
+	tsc = (tsc > base_tsc) ? tsc - base_tsc : 0;
+	return base_ns + (uint64_t)(((unsigned __int128)tsc * mult) >> FAST_CLOCK_SHIFT);
+}
+
+static int fast_clock_calibrate(void)
+{
+	struct timespec req = {.tv_sec = 0, .tv_nsec = FAST_CLOCK_CALIB_NS};
+	uint64_t tsc0 = 0, ns0 = 0, tsc1 = 0, ns1 = 0;
+	uint64_t mult, now, err;
+
+	fast_clock_sample_best(&tsc0, &ns0);
+	nanosleep(&req, NULL);
+	fast_clock_sample_best(&tsc1, &ns1);
+	if (tsc1 <= tsc0 || ns1 <= ns0) {
+		return -1;
+	}
+	mult = ((ns1 - ns0) << FAST_CLOCK_SHIFT) / (tsc1 - tsc0);
+
+	nanosleep(&req, NULL);
+	now = fast_clock_mono_ns();
+	err = fast_clock_calc_ns(fast_clock_cycles(), tsc1, ns1, mult);
+	err = (err > now) ? err - now : now - err;
+	if (err > FAST_CLOCK_CHECK_ERR_NS) {
+		FAST_CLOCK_LOG_ERROR("tsc check fail, err[%lu ns], use clock_gettime.", err);
+		return -1;
+	}
+	g_fast_clock.mult = mult;
+	g_fast_clock.base_tsc = tsc1;
+	g_fast_clock.base_ns = ns1;
+	__atomic_store_n(&g_fast_clock.use_tsc, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+#endif
+
+static void fast_clock_do_init(void)
+{
+#if defined(__x86_64__)
+	if (fast_clock_tsc_usable() && !fast_clock_calibrate()) {
+		FAST_CLOCK_LOG_NOTICE("fast clock use tsc, %lu.%03lu MHz.",
+							(1000ULL << FAST_CLOCK_SHIFT) / g_fast_clock.mult,
+							((1000000ULL << FAST_CLOCK_SHIFT) / g_fast_clock.mult) % 1000);
+	}
+#endif
+	fast_clock_wall_refresh(fast_clock_ns());
+}
+
+void fast_clock_init(void)
+{
+	pthread_once(&g_fast_clock_once, fast_clock_do_init);
+}
+
+const char *fast_clock_source(void)
+{
+	return __atomic_load_n(&g_fast_clock.use_tsc, __ATOMIC_ACQUIRE) ? "tsc" : "clock_gettime";
+}
+
+void fast_clock_wall_refresh(uint64_t now_ns)
+{
+	uint64_t next = __atomic_load_n(&g_fast_clock.wall_next_ns, __ATOMIC_RELAXED);
+	struct timespec wall;
+	uint64_t mono;
+
+	if (now_ns < next ||
+		!__atomic_compare_exchange_n(&g_fast_clock.wall_next_ns, &next, now_ns + FAST_CLOCK_WALL_REFRESH_NS,
+									0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;		// 其它线程在刷新，沿用旧偏移
+	}
+	clock_gettime(CLOCK_REALTIME, &wall);
+	mono = fast_clock_ns();
+	__atomic_store_n(&g_fast_clock.wall_offset_ns,
+					(int64_t)((uint64_t)wall.tv_sec * FAST_CLOCK_NS_PER_SEC + wall.tv_nsec) - (int64_t)mono, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file fast_clock.h
+* \brief 热路径时间源
+*
+* 内核时钟源为tsc且CPU支持invariant TSC时，直接读TSC并按启动时对CLOCK_MONOTONIC的标定换算为纳秒，
+* 否则退回vdso的clock_gettime(CLOCK_MONOTONIC)。墙上时间由单调时间加偏移得到，偏移最多每秒刷新一次，
+* 吸收TSC与NTP校时之间的漂移。另有按线程缓存的粗粒度"当前时间"，由xio loop线程和线程池工作线程每轮刷新。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _FAST_CLOCK_H_
+#define _FAST_CLOCK_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FAST_CLOCK_NS_PER_SEC		1000000000ULL
+#define FAST_CLOCK_WALL_REFRESH_NS	FAST_CLOCK_NS_PER_SEC	/* 墙上时间偏移的刷新周期 */
+#define FAST_CLOCK_SHIFT			32
+
+struct fast_clock {
+	uint32_t	use_tsc;			/* 标定成功后置1，之前一律走clock_gettime */
+	uint32_t	resv;
+	uint64_t	mult;				/* 每个TSC周期的纳秒数，定点数，小数位FAST_CLOCK_SHIFT */
+	uint64_t	base_tsc;
+	uint64_t	base_ns;			/* base_tsc对应的CLOCK_MONOTONIC */
+	int64_t		wall_offset_ns;		/* CLOCK_REALTIME与本时钟之差，原子读写 */
+	uint64_t	wall_next_ns;		/* 下次刷新偏移的时刻，原子读写 */
+};
+
+extern struct fast_clock g_fast_clock;
+extern __thread uint64_t tls_fast_clock_now;
+
+/*!
+ * @brief  标定时钟，可重复调用，只执行一次；未调用前各接口退回clock_gettime
+ */
+void fast_clock_init(void);
+
+/*!
+ * @brief  当前使用的时钟源，"tsc"或"clock_gettime"
+ */
+const char *fast_clock_source(void);
+
+/*!
+ * @brief  刷新墙上时间偏移，由fast_clock_to_wall在到期时调用
+ */
+void fast_clock_wall_refresh(uint64_t now_ns);
+
+static inline uint64_t fast_clock_mono_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);	// vdso，不进内核
+	return (uint64_t)now.tv_sec * FAST_CLOCK_NS_PER_SEC + now.tv_nsec;
+}
+
+static inline uint64_t fast_clock_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return fast_clock_mono_ns();
+#endif
+}
+
+/*!
+ * @brief  单调时间，纳秒
+ */
+static inline uint64_t fast_clock_ns(void)
+{
+#if defined(__x86_64__)
+	uint64_t tsc;
+
+	if (__builtin_expect(__atomic_load_n(&g_fast_clock.use_tsc, __ATOMIC_ACQUIRE), 1)) {
+		tsc = fast_clock_cycles();
+		tsc = (tsc > g_fast_clock.base_tsc) ? tsc - g_fast_clock.base_tsc : 0;	// 跨核读数略早于基准时按基准算
+		return g_fast_clock.base_ns + (uint64_t)(((unsigned __int128)tsc * g_fast_clock.mult) >> FAST_CLOCK_SHIFT);
+	}
+#endif
+	return fast_clock_mono_ns();
+}
+
+/*!
+ * @brief  把fast_clock_ns的读数换算为墙上时间，纳秒
+ */
+static inline uint64_t fast_clock_to_wall(uint64_t now_ns)
+{
+	struct timespec wall;
+	int64_t offset;
+
+	if (now_ns >= __atomic_load_n(&g_fast_clock.wall_next_ns, __ATOMIC_RELAXED)) {
+		fast_clock_wall_refresh(now_ns);
+	}
+	offset = __atomic_load_n(&g_fast_clock.wall_offset_ns, __ATOMIC_RELAXED);
+	if (__builtin_expect(!offset, 0)) {
+		clock_gettime(CLOCK_REALTIME, &wall);	// 首次刷新尚未完成
+		return (uint64_t)wall.tv_sec * FAST_CLOCK_NS_PER_SEC + wall.tv_nsec;
+	}
+	return now_ns + offset;
+}
+
+/*!
+ * @brief  墙上时间，纳秒，用于跨进程/跨主机的时间戳
+ */
+static inline uint64_t fast_clock_wall_ns(void)
+{
+	return fast_clock_to_wall(fast_clock_ns());
+}
+
+/*!
+ * @brief  pthread_cond_timedwait等使用CLOCK_REALTIME的绝对超时
+ */
+static inline void fast_clock_abstime(uint64_t timeout_ms, struct timespec *abstime)
+{
+	uint64_t wall = fast_clock_wall_ns() + timeout_ms * 1000000ULL;
+
+	abstime->tv_sec = (time_t)(wall / FAST_CLOCK_NS_PER_SEC);
+	abstime->tv_nsec = (long)(wall % FAST_CLOCK_NS_PER_SEC);
+}
+
+/*!
+ * @brief  刷新本线程的粗粒度时间并返回，事件循环每轮阻塞返回后调用一次
+ */
+static inline uint64_t fast_clock_tick(void)
+{
+	tls_fast_clock_now = fast_clock_ns();
+	return tls_fast_clock_now;
+}
+
+/*!
+ * @brief  本线程最近一次fast_clock_tick的时间，误差不超过一轮事件处理；
+ * 从未tick过的线程每次读时钟，不缓存
+ */
+static inline uint64_t fast_clock_coarse_ns(void)
+{
+	return tls_fast_clock_now ? tls_fast_clock_now : fast_clock_ns();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_FAST_CLOCK_H_ */
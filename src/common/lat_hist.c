@@ -0,0 +1,68 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file lat_hist.c
+* \brief 对数分桶的时延直方图
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+
+#include "lat_hist.h"
+
+static uint64_t lat_hist_value(uint32_t idx)
+{
+	uint32_t shift;
+
+	if (idx < LAT_HIST_SUB_NUM) {
+		return idx;
+	}
+	shift = idx / LAT_HIST_SUB_NUM - 1;
+	return ((uint64_t)(LAT_HIST_SUB_NUM + idx % LAT_HIST_SUB_NUM) << shift) + ((1ULL << shift) >> 1);
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	uint64_t max = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+	uint32_t i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		dst->bucket[i] += __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
+	}
+	dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+	dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+	dst->max_ns = (max > dst->max_ns) ? max : dst->max_ns;
+}
+
+// 按桶计数求和，不用count，读的同时有写入也不会越界
+uint64_t lat_hist_percentile(const struct lat_hist *h, uint32_t permyriad)
+{
+	uint64_t total = 0;
+	uint64_t rank;
+	uint64_t acc = 0;
+	uint32_t i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		total += h->bucket[i];
+	}
+	if (!total) {
+		return 0;
+	}
+	rank = (total * permyriad + 9999) / 10000;
+	rank = rank ? rank : 1;
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		acc += h->bucket[i];
+		if (acc >= rank) {
+			break;
+		}
+	}
+	i = (i < LAT_HIST_BUCKETS) ? i : LAT_HIST_BUCKETS - 1;
+	return (h->max_ns && lat_hist_value(i) > h->max_ns) ? h->max_ns : lat_hist_value(i);
+}
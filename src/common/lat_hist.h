@@ -0,0 +1,83 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file lat_hist.h
+* \brief 对数分桶的时延直方图
+*
+* 每个2的幂区间再均分为8个子桶，相对误差不超过12.5%，取子桶中点时约6%；覆盖1ns到约68s，超出计入最后一桶。
+* 记录只做几次原子加，不加锁，可被多个线程同时写；读取时逐桶累加，可把多个直方图合并后再求分位数。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _LAT_HIST_H_
+#define _LAT_HIST_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAT_HIST_SUB_BITS	3
+#define LAT_HIST_SUB_NUM	(1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_MAX_BIT	36
+#define LAT_HIST_BUCKETS	((LAT_HIST_MAX_BIT - LAT_HIST_SUB_BITS + 2) * LAT_HIST_SUB_NUM)
+
+struct lat_hist {
+	uint64_t	count;
+	uint64_t	sum_ns;
+	uint64_t	max_ns;
+	uint64_t	bucket[LAT_HIST_BUCKETS];
+};
+
+static inline uint32_t lat_hist_index(uint64_t ns)
+{
+	uint32_t msb;
+
+	if (ns < LAT_HIST_SUB_NUM) {
+		return (uint32_t)ns;
+	}
+	msb = 63 - __builtin_clzll(ns);
+	if (msb > LAT_HIST_MAX_BIT) {
+		return LAT_HIST_BUCKETS - 1;
+	}
+	return (msb - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB_NUM + (uint32_t)((ns >> (msb - LAT_HIST_SUB_BITS)) & (LAT_HIST_SUB_NUM - 1));
+}
+
+static inline void lat_hist_record(struct lat_hist *h, uint64_t ns)
+{
+	uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&h->bucket[lat_hist_index(ns)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	while (ns > max && !__atomic_compare_exchange_n(&h->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*!
+ * @brief  把src累加到dst，src可以正在被写
+ */
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+
+/*!
+ * @brief  求分位数
+ *
+ * @param[in] h 直方图
+ * @param[in] permyriad 万分位，如5000为p50，9990为p999
+ * @return  所在子桶的中点，单位ns；无数据为0
+ */
+uint64_t lat_hist_percentile(const struct lat_hist *h, uint32_t permyriad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_LAT_HIST_H_ */
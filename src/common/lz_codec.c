@@ -0,0 +1,242 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file lz_codec.c
+* \brief 轻量LZ块压缩
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+#include <stdint.h>
+
+#include "lz_codec.h"
+
+#define LZ_MIN_MATCH		4
+#define LZ_HASH_LOG			12
+#define LZ_LAST_LITERALS	5		/* 块尾固定为字面量，解码时不需要处理跨尾匹配 */
+#define LZ_MFLIMIT			12		/* 距块尾不足该长度不再找匹配 */
+#define LZ_SKIP_TRIGGER		6		/* 连续未命中2^6次后步长加1 */
+#define LZ_RUN_MASK			15
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static inline uint32_t lz_match_len(const uint8_t *ip, const uint8_t *ref, const uint8_t *limit)
+{
+	const uint8_t *start = ip;
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	uint64_t a, b;
+
+	while (ip + sizeof(uint64_t) <= limit) {
+		memcpy(&a, ip, sizeof(a));
+		memcpy(&b, ref, sizeof(b));
+		if (a != b) {
+			return (uint32_t)(ip - start) + (__builtin_ctzll(a ^ b) >> 3);
+		}
+		ip += sizeof(uint64_t);
+		ref += sizeof(uint64_t);
+	}
+#endif
+	while (ip < limit && *ip == *ref) {
+		ip++;
+		ref++;
+	}
+	return (uint32_t)(ip - start);
+}
+
+static inline uint8_t *lz_write_len(uint8_t *op, const uint8_t *oend, uint32_t len)
+{
+	while (len >= 255) {
+		if (op >= oend) {
+			return NULL;
+		}
+		*op++ = 255;
+		len -= 255;
+	}
+	if (op >= oend) {
+		return NULL;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+// 输出一个序列；match_len为0表示块尾只有字面量
+static uint8_t *lz_emit(uint8_t *op, const uint8_t *oend, const uint8_t *lit, uint32_t lit_len,
+						uint32_t offset, uint32_t match_len)
+{
+	uint8_t *token;
+
+	if (op >= oend) {
+		return NULL;
+	}
+	token = op++;
+	if (lit_len >= LZ_RUN_MASK) {
+		*token = LZ_RUN_MASK << 4;
+		op = lz_write_len(op, oend, lit_len - LZ_RUN_MASK);
+		if (!op) {
+			return NULL;
+		}
+	} else {
+		*token = (uint8_t)(lit_len << 4);
+	}
+	if (lit_len > (uint32_t)(oend - op)) {
+		return NULL;
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (!match_len) {
+		return op;
+	}
+
+	if (oend - op < 2) {
+		return NULL;
+	}
+	*op++ = (uint8_t)offset;
+	*op++ = (uint8_t)(offset >> 8);
+	match_len -= LZ_MIN_MATCH;
+	if (match_len >= LZ_RUN_MASK) {
+		*token |= LZ_RUN_MASK;
+		op = lz_write_len(op, oend, match_len - LZ_RUN_MASK);
+	} else {
+		*token |= (uint8_t)match_len;
+	}
+	return op;
+}
+
+uint32_t lz_compress(const void *src, uint32_t src_len, void *dst, uint32_t dst_cap)
+{
+	uint16_t table[1 << LZ_HASH_LOG];
+	const uint8_t *base = (const uint8_t *)src;
+	const uint8_t *ip = base;
+	const uint8_t *anchor = base;
+	const uint8_t *iend = base + src_len;
+	const uint8_t *ilimit = iend - LZ_MFLIMIT;
+	const uint8_t *mlimit = iend - LZ_LAST_LITERALS;
+	const uint8_t *ref;
+	uint8_t *op = (uint8_t *)dst;
+	const uint8_t *oend = op + dst_cap;
+	uint32_t h, len;
+	uint32_t searches = 1 << LZ_SKIP_TRIGGER;
+
+	if (!src || !dst || !src_len || src_len > LZ_BLOCK_MAX) {
+		return 0;
+	}
+	if (src_len > LZ_MFLIMIT) {
+		memset(table, 0, sizeof(table));
+		ip++;
+		while (ip < ilimit) {
+			h = lz_hash(lz_read32(ip));
+			ref = base + table[h];
+			table[h] = (uint16_t)(ip - base);
+			if (ref >= ip || lz_read32(ref) != lz_read32(ip)) {
+				ip += searches++ >> LZ_SKIP_TRIGGER;
+				continue;
+			}
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			len = LZ_MIN_MATCH + lz_match_len(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, mlimit);
+			op = lz_emit(op, oend, anchor, (uint32_t)(ip - anchor), (uint32_t)(ip - ref), len);
+			if (!op) {
+				return 0;
+			}
+			ip += len;
+			anchor = ip;
+			searches = 1 << LZ_SKIP_TRIGGER;
+			if (ip < ilimit) {
+				table[lz_hash(lz_read32(ip - 2))] = (uint16_t)(ip - 2 - base);
+			}
+		}
+	}
+	op = lz_emit(op, oend, anchor, (uint32_t)(iend - anchor), 0, 0);
+	return op ? (uint32_t)(op - (uint8_t *)dst) : 0;
+}
+
+int lz_decompress(const void *src, uint32_t src_len, void *dst, uint32_t dst_len)
+{
+	const uint8_t *ip = (const uint8_t *)src;
+	const uint8_t *iend = ip + src_len;
+	uint8_t *op = (uint8_t *)dst;
+	uint8_t *oend = op + dst_len;
+	const uint8_t *ref;
+	uint32_t token, len, offset, b;
+
+	if (!src || !dst || !src_len) {
+		return -1;
+	}
+	for (;;) {
+		if (ip >= iend) {
+			return -1;
+		}
+		token = *ip++;
+		len = token >> 4;
+		if (len == LZ_RUN_MASK) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		if (len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		offset = ip[0] | ((uint32_t)ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > (uint32_t)(op - (uint8_t *)dst)) {
+			return -1;
+		}
+		len = token & LZ_RUN_MASK;
+		if (len == LZ_RUN_MASK) {
+			do {
+				if (ip >= iend) {
+					return -1;
+				}
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		len += LZ_MIN_MATCH;
+		if (len > (uint32_t)(oend - op)) {
+			return -1;
+		}
+		ref = op - offset;
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			while (len--) {
+				*op++ = *ref++;		// 重叠复制，按字节展开重复串
+			}
+		}
+	}
+	return (op == oend) ? 0 : -1;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file lz_codec.h
+* \brief 轻量LZ块压缩
+*
+* 格式与LZ4块格式同族：token(高4位字面量长度，低4位匹配长度-4)、扩展长度、字面量、2字节小端偏移。
+* 单块不超过64KB，块之间相互独立，便于按块分段发送和解码。
+* 压缩侧追求速度：单路哈希、未命中时步长递增，不可压缩数据很快跳过。
+* 解压侧对输入逐项做边界检查，畸形数据只会返回失败。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _LZ_CODEC_H_
+#define _LZ_CODEC_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZ_BLOCK_MAX	(64 * 1024)		/* 单块原始数据上限，偏移用16位表示 */
+
+/*!
+ * @brief  压缩一块数据
+ *
+ * @param[in] src 原始数据
+ * @param[in] src_len 原始长度，不超过LZ_BLOCK_MAX
+ * @param[out] dst 输出缓冲
+ * @param[in] dst_cap 输出上限，调用者据此限定可接受的压缩率
+ * @return  压缩后长度；0表示超出dst_cap或参数非法，调用者应原样发送
+ */
+uint32_t lz_compress(const void *src, uint32_t src_len, void *dst, uint32_t dst_cap);
+
+/*!
+ * @brief  解压一块数据
+ *
+ * @param[in] src 压缩数据
+ * @param[in] src_len 压缩长度
+ * @param[out] dst 输出缓冲
+ * @param[in] dst_len 原始长度，解压结果必须恰好为该长度
+ * @return  0 成功；-1 数据损坏
+ */
+int lz_decompress(const void *src, uint32_t src_len, void *dst, uint32_t dst_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_LZ_CODEC_H_ */
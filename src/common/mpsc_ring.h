@@ -0,0 +1,205 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file mpsc_ring.h
+* \brief 有界无锁多生产者单消费者环形队列
+*
+* 基于槽位序号(sequence)的环形数组，生产者通过CAS抢占写位置，消费者独占读位置。
+* pending计数用于"门铃"判定：只有队列由空变为非空的那一次入队才需要唤醒消费者。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _MPSC_RING_H_
+#define _MPSC_RING_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MPSC_RING_CACHE_LINE	64
+
+struct mpsc_ring_slot {
+	uint64_t	seq;		/* 槽位序号，等于pos表示可写，等于pos+1表示可读 */
+	void		*data;
+};
+
+struct mpsc_ring {
+	uint64_t				head;		/* 生产者写位置 */
+	char					pad0[MPSC_RING_CACHE_LINE - sizeof(uint64_t)];
+	int64_t					pending;	/* 已入队未消费计数, 可短暂为负 */
+	char					pad1[MPSC_RING_CACHE_LINE - sizeof(int64_t)];
+	uint64_t				tail;		/* 消费者读位置 */
+	uint64_t				mask;
+	uint64_t				size;
+	struct mpsc_ring_slot	*slot;
+	void					(*slot_free)(void *slot, void *ctx);
+	void					*slot_ctx;
+};
+
+/*!
+ * @brief  初始化环形队列，槽位数组由调用者提供的分配函数申请（如按NUMA节点分配）
+ *
+ * @param[in] ring
+ * @param[in] size 槽位数，向上取整为2的幂
+ * @param[in] slot_alloc 分配函数，返回的内存需已清零；为NULL时使用calloc
+ * @param[in] slot_free 与slot_alloc配对的释放函数
+ * @param[in] ctx 分配/释放函数的上下文
+ * @return  0 成功，-1 失败
+ */
+static inline int mpsc_ring_init_ex(struct mpsc_ring *ring, uint32_t size,
+									void *(*slot_alloc)(size_t bytes, void *ctx),
+									void (*slot_free)(void *slot, void *ctx), void *ctx)
+{
+	uint64_t i;
+	uint64_t real_size = 2;
+
+	while (real_size < size) {
+		real_size <<= 1;
+	}
+	if (slot_alloc && slot_free) {
+		ring->slot = (struct mpsc_ring_slot *)slot_alloc(real_size * sizeof(struct mpsc_ring_slot), ctx);
+		ring->slot_free = slot_free;
+		ring->slot_ctx = ctx;
+	} else {
+		ring->slot = (struct mpsc_ring_slot *)calloc(real_size, sizeof(struct mpsc_ring_slot));
+		ring->slot_free = NULL;
+		ring->slot_ctx = NULL;
+	}
+	if (!ring->slot) {
+		return -1;
+	}
+	for (i = 0; i < real_size; i++) {
+		ring->slot[i].seq = i;
+	}
+	ring->size = real_size;
+	ring->mask = real_size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->pending = 0;
+	return 0;
+}
+
+/*!
+ * @brief  初始化环形队列
+ *
+ * @param[in] ring
+ * @param[in] size 槽位数，向上取整为2的幂
+ * @return  0 成功，-1 失败
+ */
+static inline int mpsc_ring_init(struct mpsc_ring *ring, uint32_t size)
+{
+	return mpsc_ring_init_ex(ring, size, NULL, NULL, NULL);
+}
+
+static inline void mpsc_ring_destroy(struct mpsc_ring *ring)
+{
+	if (ring->slot) {
+		if (ring->slot_free) {
+			ring->slot_free(ring->slot, ring->slot_ctx);
+		} else {
+			free(ring->slot);
+		}
+		ring->slot = NULL;
+	}
+	ring->size = 0;
+	ring->mask = 0;
+}
+
+/*!
+ * @brief  入队（多线程安全，无锁）
+ *
+ * @param[in] ring
+ * @param[in] data
+ * @param[out] doorbell 置1表示队列由空变为非空，调用者需要唤醒消费者
+ * @return  0 成功，-1 队列满
+ */
+static inline int mpsc_ring_push(struct mpsc_ring *ring, void *data, int *doorbell)
+{
+	struct mpsc_ring_slot *slot;
+	uint64_t pos;
+	uint64_t seq;
+	int64_t diff;
+
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &ring->slot[pos & ring->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int64_t)seq - (int64_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return -1;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+	slot->data = data;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	*doorbell = (__atomic_fetch_add(&ring->pending, 1, __ATOMIC_ACQ_REL) == 0);
+	return 0;
+}
+
+/*!
+ * @brief  出队（仅限单个消费者线程）
+ *
+ * @param[in] ring
+ * @return  队列空或下一个槽位尚未写完时返回NULL
+ */
+static inline void *mpsc_ring_pop(struct mpsc_ring *ring)
+{
+	struct mpsc_ring_slot *slot;
+	uint64_t pos = ring->tail;
+	void *data;
+
+	slot = &ring->slot[pos & ring->mask];
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+		return NULL;
+	}
+	data = slot->data;
+	slot->data = NULL;
+	__atomic_store_n(&slot->seq, pos + ring->size, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELAXED);
+	return data;
+}
+
+/*!
+ * @brief  消费者一轮取完后提交已消费数量
+ *
+ * @param[in] ring
+ * @param[in] cnt 本轮消费的数量
+ * @return  大于0表示仍有已入队但未消费的元素（其生产者不会再敲门铃），需要继续消费
+ */
+static inline int64_t mpsc_ring_consumed(struct mpsc_ring *ring, uint64_t cnt)
+{
+	return __atomic_sub_fetch(&ring->pending, (int64_t)cnt, __ATOMIC_ACQ_REL);
+}
+
+/*!
+ * @brief  当前队列深度（近似值，用于流控判断）
+ */
+static inline uint64_t mpsc_ring_depth(const struct mpsc_ring *ring)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	return (head > tail) ? (head - tail) : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_MPSC_RING_H_ */
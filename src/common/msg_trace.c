@@ -0,0 +1,234 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file msg_trace.c
+* \brief 消息全链路追踪
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "base_log.h"
+#include "msg_trace.h"
+
+#define MSG_TRACE_RING_MASK		(MSG_TRACE_RING_SIZE - 1)
+#define MSG_TRACE_ID_SEQ_BITS	40				/* 高位放pid，多个客户端进程的id不重复 */
+#define MSG_TRACE_CALIB_MIN_NS	(10 * 1000 * 1000)
+
+struct msg_trace_buf {
+	uint64_t				count;			/* 已写事件总数，只增 */
+	int32_t					owned;			/* 线程退出后置0，供新线程复用 */
+	struct msg_trace_buf	*next;
+	struct msg_trace_event	events[MSG_TRACE_RING_SIZE];
+};
+
+uint32_t g_msg_trace_sample = 0;
+
+static struct msg_trace_buf *g_trace_bufs = NULL;
+static uint64_t g_trace_seq = 0;
+static uint64_t g_trace_pid = 0;
+static uint64_t g_calib_tsc = 0;		/* 开启追踪时的时间基准，用于dump时估算TSC频率 */
+static uint64_t g_calib_ns = 0;
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_trace_key;
+
+static __thread struct msg_trace_buf *tls_trace_buf = NULL;
+static __thread uint32_t tls_trace_tid = 0;
+
+static inline uint64_t clock_ns(clockid_t id)
+{
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t trace_tsc(void)
+{
+	return fast_clock_cycles();
+}
+
+static void trace_buf_exit(void *arg)
+{
+	struct msg_trace_buf *buf = (struct msg_trace_buf *)arg;
+
+	tls_trace_buf = NULL;
+	__atomic_store_n(&buf->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_init_once(void)
+{
+	if (pthread_key_create(&g_trace_key, &trace_buf_exit)) {
+		BASE_LOG_ERROR("pthread_key_create fail, trace buffer of exited thread won't be reused.");
+	}
+}
+
+// 先复用已退出线程留下的缓冲，没有再新建；缓冲不释放，dump时仍可看到已退出线程的事件
+static struct msg_trace_buf *trace_buf_get(void)
+{
+	struct msg_trace_buf *buf;
+	int32_t owned;
+
+	pthread_once(&g_trace_once, &trace_init_once);
+	for (buf = __atomic_load_n(&g_trace_bufs, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+		owned = 0;
+		if (__atomic_compare_exchange_n(&buf->owned, &owned, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+	if (!buf) {
+		buf = (struct msg_trace_buf *)calloc(1, sizeof(struct msg_trace_buf));
+		LOG_THEN_RETURN_VAL_IF_TRUE(!buf, NULL, "calloc trace buffer fail.");
+		buf->owned = 1;
+		buf->next = __atomic_load_n(&g_trace_bufs, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&g_trace_bufs, &buf->next, buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+	pthread_setspecific(g_trace_key, buf);
+	tls_trace_buf = buf;
+	tls_trace_tid = (uint32_t)syscall(SYS_gettid);
+	return buf;
+}
+
+void msg_trace_set_sample(uint32_t sample)
+{
+	if (sample && !__atomic_load_n(&g_msg_trace_sample, __ATOMIC_RELAXED)) {
+		g_trace_pid = (uint64_t)getpid();
+		g_calib_ns = clock_ns(CLOCK_MONOTONIC);
+		g_calib_tsc = trace_tsc();
+	}
+	__atomic_store_n(&g_msg_trace_sample, sample, __ATOMIC_RELEASE);
+	BASE_LOG_NOTICE("msg trace sample set to[%u].", sample);
+}
+
+uint64_t msg_trace_new_id(void)
+{
+	uint32_t sample = __atomic_load_n(&g_msg_trace_sample, __ATOMIC_RELAXED);
+	uint64_t seq;
+
+	if (!sample) {
+		return 0;
+	}
+	seq = __atomic_fetch_add(&g_trace_seq, 1, __ATOMIC_RELAXED);
+	if (sample > 1 && (seq % sample)) {
+		return 0;
+	}
+	return (g_trace_pid << MSG_TRACE_ID_SEQ_BITS) | (((seq + 1)) & ((1ULL << MSG_TRACE_ID_SEQ_BITS) - 1));
+}
+
+void msg_trace_event(uint64_t trace_id, uint16_t point, uint16_t msg_type, uint32_t conn_id, uint32_t arg)
+{
+	struct msg_trace_buf *buf = tls_trace_buf;
+	struct msg_trace_event *ev;
+	uint64_t idx;
+
+	if (!buf) {
+		buf = trace_buf_get();
+		if (!buf) {
+			return;
+		}
+	}
+	idx = buf->count;
+	ev = &buf->events[idx & MSG_TRACE_RING_MASK];
+	ev->tsc = trace_tsc();
+	ev->trace_id = trace_id;
+	ev->tid = tls_trace_tid;
+	ev->conn_id = conn_id;
+	ev->point = point;
+	ev->msg_type = msg_type;
+	ev->arg = arg;
+	__atomic_store_n(&buf->count, idx + 1, __ATOMIC_RELEASE);
+}
+
+// 拷贝一个线程的事件环，拷贝期间写入方可能追上并覆盖最老的部分，拷完后按新计数剔除
+static uint64_t trace_buf_copy(struct msg_trace_buf *buf, struct msg_trace_event *out)
+{
+	uint64_t end = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+	uint64_t start = (end > MSG_TRACE_RING_SIZE) ? end - MSG_TRACE_RING_SIZE : 0;
+	uint64_t now;
+	uint64_t i;
+
+	for (i = start; i < end; i++) {
+		out[i - start] = buf->events[i & MSG_TRACE_RING_MASK];
+	}
+	now = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+	if (now > start + MSG_TRACE_RING_SIZE) {
+		i = now - MSG_TRACE_RING_SIZE - start;		// 已被覆盖的个数，多丢一个写入中的槽
+		i = (i + 1 < end - start) ? i + 1 : end - start;
+		memmove(out, out + i, (end - start - i) * sizeof(struct msg_trace_event));
+		return end - start - i;
+	}
+	return end - start;
+}
+
+int msg_trace_dump(const char *path)
+{
+	struct msg_trace_file_head head;
+	struct msg_trace_buf *buf;
+	struct msg_trace_event *events = NULL;
+	uint64_t buf_num = 0;
+	uint64_t num = 0;
+	uint64_t tsc0, tsc1, ns0, ns1;
+	FILE *fp = NULL;
+	int ret = -1;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!path, -1, "path null.");
+	for (buf = __atomic_load_n(&g_trace_bufs, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+		buf_num++;
+	}
+	if (buf_num) {
+		events = (struct msg_trace_event *)malloc(buf_num * MSG_TRACE_RING_SIZE * sizeof(struct msg_trace_event));
+		LOG_THEN_RETURN_VAL_IF_TRUE(!events, -1, "malloc dump buffer for [%lu] threads fail.", buf_num);
+	}
+	// 遍历期间新加入的缓冲插在链表头，不会越过已统计的数量
+	for (buf = __atomic_load_n(&g_trace_bufs, __ATOMIC_ACQUIRE); buf && buf_num; buf = buf->next, buf_num--) {
+		num += trace_buf_copy(buf, events + num);
+	}
+
+	// 以开启时的采样点与现在估算TSC频率，间隔太短时等一会儿
+	ns0 = g_calib_ns;
+	tsc0 = g_calib_tsc;
+	if (!ns0 || clock_ns(CLOCK_MONOTONIC) < ns0 + MSG_TRACE_CALIB_MIN_NS) {
+		ns0 = clock_ns(CLOCK_MONOTONIC);
+		tsc0 = trace_tsc();
+		usleep(MSG_TRACE_CALIB_MIN_NS / 1000);
+	}
+	ns1 = clock_ns(CLOCK_MONOTONIC);
+	tsc1 = trace_tsc();
+
+	memset(&head, 0, sizeof(head));
+	head.magic = MSG_TRACE_FILE_MAGIC;
+	head.version = MSG_TRACE_FILE_VERSION;
+	head.pid = (uint32_t)getpid();
+	head.event_size = sizeof(struct msg_trace_event);
+	head.tsc_hz = (uint64_t)((double)(tsc1 - tsc0) * 1e9 / (double)(ns1 - ns0));
+	head.base_tsc = trace_tsc();
+	head.base_ns = clock_ns(CLOCK_REALTIME);
+	head.event_num = num;
+
+	fp = fopen(path, "wb");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!fp, end, "open trace file[%s] fail.", path);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(fwrite(&head, sizeof(head), 1, fp) != 1, end, "write trace head fail.");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(num && fwrite(events, sizeof(struct msg_trace_event), num, fp) != num,
+									end, "write [%lu] trace events fail.", num);
+	BASE_LOG_NOTICE("dump [%lu] trace events to[%s], tsc[%lu hz].", num, path, head.tsc_hz);
+	ret = 0;
+end:
+	if (fp) {
+		fclose(fp);
+	}
+	if (events) {
+		free(events);
+	}
+	return ret;
+}
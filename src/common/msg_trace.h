@@ -0,0 +1,123 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file msg_trace.h
+* \brief 消息全链路追踪
+*
+* 每个线程一块定长事件环(飞行记录器)，事件为32字节的二进制记录，带TSC时间戳，写入无锁无系统调用。
+* 请求在发起端按采样率分配trace id，随消息属性带到对端，两端各阶段以同一id记录。
+* dump文件由文件头与事件数组组成，文件头给出TSC频率与墙上时间基准，多个进程的dump可合并还原时间线。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _MSG_TRACE_H_
+#define _MSG_TRACE_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSG_TRACE_FILE_MAGIC	0x41525443		/* "ARTC" */
+#define MSG_TRACE_FILE_VERSION	1
+#define MSG_TRACE_RING_SIZE		(16 * 1024)		/* 每线程保留的事件数，2的幂 */
+
+enum msg_trace_point {
+	MSG_TRACE_NONE = 0,
+	MSG_TRACE_REQ_BEGIN,		/* 调用者发起请求/单向消息 */
+	MSG_TRACE_GET_CONN,			/* 取到空闲连接 */
+	MSG_TRACE_ENQUEUE,			/* 进入连接发送环 */
+	MSG_TRACE_XIO_SEND,			/* loop线程交给xio发送 */
+	MSG_TRACE_RX_HEAD,			/* 对端收到消息头 */
+	MSG_TRACE_RX_DATA,			/* 数据接收、解压、校验完毕 */
+	MSG_TRACE_DISPATCH,			/* 投递到工作线程池 */
+	MSG_TRACE_PROC_BEGIN,		/* 调用用户处理函数 */
+	MSG_TRACE_PROC_END,			/* 用户处理函数返回 */
+	MSG_TRACE_RSP_DONE,			/* 回复交付给请求方 */
+	MSG_TRACE_REQ_END,			/* 同步请求返回调用者 */
+	MSG_TRACE_POINT_MAX,
+};
+
+struct msg_trace_event {
+	uint64_t	tsc;
+	uint64_t	trace_id;
+	uint32_t	tid;
+	uint32_t	conn_id;
+	uint16_t	point;			/* enum msg_trace_point */
+	uint16_t	msg_type;		/* 请求/回复/单向 */
+	uint32_t	arg;			/* 附加信息，如数据长度 */
+};
+
+struct msg_trace_file_head {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	pid;
+	uint32_t	event_size;
+	uint64_t	tsc_hz;			/* 每秒TSC计数 */
+	uint64_t	base_tsc;		/* 与base_ns同一时刻采样 */
+	uint64_t	base_ns;		/* CLOCK_REALTIME纳秒 */
+	uint64_t	event_num;
+};
+
+static inline const char *msg_trace_point_name(uint32_t point)
+{
+	static const char * const name[MSG_TRACE_POINT_MAX] = {
+		"none", "req_begin", "get_conn", "enqueue", "xio_send", "rx_head",
+		"rx_data", "dispatch", "proc_begin", "proc_end", "rsp_done", "req_end",
+	};
+	return (point < MSG_TRACE_POINT_MAX) ? name[point] : "unknown";
+}
+
+extern uint32_t g_msg_trace_sample;
+
+/*!
+ * @brief  设置采样率
+ *
+ * @param[in] sample 0 关闭；N 每N个请求追踪一个
+ */
+void msg_trace_set_sample(uint32_t sample);
+
+/*!
+ * @brief  为新请求分配trace id
+ *
+ * @return  未被采样或追踪关闭时为0
+ */
+uint64_t msg_trace_new_id(void);
+
+/*!
+ * @brief  记录一个事件，调用者需保证trace_id非0，通常经由MSG_TRACE宏调用
+ */
+void msg_trace_event(uint64_t trace_id, uint16_t point, uint16_t msg_type, uint32_t conn_id, uint32_t arg);
+
+/*!
+ * @brief  把各线程事件环中的事件写到文件
+ *
+ * @details
+ *  	不暂停写入方，拷贝期间被覆盖的事件会被丢弃。
+ *
+ * @param[in] path 输出文件
+ * @return  0 成功；-1 失败
+ */
+int msg_trace_dump(const char *path);
+
+#define MSG_TRACE(trace_id, point, msg_type, conn_id, arg)	\
+do{\
+	if(__builtin_expect(!!(trace_id), 0) && __atomic_load_n(&g_msg_trace_sample, __ATOMIC_RELAXED)){\
+		msg_trace_event((trace_id), (point), (msg_type), (conn_id), (arg));\
+	}\
+}while(0);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_MSG_TRACE_H_ */
@@ -0,0 +1,506 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file slab_cache.c
+* \brief 定长对象缓存（slab + 线程级magazine）
+*
+* 包含..
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include "base_log.h"
+#include "slab_cache.h"
+#include "queue.h"
+
+#define SC_LOG_ERROR(format, arg...) BASE_LOG_ERROR(format, ##arg)
+#define SC_LOG_NOTICE(format, arg...) BASE_LOG_NOTICE(format, ##arg)
+#define SC_LOG_DEBUG(format, arg...) 	BASE_LOG_DEBUG(format,  ##arg)
+
+#define SC_OBJ_ALIGN				16
+#define SC_DEFAULT_SLAB_OBJ_NUM		64
+#define SC_DEFAULT_MAG_SIZE			16
+#define SC_DEFAULT_REAP_INTERVAL_S	5
+
+#define SC_ALIGN_UP(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+struct _slab;
+
+/* 对象头，位于每个对象之前 */
+struct _obj_hdr {
+	struct _slab	*slab;
+	void			*next;				/* slab内空闲链 */
+};
+
+struct _slab {
+	QUEUE			q;
+	uint32_t		free_num;
+	void			*free_list;
+	char			mem[0];
+};
+
+/* 数组形式的空闲表 */
+struct _magazine {
+	QUEUE			q;
+	uint32_t		rounds;
+	void			*obj[0];
+};
+
+struct _thread_cache {
+	QUEUE				q;
+	struct _slab_cache	*cache;
+	struct _magazine	*loaded;
+	struct _magazine	*prev;
+};
+
+struct _slab_cache {
+	char				name[32];
+	uint32_t			obj_size;
+	uint32_t			unit_size;				/* 对象头+对象 */
+	uint32_t			slab_obj_num;
+	uint32_t			mag_size;
+	uint32_t			reap_interval_s;
+	int  (*ctor)(void *obj, void *usr_ctx);
+	void (*dtor)(void *obj, void *usr_ctx);
+	void				*usr_ctx;
+	pthread_key_t		key;
+	pthread_mutex_t		lock;					/* depot锁 */
+	QUEUE				q_slab_partial;			/* 还有空闲对象的slab */
+	QUEUE				q_slab_used;			/* 对象已全部借出的slab */
+	QUEUE				q_mag_full;
+	QUEUE				q_mag_empty;
+	QUEUE				q_thread;
+	uint32_t			slab_num;
+	uint32_t			full_num;
+	uint32_t			full_min;				/* 两次回收之间depot满magazine的最小值，即空闲的工作集余量 */
+	uint64_t			last_reap_s;
+};
+
+static inline void *_obj_of(struct _obj_hdr *hdr)
+{
+	return (void *)(hdr + 1);
+}
+
+static inline struct _obj_hdr *_hdr_of(void *obj)
+{
+	return ((struct _obj_hdr *)obj) - 1;
+}
+
+static struct _slab *_slab_create(struct _slab_cache *cache)
+{
+	struct _slab *slab;
+	struct _obj_hdr *hdr;
+	uint32_t i;
+
+	slab = (struct _slab *)malloc(sizeof(struct _slab) + (uint64_t)cache->unit_size * cache->slab_obj_num);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!slab, NULL, "malloc slab fail.");
+	QUEUE_INIT(&slab->q);
+	slab->free_list = NULL;
+	slab->free_num = 0;
+	for (i = 0; i < cache->slab_obj_num; i++) {
+		hdr = (struct _obj_hdr *)(slab->mem + (uint64_t)cache->unit_size * i);
+		memset(hdr, 0, cache->unit_size);
+		hdr->slab = slab;
+		if (cache->ctor && cache->ctor(_obj_of(hdr), cache->usr_ctx)) {
+			SC_LOG_ERROR("cache[%s] ctor obj fail.", cache->name);
+			goto free_obj;
+		}
+		hdr->next = slab->free_list;
+		slab->free_list = hdr;
+		slab->free_num++;
+	}
+	cache->slab_num++;
+	return slab;
+free_obj:
+	while (cache->dtor && i--) {
+		hdr = (struct _obj_hdr *)(slab->mem + (uint64_t)cache->unit_size * i);
+		cache->dtor(_obj_of(hdr), cache->usr_ctx);
+	}
+	free(slab);
+	return NULL;
+}
+
+static void _slab_destroy(struct _slab_cache *cache, struct _slab *slab)
+{
+	uint32_t i;
+	struct _obj_hdr *hdr;
+	QUEUE_REMOVE(&slab->q);
+	for (i = 0; cache->dtor && i < cache->slab_obj_num; i++) {
+		hdr = (struct _obj_hdr *)(slab->mem + (uint64_t)cache->unit_size * i);
+		cache->dtor(_obj_of(hdr), cache->usr_ctx);
+	}
+	cache->slab_num--;
+	free(slab);
+}
+
+/* 以下函数需持有depot锁 */
+static void _slab_put_obj(struct _slab_cache *cache, void *obj)
+{
+	struct _obj_hdr *hdr = _hdr_of(obj);
+	struct _slab *slab = hdr->slab;
+
+	hdr->next = slab->free_list;
+	slab->free_list = hdr;
+	if (!slab->free_num++) {
+		QUEUE_REMOVE(&slab->q);
+		QUEUE_INSERT_TAIL(&cache->q_slab_partial, &slab->q);
+	}
+}
+
+static void *_slab_get_obj(struct _slab_cache *cache)
+{
+	struct _slab *slab;
+	struct _obj_hdr *hdr;
+
+	if (QUEUE_EMPTY(&cache->q_slab_partial)) {
+		slab = _slab_create(cache);
+		LOG_THEN_RETURN_VAL_IF_TRUE(!slab, NULL, "cache[%s] grow slab fail.", cache->name);
+		QUEUE_INSERT_TAIL(&cache->q_slab_partial, &slab->q);
+	}
+	slab = QUEUE_DATA(QUEUE_HEAD(&cache->q_slab_partial), struct _slab, q);
+	hdr = (struct _obj_hdr *)slab->free_list;
+	slab->free_list = hdr->next;
+	hdr->next = NULL;
+	if (!--slab->free_num) {
+		QUEUE_REMOVE(&slab->q);
+		QUEUE_INSERT_TAIL(&cache->q_slab_used, &slab->q);
+	}
+	return _obj_of(hdr);
+}
+
+static struct _magazine *_mag_get_empty(struct _slab_cache *cache)
+{
+	struct _magazine *mag;
+	if (!QUEUE_EMPTY(&cache->q_mag_empty)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_empty), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		QUEUE_INIT(&mag->q);
+		return mag;
+	}
+	mag = (struct _magazine *)malloc(sizeof(struct _magazine) + sizeof(void *) * cache->mag_size);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!mag, NULL, "malloc magazine fail.");
+	QUEUE_INIT(&mag->q);
+	mag->rounds = 0;
+	return mag;
+}
+
+static void _mag_flush(struct _slab_cache *cache, struct _magazine *mag)
+{
+	while (mag->rounds) {
+		_slab_put_obj(cache, mag->obj[--mag->rounds]);
+	}
+}
+
+static void _thread_cache_release(void *arg)
+{
+	struct _thread_cache *tc = (struct _thread_cache *)arg;
+	struct _slab_cache *cache;
+	if (!tc) {
+		return;
+	}
+	cache = tc->cache;
+	pthread_mutex_lock(&cache->lock);
+	QUEUE_REMOVE(&tc->q);
+	if (tc->loaded) {
+		_mag_flush(cache, tc->loaded);
+		QUEUE_INSERT_TAIL(&cache->q_mag_empty, &tc->loaded->q);
+	}
+	if (tc->prev) {
+		_mag_flush(cache, tc->prev);
+		QUEUE_INSERT_TAIL(&cache->q_mag_empty, &tc->prev->q);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	free(tc);
+}
+
+static struct _thread_cache *_thread_cache_get(struct _slab_cache *cache)
+{
+	struct _thread_cache *tc = (struct _thread_cache *)pthread_getspecific(cache->key);
+	if (tc) {
+		return tc;
+	}
+	tc = (struct _thread_cache *)calloc(1, sizeof(struct _thread_cache));
+	LOG_THEN_RETURN_VAL_IF_TRUE(!tc, NULL, "calloc thread cache fail.");
+	tc->cache = cache;
+	pthread_mutex_lock(&cache->lock);
+	tc->loaded = _mag_get_empty(cache);
+	tc->prev = _mag_get_empty(cache);
+	QUEUE_INSERT_TAIL(&cache->q_thread, &tc->q);
+	pthread_mutex_unlock(&cache->lock);
+	if (!tc->loaded || !tc->prev) {
+		_thread_cache_release(tc);
+		return NULL;
+	}
+	pthread_setspecific(cache->key, tc);
+	return tc;
+}
+
+slab_cache_t slab_cache_create(const struct slab_cache_param *param)
+{
+	struct _slab_cache *cache;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!param || !param->obj_size, NULL, "param invalid.");
+	cache = (struct _slab_cache *)calloc(1, sizeof(struct _slab_cache));
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, NULL, "calloc slab cache fail.");
+
+	snprintf(cache->name, sizeof(cache->name), "%s", param->name ? param->name : "none");
+	cache->obj_size = param->obj_size;
+	cache->unit_size = SC_ALIGN_UP(sizeof(struct _obj_hdr) + param->obj_size, SC_OBJ_ALIGN);
+	cache->slab_obj_num = param->slab_obj_num ? param->slab_obj_num : SC_DEFAULT_SLAB_OBJ_NUM;
+	cache->mag_size = param->mag_size ? param->mag_size : SC_DEFAULT_MAG_SIZE;
+	cache->reap_interval_s = param->reap_interval_s ? param->reap_interval_s : SC_DEFAULT_REAP_INTERVAL_S;
+	cache->ctor = param->ctor;
+	cache->dtor = param->dtor;
+	cache->usr_ctx = param->usr_ctx;
+	QUEUE_INIT(&cache->q_slab_partial);
+	QUEUE_INIT(&cache->q_slab_used);
+	QUEUE_INIT(&cache->q_mag_full);
+	QUEUE_INIT(&cache->q_mag_empty);
+	QUEUE_INIT(&cache->q_thread);
+
+	ret = pthread_mutex_init(&cache->lock, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_cache, "pthread_mutex_init fail.");
+	ret = pthread_key_create(&cache->key, _thread_cache_release);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_lock, "pthread_key_create fail.");
+	SC_LOG_DEBUG("cache[%s] create, obj size[%u], unit size[%u].", cache->name, cache->obj_size, cache->unit_size);
+	return (slab_cache_t)cache;
+free_lock:
+	pthread_mutex_destroy(&cache->lock);
+free_cache:
+	free(cache);
+	return NULL;
+}
+
+int slab_cache_destroy(slab_cache_t handle)
+{
+	struct _slab_cache *cache = (struct _slab_cache *)handle;
+	struct _thread_cache *tc;
+	struct _magazine *mag;
+	QUEUE *iter;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, SLAB_CACHE_ERROR, "cache is null.");
+	pthread_key_delete(cache->key);
+	pthread_mutex_lock(&cache->lock);
+	while (!QUEUE_EMPTY(&cache->q_thread)) {
+		iter = QUEUE_HEAD(&cache->q_thread);
+		tc = QUEUE_DATA(iter, struct _thread_cache, q);
+		QUEUE_REMOVE(iter);
+		free(tc->loaded);
+		free(tc->prev);
+		free(tc);
+	}
+	while (!QUEUE_EMPTY(&cache->q_mag_full)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_full), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		free(mag);
+	}
+	while (!QUEUE_EMPTY(&cache->q_mag_empty)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_empty), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		free(mag);
+	}
+	while (!QUEUE_EMPTY(&cache->q_slab_partial)) {
+		_slab_destroy(cache, QUEUE_DATA(QUEUE_HEAD(&cache->q_slab_partial), struct _slab, q));
+	}
+	while (!QUEUE_EMPTY(&cache->q_slab_used)) {
+		_slab_destroy(cache, QUEUE_DATA(QUEUE_HEAD(&cache->q_slab_used), struct _slab, q));
+	}
+	pthread_mutex_unlock(&cache->lock);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	return SLAB_CACHE_SUCCESS;
+}
+
+void *slab_cache_alloc(slab_cache_t handle)
+{
+	struct _slab_cache *cache = (struct _slab_cache *)handle;
+	struct _thread_cache *tc;
+	struct _magazine *mag;
+	void *obj = NULL;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, NULL, "cache is null.");
+	tc = _thread_cache_get(cache);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!tc, NULL, "get thread cache fail.");
+
+	if (tc->loaded->rounds) {
+		return tc->loaded->obj[--tc->loaded->rounds];
+	}
+	if (tc->prev->rounds) {
+		mag = tc->loaded;
+		tc->loaded = tc->prev;
+		tc->prev = mag;
+		return tc->loaded->obj[--tc->loaded->rounds];
+	}
+
+	// 两个magazine均为空，到depot换一个满的
+	pthread_mutex_lock(&cache->lock);
+	if (!QUEUE_EMPTY(&cache->q_mag_full)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_full), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		QUEUE_INIT(&mag->q);
+		cache->full_num--;
+		if (cache->full_num < cache->full_min) {
+			cache->full_min = cache->full_num;
+		}
+		QUEUE_INSERT_TAIL(&cache->q_mag_empty, &tc->prev->q);
+		tc->prev = tc->loaded;
+		tc->loaded = mag;
+	}else{
+		// depot也没有，从slab装填半个magazine，另一半留给释放
+		while (tc->loaded->rounds < (cache->mag_size + 1) / 2) {
+			obj = _slab_get_obj(cache);
+			if (!obj) {
+				break;
+			}
+			tc->loaded->obj[tc->loaded->rounds++] = obj;
+		}
+	}
+	if (tc->loaded->rounds) {
+		obj = tc->loaded->obj[--tc->loaded->rounds];
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return obj;
+}
+
+void slab_cache_free(slab_cache_t handle, void *obj)
+{
+	struct _slab_cache *cache = (struct _slab_cache *)handle;
+	struct _thread_cache *tc;
+	struct _magazine *mag;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache || !obj, ;, "cache or obj is null.");
+	tc = _thread_cache_get(cache);
+	if (!tc) {
+		pthread_mutex_lock(&cache->lock);
+		_slab_put_obj(cache, obj);
+		pthread_mutex_unlock(&cache->lock);
+		return;
+	}
+
+	if (tc->loaded->rounds < cache->mag_size) {
+		tc->loaded->obj[tc->loaded->rounds++] = obj;
+		return;
+	}
+	if (!tc->prev->rounds) {
+		mag = tc->loaded;
+		tc->loaded = tc->prev;
+		tc->prev = mag;
+		tc->loaded->obj[tc->loaded->rounds++] = obj;
+		return;
+	}
+
+	// 两个magazine均满，把满的交给depot
+	pthread_mutex_lock(&cache->lock);
+	mag = _mag_get_empty(cache);
+	if (mag) {
+		QUEUE_INSERT_TAIL(&cache->q_mag_full, &tc->prev->q);
+		cache->full_num++;
+		tc->prev = tc->loaded;
+		tc->loaded = mag;
+		tc->loaded->obj[tc->loaded->rounds++] = obj;
+	}else{
+		_slab_put_obj(cache, obj);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+int slab_cache_reap(slab_cache_t handle, uint64_t now_s)
+{
+	struct _slab_cache *cache = (struct _slab_cache *)handle;
+	struct _magazine *mag;
+	struct _slab *slab;
+	QUEUE *iter;
+	QUEUE *next;
+	int free_slab = 0;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, 0, "cache is null.");
+	if (now_s < __atomic_load_n(&cache->last_reap_s, __ATOMIC_RELAXED) + cache->reap_interval_s) {
+		return 0;
+	}
+	if (pthread_mutex_trylock(&cache->lock)) {
+		return 0;
+	}
+	cache->last_reap_s = now_s;
+
+	// 上个周期内一直没被取走的满magazine不在工作集内，归还slab
+	while (cache->full_min && !QUEUE_EMPTY(&cache->q_mag_full)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_full), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		_mag_flush(cache, mag);
+		free(mag);
+		cache->full_num--;
+		cache->full_min--;
+	}
+	while (!QUEUE_EMPTY(&cache->q_mag_empty)) {
+		mag = QUEUE_DATA(QUEUE_HEAD(&cache->q_mag_empty), struct _magazine, q);
+		QUEUE_REMOVE(&mag->q);
+		free(mag);
+	}
+	for (iter = QUEUE_HEAD(&cache->q_slab_partial); iter != &cache->q_slab_partial; iter = next) {
+		next = QUEUE_NEXT(iter);
+		slab = QUEUE_DATA(iter, struct _slab, q);
+		if (slab->free_num == cache->slab_obj_num) {
+			_slab_destroy(cache, slab);
+			free_slab++;
+		}
+	}
+	cache->full_min = cache->full_num;
+	if (free_slab) {
+		SC_LOG_DEBUG("cache[%s] reap %d slab, remain slab[%u].", cache->name, free_slab, cache->slab_num);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return free_slab;
+}
+
+int slab_cache_reclaim(slab_cache_t handle, int (*match)(void *obj, void *arg), void *arg)
+{
+	struct _slab_cache *cache = (struct _slab_cache *)handle;
+	struct _slab *slab;
+	struct _obj_hdr *hdr;
+	QUEUE *iter;
+	QUEUE *next;
+	uint32_t i;
+	int cnt = 0;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache || !match, SLAB_CACHE_ERROR, "cache or match is null.");
+	pthread_mutex_lock(&cache->lock);
+	// 只有借出的对象需要回收，空闲对象由调用者的match过滤
+	for (iter = QUEUE_HEAD(&cache->q_slab_used); iter != &cache->q_slab_used; iter = next) {
+		next = QUEUE_NEXT(iter);
+		slab = QUEUE_DATA(iter, struct _slab, q);
+		for (i = 0; i < cache->slab_obj_num; i++) {
+			hdr = (struct _obj_hdr *)(slab->mem + (uint64_t)cache->unit_size * i);
+			if (match(_obj_of(hdr), arg)) {
+				_slab_put_obj(cache, _obj_of(hdr));
+				cnt++;
+			}
+		}
+	}
+	for (iter = QUEUE_HEAD(&cache->q_slab_partial); iter != &cache->q_slab_partial; iter = next) {
+		next = QUEUE_NEXT(iter);
+		slab = QUEUE_DATA(iter, struct _slab, q);
+		for (i = 0; i < cache->slab_obj_num; i++) {
+			hdr = (struct _obj_hdr *)(slab->mem + (uint64_t)cache->unit_size * i);
+			if (match(_obj_of(hdr), arg)) {
+				_slab_put_obj(cache, _obj_of(hdr));
+				cnt++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return cnt;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file slab_cache.h
+* \brief 定长对象缓存（slab + 线程级magazine）
+*
+* 对象按slab成批申请，构造函数只在slab创建时调用一次；每个线程持有两个magazine（数组形式空闲表），
+* 常规的申请/释放只操作本线程magazine，不加锁；magazine空/满时才与全局depot交换。
+* 通过slab_cache_reap定期把depot中超出工作集的对象归还slab，并释放完全空闲的slab。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _SLAB_CACHE_H_
+#define _SLAB_CACHE_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SLAB_CACHE_ERROR		-1
+#define SLAB_CACHE_SUCCESS		 0
+
+typedef void *slab_cache_t;
+
+struct slab_cache_param {
+	const char	*name;
+	uint32_t	obj_size;							/* 对象大小 */
+	uint32_t	slab_obj_num;						/* 每个slab的对象数 */
+	uint32_t	mag_size;							/* 每个magazine的容量 */
+	uint32_t	reap_interval_s;					/* 回收间隔 */
+	int  (*ctor)(void *obj, void *usr_ctx);			/* slab创建时对每个对象调用 */
+	void (*dtor)(void *obj, void *usr_ctx);			/* slab释放时对每个对象调用 */
+	void		*usr_ctx;
+};
+
+/*!
+ * @brief  创建对象缓存
+ *
+ * @param[in] param
+ * @return  缓存句柄，失败返回NULL
+ */
+slab_cache_t slab_cache_create(const struct slab_cache_param *param);
+
+/*!
+ * @brief  销毁对象缓存
+ *
+ * 调用者需保证已没有线程在使用该缓存，使用中的对象随slab一起释放
+ */
+int slab_cache_destroy(slab_cache_t cache);
+
+/*!
+ * @brief  申请一个对象（线程安全，常规路径无锁）
+ */
+void *slab_cache_alloc(slab_cache_t cache);
+
+/*!
+ * @brief  释放一个对象（线程安全，常规路径无锁）
+ */
+void slab_cache_free(slab_cache_t cache, void *obj);
+
+/*!
+ * @brief  回收depot中超出工作集的对象，释放完全空闲的slab
+ *
+ * @param[in] cache
+ * @param[in] now_s 当前时间(秒)，距上次回收不足reap_interval_s时直接返回
+ * @return  释放的slab数
+ */
+int slab_cache_reap(slab_cache_t cache, uint64_t now_s);
+
+/*!
+ * @brief  强制回收借出未归还的对象（持depot锁，仅用于资源清理等低频场景）
+ *
+ * match对象返回非0则将其直接归还slab；调用者需保证match不会命中已在空闲表中的对象，
+ * 且回调内不能再调用本缓存的接口
+ *
+ * @return  回收的对象数
+ */
+int slab_cache_reclaim(slab_cache_t cache, int (*match)(void *obj, void *arg), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_SLAB_CACHE_H_ */
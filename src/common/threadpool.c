@@ -24,10 +24,16 @@
 #include <semaphore.h>
 #include <sys/sysinfo.h>
 #include <sys/prctl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "base_log.h"
 #include "threadpool.h"
 #include "queue.h"
+#include "ws_deque.h"
+#include "slab_cache.h"
 
 
 #define TP_LOG_ERROR(format, arg...) BASE_LOG_ERROR(format, ##arg)
@@ -43,6 +49,7 @@
 #define FLAG_WORK_RUN     1
 #define FLAG_WORK_DONE    2
 #define FLAG_WORK_WAIT    3
+#define FLAG_WORK_AUTO_FREE 4
 
 #define IS_SET(flag, tag) (flag&(1<<tag))
 #define SET_FLAG(flag, tag) flag=(flag|(1<<tag))
@@ -57,9 +64,20 @@
 #define TASK_SET_EXIT(flag) flag=(flag|(1<<FLAG_TASK_EXIT))
 #define TASK_CLR_EXIT(flag) flag=(flag&~(1<<FLAG_TASK_EXIT))
 
+#define TP_DEQUE_SIZE			1024	/* 每个工作线程本地队列容量，满时进入共享队列 */
+#define TP_WORK_SLAB_OBJ_NUM	64
+#define TP_WORK_MAG_SIZE		32
+#define TP_WORK_REAP_INTERVAL_S	10
+#define TP_PARK_TIMEOUT_MS		1000	/* 休眠兜底超时 */
+#define TP_SCALE_DELAY_US		500		/* 默认扩容阈值：任务排队时延 */
+#define TP_IDLE_TIMEOUT_MS		(30*1000)	/* 默认缩容冷却：线程连续空闲时长 */
+#define TP_DELAY_EWMA_SHIFT		3		/* 排队时延滑动平均权重1/8 */
+#define TP_NAME_MAX_LEN			16		/* 与PR_SET_NAME长度一致 */
+#define TP_STAT_SAMPLE_MASK		15		/* 每16个任务采样一次执行耗时，只用于状态打印 */
+
 #define HIDE_ADDR 1
 #define THREAD_STATUS_SHOW_HEAD\
- "### threadpool:%p  total:%u  idle:%u  queue:%lu ###\n*thread-id     *work-id     *run-cnt     *ave-time    *curtime *\n"
+ "### threadpool[%s]:%p  total:%u  idle:%u  queue:%lu ###\n*thread-id     *work-id     *run-cnt     *ave-time    *curtime *\n"
 
 #define THREAD_STATUS_SHOW\
  "%-9lu   %-9u   %-9u   %03lu.%06lu   %03lu.%06lu\n" 
@@ -69,7 +87,7 @@ struct _work {
 	int (*loop)(void *usr_ctx);		/* 循环回调函数*/
 	void (*stop)(void *usr_ctx);		/* 停止循环回调函数*/
 	void *usr_ctx;						/* 任务上下文*/
-	struct timeval now;
+	uint64_t post_us;					/* 投递时刻，单调时钟*/
 	pthread_t  thread_id;
 	WORK_PRIVATE_DATA;					/* 队列标识，内部使用，无需设置*/
 };
@@ -82,101 +100,504 @@ struct _thread_msg{
     uint32_t          flag;
 };
 
+struct _thread_pool_msg;
+
+/* 工作线程：本地窃取队列 + 单槽信箱(直接交付给休眠线程) + 私有futex唤醒字 */
+struct _worker {
+	struct ws_deque			deque;
+	struct _work			*mailbox;				/* 由投递者在idle锁内写入 */
+	uint32_t				futex;					/* 唤醒序号 */
+	uint32_t				parked;					/* 在idle栈中，idle锁保护 */
+	uint32_t				rand;
+	uint32_t				alive;					/* 槽位在用，idle锁内修改 */
+	uint64_t				idle_start_ms;			/* 本轮空闲开始时间，0表示忙 */
+	struct _thread_pool_msg	*pool;
+	struct _thread_msg		msg;
+	char					pad[WS_DEQUE_CACHE_LINE];
+};
 
 struct _thread_pool_msg{
-    QUEUE               wait_to_run;
-    pthread_cond_t 	    cond;					/* 数据接收的条件变量*/
-	pthread_mutex_t     mutex;	    			/* lock */
-    uint32_t            thread_num;
-    struct _thread_msg  *thread;
-    uint32_t            idle_num;
+	pthread_mutex_t     mutex;	    			/* 保护idle栈与共享队列 */
+	QUEUE               wait_to_run;			/* 共享队列：外部线程投递且无空闲线程，或本地队列满 */
+	uint64_t			shared_num;				/* 共享队列长度，原子读 */
+	uint32_t			*idle_stack;			/* 休眠线程栈，后进先出，优先唤醒最近休眠（缓存更热）的线程 */
+	uint32_t			idle_top;
+    uint32_t            idle_num;				/* 原子读 */
+    uint32_t            thread_num;				/* 当前线程数，idle锁内修改，原子读 */
+	uint32_t			slot_num;				/* 用过的最大槽位数，遍历上限 */
+	uint32_t			thread_max_num;
+	uint32_t			thread_min_num;			/* 等于max时不伸缩 */
+	uint64_t			scale_delay_us;
+	uint64_t			idle_timeout_ms;
+	uint64_t			delay_us;				/* 排队时延滑动平均 */
+	uint64_t			grow_next_us;			/* 扩容限速，两次扩容至少间隔scale_delay_us */
+	struct _worker		*worker;
+	uint32_t			exit;
 	uint32_t			cpu_max_num;
+	char				name[TP_NAME_MAX_LEN];
+	void (*thread_init)(uint32_t thread_index, void *init_ctx);
+	void				*init_ctx;
 	sem_t 				*sync;
-	struct timeval 	    interval;					/* 统计间隔*/
-	uint64_t			wait_task_num;
-	char  				ext_data[0];				
+	int64_t 		    interval_s;					/* 统计间隔*/
+	uint64_t			wait_task_num;				/* 已投递未开始执行的任务数，原子操作 */
 };
 
+static __thread struct _worker *tls_worker = NULL;
+
+static slab_cache_t g_work_cache = NULL;
+static pthread_once_t g_work_cache_once = PTHREAD_ONCE_INIT;
+
+static int work_ctor(void *obj, void *usr_ctx)
+{
+	struct _work *work = (struct _work *)obj;
+	memset(work, 0, sizeof(struct _work));
+	if (pthread_mutex_init(&work->mutex, NULL)) {
+		return -1;
+	}
+	if (pthread_cond_init(&work->cond, NULL)) {
+		pthread_mutex_destroy(&work->mutex);
+		return -1;
+	}
+	QUEUE_INIT(&work->queue);
+	return 0;
+}
+
+static void work_dtor(void *obj, void *usr_ctx)
+{
+	struct _work *work = (struct _work *)obj;
+	pthread_cond_destroy(&work->cond);
+	pthread_mutex_destroy(&work->mutex);
+}
+
+static void work_cache_init(void)
+{
+	struct slab_cache_param param;
+	memset(&param, 0, sizeof(param));
+	param.name = "tp_work";
+	param.obj_size = sizeof(struct _work);
+	param.slab_obj_num = TP_WORK_SLAB_OBJ_NUM;
+	param.mag_size = TP_WORK_MAG_SIZE;
+	param.reap_interval_s = TP_WORK_REAP_INTERVAL_S;
+	param.ctor = work_ctor;
+	param.dtor = work_dtor;
+	g_work_cache = slab_cache_create(&param);
+}
+
+// 描述符的锁和条件变量只在slab创建时初始化一次，之后循环复用
+static struct _work *work_alloc(void)
+{
+	struct _work *work;
+	pthread_once(&g_work_cache_once, work_cache_init);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!g_work_cache, NULL, "work cache is null.");
+	work = (struct _work *)slab_cache_alloc(g_work_cache);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!work, NULL, "alloc work fail.");
+	work->thread_id = 0;
+	work->flag = 0;
+	QUEUE_INIT(&work->queue);
+	return work;
+}
+
+static void work_free(struct _work *work)
+{
+	work->loop = NULL;
+	work->stop = NULL;
+	work->usr_ctx = NULL;
+	slab_cache_free(g_work_cache, work);
+	(void)slab_cache_reap(g_work_cache, (uint64_t)time(NULL));
+}
+
+static inline void tp_futex_wait(uint32_t *addr, uint32_t val, uint32_t timeout_ms)
+{
+	struct timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+	(void)syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static inline void tp_futex_wake(uint32_t *addr)
+{
+	__atomic_add_fetch(addr, 1, __ATOMIC_RELEASE);
+	(void)syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* 粗粒度时间：工作线程和xio loop线程每轮刷新，其它线程直接读时钟 */
+static inline uint64_t tp_now_us(void)
+{
+	return fast_clock_coarse_ns() / 1000;
+}
+
+static inline int tp_is_elastic(const struct _thread_pool_msg *pool)
+{
+	return pool->thread_min_num < pool->thread_max_num;
+}
+
+static void *task_worker(void* arg);
+
+/* 在空闲槽位上启动一个工作线程，调用者持idle锁 */
+static int tp_start_worker(struct _thread_pool_msg *pool)
+{
+	uint32_t i;
+	struct _worker *w;
+
+	for (i = 0; i < pool->thread_max_num; i++) {
+		if (!pool->worker[i].alive) {
+			break;
+		}
+	}
+	if (i >= pool->thread_max_num) {
+		return -1;
+	}
+	w = &pool->worker[i];
+	w->alive = 1;
+	w->parked = 0;
+	w->mailbox = NULL;
+	w->idle_start_ms = 0;
+	w->msg.flag = 0;		// 本地队列已空，下标沿用，窃取者不会看到旧数据
+	if (i >= pool->slot_num) {
+		__atomic_store_n(&pool->slot_num, i + 1, __ATOMIC_RELEASE);	// 先于线程启动，新线程遍历时可见自身
+	}
+	__atomic_add_fetch(&pool->thread_num, 1, __ATOMIC_RELEASE);
+	if (pthread_create(&w->msg.thread_id, NULL, task_worker, w) != 0) {
+		TP_LOG_ERROR("create thread fail.");
+		__atomic_sub_fetch(&pool->thread_num, 1, __ATOMIC_RELEASE);
+		w->msg.thread_id = 0;
+		w->alive = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* 共享队列队首任务已等待的时长，队列按投递顺序，队首最老 */
+static uint64_t tp_shared_oldest_us(struct _thread_pool_msg *pool, uint64_t now_us)
+{
+	uint64_t post_us = now_us;
+
+	if (!__atomic_load_n(&pool->shared_num, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (!QUEUE_EMPTY(&pool->wait_to_run)) {
+		post_us = QUEUE_DATA(QUEUE_HEAD(&pool->wait_to_run), struct _work, queue)->post_us;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return (now_us > post_us) ? now_us - post_us : 0;
+}
 
-/* To avoid deadlock with uv_cancel() it's crucial that the worker
- * never holds the global mutex and the loop-local mutex at the same time.
+/*
+ * 没有空闲线程时按排队时延扩容：已出队任务排队时延的滑动平均超过阈值，
+ * 或全部线程被长任务占住、无任务出队时，共享队列队首已等待超过阈值。
  */
-static void *task_worker(void* arg) {
+static void tp_try_grow(struct _thread_pool_msg *pool, uint64_t now_us)
+{
+	uint64_t next = __atomic_load_n(&pool->grow_next_us, __ATOMIC_RELAXED);
+	uint64_t delay = __atomic_load_n(&pool->delay_us, __ATOMIC_RELAXED);
+	int ret;
+
+	if (!tp_is_elastic(pool) || now_us < next ||
+		__atomic_load_n(&pool->thread_num, __ATOMIC_RELAXED) >= pool->thread_max_num) {
+		return;
+	}
+	if (delay <= pool->scale_delay_us) {
+		delay = tp_shared_oldest_us(pool, now_us);
+		if (delay <= pool->scale_delay_us) {
+			return;
+		}
+	}
+	if (!__atomic_compare_exchange_n(&pool->grow_next_us, &next, now_us + pool->scale_delay_us, 
+									0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;	// 其它线程在扩容
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (__atomic_load_n(&pool->exit, __ATOMIC_ACQUIRE) || pool->thread_num >= pool->thread_max_num) {
+		pthread_mutex_unlock(&pool->mutex);
+		return;
+	}
+	ret = tp_start_worker(pool);
+	pthread_mutex_unlock(&pool->mutex);
+	if (!ret) {
+		__atomic_store_n(&pool->delay_us, 0, __ATOMIC_RELAXED);	// 重新采样，扩容后的时延才作为下次依据
+		TP_LOG_NOTICE("threadpool[%s] grow to %u, queue delay:%lu us.", pool->name, 
+						__atomic_load_n(&pool->thread_num, __ATOMIC_RELAXED), delay);
+	}
+}
+
+/* 取出一个休眠线程并把任务直接放入其信箱，没有休眠线程返回-1 */
+static int tp_handoff_idle(struct _thread_pool_msg *pool, struct _work *work)
+{
+	struct _worker *w = NULL;
+
+	if (!__atomic_load_n(&pool->idle_num, __ATOMIC_ACQUIRE)) {
+		return -1;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->idle_top) {
+		w = &pool->worker[pool->idle_stack[--pool->idle_top]];
+		__atomic_sub_fetch(&pool->idle_num, 1, __ATOMIC_RELEASE);
+		w->parked = 0;
+		w->mailbox = work;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (!w) {
+		return -1;
+	}
+	tp_futex_wake(&w->futex);
+	return 0;
+}
+
+/* 唤醒一个休眠线程去窃取 */
+static void tp_wake_one(struct _thread_pool_msg *pool)
+{
+	struct _worker *w = NULL;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);	// 与tp_park中的复查配对
+	if (!__atomic_load_n(&pool->idle_num, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->idle_top) {
+		w = &pool->worker[pool->idle_stack[--pool->idle_top]];
+		__atomic_sub_fetch(&pool->idle_num, 1, __ATOMIC_RELEASE);
+		w->parked = 0;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	if (w) {
+		tp_futex_wake(&w->futex);
+	}
+}
+
+static void tp_push_shared(struct _thread_pool_msg *pool, struct _work *work)
+{
+	pthread_mutex_lock(&pool->mutex);
+	QUEUE_INSERT_TAIL(&pool->wait_to_run, &work->queue);
+	__atomic_add_fetch(&pool->shared_num, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static struct _work *tp_pop_shared(struct _thread_pool_msg *pool)
+{
 	QUEUE* q;
-	struct _work *to_run;
-	struct _thread_msg  *t_msg;
-	//cpu_set_t		cpuset;
-	struct timeval now;
-	struct _thread_pool_msg* pool_ctx = (struct _thread_pool_msg*) arg;
-	LOG_THEN_RETURN_VAL_IF_TRUE((!pool_ctx), NULL, "pool_ctx empty fail.");
-
-	pthread_mutex_lock(&pool_ctx->mutex);
-	t_msg = &pool_ctx->thread[pool_ctx->idle_num];
-	t_msg->work_id = pool_ctx->idle_num;
-
-	/*CPU_ZERO(&cpuset);
-	CPU_SET((pool_ctx->thread_num)%(pool_ctx->cpu_max_num), &cpuset);
-	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);*/
-
-	prctl(PR_SET_NAME, "share_thread");
-
-	TASK_SET_ACTIVE(t_msg->flag);
-	TP_LOG_DEBUG(" Eentry thread[%lu], init first.", t_msg->thread_id);
-	/* 线程同步*/
-	sem_post(pool_ctx->sync);
-	for (;;) {
-		while (QUEUE_EMPTY(&pool_ctx->wait_to_run)) {
-			pool_ctx->idle_num++;
-			TASK_SET_IDLE(t_msg->flag);
-			pthread_cond_wait(&pool_ctx->cond, &pool_ctx->mutex);
-			TASK_CLR_IDLE(t_msg->flag);
-			pool_ctx->idle_num--;
-			if (IS_SET(t_msg->flag, FLAG_TASK_EXIT)){
-				break; // 被要求退出线程
-			}
+	struct _work *work = NULL;
+
+	if (!__atomic_load_n(&pool->shared_num, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (!QUEUE_EMPTY(&pool->wait_to_run)) {
+		q = QUEUE_HEAD(&pool->wait_to_run);
+		QUEUE_REMOVE(q);
+		QUEUE_INIT(q);
+		__atomic_sub_fetch(&pool->shared_num, 1, __ATOMIC_RELEASE);
+		work = QUEUE_DATA(q, struct _work, queue);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return work;
+}
+
+static struct _work *tp_steal(struct _thread_pool_msg *pool, struct _worker *self)
+{
+	uint32_t i;
+	uint32_t start;
+	uint32_t slot_num = __atomic_load_n(&pool->slot_num, __ATOMIC_ACQUIRE);
+	struct _worker *victim;
+	struct _work *work;
+
+	self->rand ^= self->rand << 13;
+	self->rand ^= self->rand >> 17;
+	self->rand ^= self->rand << 5;
+	start = self->rand % slot_num;
+	for (i = 0; i < slot_num; i++) {
+		victim = &pool->worker[(start + i) % slot_num];
+		if (victim == self || !ws_deque_size(&victim->deque)) {
+			continue;
 		}
-		if (IS_SET(t_msg->flag, FLAG_TASK_EXIT)){
-			break; // 被要求退出线程
+		work = (struct _work *)ws_deque_steal(&victim->deque);
+		if (work) {
+			return work;
 		}
+	}
+	return NULL;
+}
 
-		q = QUEUE_HEAD(&pool_ctx->wait_to_run);
+static struct _work *tp_find_work(struct _thread_pool_msg *pool, struct _worker *self)
+{
+	struct _work *work;
 
-		QUEUE_REMOVE(q);
-		QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is executing. */
-		pool_ctx->wait_task_num--;
-		pthread_mutex_unlock(&pool_ctx->mutex);
-		to_run = QUEUE_DATA(q, struct _work, queue);
-
-		pthread_mutex_lock(&to_run->mutex);
-		to_run->thread_id = t_msg->thread_id;
-		CLR_FLAG(to_run->flag, FLAG_WORK_DONE);
-		SET_FLAG(to_run->flag, FLAG_WORK_RUN);
-		pthread_mutex_unlock(&to_run->mutex);
+	work = __atomic_exchange_n(&self->mailbox, NULL, __ATOMIC_ACQUIRE);
+	if (work) {
+		return work;
+	}
+	work = (struct _work *)ws_deque_pop(&self->deque);
+	if (work) {
+		return work;
+	}
+	work = tp_pop_shared(pool);
+	if (work) {
+		return work;
+	}
+	return tp_steal(pool, self);
+}
 
-		to_run->loop(to_run->usr_ctx);
-		pthread_mutex_lock(&to_run->mutex);
-		to_run->thread_id = 0;
-		now = to_run->now;
+/* 
+ * 休眠：先入idle栈再复查一次，避免与投递者错过唤醒。
+ * 返回1表示连续空闲超过冷却时间，已退出槽位，调用者需直接结束线程且不再访问self。
+ */
+static int tp_park(struct _thread_pool_msg *pool, struct _worker *self)
+{
+	uint32_t seq;
+	uint32_t i;
+	uint32_t slot_num;
+	uint32_t timeout_ms = TP_PARK_TIMEOUT_MS;
+	uint64_t now_ms;
+	int has_work = 0;
+	int retire = 0;
+
+	now_ms = tp_now_us() / 1000;
+	if (!self->idle_start_ms) {
+		self->idle_start_ms = now_ms;
+	}
+	if (tp_is_elastic(pool) && pool->idle_timeout_ms < timeout_ms) {
+		timeout_ms = (uint32_t)pool->idle_timeout_ms;
+	}
 
-		if (IS_SET(to_run->flag, FLAG_WORK_WAIT)) {
-			CLR_FLAG(to_run->flag, FLAG_WORK_RUN);
-			SET_FLAG(to_run->flag, FLAG_WORK_DONE);
-			pthread_cond_signal(&to_run->cond);
-			pthread_mutex_unlock(&to_run->mutex);
-		}else{
-			pthread_mutex_unlock(&to_run->mutex); // *主动释放
-			pthread_cond_destroy(&to_run->cond);
-			pthread_mutex_destroy(&to_run->mutex);
-			free(to_run);
+	seq = __atomic_load_n(&self->futex, __ATOMIC_ACQUIRE);
+	pthread_mutex_lock(&pool->mutex);
+	pool->idle_stack[pool->idle_top++] = (uint32_t)(self - pool->worker);
+	self->parked = 1;
+	TASK_SET_IDLE(self->msg.flag);
+	__atomic_add_fetch(&pool->idle_num, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pool->mutex);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool->shared_num, __ATOMIC_ACQUIRE) || __atomic_load_n(&pool->exit, __ATOMIC_ACQUIRE)) {
+		has_work = 1;
+	}
+	slot_num = __atomic_load_n(&pool->slot_num, __ATOMIC_ACQUIRE);
+	for (i = 0; !has_work && i < slot_num; i++) {
+		if (ws_deque_size(&pool->worker[i].deque)) {
+			has_work = 1;
+		}
+	}
+	if (!has_work) {
+		tp_futex_wait(&self->futex, seq, timeout_ms);
+	}
+
+	// 醒来(或复查发现任务)时如仍在idle栈中，自行移除
+	now_ms = fast_clock_tick() / 1000000;	// 休眠后的新一轮
+	pthread_mutex_lock(&pool->mutex);
+	if (self->parked) {
+		for (i = 0; i < pool->idle_top; i++) {
+			if (&pool->worker[pool->idle_stack[i]] == self) {
+				pool->idle_stack[i] = pool->idle_stack[--pool->idle_top];
+				break;
+			}
 		}
+		self->parked = 0;
+		__atomic_sub_fetch(&pool->idle_num, 1, __ATOMIC_RELEASE);
+		if (!has_work && tp_is_elastic(pool) && !__atomic_load_n(&pool->exit, __ATOMIC_ACQUIRE) &&
+			pool->thread_num > pool->thread_min_num && 
+			now_ms >= self->idle_start_ms + pool->idle_timeout_ms) {
+			retire = 1;
+		}
+	}
+	TASK_CLR_IDLE(self->msg.flag);
+	if (retire) {
+		TP_LOG_NOTICE("threadpool[%s] thread[%lu] idle %lu ms, shrink to %u.", pool->name, 
+						self->msg.thread_id, now_ms - self->idle_start_ms, pool->thread_num - 1);
+		TASK_CLR_ACTIVE(self->msg.flag);
+		pthread_detach(self->msg.thread_id);
+		self->alive = 0;		// 解锁后槽位可能被扩容复用
+		__atomic_sub_fetch(&pool->thread_num, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return retire;
+}
+
+static void tp_run_work(struct _worker *self, struct _work *to_run)
+{
+	uint64_t post_us;
+	struct _thread_pool_msg *pool = self->pool;
+	uint64_t now_us;
+	uint64_t delay;
+	uint64_t ewma;
+
+	__atomic_sub_fetch(&pool->wait_task_num, 1, __ATOMIC_RELAXED);
+	self->idle_start_ms = 0;
+	if (tp_is_elastic(pool)) {
+		now_us = tp_now_us();
+		delay = (now_us > to_run->post_us) ? now_us - to_run->post_us : 0;
+		ewma = __atomic_load_n(&pool->delay_us, __ATOMIC_RELAXED);
+		ewma = ewma - (ewma >> TP_DELAY_EWMA_SHIFT) + (delay >> TP_DELAY_EWMA_SHIFT);
+		__atomic_store_n(&pool->delay_us, ewma, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_lock(&to_run->mutex);
+	to_run->thread_id = self->msg.thread_id;
+	CLR_FLAG(to_run->flag, FLAG_WORK_DONE);
+	SET_FLAG(to_run->flag, FLAG_WORK_RUN);
+	pthread_mutex_unlock(&to_run->mutex);
+
+	to_run->loop(to_run->usr_ctx);
+	(void)fast_clock_tick();	// 任务可能执行很久，为下一轮刷新
+
+	pthread_mutex_lock(&to_run->mutex);
+	to_run->thread_id = 0;
+	post_us = to_run->post_us;
+	CLR_FLAG(to_run->flag, FLAG_WORK_RUN);
+	SET_FLAG(to_run->flag, FLAG_WORK_DONE);
+	if (IS_SET(to_run->flag, FLAG_WORK_WAIT)) {
+		pthread_cond_signal(&to_run->cond);		// 由等待者释放
+		pthread_mutex_unlock(&to_run->mutex);
+	}else if (IS_SET(to_run->flag, FLAG_WORK_AUTO_FREE)) {
+		pthread_mutex_unlock(&to_run->mutex); // *主动释放，归还描述符缓存
+		work_free(to_run);
+	}else{
+		pthread_mutex_unlock(&to_run->mutex);	// WORK_DONE_MANUAL_FREE，由tp_wait_work_done释放
+	}
+
+	if (!(self->msg.run_count++ & TP_STAT_SAMPLE_MASK)) {
+		statistics_per_time(post_us, &self->msg.time, 2);
+	}
+}
+
+static void *task_worker(void* arg) {
+	struct _work *to_run;
+	struct _worker *self = (struct _worker*) arg;
+	struct _thread_pool_msg* pool_ctx;
+	LOG_THEN_RETURN_VAL_IF_TRUE((!self || !self->pool), NULL, "pool_ctx empty fail.");
+
+	pool_ctx = self->pool;
+	tls_worker = self;
+	self->msg.thread_id = pthread_self();
+	self->rand = ((uint32_t)syscall(SYS_gettid) * 2654435761U) | 1;
+
+	if (pool_ctx->thread_init) {
+		pool_ctx->thread_init(self->msg.work_id, pool_ctx->init_ctx);	// 绑核策略由调用者决定
+	}
+
+	prctl(PR_SET_NAME, pool_ctx->name);
+	(void)fast_clock_tick();
 
-		pthread_mutex_lock(&pool_ctx->mutex);
-		t_msg->run_count++;
-		statistics_per_time(&now, &t_msg->time, 2);
+	TASK_SET_ACTIVE(self->msg.flag);
+	TP_LOG_DEBUG(" Eentry thread[%lu], init first.", self->msg.thread_id);
+	/* 线程同步，扩容启动的线程无需同步*/
+	if (pool_ctx->sync)
+		sem_post(pool_ctx->sync);
+	for (;;) {
+		to_run = tp_find_work(pool_ctx, self);
+		if (to_run) {
+			tp_run_work(self, to_run);
+			continue;
+		}
+		if (__atomic_load_n(&pool_ctx->exit, __ATOMIC_ACQUIRE)){
+			break; // 被要求退出线程
+		}
+		if (tp_park(pool_ctx, self)) {
+			tls_worker = NULL;
+			return NULL;	// 缩容退出，槽位已归还
+		}
 	}
-	TASK_CLR_ACTIVE(t_msg->flag);
-	pthread_mutex_unlock(&pool_ctx->mutex);
-	TP_LOG_NOTICE("work thread[%lu] exit success.", t_msg->thread_id);
+	TASK_CLR_ACTIVE(self->msg.flag);
+	tls_worker = NULL;
+	TP_LOG_NOTICE("work thread[%lu] exit success.", self->msg.thread_id);
 	return NULL;
 }
 
@@ -186,73 +607,95 @@ tp_handle tp_create_thread_pool(struct tp_param *p)
 	uint32_t i;
 	struct _thread_pool_msg *pool = NULL;
 	uint32_t thread_num = 5;
+	uint32_t min_num;
 
 	if (p) {
 		thread_num = (p->thread_max_num > 0)?p->thread_max_num:thread_num;
 	}
-	pool = (struct _thread_pool_msg *)calloc(1, sizeof(struct _thread_pool_msg) + thread_num * sizeof(struct _thread_msg));
+	min_num = (p && p->thread_min_num > 0 && p->thread_min_num < thread_num)?p->thread_min_num:thread_num;
+	fast_clock_init();
+	pool = (struct _thread_pool_msg *)calloc(1, sizeof(struct _thread_pool_msg));
 	LOG_THEN_RETURN_VAL_IF_TRUE((!pool), NULL, "pool calloc fail.");
 
-	pool->thread_num = thread_num;
+	pool->thread_max_num = thread_num;
+	pool->thread_min_num = min_num;
+	pool->scale_delay_us = (p && p->scale_delay_us)?p->scale_delay_us:TP_SCALE_DELAY_US;
+	pool->idle_timeout_ms = (p && p->idle_timeout_ms)?p->idle_timeout_ms:TP_IDLE_TIMEOUT_MS;
 	pool->cpu_max_num = get_nprocs();
 	TP_LOG_NOTICE("Get machine CPU num[%u].", pool->cpu_max_num);
 	if (p){
 		pool->cpu_max_num = (p->cpu_max_num >= 4)?p->cpu_max_num:pool->cpu_max_num;
+		pool->thread_init = p->thread_init;
+		pool->init_ctx = p->init_ctx;
 	}
+	strncpy(pool->name, (p && p->name)?p->name:"share_thread", TP_NAME_MAX_LEN - 1);
 	TP_LOG_NOTICE("Set thread bind CPU num[%u].", pool->cpu_max_num);
 
 	pthread_mutex_init(&pool->mutex, NULL); /* 初始化互斥锁 */
-	pthread_cond_init(&pool->cond, NULL);	 /* 初始化条件变量 */
-
 	QUEUE_INIT(&pool->wait_to_run);
 
-	pool->thread = (struct _thread_msg*)pool->ext_data;
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!pool->thread), error_1, "pool->thread calloc fail.");
+	pool->worker = (struct _worker *)calloc(thread_num, sizeof(struct _worker));
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!pool->worker), error_1, "pool->worker calloc fail.");
+	pool->idle_stack = (uint32_t *)calloc(thread_num, sizeof(uint32_t));
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!pool->idle_stack), error_1, "pool->idle_stack calloc fail.");
+	for (i = 0; i < thread_num; i++){
+		pool->worker[i].pool = pool;
+		pool->worker[i].msg.work_id = i;
+		if (ws_deque_init(&pool->worker[i].deque, TP_DEQUE_SIZE)) {
+			TP_LOG_ERROR("ws_deque_init fail.");
+			goto error_1;
+		}
+	}
 	
 	pool->sync = (sem_t *)calloc(1, sizeof(sem_t));
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!pool->thread), error_1, "pool->sync calloc fail.");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!pool->sync), error_1, "pool->sync calloc fail.");
 
 	if(sem_init(pool->sync, 0, 0) < 0) {
 		TP_LOG_ERROR("sem_init fail, to free pool.");
         goto error_2;
 	}
-	TP_LOG_NOTICE("create thread num:%u.", p->thread_max_num);
-	for (i = 0; i < p->thread_max_num; i++){
-		if (pthread_create(&pool->thread[i].thread_id, NULL, task_worker, pool) < 0) {
+	TP_LOG_NOTICE("create thread num:%u, range[%u, %u].", min_num, min_num, thread_num);
+	for (i = 0; i < min_num; i++){
+		pthread_mutex_lock(&pool->mutex);
+		if (tp_start_worker(pool)) {
+			pthread_mutex_unlock(&pool->mutex);
 			TP_LOG_ERROR("create thread fail, to free pool.");
-			pool->thread[i].thread_id = 0;
 			goto error_3;
 		}
+		pthread_mutex_unlock(&pool->mutex);
 		sem_wait(pool->sync);
-		TP_LOG_NOTICE("create thread[%lu] success, do next.", pool->thread[i].thread_id);
+		TP_LOG_NOTICE("create thread[%lu] success, do next.", pool->worker[i].msg.thread_id);
 	}
-	if(pool->sync)
-		free(pool->sync);
+	sem_destroy(pool->sync);
+	free(pool->sync);
 	pool->sync = NULL;
 
 	return pool;
 error_3:
-	pthread_mutex_lock(&pool->mutex);
-	for (i = 0; i < p->thread_max_num; i++){
-		TASK_SET_EXIT(pool->thread[i].flag);
-		TP_LOG_DEBUG("notify thread[%lu] exit, wait.", pool->thread[i].thread_id);
-	}
-	pthread_cond_broadcast(&pool->cond);
-	pthread_mutex_unlock(&pool->mutex);
-	for (i = 0; i < pool->thread_num; i++){
-		TP_LOG_DEBUG("join thread[%lu] exit, do next.", pool->thread[i].thread_id);
-		if (pool->thread[i].thread_id > 0)
-			pthread_join(pool->thread[i].thread_id, NULL);
+	__atomic_store_n(&pool->exit, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < pool->slot_num; i++){
+		if (pool->worker[i].alive) {
+			tp_futex_wake(&pool->worker[i].futex);
+			TP_LOG_DEBUG("join thread[%lu] exit, do next.", pool->worker[i].msg.thread_id);
+			pthread_join(pool->worker[i].msg.thread_id, NULL);
+		}
 	}
+	sem_destroy(pool->sync);
 error_2:
 	if(pool->sync)
 		free(pool->sync);
 	pool->sync = NULL;
 error_1:
-	pthread_cond_destroy(&pool->cond);
+	if (pool->worker) {
+		for (i = 0; i < thread_num; i++){
+			ws_deque_destroy(&pool->worker[i].deque);
+		}
+		free(pool->worker);
+	}
+	if (pool->idle_stack)
+		free(pool->idle_stack);
 	pthread_mutex_destroy(&pool->mutex);
-	if (pool)
-		free(pool);
+	free(pool);
 	return NULL;
 }
 
@@ -275,116 +718,137 @@ int tp_destroy_thread_pool(tp_handle *fd)
 	struct _thread_pool_msg *pool = (struct _thread_pool_msg *)(*fd);
 	LOG_THEN_RETURN_VAL_IF_TRUE((!pool), -1,"pool null fail.");
 
-	pthread_mutex_lock(&pool->mutex);
 wait_idle:
-	for (i = 0; i < pool->thread_num; i++){
-		if (!(IS_SET(pool->thread[i].flag, FLAG_TASK_IDLE))){
-			TP_LOG_ERROR("the thread[%lu], work_id[%u] is runing,can't stop it", pool->thread[i].thread_id, i);
+	for (i = 0; i < pool->slot_num; i++){
+		if (!__atomic_load_n(&pool->worker[i].alive, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		if (!(IS_SET(__atomic_load_n(&pool->worker[i].msg.flag, __ATOMIC_ACQUIRE), FLAG_TASK_IDLE))){
+			TP_LOG_ERROR("the thread[%lu], work_id[%u] is runing,can't stop it", pool->worker[i].msg.thread_id, i);
 			if (retry) {
 				retry--;
-				pthread_mutex_unlock(&pool->mutex);
 				tp_usleep(10*1000);
-				pthread_mutex_lock(&pool->mutex);
 				goto wait_idle;
 			}else{
-				goto error;
+				return -1;
 			}
 		}
 	}
-	for (i = 0; i < pool->thread_num; i++){
-		TASK_SET_EXIT(pool->thread[i].flag);
-		TP_LOG_DEBUG("notify thread[%lu] exit, wait.", pool->thread[i].thread_id);
-	}
-
-	pthread_cond_broadcast(&pool->cond);
+	// 锁内置退出标记，之后不会再有线程扩容或缩容，alive稳定
+	pthread_mutex_lock(&pool->mutex);
+	__atomic_store_n(&pool->exit, 1, __ATOMIC_RELEASE);
 	pthread_mutex_unlock(&pool->mutex);
+	for (i = 0; i < pool->slot_num; i++){
+		if (!pool->worker[i].alive)
+			continue;
+		TP_LOG_DEBUG("notify thread[%lu] exit, wait.", pool->worker[i].msg.thread_id);
+		tp_futex_wake(&pool->worker[i].futex);
+	}
 
-	for (i = 0; i < pool->thread_num; i++){
-		TP_LOG_DEBUG("join[%u] thread[%lu] exit, do next.", i, pool->thread[i].thread_id);
-		if (pool->thread[i].thread_id > 0)
-			pthread_join(pool->thread[i].thread_id, NULL);
+	for (i = 0; i < pool->thread_max_num; i++){
+		if (pool->worker[i].alive) {
+			TP_LOG_DEBUG("join[%u] thread[%lu] exit, do next.", i, pool->worker[i].msg.thread_id);
+			pthread_join(pool->worker[i].msg.thread_id, NULL);
+		}
+		ws_deque_destroy(&pool->worker[i].deque);
 	}
 
-	pthread_cond_destroy(&pool->cond);
+	free(pool->worker);
+	free(pool->idle_stack);
 	pthread_mutex_destroy(&pool->mutex);
-	if(pool)
-		free(pool);
+	free(pool);
 	TP_LOG_DEBUG(" free pool success, exit.");
 	*fd = NULL;
 	return 0;
-error:
-  	pthread_mutex_unlock(&pool->mutex);
-  	return -1;
 }
 
-work_handle_t tp_post_one_work(tp_handle fd, struct tp_thread_work *w, uint8_t auto_free)
+static void tp_print_status(struct _thread_pool_msg *pool, uint64_t now_us)
 {
-  struct _thread_pool_msg *pool = (struct _thread_pool_msg *)fd;
-  struct _work *work;
-  int ret;
-  int i;
-  LOG_THEN_RETURN_VAL_IF_TRUE((!pool || !w), NULL,"pool null or w null fail.");
-  LOG_THEN_RETURN_VAL_IF_TRUE(!w->loop, NULL, "work loop null, fail.");
-  
-  work = (struct _work*)calloc(1, sizeof(struct _work));
-  gettimeofday(&work->now, NULL);	// 线程安全
-
-  work->loop = w->loop;
-  work->stop = w->stop;
-  work->usr_ctx = w->usr_ctx;
-  work->thread_id = 0;
-  ret = pthread_mutex_init(&work->mutex, NULL); /* 初始化互斥锁 */
-  LOG_THEN_GOTO_TAG_IF_VAL_TRUE((ret != 0), error, "pthread_mutex_init fail.");
-  ret = pthread_cond_init(&work->cond, NULL);	 /* 初始化条件变量 */
-  if (ret != 0) {
-    pthread_cond_destroy(&work->cond);
-    goto error;
-  }
-  SET_FLAG(work->flag, FLAG_WORK_INIT);
-  if (auto_free){
-    CLR_FLAG(work->flag, FLAG_WORK_WAIT);
-  }
-  pthread_mutex_lock(&pool->mutex);
-  QUEUE_INSERT_TAIL(&pool->wait_to_run, &work->queue);
-  pool->wait_task_num++;
-  if (pool->idle_num > 0){
-    	pthread_cond_signal(&pool->cond);
-  }else{
-	  if (pool->wait_task_num > 1000 && (pool->wait_task_num%3 == 0)) {
-		  TP_LOG_DEBUG("no idle thread to process task, wait queue:%lu, total:%u.", pool->wait_task_num, pool->thread_num);
-	  }
-  }
-  if (pool->interval.tv_sec + STATISTICS_PRINT_INTERVAL_S <= work->now.tv_sec) {
-	pool->interval = work->now;
-	TP_LOG_STATUS(THREAD_STATUS_SHOW_HEAD, pool, pool->thread_num,pool->idle_num, pool->wait_task_num);
-	for (i = 0; i < pool->thread_num; i++) {
+	int64_t last = __atomic_load_n(&pool->interval_s, __ATOMIC_RELAXED);
+	int64_t now_s = (int64_t)(now_us / 1000000);
+	uint32_t i;
+
+	if (last + STATISTICS_PRINT_INTERVAL_S > now_s) {
+		return;
+	}
+	if (!__atomic_compare_exchange_n(&pool->interval_s, &last, now_s, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;	// 其它线程在打印
+	}
+	TP_LOG_STATUS(THREAD_STATUS_SHOW_HEAD, pool->name, pool, 
+					__atomic_load_n(&pool->thread_num, __ATOMIC_RELAXED), 
+					__atomic_load_n(&pool->idle_num, __ATOMIC_RELAXED), 
+					__atomic_load_n(&pool->wait_task_num, __ATOMIC_RELAXED));
+	if (tp_is_elastic(pool)) {
+		TP_LOG_STATUS("range[%u, %u] queue delay:%lu us\n", pool->thread_min_num, pool->thread_max_num, 
+					__atomic_load_n(&pool->delay_us, __ATOMIC_RELAXED));
+	}
+	for (i = 0; i < __atomic_load_n(&pool->slot_num, __ATOMIC_ACQUIRE); i++) {
+		if (!__atomic_load_n(&pool->worker[i].alive, __ATOMIC_RELAXED)) {
+			continue;
+		}
 		TP_LOG_STATUS(THREAD_STATUS_SHOW, 
-					pool->thread[i].thread_id, 
-					pool->thread[i].work_id, 
-					pool->thread[i].run_count, 
-					pool->thread[i].time.ave.tv_sec,
-					pool->thread[i].time.ave.tv_usec,
-					pool->thread[i].time.cur.tv_sec,
-					pool->thread[i].time.cur.tv_usec);
+					pool->worker[i].msg.thread_id, 
+					pool->worker[i].msg.work_id, 
+					pool->worker[i].msg.run_count, 
+					pool->worker[i].msg.time.ave.tv_sec,
+					pool->worker[i].msg.time.ave.tv_usec,
+					pool->worker[i].msg.time.cur.tv_sec,
+					pool->worker[i].msg.time.cur.tv_usec);
 	}
 	TP_LOG_STATUS("------------------------------------\n");
-  }
-  pthread_mutex_unlock(&pool->mutex);
-  return work;
-error:
-  if (work)
-    free(work);
-  work = NULL;
+}
+
+/*
+ * 投递顺序：有休眠线程时直接交付到其信箱并只唤醒它；
+ * 否则本池工作线程压入自己的窃取队列（无锁），外部线程进入共享队列。
+ */
+work_handle_t tp_post_one_work(tp_handle fd, struct tp_thread_work *w, uint8_t auto_free)
+{
+	struct _thread_pool_msg *pool = (struct _thread_pool_msg *)fd;
+	struct _work *work;
+	struct _worker *self = tls_worker;
+	uint64_t wait_num;
+	uint64_t now_us;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!pool || !w), NULL,"pool null or w null fail.");
+	LOG_THEN_RETURN_VAL_IF_TRUE(!w->loop, NULL, "work loop null, fail.");
+	LOG_THEN_RETURN_VAL_IF_TRUE(__atomic_load_n(&pool->exit, __ATOMIC_ACQUIRE), NULL, "pool is exiting.");
+
+	work = work_alloc();
+	LOG_THEN_RETURN_VAL_IF_TRUE(!work, NULL, "work_alloc fail.");
+	now_us = tp_now_us();
+	work->post_us = now_us;		// 交付后work可能已执行完并回收，之后只用now_us
+
+	work->loop = w->loop;
+	work->stop = w->stop;
+	work->usr_ctx = w->usr_ctx;
+	work->thread_id = 0;
+	SET_FLAG(work->flag, FLAG_WORK_INIT);
+	if (auto_free){
+		SET_FLAG(work->flag, FLAG_WORK_AUTO_FREE);
+	}
+	wait_num = __atomic_add_fetch(&pool->wait_task_num, 1, __ATOMIC_RELAXED);
 
-  return NULL;
+	if (tp_handoff_idle(pool, work)) {
+		if (self && self->pool == pool && !ws_deque_push(&self->deque, work)) {
+			tp_wake_one(pool);	// 有线程在复查/刚休眠时由其窃取
+		}else{
+			tp_push_shared(pool, work);
+			tp_wake_one(pool);
+		}
+		tp_try_grow(pool, now_us);
+		if (wait_num > 1000 && (wait_num%3 == 0)) {
+			TP_LOG_DEBUG("no idle thread to process task, wait queue:%lu, total:%u.", wait_num, pool->thread_num);
+		}
+	}
+	tp_print_status(pool, now_us);
+	return work;
 }
 
 int tp_wait_work_done(work_handle_t *w, uint32_t timeout_ms)
 {
 	struct _work *work = (struct _work *)(*w);
 	struct timespec abstime;
-	struct timeval now;
-	uint64_t nsec;
 	LOG_THEN_RETURN_VAL_IF_TRUE((!w || !work || (work == (void*)HIDE_ADDR)), -1, "work_handle_t  fail.");
 	pthread_mutex_lock(&work->mutex);
 	if (IS_SET(work->flag, FLAG_WORK_DONE)){
@@ -393,10 +857,7 @@ int tp_wait_work_done(work_handle_t *w, uint32_t timeout_ms)
 
 	SET_FLAG(work->flag, FLAG_WORK_WAIT);
 	if (timeout_ms > 0) {
-		gettimeofday(&now, NULL);	// 线程安全
-		nsec = now.tv_usec * 1000 + (timeout_ms % 1000) * 1000000;
-		abstime.tv_sec=now.tv_sec + nsec / 1000000000 + timeout_ms / 1000;
-		abstime.tv_nsec=nsec % 1000000000;
+		fast_clock_abstime(timeout_ms, &abstime);
 		pthread_cond_timedwait(&work->cond, &work->mutex, &abstime);
 	}else{
 		pthread_cond_wait(&work->cond, &work->mutex);
@@ -409,14 +870,9 @@ int tp_wait_work_done(work_handle_t *w, uint32_t timeout_ms)
 		return -1;
 	}
 
-	pthread_mutex_unlock(&work->mutex);
 end:
-	if (IS_SET(work->flag, FLAG_WORK_INIT)) {
-		pthread_cond_destroy(&work->cond);
-		pthread_mutex_destroy(&work->mutex);
-	}
-	if (work)
-		free(work);
+	pthread_mutex_unlock(&work->mutex);
+	work_free(work);
 	*w = NULL;
 	return 0;
 }
@@ -436,15 +892,12 @@ int tp_cancel_one_work(work_handle_t *w)
 	}
 	SET_FLAG(work->flag, FLAG_WORK_WAIT);
 	work->stop(work->usr_ctx);
-	pthread_cond_wait(&work->cond, &work->mutex);
+	while (!IS_SET(work->flag, FLAG_WORK_DONE)) {
+		pthread_cond_wait(&work->cond, &work->mutex);
+	}
 end:
 	pthread_mutex_unlock(&work->mutex);
-	if (IS_SET(work->flag, FLAG_WORK_INIT)) {
-		pthread_cond_destroy(&work->cond);
-		pthread_mutex_destroy(&work->mutex);
-	}
-	if (*w)
-		free(*w);
+	work_free(work);
 	*w = NULL;
 	return 0;
 }
@@ -461,11 +914,20 @@ uint64_t tp_get_work_thread_id(work_handle_t w)
 uint32_t tp_get_pool_idle_num(tp_handle fd)
 {
 	struct _thread_pool_msg *pool = (struct _thread_pool_msg *)fd;
-  	int ret;
-	uint32_t idle = 0;
   	LOG_THEN_RETURN_VAL_IF_TRUE((!pool), 0,"pool null or w null fail.");
-	pthread_mutex_lock(&pool->mutex);
-	idle = pool->idle_num;
-  	pthread_mutex_unlock(&pool->mutex);
-	return idle;
-}
\ No newline at end of file
+	return __atomic_load_n(&pool->idle_num, __ATOMIC_ACQUIRE);
+}
+
+uint32_t tp_get_pool_thread_num(tp_handle fd)
+{
+	struct _thread_pool_msg *pool = (struct _thread_pool_msg *)fd;
+  	LOG_THEN_RETURN_VAL_IF_TRUE((!pool), 0,"pool null fail.");
+	return __atomic_load_n(&pool->thread_num, __ATOMIC_ACQUIRE);
+}
+
+uint64_t tp_get_pool_wait_num(tp_handle fd)
+{
+	struct _thread_pool_msg *pool = (struct _thread_pool_msg *)fd;
+  	LOG_THEN_RETURN_VAL_IF_TRUE((!pool), 0,"pool null fail.");
+	return __atomic_load_n(&pool->wait_task_num, __ATOMIC_RELAXED);
+}
@@ -40,6 +40,12 @@ struct tp_param {
 	uint32_t max_stack_size;		/* 线程栈空间大小*/
 	uint32_t cpu_max_num;
 	uint32_t flag;
+	void (*thread_init)(uint32_t thread_index, void *init_ctx);	/* 工作线程启动时回调，用于绑核等，可为NULL*/
+	void *init_ctx;
+	const char *name;					/* 线程名及统计标识，NULL时为share_thread*/
+	uint32_t thread_min_num;			/* 最小线程数，0或不小于thread_max_num时线程数固定*/
+	uint32_t scale_delay_us;			/* 任务排队时延超过该值时扩容，0取默认*/
+	uint32_t idle_timeout_ms;			/* 线程连续空闲超过该值时缩容，0取默认*/
 };
 
 tp_handle tp_create_thread_pool(struct tp_param *p);
@@ -58,6 +64,8 @@ int tp_wait_work_done(work_handle_t *w, uint32_t timeout_ms);
 int tp_cancel_one_work(work_handle_t *w);
 uint64_t tp_get_work_thread_id(work_handle_t w);
 uint32_t tp_get_pool_idle_num(tp_handle fd);
+uint32_t tp_get_pool_thread_num(tp_handle fd);
+uint64_t tp_get_pool_wait_num(tp_handle fd);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file ws_deque.h
+* \brief 定长Chase-Lev工作窃取双端队列
+*
+* 属主线程在bottom端无锁压入/弹出（LIFO，缓存友好），其它线程在top端通过CAS窃取（FIFO）。
+* 数组长度固定，满时由调用者转入共享队列。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _WS_DEQUE_H_
+#define _WS_DEQUE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WS_DEQUE_CACHE_LINE	64
+
+struct ws_deque {
+	int64_t		top;			/* 窃取端 */
+	char		pad0[WS_DEQUE_CACHE_LINE - sizeof(int64_t)];
+	int64_t		bottom;			/* 属主端 */
+	char		pad1[WS_DEQUE_CACHE_LINE - sizeof(int64_t)];
+	int64_t		mask;
+	void		**buf;
+};
+
+/*!
+ * @brief  初始化
+ *
+ * @param[in] dq
+ * @param[in] size 容量，向上取整为2的幂
+ * @return  0 成功，-1 失败
+ */
+static inline int ws_deque_init(struct ws_deque *dq, uint32_t size)
+{
+	int64_t real_size = 2;
+
+	while (real_size < size) {
+		real_size <<= 1;
+	}
+	dq->buf = (void **)calloc(real_size, sizeof(void *));
+	if (!dq->buf) {
+		return -1;
+	}
+	dq->mask = real_size - 1;
+	dq->top = 0;
+	dq->bottom = 0;
+	return 0;
+}
+
+static inline void ws_deque_destroy(struct ws_deque *dq)
+{
+	if (dq->buf) {
+		free(dq->buf);
+		dq->buf = NULL;
+	}
+}
+
+/*!
+ * @brief  属主压入
+ *
+ * @return  0 成功，-1 队列满
+ */
+static inline int ws_deque_push(struct ws_deque *dq, void *data)
+{
+	int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+
+	if (b - t > dq->mask) {
+		return -1;
+	}
+	__atomic_store_n(&dq->buf[b & dq->mask], data, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*!
+ * @brief  属主弹出（最近压入的）
+ *
+ * @return  队列空返回NULL
+ */
+static inline void *ws_deque_pop(struct ws_deque *dq)
+{
+	int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+	int64_t t;
+	void *data;
+
+	__atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+	if (t > b) {
+		__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	data = __atomic_load_n(&dq->buf[b & dq->mask], __ATOMIC_RELAXED);
+	if (t == b) {
+		// 最后一个元素，与窃取者竞争
+		if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			data = NULL;
+		}
+		__atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return data;
+}
+
+/*!
+ * @brief  其它线程窃取（最早压入的）
+ *
+ * @return  队列空或竞争失败返回NULL
+ */
+static inline void *ws_deque_steal(struct ws_deque *dq)
+{
+	int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+	int64_t b;
+	void *data;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b) {
+		return NULL;
+	}
+	data = __atomic_load_n(&dq->buf[t & dq->mask], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		return NULL;
+	}
+	return data;
+}
+
+/*!
+ * @brief  近似元素数
+ */
+static inline int64_t ws_deque_size(const struct ws_deque *dq)
+{
+	int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+	return (b > t) ? (b - t) : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_WS_DEQUE_H_ */
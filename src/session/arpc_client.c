@@ -86,9 +86,13 @@ arpc_session_handle_t arpc_client_create_session(const struct arpc_client_sessio
 	struct xio_connection_params xio_con_param;
 	struct arpc_connection_param conn_param;
 	struct arpc_proto_new_session req_new;
+	struct arpc_proto_new_session_ext req_ext;
+	uint8_t *private_data;
 	struct tp_param pool_param;
 	uint32_t rx_con_num = 1;
 	struct tp_thread_work thread;
+	void *thread_pool;
+	void *loop_pool;
 	//LOG_THEN_RETURN_VAL_IF_TRUE(!param->ops, NULL, "ops is null.");
 
 	session = arpc_create_session(ARPC_SESSION_CLIENT, sizeof(struct arpc_client_ctx));
@@ -122,32 +126,36 @@ arpc_session_handle_t arpc_client_create_session(const struct arpc_client_sessio
 	req_new.max_head_len = session->msg_head_max_len;
 	req_new.max_data_len = session->msg_data_max_len;
 	req_new.max_iov_len  = session->msg_iov_max_len;
+	req_ext.csum_mask    = arpc_csum_hw_mask();
+	req_ext.zip_mask     = arpc_zip_mask();
+	idle_thread_num = (param->con_num > 0)? param->con_num : 2; // 默认是两个链接
+	req_ext.conn_base    = ARPC_CONN_XIO_IDX(ARPC_CONN_ID_OFFSET);
+	req_ext.conn_num     = idle_thread_num;
 	ARPC_LOG_NOTICE("req_new.max_data_len:%lu.", req_new.max_data_len);
-	if (param->req_data && param->req_data_len && param->req_data_len < MAX_SESSION_REQ_DATA_LEN) {
-		client_ctx->xio_param.private_data = arpc_mem_alloc(sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session), NULL);
-		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!client_ctx->xio_param.private_data, error_1, "arpc_mem_alloc fail.");
-		arpc_write_tlv(ARPC_PROTO_NEW_SESSION, sizeof(struct arpc_proto_new_session), client_ctx->xio_param.private_data);
-		pack_new_session(&req_new, 
-						(uint8_t*)client_ctx->xio_param.private_data + sizeof(struct arpc_tlv), 
-						sizeof(struct arpc_proto_new_session));
-		client_ctx->xio_param.private_data_len = sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session);
-		ARPC_LOG_NOTICE("private_data_le:%u.", client_ctx->xio_param.private_data_len);
-	}else{
-		client_ctx->xio_param.private_data = arpc_mem_alloc(sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session), NULL);
-		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!client_ctx->xio_param.private_data, error_1, "arpc_mem_alloc fail.");
-		arpc_write_tlv(ARPC_PROTO_NEW_SESSION, sizeof(struct arpc_proto_new_session), client_ctx->xio_param.private_data);
-		pack_new_session(&req_new,
-						 (uint8_t*)client_ctx->xio_param.private_data + sizeof(struct arpc_tlv), 
-						sizeof(struct arpc_proto_new_session));
-		client_ctx->xio_param.private_data_len = sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session);
-		ARPC_LOG_NOTICE("private_data_le:%u.", client_ctx->xio_param.private_data_len);
-	}
+	// 旧版本服务端要求第一个TLV长度与旧结构一致，扩展字段放在其后单独的TLV里
+	client_ctx->xio_param.private_data_len = 2 * sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session) +
+											sizeof(struct arpc_proto_new_session_ext);
+	client_ctx->xio_param.private_data = arpc_mem_alloc(client_ctx->xio_param.private_data_len, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!client_ctx->xio_param.private_data, error_1, "arpc_mem_alloc fail.");
+	private_data = (uint8_t *)client_ctx->xio_param.private_data;
+	arpc_write_tlv(ARPC_PROTO_NEW_SESSION, sizeof(struct arpc_proto_new_session), private_data);
+	pack_new_session(&req_new, private_data + sizeof(struct arpc_tlv), sizeof(struct arpc_proto_new_session));
+	private_data += sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session);
+	arpc_write_tlv(ARPC_PROTO_NEW_SESSION_EXT, sizeof(struct arpc_proto_new_session_ext), private_data);
+	pack_new_session_ext(&req_ext, private_data + sizeof(struct arpc_tlv), sizeof(struct arpc_proto_new_session_ext));
+	ARPC_LOG_NOTICE("private_data_le:%u.", client_ctx->xio_param.private_data_len);
 
+	// loop线程各自绑核，不走工作线程的绑核回调
+	memset(&pool_param, 0, sizeof(struct tp_param));
 	pool_param.cpu_max_num = 16;
-	pool_param.thread_max_num = (param->con_num > 0)?(param->con_num*2 + 2 + 1):12;	// 默认是1:3的关系	,一个状态线程				
-	session->threadpool = tp_create_thread_pool(&pool_param);
+	pool_param.name = ARPC_LOOP_THREAD_NAME;
+	pool_param.thread_max_num = idle_thread_num + ARPC_LOOP_THREAD_EXTRA_NUM;
+	session->loop_pool = tp_create_thread_pool(&pool_param);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!session->loop_pool, error_1, "tp_create_thread_pool loop fail.");
 
-	idle_thread_num = (param->con_num > 0)? param->con_num : 2; // 默认是两个链接
+	arpc_work_pool_param(&pool_param);
+	session->threadpool = tp_create_thread_pool(&pool_param);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!session->threadpool, error_1, "tp_create_thread_pool work fail.");
 
 	memset(&conn_param, 0, sizeof(struct arpc_connection_param));
 	conn_param.type = ARPC_CON_TYPE_CLIENT;
@@ -156,6 +164,9 @@ arpc_session_handle_t arpc_client_create_session(const struct arpc_client_sessio
 	if (conn_param.timeout_ms > 0){
 		SET_FLAG(session->flags, ARPC_SESSION_ATTR_AUTO_DISCONNECT);
 	}
+	if (IS_SET(param->flags, ARPC_SESSION_ARRT_CLIENT_THREAD_AFFINITY)) {
+		SET_FLAG(session->flags, ARPC_SESSION_ATTR_THREAD_AFFINITY);
+	}
 	rx_con_num = (param->rx_con_num > 0 && param->rx_con_num <= (idle_thread_num/2))?(param->rx_con_num):(idle_thread_num/2);
 
 	for (i = 0; i < idle_thread_num; i++) {
@@ -182,7 +193,8 @@ arpc_session_handle_t arpc_client_create_session(const struct arpc_client_sessio
 	thread.stop = NULL;
 	thread.usr_ctx = (void*)session;
 
-	tp_post_one_work(session->threadpool, &thread, WORK_DONE_AUTO_FREE);
+	tp_post_one_work(session->loop_pool, &thread, WORK_DONE_AUTO_FREE);
+	session->stat_slot = arpc_stat_shm_register(ARPC_STAT_SHM_CLIENT, client_ctx->uri, &session_stat_collect, session);
 
 	return (arpc_session_handle_t)session;
 
@@ -193,7 +205,13 @@ destroy_conn:
 error_2:
 	SAFE_FREE_MEM(client_ctx->private_data);
 error_1:
+	thread_pool = session->threadpool;
+	loop_pool = session->loop_pool;
 	arpc_destroy_session(session, CLIENT_DESTROY_SESSION_MAX_TIME);
+	if (loop_pool)
+		tp_destroy_thread_pool(&loop_pool);
+	if (thread_pool)
+		tp_destroy_thread_pool(&thread_pool);
 	ARPC_LOG_ERROR( "create session fail, exit.");
 	return NULL;
 }
@@ -204,15 +222,18 @@ int arpc_client_destroy_session(arpc_session_handle_t *fd)
 	struct arpc_client_ctx *client_ctx = NULL;
 	struct arpc_session_handle *session = NULL;
 	void *thread_pool;
+	void *loop_pool;
 	LOG_THEN_RETURN_VAL_IF_TRUE(!fd, -1, "client session handle is null fail.");
 
 	session = (struct arpc_session_handle *)(*fd);
 	client_ctx = (struct arpc_client_ctx *)session->ex_ctx;
 	SAFE_FREE_MEM(client_ctx->private_data);
 	thread_pool = session->threadpool;
+	loop_pool = session->loop_pool;
 	ret = arpc_destroy_session(session, CLIENT_DESTROY_SESSION_MAX_TIME);//todo
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "arpc_destroy_session[%p] fail.", session);
 	ARPC_LOG_NOTICE( "destroy session[%p] success.", session);
+	tp_destroy_thread_pool(&loop_pool);		// 先停loop，不再产生新的异步任务
 	tp_destroy_thread_pool(&thread_pool);
 	*fd = NULL;
 	return ret;
@@ -220,8 +241,22 @@ int arpc_client_destroy_session(arpc_session_handle_t *fd)
 
 static int client_session_established(struct xio_session *session, struct xio_new_session_rsp *rsp, void *session_context)
 {
+	void *rsp_addr = NULL;
+	uint64_t rsp_len = 0;
+	arpc_proto_t tlv_type = 0;
+	struct arpc_proto_new_session_rsp new_rsp = {0};
 	SESSION_CTX(session_ctx, session_context);
 	ARPC_LOG_TRACE("session established for client");
+	// 旧版本服务端不回复协商结果，保持默认算法
+	if (rsp && rsp->private_data && rsp->private_data_len >= sizeof(struct arpc_tlv)) {
+		arpc_read_tlv(&tlv_type, &rsp_len, &rsp_addr, rsp->private_data);
+		if (tlv_type == ARPC_PROTO_NEW_SESSION_RSP && rsp_len + sizeof(struct arpc_tlv) <= rsp->private_data_len) {
+			unpack_new_session_rsp(rsp_addr, rsp_len, &new_rsp);
+			__atomic_store_n(&session_ctx->csum_type, new_rsp.csum_type, __ATOMIC_RELAXED);
+			__atomic_store_n(&session_ctx->zip_type, new_rsp.zip_type, __ATOMIC_RELAXED);
+			ARPC_LOG_NOTICE("session csum type[%u], zip type[%u].", new_rsp.csum_type, new_rsp.zip_type);
+		}
+	}
 	return session_established_for_client(session_ctx);
 }
 
@@ -237,6 +272,11 @@ static int client_session_event(struct xio_session *session, struct xio_session_
 					xio_session_event_str(event_data->event), 
 					xio_strerror(event_data->reason));
 	
+	// 迁移中的新连接和排空中的旧连接不影响连接状态
+	if (con_ctx && event_data->conn && event_data->event != XIO_SESSION_TEARDOWN_EVENT &&
+		arpc_client_migrate_event(con_ctx, event_data->conn, event_data->event)) {
+		return 0;
+	}
 	switch (event_data->event) {
 		case XIO_SESSION_TEARDOWN_EVENT:
 			xio_session_destroy(session);
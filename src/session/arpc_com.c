@@ -18,13 +18,47 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <arpa/inet.h>
 #include <sys/sysinfo.h>
 
 #include "arpc_com.h"
 #include "threadpool.h"
 #include "arpc_response.h"
-#include "crc64.h"
+#include "csum.h"
+#include "lz_codec.h"
+#include "cpu_topo.h"
+#include "slab_cache.h"
+#include "xio_mem.h"
+
+#define RX_SGL_CACHE_NENTS			64		//缓存的接收sglist容量，超过则临时申请
+#define RX_HOLD_VEC_NUM				64		//零拷贝接收容器内的vec数
+#define RX_HOLD_HEAD_LEN			256		//零拷贝接收容器内的head长度
+#define RX_CACHE_SLAB_OBJ_NUM		64
+#define RX_CACHE_MAG_SIZE			32
+#define RX_CACHE_REAP_INTERVAL_S	5
+
+#define ZIP_MIN_LEN					(4*1024)	//数据小于该值不压缩
+#define ZIP_BLK_LEN					LZ_BLOCK_MAX	//压缩分块的原始长度
+#define ZIP_FRAME_LEN				sizeof(struct arpc_zip_frame)
+#define ZIP_SAVE_SHIFT				3		//至少节省1/8才压缩，否则原样发送
+#define ZIP_CACHE_SLAB_OBJ_NUM		16
+#define ZIP_CACHE_MAG_SIZE			8
+
+#define RX_SGL_ALLOC				1		//xio_vmsg.pad: sglist临时申请
+#define RX_SGL_POOL					2		//xio_vmsg.pad: sglist取自缓存
+
+/* 零拷贝接收时vec数组与拷贝的head放在同一个缓存对象里，vec位于首部 */
+struct arpc_rx_hold {
+	struct arpc_iov	vec[RX_HOLD_VEC_NUM];
+	char			head[RX_HOLD_HEAD_LEN];
+};
+
+static pthread_once_t g_rx_cache_once = PTHREAD_ONCE_INIT;
+static slab_cache_t g_rx_sgl_cache = NULL;
+static slab_cache_t g_rx_hold_cache = NULL;
+static pthread_once_t g_zip_cache_once = PTHREAD_ONCE_INIT;
+static slab_cache_t g_zip_cache = NULL;		/* 压缩帧缓冲：帧头加一块数据，收发共用 */
 
 static const char *version = "v1.0.0";
 struct aprc_paramter{
@@ -33,6 +67,9 @@ struct aprc_paramter{
 	tp_handle thread_pool;
 	struct arpc_mutex mutex;
 	struct aprc_option opt;
+	struct cpu_topo_plan plan;		/* 绑核计划 */
+	uint32_t loop_seq;				/* 已分配的xio loop线程序号 */
+	uint32_t worker_seq;			/* 已分配的工作线程序号 */
 };
 
 const char *arpc_version()
@@ -54,6 +91,9 @@ static struct aprc_paramter g_param= {
 						.tx_queue_max_size  = (128*1024*1024),
 						.rx_queue_max_depth = 1024,
 						.rx_queue_max_size  = (128*1024*1024),
+						.thread_min_num     = ARPC_MIN_THREAD_IDLE_NUM,
+						.thread_scale_delay_us  = 500,
+						.thread_idle_timeout_ms = (30*1000),
 					}
 	
 };
@@ -81,6 +121,20 @@ static void set_user_option(const struct aprc_option *opt, struct aprc_option *o
 	 out_opt->rx_queue_max_size = (opt->rx_queue_max_size >= (8*1024*1024) && opt->rx_queue_max_size <= (1024*1024*1024))?
 	 							opt->rx_queue_max_size:out_opt->rx_queue_max_size;
 	 out_opt->control = opt->control;
+	 out_opt->cpu_bind_policy = (opt->cpu_bind_policy < ARPC_CPU_BIND_MAX)?
+	 							opt->cpu_bind_policy:out_opt->cpu_bind_policy;
+	 (void)snprintf(out_opt->cpu_list, sizeof(out_opt->cpu_list), "%s", opt->cpu_list);
+	 out_opt->thread_min_num = (opt->thread_min_num && opt->thread_min_num <= out_opt->thread_max_num)?
+	 							opt->thread_min_num:out_opt->thread_min_num;
+	 out_opt->thread_min_num = (out_opt->thread_min_num <= out_opt->thread_max_num)?
+	 							out_opt->thread_min_num:out_opt->thread_max_num;
+	 out_opt->thread_scale_delay_us = (opt->thread_scale_delay_us >= 50 && opt->thread_scale_delay_us <= 1000000)?
+	 							opt->thread_scale_delay_us:out_opt->thread_scale_delay_us;
+	 out_opt->thread_idle_timeout_ms = (opt->thread_idle_timeout_ms >= 100 && opt->thread_idle_timeout_ms <= 3600000)?
+	 							opt->thread_idle_timeout_ms:out_opt->thread_idle_timeout_ms;
+	 out_opt->trace_sample = opt->trace_sample;
+	 out_opt->metrics_port = (opt->metrics_port <= 65535)? opt->metrics_port : 0;
+	 (void)snprintf(out_opt->metrics_path, sizeof(out_opt->metrics_path), "%s", opt->metrics_path);
 }
 
 const struct aprc_option *get_option()
@@ -135,10 +189,65 @@ static void set_xio_option(const struct aprc_option *opt)
 }
 
 static inline void arpc_crc_init();
-static inline uint64_t arpc_cal_crc64(uint64_t crc, const unsigned char *data, uint64_t len);
+static inline int arpc_crc_enable();
+
+static void arpc_rx_cache_init(void)
+{
+	struct slab_cache_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.name = "arpc_rx_sgl";
+	param.obj_size = RX_SGL_CACHE_NENTS * sizeof(struct xio_iovec_ex);
+	param.slab_obj_num = RX_CACHE_SLAB_OBJ_NUM;
+	param.mag_size = RX_CACHE_MAG_SIZE;
+	param.reap_interval_s = RX_CACHE_REAP_INTERVAL_S;
+	g_rx_sgl_cache = slab_cache_create(&param);
+	LOG_ERROR_IF_VAL_TRUE(!g_rx_sgl_cache, "slab_cache_create for %s fail.", param.name);
+
+	param.name = "arpc_rx_hold";
+	param.obj_size = sizeof(struct arpc_rx_hold);
+	g_rx_hold_cache = slab_cache_create(&param);
+	LOG_ERROR_IF_VAL_TRUE(!g_rx_hold_cache, "slab_cache_create for %s fail.", param.name);
+}
+
+static void arpc_zip_cache_init(void)
+{
+	struct slab_cache_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.name = "arpc_zip_blk";
+	param.obj_size = ZIP_FRAME_LEN + ZIP_BLK_LEN;
+	param.slab_obj_num = ZIP_CACHE_SLAB_OBJ_NUM;
+	param.mag_size = ZIP_CACHE_MAG_SIZE;
+	param.reap_interval_s = RX_CACHE_REAP_INTERVAL_S;
+	g_zip_cache = slab_cache_create(&param);
+	LOG_ERROR_IF_VAL_TRUE(!g_zip_cache, "slab_cache_create for %s fail.", param.name);
+}
+
+// 首次压缩或解压时创建
+static inline slab_cache_t arpc_zip_cache(void)
+{
+	pthread_once(&g_zip_cache_once, &arpc_zip_cache_init);
+	return g_zip_cache;
+}
+
+// 缓存为进程级，首次接收时创建
+static inline void arpc_rx_cache_once(void)
+{
+	pthread_once(&g_rx_cache_once, &arpc_rx_cache_init);
+}
+
+uint32_t arpc_rx_zero_copy_flags(int borrow_head)
+{
+	if (!IS_SET(g_param.opt.control, ARPC_E_CTRL_RX_ZERO_COPY)) {
+		return 0;
+	}
+	return borrow_head ? (ARPC_RX_FLAG_BORROW_HEAD | ARPC_RX_FLAG_POOL) : ARPC_RX_FLAG_POOL;
+}
 
 int arpc_init_r(struct aprc_option *opt)
 {
+	int ret;
 	struct tp_param p = {0};
 	ARPC_LOG_DEBUG( "arpc_init.");
 	arpc_mutex_lock(&g_param.mutex);
@@ -152,11 +261,23 @@ int arpc_init_r(struct aprc_option *opt)
 	if (opt) {
 		set_user_option(opt, &g_param.opt);
 	}
+	ret = cpu_topo_plan_init(&g_param.plan, (enum cpu_topo_policy)g_param.opt.cpu_bind_policy, 
+							g_param.opt.cpu_list, g_param.opt.cpu_max_num);
+	LOG_ERROR_IF_VAL_TRUE(ret, "cpu_topo_plan_init fail, threads will not be bound.");
 	g_param.thread_pool = NULL;
 	arpc_mutex_unlock(&g_param.mutex);
 	xio_init();
 	set_xio_option(&g_param.opt);
 	arpc_crc_init();
+	fast_clock_init();
+	ARPC_LOG_NOTICE("arpc clock source: %s.", fast_clock_source());
+	if (g_param.opt.trace_sample) {
+		msg_trace_set_sample(g_param.opt.trace_sample);
+	}
+	if (arpc_metrics_enabled(&g_param.opt)) {
+		ret = arpc_metrics_start(&g_param.opt);
+		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_metrics_start fail, metrics will not be exported.");
+	}
 	
 	return 0;
 }
@@ -177,6 +298,8 @@ int arpc_init()
 	xio_init();
 	set_xio_option(&g_param.opt);
 	arpc_crc_init();
+	fast_clock_init();
+	ARPC_LOG_NOTICE("arpc clock source: %s.", fast_clock_source());
 	return 0;
 }
 
@@ -190,19 +313,193 @@ void arpc_finish()
 		return;
 	}
 	g_param.is_init = 0;
+	arpc_metrics_stop();
+	arpc_stat_shm_stop();
 	xio_shutdown();
 }
 
+void arpc_stat_merge(struct arpc_stat_set *dst, const struct arpc_stat_set *src)
+{
+	uint32_t i;
+
+	dst->tx_req += __atomic_load_n(&src->tx_req, __ATOMIC_RELAXED);
+	dst->tx_rsp += __atomic_load_n(&src->tx_rsp, __ATOMIC_RELAXED);
+	dst->tx_ow += __atomic_load_n(&src->tx_ow, __ATOMIC_RELAXED);
+	dst->rx_req += __atomic_load_n(&src->rx_req, __ATOMIC_RELAXED);
+	dst->rx_rsp += __atomic_load_n(&src->rx_rsp, __ATOMIC_RELAXED);
+	dst->rx_ow += __atomic_load_n(&src->rx_ow, __ATOMIC_RELAXED);
+	dst->tx_bytes += __atomic_load_n(&src->tx_bytes, __ATOMIC_RELAXED);
+	dst->rx_bytes += __atomic_load_n(&src->rx_bytes, __ATOMIC_RELAXED);
+	dst->rx_release_err += __atomic_load_n(&src->rx_release_err, __ATOMIC_RELAXED);
+	for (i = 0; i < ARPC_STAT_LAT_MAX; i++) {
+		lat_hist_merge(&dst->lat[i], &src->lat[i]);
+	}
+}
+
+void arpc_stat_export(const struct arpc_stat_set *set, uint32_t conn_num, struct arpc_stats *stats)
+{
+	const struct lat_hist *h;
+	uint32_t i;
+
+	memset(stats, 0, sizeof(struct arpc_stats));
+	stats->conn_num = conn_num;
+	stats->tx_req = set->tx_req;
+	stats->tx_rsp = set->tx_rsp;
+	stats->tx_ow = set->tx_ow;
+	stats->rx_req = set->rx_req;
+	stats->rx_rsp = set->rx_rsp;
+	stats->rx_ow = set->rx_ow;
+	stats->tx_bytes = set->tx_bytes;
+	stats->rx_bytes = set->rx_bytes;
+	stats->rx_release_err = set->rx_release_err;
+	for (i = 0; i < ARPC_STAT_LAT_MAX; i++) {
+		h = &set->lat[i];
+		stats->lat[i].count = h->count;
+		stats->lat[i].avg_ns = h->count ? h->sum_ns / h->count : 0;
+		stats->lat[i].p50_ns = lat_hist_percentile(h, 5000);
+		stats->lat[i].p99_ns = lat_hist_percentile(h, 9900);
+		stats->lat[i].p999_ns = lat_hist_percentile(h, 9990);
+		stats->lat[i].max_ns = h->max_ns;
+	}
+}
+
+void arpc_trace_set_sample(uint32_t sample)
+{
+	msg_trace_set_sample(sample);
+}
+
+int arpc_trace_dump(const char *path)
+{
+	return msg_trace_dump(path);
+}
+
 uint32_t arpc_thread_max_num()
 {
 	return g_param.opt.thread_max_num;
 }
 
+void arpc_work_pool_param(struct tp_param *param)
+{
+	memset(param, 0, sizeof(struct tp_param));
+	param->cpu_max_num = 16;
+	param->thread_init = &arpc_placement_bind_worker;
+	param->name = ARPC_WORK_THREAD_NAME;
+	param->thread_max_num = g_param.opt.thread_max_num;
+	param->thread_min_num = g_param.opt.thread_min_num;
+	param->scale_delay_us = g_param.opt.thread_scale_delay_us;
+	param->idle_timeout_ms = g_param.opt.thread_idle_timeout_ms;
+}
+
 uint32_t arpc_cpu_max_num()
 {
 	return g_param.opt.cpu_max_num;
 }
 
+static __thread int g_worker_index = -1;		/* 当前线程作为工作线程的序号 */
+static __thread int g_thread_node = -1;			/* 当前线程绑定的NUMA节点，-1为未绑定到单个节点 */
+
+int arpc_placement_pick(int *cpu, int *node)
+{
+	uint32_t index;
+	int c;
+
+	if (g_param.plan.policy == CPU_TOPO_POLICY_NONE) {
+		*cpu = -1;
+		*node = -1;
+		return ARPC_ERROR;
+	}
+	index = __atomic_fetch_add(&g_param.loop_seq, 1, __ATOMIC_RELAXED);
+	c = cpu_topo_plan_cpu(&g_param.plan, index);
+	*cpu = c;
+	*node = (c >= 0)? cpu_topo_cpu_node(c) : -1;
+	return (c >= 0)? ARPC_SUCCESS : ARPC_ERROR;
+}
+
+int arpc_placement_bind_loop(int cpu)
+{
+	int ret;
+	int node;
+
+	if (cpu < 0 || g_param.plan.policy == CPU_TOPO_POLICY_NONE) {
+		return ARPC_SUCCESS;
+	}
+	node = cpu_topo_cpu_node(cpu);
+	if (g_param.plan.policy == CPU_TOPO_POLICY_NUMA) {
+		ret = cpu_topo_bind_node(&g_param.plan, node);
+	}else{
+		ret = cpu_topo_bind_cpu(cpu);
+	}
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "bind loop thread to cpu[%d] node[%d] fail.", cpu, node);
+	g_thread_node = node;
+	ARPC_LOG_DEBUG("loop thread[%lu] bind to cpu[%d] node[%d].", pthread_self(), cpu, node);
+	return ARPC_SUCCESS;
+}
+
+void arpc_placement_bind_worker(uint32_t thread_index, void *init_ctx)
+{
+	int ret;
+	int cpu;
+
+	if (g_param.plan.policy == CPU_TOPO_POLICY_NONE) {
+		return;
+	}
+	// 多个线程池共用一个序号，保证各节点上的工作线程数均衡
+	if (g_worker_index < 0) {
+		g_worker_index = (int)__atomic_fetch_add(&g_param.worker_seq, 1, __ATOMIC_RELAXED);
+	}
+	if (g_param.plan.policy == CPU_TOPO_POLICY_NUMA) {
+		cpu = cpu_topo_plan_cpu(&g_param.plan, (uint32_t)g_worker_index);
+		g_thread_node = cpu_topo_cpu_node(cpu);
+		ret = cpu_topo_bind_node(&g_param.plan, g_thread_node);
+	}else{
+		g_thread_node = -1;
+		ret = cpu_topo_bind_plan(&g_param.plan);
+	}
+	LOG_ERROR_IF_VAL_TRUE(ret, "bind work thread[%u] fail.", thread_index);
+	return;
+}
+
+void arpc_placement_restore(void)
+{
+	if (g_worker_index >= 0) {
+		arpc_placement_bind_worker((uint32_t)g_worker_index, NULL);
+	}
+}
+
+void arpc_placement_migrate(int node)
+{
+	int ret;
+	if (node < 0 || node == g_thread_node || g_param.plan.policy == CPU_TOPO_POLICY_NONE) {
+		return;
+	}
+	if (cpu_topo_node_num() <= 1) {
+		return;
+	}
+	ret = cpu_topo_bind_node(&g_param.plan, node);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ;, "migrate thread to node[%d] fail.", node);
+	g_thread_node = node;
+}
+
+void *arpc_numa_alloc(size_t size, int node)
+{
+	if (node < 0 || cpu_topo_node_num() <= 1) {
+		return calloc(1, size);
+	}
+	return xio_numa_alloc(size, node);
+}
+
+void arpc_numa_free(void *ptr, int node)
+{
+	if (!ptr) {
+		return;
+	}
+	if (node < 0 || cpu_topo_node_num() <= 1) {
+		free(ptr);
+		return;
+	}
+	xio_numa_free_ptr(ptr);
+}
+
 int get_uri(const struct arpc_con_info *param, char *uri, uint32_t uri_len)
 {
 	const char *type = NULL, *ip=NULL;
@@ -267,12 +564,20 @@ void debug_printf_msg(struct xio_msg *rsp)
 	return;
 }
 
+// 异步任务先迁移到连接所在的NUMA节点再执行
+static int async_thread_entry(void *usr_ctx)
+{
+	struct arpc_thread_param *param = (struct arpc_thread_param *)usr_ctx;
+	arpc_placement_migrate(param->numa_node);
+	return param->loop(param);
+}
+
 int post_to_async_thread(struct arpc_thread_param *param)
 {
 	struct tp_thread_work thread;
 	LOG_THEN_RETURN_VAL_IF_TRUE((!param), ARPC_ERROR, "param null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!param->loop), ARPC_ERROR, "loop null.");
-	thread.loop = param->loop;
+	thread.loop = &async_thread_entry;
 	thread.stop = NULL;
 	thread.usr_ctx = (void*)param;
 	if(!tp_post_one_work(param->threadpool, &thread, WORK_DONE_AUTO_FREE)){
@@ -282,6 +587,16 @@ int post_to_async_thread(struct arpc_thread_param *param)
 	return 0;
 }
 
+static void free_rx_sglist(struct xio_vmsg *in, struct xio_iovec_ex *sglist)
+{
+	if (in->pad == RX_SGL_POOL) {
+		slab_cache_free(g_rx_sgl_cache, sglist);
+	} else {
+		arpc_mem_free(sglist, NULL);
+	}
+	in->pad = 0;
+}
+
 int create_xio_msg_usr_buf(struct xio_msg *msg, struct proc_header_func *ops, uint64_t iov_max_len, void *usr_ctx, struct arpc_msg_attr *attr)
 {
 	struct xio_iovec_ex	*sglist =NULL;
@@ -343,7 +658,17 @@ int create_xio_msg_usr_buf(struct xio_msg *msg, struct proc_header_func *ops, ui
 	last_size = msg->in.total_data_len%iov_max_len;
 	nents = (last_size)? 1: 0;
 	nents += (msg->in.total_data_len / iov_max_len);
-	sglist = (struct xio_iovec_ex* )arpc_mem_alloc(nents * sizeof(struct xio_iovec_ex), NULL);
+	arpc_rx_cache_once();
+	if (nents <= RX_SGL_CACHE_NENTS && g_rx_sgl_cache) {
+		sglist = (struct xio_iovec_ex* )slab_cache_alloc(g_rx_sgl_cache);	// 本线程magazine内无锁
+		msg->in.pad = RX_SGL_POOL;
+	}
+	if (!sglist) {
+		sglist = (struct xio_iovec_ex* )arpc_mem_alloc(nents * sizeof(struct xio_iovec_ex), NULL);
+		msg->in.pad = RX_SGL_ALLOC;
+	}
+	LOG_THEN_RETURN_VAL_IF_TRUE((!sglist), ARPC_ERROR, "alloc sglist fail, nents[%u].", nents);
+	memset(sglist, 0, nents * sizeof(struct xio_iovec_ex));
 	last_size = (last_size)? last_size :iov_max_len;
 
 	ARPC_LOG_DEBUG("get msg, nent:%u, iov_max_len:%lu, total_size:%lu, sglist:%p", nents, iov_max_len, msg->in.total_data_len, sglist);
@@ -373,7 +698,7 @@ error_1:
 		sglist[i].iov_base =NULL;
 	}
 	if (sglist) {
-		arpc_mem_free(sglist, NULL);
+		free_rx_sglist(&msg->in, sglist);
 		sglist = NULL;
 	}
 	msg->in.sgl_type = XIO_SGL_TYPE_IOV;
@@ -401,7 +726,7 @@ int destroy_xio_msg_usr_buf(struct xio_msg *msg, mem_free_cb_t free_cb, void *us
 			sglist[i].iov_len = 0;
 		}
 		if (sglist){
-			arpc_mem_free(sglist, NULL);
+			free_rx_sglist(&msg->in, sglist);
 		}
 		vmsg_sglist_set_nents(&msg->in, 0);
 		msg->in.pdata_iov.sglist = NULL;
@@ -421,7 +746,8 @@ static int unpack_msg_head(uint8_t *rx_head, uint32_t rx_head_len, struct arpc_m
 	int32_t index = 0;
 	int32_t ret;
 
-	if (rx_head_len < 2 * sizeof(struct arpc_tlv) + sizeof(struct arpc_msg_attr)) {
+	// 旧版本对端的属性里没有csum_type
+	if (rx_head_len < 2 * sizeof(struct arpc_tlv) + offsetof(struct arpc_msg_attr, csum_type)) {
 		return -1;
 	}
 	index = arpc_read_tlv(&tlv_type, &req_len, &req_addr, rx_head);
@@ -453,15 +779,177 @@ static void hexdump(char *addr, uint64_t len)
 	return;
 }
 
-int move_msg_xio2arpc(struct xio_vmsg *xio_msg, struct arpc_vmsg *msg, struct arpc_msg_attr *attr)
+/* 解压时在压缩数据sglist上的读位置 */
+struct rx_zip_cursor {
+	struct xio_iovec_ex	*sglist;
+	uint32_t			nents;
+	uint32_t			si;
+	uint64_t			off;
+};
+
+// 数据在当前段内连续时直接返回地址，跨段时拷贝到tmp；数据不足返回NULL
+static const uint8_t *rx_zip_read(struct rx_zip_cursor *cur, uint32_t len, uint8_t *tmp)
+{
+	const uint8_t *ptr;
+	uint32_t done = 0;
+	uint64_t n;
+
+	while (cur->si < cur->nents && cur->off >= cur->sglist[cur->si].iov_len) {
+		cur->si++;
+		cur->off = 0;
+	}
+	if (cur->si >= cur->nents) {
+		return NULL;
+	}
+	if (cur->sglist[cur->si].iov_len - cur->off >= len) {
+		ptr = (const uint8_t *)cur->sglist[cur->si].iov_base + cur->off;
+		cur->off += len;
+		return ptr;
+	}
+	while (done < len) {
+		if (cur->si >= cur->nents) {
+			return NULL;
+		}
+		n = cur->sglist[cur->si].iov_len - cur->off;
+		n = (n < len - done) ? n : len - done;
+		memcpy(tmp + done, (const uint8_t *)cur->sglist[cur->si].iov_base + cur->off, n);
+		done += n;
+		cur->off += n;
+		if (cur->off >= cur->sglist[cur->si].iov_len) {
+			cur->si++;
+			cur->off = 0;
+		}
+	}
+	return tmp;
+}
+
+// 解压后需要的vec数，属性非法时返回0
+static uint32_t rx_zip_vec_num(const struct arpc_msg_attr *proto, const struct arpc_rx_zip_buf *zbuf)
+{
+	uint64_t per_blk;
+	uint64_t last;
+
+	if (proto->zip_type != ARPC_ZIP_LZ || !zbuf || !zbuf->alloc_cb || !zbuf->free_cb || !zbuf->iov_max_len) {
+		return 0;
+	}
+	if (!proto->zip_blk_len || proto->zip_blk_len > ZIP_BLK_LEN || !proto->zip_raw_len ||
+		proto->zip_raw_len > get_option()->msg_data_max_len) {
+		return 0;
+	}
+	per_blk = (proto->zip_blk_len + zbuf->iov_max_len - 1) / zbuf->iov_max_len;
+	last = proto->zip_raw_len % proto->zip_blk_len;
+	return (uint32_t)((proto->zip_raw_len / proto->zip_blk_len) * per_blk + (last + zbuf->iov_max_len - 1) / zbuf->iov_max_len);
+}
+
+/*
+ * 逐帧解压到alloc_cb申请的vec：一帧不超过iov_max_len时直接解压进vec，否则先解压到帧缓冲再切分。
+ * 成功后压缩数据段由free_cb释放；失败时释放已解压的vec，压缩数据仍留在sglist里由destroy_xio_msg_usr_buf回收。
+ */
+static int rx_unzip_data(struct xio_iovec_ex *sglist, uint32_t nents, const struct arpc_msg_attr *proto,
+						 const struct arpc_rx_zip_buf *zbuf, struct arpc_vmsg *msg, uint32_t vec_max)
+{
+	struct rx_zip_cursor cur = {sglist, nents, 0, 0};
+	struct arpc_zip_frame frame;
+	uint8_t head[ZIP_FRAME_LEN];
+	slab_cache_t cache = arpc_zip_cache();
+	uint8_t *in_tmp = NULL;
+	uint8_t *out_tmp = NULL;
+	const uint8_t *in;
+	uint8_t *dst;
+	uint64_t done = 0;
+	uint32_t off, n;
+	uint32_t i;
+	int ret = ARPC_ERROR;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, ARPC_ERROR, "zip cache null.");
+	in_tmp = (uint8_t *)slab_cache_alloc(cache);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!in_tmp, end, "alloc zip frame buf fail.");
+	msg->vec_num = 0;
+	msg->total_data = 0;
+	while (done < proto->zip_raw_len) {
+		in = rx_zip_read(&cur, ZIP_FRAME_LEN, head);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!in, end, "zip frame head truncated, done[%lu].", done);
+		unpack_zip_frame(in, ZIP_FRAME_LEN, &frame);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!frame.raw_len || frame.raw_len > proto->zip_blk_len ||
+										frame.raw_len > proto->zip_raw_len - done ||
+										!frame.zip_len || frame.zip_len > frame.raw_len),
+									end, "zip frame invalid, raw[%u], zip[%u].", frame.raw_len, frame.zip_len);
+		in = rx_zip_read(&cur, frame.zip_len, in_tmp);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!in, end, "zip frame data truncated, zip[%u].", frame.zip_len);
+		if (frame.raw_len <= zbuf->iov_max_len) {
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(msg->vec_num >= vec_max, end, "zip vec over[%u].", vec_max);
+			dst = (uint8_t *)zbuf->alloc_cb(zbuf->iov_max_len, zbuf->usr_ctx);
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!dst, end, "alloc_cb fail.");
+			msg->vec[msg->vec_num].data = dst;
+			msg->vec[msg->vec_num].len = frame.raw_len;
+			msg->vec_num++;
+		} else {
+			if (!out_tmp) {
+				out_tmp = (uint8_t *)slab_cache_alloc(cache);
+				LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!out_tmp, end, "alloc zip frame buf fail.");
+			}
+			dst = out_tmp;
+		}
+		if (frame.zip_len == frame.raw_len) {
+			memcpy(dst, in, frame.raw_len);
+		} else {
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(lz_decompress(in, frame.zip_len, dst, frame.raw_len), end,
+										"lz_decompress fail, raw[%u], zip[%u].", frame.raw_len, frame.zip_len);
+		}
+		for (off = 0; dst == out_tmp && off < frame.raw_len; off += n) {
+			n = frame.raw_len - off;
+			n = (n < zbuf->iov_max_len) ? n : (uint32_t)zbuf->iov_max_len;
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(msg->vec_num >= vec_max, end, "zip vec over[%u].", vec_max);
+			msg->vec[msg->vec_num].data = zbuf->alloc_cb(zbuf->iov_max_len, zbuf->usr_ctx);
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!msg->vec[msg->vec_num].data, end, "alloc_cb fail.");
+			memcpy(msg->vec[msg->vec_num].data, out_tmp + off, n);
+			msg->vec[msg->vec_num].len = n;
+			msg->vec_num++;
+		}
+		done += frame.raw_len;
+	}
+	msg->total_data = done;
+	for (i = 0; i < nents; i++) {
+		if (sglist[i].iov_base) {
+			zbuf->free_cb(sglist[i].iov_base, zbuf->usr_ctx);
+		}
+		sglist[i].iov_base = NULL;
+		sglist[i].iov_len = 0;
+	}
+	ret = 0;
+end:
+	if (in_tmp) {
+		slab_cache_free(cache, in_tmp);
+	}
+	if (out_tmp) {
+		slab_cache_free(cache, out_tmp);
+	}
+	if (ret) {
+		for (i = 0; i < msg->vec_num; i++) {
+			zbuf->free_cb(msg->vec[i].data, zbuf->usr_ctx);
+			msg->vec[i].data = NULL;
+		}
+		msg->vec_num = 0;
+		msg->total_data = 0;
+	}
+	return ret;
+}
+
+int move_msg_xio2arpc(struct xio_vmsg *xio_msg, struct arpc_vmsg *msg, struct arpc_msg_attr *attr, uint32_t *rx_flags,
+					  const struct arpc_rx_zip_buf *zbuf)
 {
 	struct xio_iovec_ex  *sglist = NULL;
 	uint32_t			nents = 0;
+	uint32_t			vec_need = 0;
 	uint32_t 			i;
 	int 				ret;
-	uint64_t 			crc = 0;
+	int					zipped;
 	void 				*usr_addr;
 	struct arpc_msg_attr proto = {0};
+	struct arpc_rx_hold *hold = NULL;
+	uint32_t			allow = rx_flags ? *rx_flags : 0;
+	uint32_t			used = 0;
+	int					do_crc = 0;
 	
 	LOG_THEN_RETURN_VAL_IF_TRUE((!xio_msg), ARPC_ERROR, "xio_msg null, exit.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!msg), ARPC_ERROR, "msg null, exit.");
@@ -471,64 +959,120 @@ int move_msg_xio2arpc(struct xio_vmsg *xio_msg, struct arpc_vmsg *msg, struct ar
 		msg->head_len = xio_msg->header.iov_len;
 		usr_addr = xio_msg->header.iov_base;
 	}
+	// 两边都开启crc才有意义，未开启时不遍历数据；允许推迟时由调用者在工作线程校验
+	do_crc = (arpc_crc_enable() && proto.req_crc && !IS_SET(allow, ARPC_RX_FLAG_DEFER_CRC));
+	nents = vmsg_sglist_nents(xio_msg);
+	zipped = (proto.zip_type != ARPC_ZIP_NONE && nents && xio_msg->sgl_type == XIO_SGL_TYPE_IOV_PTR);
+	vec_need = zipped ? rx_zip_vec_num(&proto, zbuf) : nents;
+	if (IS_SET(allow, ARPC_RX_FLAG_POOL)) {
+		arpc_rx_cache_once();
+		if (vec_need <= RX_HOLD_VEC_NUM && g_rx_hold_cache) {
+			hold = (struct arpc_rx_hold *)slab_cache_alloc(g_rx_hold_cache);
+		}
+		if (hold) {
+			used |= ARPC_RX_FLAG_POOL;
+		}
+	}
 
 	if (msg->head_len) {
-		msg->head = arpc_mem_alloc(msg->head_len, NULL);
-		memcpy(msg->head, usr_addr, msg->head_len);
-		crc = arpc_cal_crc64(crc, (const unsigned char *)msg->head, msg->head_len);
+		if (IS_SET(allow, ARPC_RX_FLAG_BORROW_HEAD)) {
+			msg->head = usr_addr;	// 直接使用xio接收缓冲
+			used |= ARPC_RX_FLAG_BORROW_HEAD;
+		} else if (hold && msg->head_len <= RX_HOLD_HEAD_LEN) {
+			msg->head = hold->head;
+			memcpy(msg->head, usr_addr, msg->head_len);
+		} else {
+			msg->head = arpc_mem_alloc(msg->head_len, NULL);
+			memcpy(msg->head, usr_addr, msg->head_len);
+		}
 	}
-	nents = vmsg_sglist_nents(xio_msg);
 	msg->total_data = 0;
-	msg->vec =NULL;
+	msg->vec = hold ? hold->vec : NULL;	// 容器随vec指针一起释放，无数据时也保持
 	msg->vec_num = 0;
 	if (nents && (xio_msg->sgl_type == XIO_SGL_TYPE_IOV_PTR)){
 		sglist = vmsg_sglist(xio_msg);
-		msg->vec = (struct arpc_iov *)arpc_mem_alloc(nents * sizeof(struct arpc_iov), NULL);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!vec_need), fail_out, "zip attr invalid, type[%u], raw[%u], blk[%u].",
+									proto.zip_type, proto.zip_raw_len, proto.zip_blk_len);
+		if (!hold) {
+			msg->vec = (struct arpc_iov *)arpc_mem_alloc(vec_need * sizeof(struct arpc_iov), NULL);
+		}
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!msg->vec), fail_out,"vec alloc is empty.");
-		for(i = 0; i < nents; i++){
-			msg->vec[i].data = sglist[i].iov_base;
-			msg->vec[i].len	= sglist[i].iov_len;
-			msg->total_data +=msg->vec[i].len;
-			crc = arpc_cal_crc64(crc, (const unsigned char *)msg->vec[i].data, msg->vec[i].len);
-			sglist[i].iov_base = NULL;
-			sglist[i].iov_len = 0; 
-			ARPC_ASSERT(msg->vec[i].data, "vec[%u].data null, but nents:%u", i, nents);
-			ARPC_ASSERT(msg->vec[i].len, "vec[%u].len 0, but nents:%u", i, nents);
+		if (zipped) {
+			ret = rx_unzip_data(sglist, nents, &proto, zbuf, msg, vec_need);
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, fail_out, "unzip data fail.");
+		} else {
+			for(i = 0; i < nents; i++){
+				msg->vec[i].data = sglist[i].iov_base;
+				msg->vec[i].len	= sglist[i].iov_len;
+				msg->total_data +=msg->vec[i].len;
+				sglist[i].iov_base = NULL;
+				sglist[i].iov_len = 0; 
+				ARPC_ASSERT(msg->vec[i].data, "vec[%u].data null, but nents:%u", i, nents);
+				ARPC_ASSERT(msg->vec[i].len, "vec[%u].len 0, but nents:%u", i, nents);
+			}
+			msg->vec_num = nents;
 		}
-		msg->vec_num = nents;
 		vmsg_sglist_set_nents(xio_msg, 0);
 		msg->vec_type = ARPC_VEC_TYPE_PRT;
 	}else{
 		if (!msg->head_len) {
 			ARPC_LOG_ERROR("no header and data in msg.");
 		}
-		msg->vec_type = ARPC_VEC_TYPE_NONE;
+		msg->vec_type = hold ? ARPC_VEC_TYPE_PRT : ARPC_VEC_TYPE_NONE;
 	}
 	if (attr){
 		*attr = proto;
 	}
-	ARPC_LOG_DEBUG("rx crc:0x%lx, cal crc:0x%lx", proto.req_crc, crc);
-	if (crc && proto.req_crc){
-		// 确保两边都开启crc才有意义,0 默认不开启
-		ARPC_ASSERT(proto.req_crc == crc, "crc check fail, rx crc:0x%lx, but cal crc:0x%lx.",
-											proto.req_crc,
-											crc);
-		LOG_THEN_GOTO_TAG_IF_VAL_TRUE((proto.req_crc != crc), fail_out, 
-									"crc check fail, rx crc:0x%lx, but cal crc:0x%lx.", 
-									proto.req_crc, 
-									crc);
+	if (rx_flags){
+		*rx_flags = used;
+	}
+	// 校验的是压缩前的数据，压缩消息解压后才能校验
+	if (do_crc) {
+		ret = arpc_rx_crc_verify(msg, proto.csum_type, proto.req_crc);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, fail_out, "rx crc verify fail.");
 	}
 	return 0;
 fail_out:
-	SAFE_FREE_MEM(msg->head);
+	for (i = 0; zbuf && zbuf->free_cb && msg->vec && i < msg->vec_num; i++) {
+		zbuf->free_cb(msg->vec[i].data, zbuf->usr_ctx);	// 数据已移出sglist，由这里归还
+	}
+	release_msg_xio2arpc(msg, used);
+	if (!used) {
+		SAFE_FREE_MEM(msg->head);
+		SAFE_FREE_MEM(msg->vec);
+	}
 	msg->head_len = 0;
-	SAFE_FREE_MEM(msg->vec);
 	msg->vec_num = 0;
 	msg->total_data = 0;
+	if (rx_flags){
+		*rx_flags = 0;
+	}
 	return 0;
 }
 
-void free_msg_xio2arpc(struct arpc_vmsg *msg, mem_free_cb_t free_cb, void *usr_ctx)
+void release_msg_xio2arpc(struct arpc_vmsg *msg, uint32_t rx_flags)
+{
+	struct arpc_rx_hold *hold;
+
+	if (!msg || !rx_flags) {
+		return;
+	}
+	hold = IS_SET(rx_flags, ARPC_RX_FLAG_POOL) ? (struct arpc_rx_hold *)msg->vec : NULL;
+	if (!IS_SET(rx_flags, ARPC_RX_FLAG_BORROW_HEAD) && msg->head && (!hold || msg->head != hold->head)) {
+		arpc_mem_free(msg->head, NULL);
+	}
+	msg->head = NULL;
+	if (hold) {
+		slab_cache_free(g_rx_hold_cache, hold);
+	} else if (msg->vec_type == ARPC_VEC_TYPE_PRT) {
+		SAFE_FREE_MEM(msg->vec);
+	}
+	msg->vec = NULL;
+	msg->vec_num = 0;
+	msg->vec_type = ARPC_VEC_TYPE_NONE;
+}
+
+void free_msg_xio2arpc(struct arpc_vmsg *msg, mem_free_cb_t free_cb, void *usr_ctx, uint32_t rx_flags)
 {
 	int i;
 	LOG_THEN_RETURN_IF_VAL_TRUE((!msg), "msg null, exit.");
@@ -542,89 +1086,309 @@ void free_msg_xio2arpc(struct arpc_vmsg *msg, mem_free_cb_t free_cb, void *usr_c
 			}
 			msg->vec[i].len = 0;
 		}
-		SAFE_FREE_MEM(msg->vec);
+		if (!rx_flags) {
+			SAFE_FREE_MEM(msg->vec);
+			msg->vec_type = ARPC_VEC_TYPE_NONE;
+		}
 		msg->vec_num =0;
 		msg->total_data =0;
-		msg->vec_type = ARPC_VEC_TYPE_NONE;
+	}
+	if (rx_flags) {
+		release_msg_xio2arpc(msg, rx_flags);
+		return;
 	}
 	SAFE_FREE_MEM(msg->head);
 	return;
 }
 
-int convert_msg_arpc2xio(const struct arpc_vmsg *usr_msg, struct xio_vmsg *xio_msg, struct arpc_msg_attr *attr)
+int arpc_rx_crc_verify(const struct arpc_vmsg *msg, uint32_t csum_type, uint64_t expect_crc)
+{
+	uint64_t crc = 0;
+	uint32_t i;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!msg), ARPC_ERROR, "msg null, exit.");
+	if (!expect_crc || !arpc_crc_enable()) {
+		return 0;
+	}
+	if (msg->head_len) {
+		crc = csum_calc((enum csum_type)csum_type, crc, msg->head, msg->head_len);
+	}
+	for (i = 0; i < msg->vec_num; i++) {
+		crc = csum_calc((enum csum_type)csum_type, crc, msg->vec[i].data, msg->vec[i].len);
+	}
+	ARPC_ASSERT(expect_crc == crc, "crc check fail, rx crc:0x%lx, but cal crc:0x%lx.", expect_crc, crc);
+	LOG_THEN_RETURN_VAL_IF_TRUE((expect_crc != crc), ARPC_ERROR,
+								"crc check fail, rx crc:0x%lx, but cal crc:0x%lx.", expect_crc, crc);
+	return 0;
+}
+
+/* 发送描述符中的xio_vmsg.pad记录sglist/header的来源 */
+#define TX_SGL_HEAP		(1<<0)
+#define TX_HEAD_HEAP	(1<<1)
+#define TX_SGL_ZIP		(1<<2)	/* sglist里有压缩帧缓冲，由user_context标记 */
+
+/* 压缩时在用户vec上的读位置 */
+struct tx_zip_cursor {
+	const struct arpc_vmsg	*msg;
+	uint32_t				vi;
+	uint64_t				off;
+};
+
+static void tx_zip_skip(struct tx_zip_cursor *cur, uint64_t len)
+{
+	cur->off += len;
+	while (cur->vi < cur->msg->vec_num && cur->off >= cur->msg->vec[cur->vi].len) {
+		cur->off -= cur->msg->vec[cur->vi].len;
+		cur->vi++;
+	}
+}
+
+// 一块数据落在单个vec内时直接返回地址，跨vec时拷贝到tmp，tmp为空返回NULL；不移动读位置
+static const uint8_t *tx_zip_peek(const struct tx_zip_cursor *cur, uint32_t len, uint8_t *tmp)
+{
+	const struct arpc_iov *vec = cur->msg->vec;
+	uint32_t vi = cur->vi;
+	uint64_t off = cur->off;
+	uint32_t done = 0;
+	uint64_t n;
+
+	if (vec[vi].len - off >= len) {
+		return (const uint8_t *)vec[vi].data + off;
+	}
+	if (!tmp) {
+		return NULL;
+	}
+	while (done < len && vi < cur->msg->vec_num) {
+		n = vec[vi].len - off;
+		n = (n < len - done) ? n : len - done;
+		memcpy(tmp + done, (const uint8_t *)vec[vi].data + off, n);
+		done += n;
+		vi++;
+		off = 0;
+	}
+	return tmp;
+}
+
+static void tx_zip_release(struct xio_iovec_ex *sglist, uint32_t nents)
+{
+	uint32_t i;
+
+	for (i = 0; i < nents; i++) {
+		if (sglist[i].user_context == (void *)g_zip_cache && sglist[i].iov_base) {
+			slab_cache_free(g_zip_cache, sglist[i].iov_base);
+		}
+		sglist[i].iov_base = NULL;
+		sglist[i].user_context = NULL;
+	}
+}
+
+/*
+ * 按ZIP_BLK_LEN分块压缩到帧缓冲，sglist依次为各帧；某块不可压缩时帧头后直接引用用户数据。
+ * 累计节省不足1/8时尽早放弃，返回-1由调用者原样发送，不可压缩的数据最多只多压一块。
+ */
+static int tx_zip_data(const struct arpc_vmsg *usr_msg, uint64_t raw_len, struct xio_vmsg *xio_msg)
+{
+	struct xio_iovec_ex *sglist = xio_msg->data_iov.sglist;
+	struct tx_zip_cursor cur = {usr_msg, 0, 0};
+	struct arpc_zip_frame frame;
+	slab_cache_t cache = arpc_zip_cache();
+	uint8_t *buf;
+	uint8_t *tmp = NULL;
+	const uint8_t *src;
+	uint64_t done = 0;
+	uint64_t wire = 0;
+	uint64_t remain, piece;
+	uint32_t nents = 0;
+
+	if (!cache) {
+		return -1;
+	}
+	while (done < raw_len) {
+		frame.raw_len = (raw_len - done < ZIP_BLK_LEN) ? (uint32_t)(raw_len - done) : ZIP_BLK_LEN;
+		if (nents >= XIO_IOVLEN) {
+			goto bypass;
+		}
+		buf = (uint8_t *)slab_cache_alloc(cache);	// 本线程magazine内无锁
+		if (!buf) {
+			goto bypass;
+		}
+		sglist[nents].iov_base = buf;
+		sglist[nents].iov_len = ZIP_FRAME_LEN;
+		sglist[nents].mr = NULL;
+		sglist[nents].user_context = (void *)cache;
+		nents++;
+
+		src = tx_zip_peek(&cur, frame.raw_len, tmp);
+		if (!src) {
+			tmp = (uint8_t *)slab_cache_alloc(cache);
+			if (!tmp) {
+				goto bypass;
+			}
+			src = tx_zip_peek(&cur, frame.raw_len, tmp);
+		}
+		frame.zip_len = lz_compress(src, frame.raw_len, buf + ZIP_FRAME_LEN,
+									frame.raw_len - (frame.raw_len >> ZIP_SAVE_SHIFT));
+		if (frame.zip_len) {
+			sglist[nents - 1].iov_len += frame.zip_len;
+			tx_zip_skip(&cur, frame.raw_len);
+		} else {
+			frame.zip_len = frame.raw_len;
+			for (remain = frame.raw_len; remain; remain -= piece) {
+				if (nents >= XIO_IOVLEN) {
+					goto bypass;
+				}
+				piece = usr_msg->vec[cur.vi].len - cur.off;
+				piece = (piece < remain) ? piece : remain;
+				sglist[nents].iov_base = (uint8_t *)usr_msg->vec[cur.vi].data + cur.off;
+				sglist[nents].iov_len = piece;
+				sglist[nents].mr = NULL;
+				sglist[nents].user_context = NULL;
+				nents++;
+				tx_zip_skip(&cur, piece);
+			}
+		}
+		pack_zip_frame(&frame, buf, ZIP_FRAME_LEN);
+		done += frame.raw_len;
+		wire += ZIP_FRAME_LEN + frame.zip_len;
+		if (wire > done - (done >> ZIP_SAVE_SHIFT)) {
+			goto bypass;
+		}
+	}
+	if (tmp) {
+		slab_cache_free(cache, tmp);
+	}
+	xio_msg->sgl_type = XIO_SGL_TYPE_IOV;
+	xio_msg->data_iov.max_nents = XIO_IOVLEN;
+	xio_msg->data_iov.nents = nents;
+	xio_msg->total_data_len = wire;
+	xio_msg->pad |= TX_SGL_ZIP;
+	return 0;
+bypass:
+	if (tmp) {
+		slab_cache_free(cache, tmp);
+	}
+	tx_zip_release(sglist, nents);
+	return -1;
+}
+
+int convert_msg_arpc2xio(const struct arpc_vmsg *usr_msg, struct xio_vmsg *xio_msg, struct arpc_msg_attr *attr,
+						 void *head_buf, uint32_t head_buf_len)
 {
 	uint32_t i;
 	uint32_t index = 0;
 	uint8_t  *ptr;
 	uint64_t crc = 0;
+	uint64_t raw_len = 0;
 	struct arpc_msg_attr proto = {0};
-	void *read_add = NULL;
-	uint32_t read_len = 0;
+	struct xio_iovec_ex *sglist;
+	int do_crc = arpc_crc_enable();
 
 	LOG_THEN_RETURN_VAL_IF_TRUE((!attr), ARPC_ERROR, "attr null, exit.");
 	/* header */
-	crc = arpc_cal_crc64(crc, (const unsigned char *)usr_msg->head, usr_msg->head_len);
-	xio_msg->pdata_iov.max_nents = usr_msg->vec_num;
-	xio_msg->pdata_iov.nents = usr_msg->vec_num;
+	if (do_crc) {
+		crc = csum_calc((enum csum_type)attr->csum_type, crc, usr_msg->head, usr_msg->head_len);
+	}
+	// crc按压缩前的数据计算，接收方解压后校验
+	for (i = 0; i < usr_msg->vec_num; i++){
+		ARPC_ASSERT(usr_msg->vec[i].data, "data is null.");
+		ARPC_ASSERT(usr_msg->vec[i].len, "data len is 0.");
+		if (do_crc) {
+			crc = csum_calc((enum csum_type)attr->csum_type, crc, usr_msg->vec[i].data, usr_msg->vec[i].len);
+		}
+		raw_len += usr_msg->vec[i].len;
+	}
+	attr->req_crc = crc;
+	attr->iovec_num = usr_msg->vec_num;
+	proto = *attr;			// attr->zip_type保留会话的压缩配置，实际结果只写到线上
+	proto.zip_type = ARPC_ZIP_NONE;
+	proto.zip_raw_len = 0;
+	proto.zip_blk_len = 0;
+
 	xio_msg->total_data_len = 0;
-	if (xio_msg->pdata_iov.nents) {
-		xio_msg->pdata_iov.sglist = (struct xio_iovec_ex *)arpc_mem_alloc((xio_msg->pdata_iov.nents) * sizeof(struct xio_iovec_ex), NULL);
-		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!xio_msg->pdata_iov.sglist, data_null, "arpc_mem_alloc fail.");
-		memset(xio_msg->pdata_iov.sglist, 0, xio_msg->pdata_iov.nents * sizeof(struct xio_iovec_ex));
-		xio_msg->pad = 1;
-		for (i = 0; i < xio_msg->pdata_iov.nents; i++){
-			ARPC_ASSERT(usr_msg->vec[i].data, "data is null.");
-			ARPC_ASSERT(usr_msg->vec[i].len, "data len is 0.");
-			xio_msg->pdata_iov.sglist[i].iov_base = usr_msg->vec[i].data;
-			xio_msg->pdata_iov.sglist[i].iov_len = usr_msg->vec[i].len;
-			crc = arpc_cal_crc64(crc, (const unsigned char *)usr_msg->vec[i].data, usr_msg->vec[i].len);
-			xio_msg->total_data_len += xio_msg->pdata_iov.sglist[i].iov_len;
-		}
-		xio_msg->sgl_type = XIO_SGL_TYPE_IOV_PTR;
-		ARPC_ASSERT(xio_msg->total_data_len <= DATA_DEFAULT_MAX_LEN, "total_data_len is over.");
+	xio_msg->pad = 0;
+	if (attr->zip_type == ARPC_ZIP_LZ && raw_len >= ZIP_MIN_LEN && !tx_zip_data(usr_msg, raw_len, xio_msg)) {
+		proto.zip_type = ARPC_ZIP_LZ;
+		proto.zip_raw_len = (uint32_t)raw_len;
+		proto.zip_blk_len = ZIP_BLK_LEN;
 	}else{
-		xio_msg->sgl_type = XIO_SGL_TYPE_IOV;
-		xio_msg->data_iov.nents = 0;
-		xio_msg->data_iov.max_nents = XIO_IOVLEN;
-		xio_msg->pad = 0;
+		if (usr_msg->vec_num <= XIO_IOVLEN) {
+			// 描述符内嵌的xio_msg自带XIO_IOVLEN个iovec，合法消息都不需要另行申请
+			xio_msg->sgl_type = XIO_SGL_TYPE_IOV;
+			xio_msg->data_iov.max_nents = XIO_IOVLEN;
+			xio_msg->data_iov.nents = usr_msg->vec_num;
+			sglist = xio_msg->data_iov.sglist;
+		}else{
+			// 超出上限的消息随后会被check_xio_msg_valid拒绝，这里仍保证转换本身正确
+			sglist = (struct xio_iovec_ex *)arpc_mem_alloc(usr_msg->vec_num * sizeof(struct xio_iovec_ex), NULL);
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!sglist, data_null, "arpc_mem_alloc fail.");
+			xio_msg->sgl_type = XIO_SGL_TYPE_IOV_PTR;
+			xio_msg->pdata_iov.max_nents = usr_msg->vec_num;
+			xio_msg->pdata_iov.nents = usr_msg->vec_num;
+			xio_msg->pdata_iov.sglist = sglist;
+			xio_msg->pad |= TX_SGL_HEAP;
+		}
+		for (i = 0; i < usr_msg->vec_num; i++){
+			sglist[i].iov_base = usr_msg->vec[i].data;
+			sglist[i].iov_len = usr_msg->vec[i].len;
+			sglist[i].mr = NULL;
+			sglist[i].user_context = NULL;
+		}
+		xio_msg->total_data_len = raw_len;
 	}
+	ARPC_ASSERT(xio_msg->total_data_len <= DATA_DEFAULT_MAX_LEN, "total_data_len is over.");
 
-	attr->req_crc = crc;
-	attr->iovec_num = usr_msg->vec_num;
 	xio_msg->header.iov_len = 2 * sizeof(struct arpc_tlv) + sizeof(struct arpc_msg_attr) + usr_msg->head_len;
-	xio_msg->header.iov_base = arpc_mem_alloc(xio_msg->header.iov_len, NULL);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!xio_msg->header.iov_base, data_null, "arpc_mem_alloc head buf fail.");
+	if (head_buf && xio_msg->header.iov_len <= head_buf_len) {
+		xio_msg->header.iov_base = head_buf;
+	}else{
+		xio_msg->header.iov_base = arpc_mem_alloc(xio_msg->header.iov_len, NULL);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!xio_msg->header.iov_base, data_null, "arpc_mem_alloc head buf fail.");
+		xio_msg->pad |= TX_HEAD_HEAP;
+	}
 
 	ptr = xio_msg->header.iov_base;
 	index = arpc_write_tlv(ARPC_PROTO_MSG_INTER_HEAD, sizeof(struct arpc_msg_attr), ptr);
 	ptr += sizeof(struct arpc_tlv);
-	pack_msg_attr(attr, ptr, sizeof(struct arpc_msg_attr));
+	pack_msg_attr(&proto, ptr, sizeof(struct arpc_msg_attr));
 
 	ptr = (uint8_t*)xio_msg->header.iov_base + index;
 	index = arpc_write_tlv(ARPC_PROTO_MSG_USER_HEAD, usr_msg->head_len, ptr);
 	ptr += sizeof(struct arpc_tlv);
 	memcpy(ptr, usr_msg->head, usr_msg->head_len);
-	ARPC_LOG_DEBUG("send crc:0x%lx", crc);
+	ARPC_LOG_DEBUG("send crc:0x%lx, zip[%u], raw len[%lu], tx len[%lu]", crc, proto.zip_type, raw_len,
+					xio_msg->total_data_len);
 	return 0;
 data_null:
+	if (xio_msg->pad & TX_SGL_HEAP) {
+		SAFE_FREE_MEM(xio_msg->pdata_iov.sglist);
+	}
+	if (xio_msg->pad & TX_SGL_ZIP) {
+		tx_zip_release(xio_msg->data_iov.sglist, xio_msg->data_iov.nents);
+	}
 	xio_msg->header.iov_base = 0;
 	xio_msg->header.iov_len = 0;
-	xio_msg->pdata_iov.max_nents =0;
-	xio_msg->pdata_iov.nents = 0;
-	xio_msg->pdata_iov.sglist = NULL;
+	xio_msg->sgl_type = XIO_SGL_TYPE_IOV;
+	xio_msg->data_iov.max_nents = XIO_IOVLEN;
+	xio_msg->data_iov.nents = 0;
+	xio_msg->pad = 0;
 	return -1;
 }
 
 void free_msg_arpc2xio(struct xio_vmsg *xio_msg)
 {
-	struct xio_msg 	*req = NULL;
-	if ((xio_msg->pad) && xio_msg->pdata_iov.sglist){
+	if ((xio_msg->pad & TX_SGL_HEAP) && xio_msg->sgl_type == XIO_SGL_TYPE_IOV_PTR){
 		SAFE_FREE_MEM(xio_msg->pdata_iov.sglist);
-		vmsg_sglist_set_nents(xio_msg, 0);
-		xio_msg->pad = 0;
 	}
-	SAFE_FREE_MEM(xio_msg->header.iov_base);
+	if ((xio_msg->pad & TX_SGL_ZIP) && xio_msg->sgl_type == XIO_SGL_TYPE_IOV){
+		tx_zip_release(xio_msg->data_iov.sglist, xio_msg->data_iov.nents);
+	}
+	vmsg_sglist_set_nents(xio_msg, 0);
+	if (xio_msg->pad & TX_HEAD_HEAP) {
+		SAFE_FREE_MEM(xio_msg->header.iov_base);
+	}
+	xio_msg->header.iov_base = NULL;
 	xio_msg->header.iov_len = 0;
+	xio_msg->pad = 0;
 	return;
 }
 
@@ -719,16 +1483,31 @@ int arpc_uri_get_proto(const char *uri, char *proto, int proto_len)
 
 static inline void arpc_crc_init()
 {
-	if(IS_SET(g_param.opt.control, ARPC_E_CTRL_CRC)){
-		crc64_init();
-	}
+	csum_init();
 }
 
-static inline uint64_t arpc_cal_crc64(uint64_t crc, const unsigned char *data, uint64_t len)
+static inline int arpc_crc_enable()
 {
-	if(IS_SET(g_param.opt.control, ARPC_E_CTRL_CRC)){
-		return crc64(crc, data, len);
-	}
-	return 0;
+	return IS_SET(g_param.opt.control, ARPC_E_CTRL_CRC);
+}
+
+uint32_t arpc_csum_hw_mask()
+{
+	return arpc_crc_enable() ? csum_hw_mask() : 0;
+}
+
+uint32_t arpc_csum_select(uint32_t peer_hw_mask)
+{
+	return arpc_crc_enable() ? (uint32_t)csum_select(peer_hw_mask) : (uint32_t)CSUM_TYPE_CRC64;
+}
+
+uint32_t arpc_zip_mask()
+{
+	return IS_SET(g_param.opt.control, ARPC_E_CTRL_ZIP) ? ARPC_ZIP_BIT(ARPC_ZIP_LZ) : 0;
+}
+
+uint32_t arpc_zip_select(uint32_t peer_mask)
+{
+	return (arpc_zip_mask() & peer_mask & ARPC_ZIP_BIT(ARPC_ZIP_LZ)) ? ARPC_ZIP_LZ : ARPC_ZIP_NONE;
 }
 
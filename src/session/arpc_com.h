@@ -24,10 +24,18 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #include "base_log.h"
 #include "queue.h"
 #include "threadpool.h"
+#include "msg_trace.h"
+#include "arpc_stat_shm.h"
 
 #include "libxio.h"
 #include "arpc_api.h"
@@ -83,6 +91,7 @@ static inline void arpc_update_log_status()
 #define IS_SET_REQ(flag) (flag&XIO_MSG_REQ)
 
 #define ARPC_CONN_ID_OFFSET 10
+#define ARPC_CONN_XIO_IDX(id) ((id) + 1)		// 客户端连接在xio中的conn_idx，服务端按它分配工作线程入口
 // 互斥锁
 struct arpc_mutex{
   pthread_mutex_t     lock;	    			/* lock */
@@ -184,13 +193,8 @@ inline static int arpc_cond_wait_timeout(struct arpc_cond *cond, uint64_t timeou
 {
 	int ret;
 	struct timespec abstime;
-	struct timeval now;
-	uint64_t nsec;
 
-	gettimeofday(&now, NULL);	// 线程安全
-	nsec = now.tv_usec * 1000 + (timeout_ms % 1000) * 1000000;
-	abstime.tv_sec=now.tv_sec + nsec / 1000000000 + timeout_ms / 1000;
-	abstime.tv_nsec=nsec % 1000000000;
+	fast_clock_abstime(timeout_ms, &abstime);
 	return pthread_cond_timedwait(&cond->cond, &cond->lock, &abstime);
 }
 
@@ -216,11 +220,184 @@ inline static int arpc_cond_destroy(struct arpc_cond *cond)
 	return 0;
 }
 
+// 一次性完成通知（futex）
+/*
+ * seq为futex字，每完成一次加ARPC_COMP_STEP，永不回退，等待方只比较发送前取得的序号，
+ * 因此描述符被归还复用后，迟到的等待方也不会误判；低两位记录放弃/认领状态。
+ */
+#define ARPC_COMP_ABANDON		(1U<<0)		/* 等待方已超时放弃 */
+#define ARPC_COMP_CLAIM			(1U<<1)		/* 完成方已认领，正在写结果 */
+#define ARPC_COMP_STEP			(1U<<2)
+#define ARPC_COMP_MASK			(ARPC_COMP_STEP - 1)
+
+#define ARPC_COMP_ABANDONED		1
+
+#define ARPC_COMP_SPIN_MIN		64
+#define ARPC_COMP_SPIN_MAX		1024		/* 新架构上PAUSE约百余周期，上限控制在数十微秒内，再长不如睡眠 */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARPC_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define ARPC_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ARPC_CPU_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+struct arpc_completion{
+	uint32_t seq;
+	uint32_t waiters;
+};
+
+inline static void arpc_completion_init(struct arpc_completion *comp)
+{
+	comp->seq = 0;
+	comp->waiters = 0;
+}
+
+// 描述符复用前调用，清掉上一轮残留的状态位
+inline static void arpc_completion_reset(struct arpc_completion *comp)
+{
+	uint32_t cur = __atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE);
+	if (cur & ARPC_COMP_MASK) {
+		__atomic_store_n(&comp->seq, (cur | ARPC_COMP_MASK) + 1, __ATOMIC_RELEASE);
+	}
+}
+
+// 等待方在提交消息前取得本轮序号
+inline static uint32_t arpc_completion_seq(struct arpc_completion *comp)
+{
+	return __atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE) & ~ARPC_COMP_MASK;
+}
+
+inline static int arpc_completion_abandoned(struct arpc_completion *comp)
+{
+	return (__atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE) & ARPC_COMP_ABANDON) != 0;
+}
+
+/*!
+ * @brief  完成方认领，认领后等待方不能再放弃
+ *
+ * @return  0 认领成功；ARPC_COMP_ABANDONED 等待方已放弃，资源由完成方回收
+ */
+inline static int arpc_completion_claim(struct arpc_completion *comp)
+{
+	uint32_t cur = __atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE);
+	for (;;) {
+		if (cur & ARPC_COMP_ABANDON) {
+			return ARPC_COMP_ABANDONED;
+		}
+		if (cur & ARPC_COMP_CLAIM) {
+			return 0;
+		}
+		if (__atomic_compare_exchange_n(&comp->seq, &cur, cur | ARPC_COMP_CLAIM, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return 0;
+		}
+	}
+}
+
+// 完成方发布结果并唤醒，调用后不能再访问等待方的资源
+inline static void arpc_completion_done(struct arpc_completion *comp)
+{
+	uint32_t cur = __atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&comp->seq, (cur & ~ARPC_COMP_MASK) + ARPC_COMP_STEP, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&comp->waiters, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &comp->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+inline static int arpc_complete(struct arpc_completion *comp)
+{
+	int ret = arpc_completion_claim(comp);
+	if (!ret) {
+		arpc_completion_done(comp);
+	}
+	return ret;
+}
+
+/*!
+ * @brief  等待完成
+ *
+ * 先做自适应自旋（本线程上次自旋命中则加倍，落入futex则减半），再以单调时钟超时睡眠
+ *
+ * @param[in] seq 提交前arpc_completion_seq取得的序号
+ * @param[in] timeout_ms 超时时间
+ * @param[in] spin 是否允许自旋
+ * @return  0 已完成；ETIMEDOUT 超时
+ */
+inline static int arpc_completion_wait(struct arpc_completion *comp, uint32_t seq, uint64_t timeout_ms, int spin)
+{
+	static __thread uint32_t spin_budget = ARPC_COMP_SPIN_MIN;
+	struct timespec rel;
+	uint64_t deadline_ns;
+	uint64_t now_ns;
+	uint32_t cur;
+	uint32_t i;
+	int ret = ETIMEDOUT;
+
+	if (spin) {
+		for (i = 0; i < spin_budget; i++) {
+			if ((__atomic_load_n(&comp->seq, __ATOMIC_ACQUIRE) & ~ARPC_COMP_MASK) != seq) {
+				if (spin_budget < ARPC_COMP_SPIN_MAX) {
+					spin_budget <<= 1;
+				}
+				return 0;
+			}
+			ARPC_CPU_RELAX();
+		}
+		if (spin_budget > ARPC_COMP_SPIN_MIN) {
+			spin_budget >>= 1;
+		}
+	}
+
+	deadline_ns = fast_clock_ns() + timeout_ms * 1000000ULL;
+	__atomic_add_fetch(&comp->waiters, 1, __ATOMIC_SEQ_CST);
+	for (;;) {
+		cur = __atomic_load_n(&comp->seq, __ATOMIC_SEQ_CST);
+		if ((cur & ~ARPC_COMP_MASK) != seq) {
+			ret = 0;
+			break;
+		}
+		now_ns = fast_clock_ns();
+		if (now_ns >= deadline_ns) {
+			ret = ETIMEDOUT;
+			break;
+		}
+		rel.tv_sec = (deadline_ns - now_ns) / 1000000000ULL;
+		rel.tv_nsec = (deadline_ns - now_ns) % 1000000000ULL;
+		syscall(SYS_futex, &comp->seq, FUTEX_WAIT_PRIVATE, cur, &rel, NULL, 0);
+	}
+	__atomic_sub_fetch(&comp->waiters, 1, __ATOMIC_SEQ_CST);
+	return ret;
+}
+
+/*!
+ * @brief  等待方超时后放弃
+ *
+ * @return  0 放弃成功，资源转交完成方回收；1 完成方已认领，已等到其完成，按成功处理
+ */
+inline static int arpc_completion_abandon(struct arpc_completion *comp, uint32_t seq)
+{
+	uint32_t cur = seq;
+	if (__atomic_compare_exchange_n(&comp->seq, &cur, seq | ARPC_COMP_ABANDON, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+	// 完成方正在写结果，时间很短，等它结束
+	while (arpc_completion_wait(comp, seq, 1000, 1) == ETIMEDOUT) {
+		;
+	}
+	return 1;
+}
+
 #define ARPC_MINI_IO_DATA_MAX_LEN   (2*1024)
 
 // 最小空闲的线程数
 #define ARPC_MIN_THREAD_IDLE_NUM    (4)
 
+// 线程池分类：loop线程常驻运行xio事件循环，work线程执行消息异步处理，两者互不占用
+#define ARPC_LOOP_THREAD_NAME       "arpc_loop"
+#define ARPC_WORK_THREAD_NAME       "arpc_work"
+#define ARPC_LOOP_THREAD_EXTRA_NUM  (2)			/* loop池除连接/work外的额外线程：守护线程、重连任务 */
+
 struct async_proc_ops{
 	void* (*alloc_cb)(uint32_t size, void* usr_context);
 	int (*free_cb)(void* buf_ptr, void* usr_context);
@@ -261,10 +438,16 @@ struct arpc_thread_param{
 	void					*rsp_ctx;
 	struct xio_msg			*req_msg;
 	struct arpc_vmsg 		rev_iov;
+	uint32_t				rx_flags;			/* rev_iov的零拷贝方式 */
+	uint32_t				rx_csum_type;		/* 推迟到工作线程的校验，rx_crc为0表示无需校验 */
+	uint64_t				rx_crc;
 	struct async_proc_ops	ops;
 	int (*loop)(void *usr_ctx);
 	void 					*threadpool;
+	int32_t					numa_node;			/* 连接所在NUMA节点，-1不迁移 */
 	void					*usr_ctx;
+	uint64_t				trace_id;			/* 消息的追踪id，0未采样 */
+	uint32_t				conn_id;
 };
 
 #define ARPC_COM_MSG_MAGIC 0xfa577
@@ -279,22 +462,129 @@ enum  arpc_msg_status{
 	ARPC_MSG_STATUS_USED,
 	ARPC_MSG_STATUS_TX,
 	ARPC_MSG_STATUS_FREE,
+	ARPC_MSG_STATUS_TX_PUT,		/* 在发送环中被归还，由发送线程出环时回收 */
 };
 
+static inline uint64_t arpc_clock_ns(void)
+{
+	return fast_clock_ns();
+}
+
+// 本轮事件处理开始时的时间，只用于超时、限频等粗粒度判断
+static inline uint64_t arpc_clock_coarse_ns(void)
+{
+	return fast_clock_coarse_ns();
+}
+
+// xio事件循环每轮回调，刷新loop线程的粗粒度时间
+static inline void arpc_loop_tick(void *ctx)
+{
+	(void)fast_clock_tick();
+}
+
+static inline void arpc_stat_lat(struct arpc_stat_set *set, enum arpc_stat_lat_type type, uint64_t start_ns)
+{
+	uint64_t now;
+
+	if (!start_ns) {
+		return;
+	}
+	now = arpc_clock_ns();
+	lat_hist_record(&set->lat[type], (now > start_ns) ? now - start_ns : 0);
+}
+
+// 对端的发送时间是墙上时间，两端时钟不同步时只有相对变化有参考意义；rx_ns为收到消息头时的arpc_clock_ns
+static inline void arpc_stat_wire(struct arpc_stat_set *set, enum arpc_stat_lat_type type, const struct arpc_msg_attr *attr,
+								uint64_t rx_ns)
+{
+	int64_t ns;
+
+	if (!attr->tx_ns) {
+		return;
+	}
+	ns = (int64_t)(fast_clock_to_wall(rx_ns) - attr->tx_ns);
+	lat_hist_record(&set->lat[type], (ns > 0) ? (uint64_t)ns : 0);
+}
+
+/*!
+ * @brief  把src累加到dst，src可以正在被更新
+ */
+void arpc_stat_merge(struct arpc_stat_set *dst, const struct arpc_stat_set *src);
+
+/*!
+ * @brief  转为对外的统计结构，计算分位数
+ */
+void arpc_stat_export(const struct arpc_stat_set *set, uint32_t conn_num, struct arpc_stats *stats);
+
+/*!
+ * @brief  采集一个对象的统计，由发布线程周期调用
+ *
+ * @param[in] obj 注册时的对象
+ * @param[out] data 已清零，计数累加到set，并填写连接数、线程池与连接明细
+ */
+typedef void (*arpc_stat_collect_cb)(void *obj, struct arpc_stat_shm_data *data);
+
+/*!
+ * @brief  是否需要发布统计：开启了ARPC_E_CTRL_STAT_SHM或指标导出
+ */
+int arpc_stat_shm_enabled(void);
+
+/*!
+ * @brief  在统计区登记一个对象，首次登记时建立映射并启动发布线程
+ *
+ * @return  槽位号；未开启统计发布或槽位已满时返回-1，不影响通信
+ */
+int arpc_stat_shm_register(enum arpc_stat_shm_type type, const char *name, arpc_stat_collect_cb collect, void *obj);
+
+/*!
+ * @brief  注销对象，先发布最后一次；返回后发布线程不再访问该对象
+ */
+void arpc_stat_shm_unregister(int index);
+
+/*!
+ * @brief  停止发布线程并删除映射文件
+ */
+void arpc_stat_shm_stop(void);
+
+/*!
+ * @brief  取进程内槽位的一致快照，不加锁，不影响发布线程与数据路径
+ *
+ * @return  0 成功；-1 统计区未建立、槽位未使用或正在写入
+ */
+int arpc_stat_shm_snapshot(uint32_t index, struct arpc_stat_shm_slot *out);
+
+/*!
+ * @brief  选项中是否配置了指标导出地址
+ */
+int arpc_metrics_enabled(const struct aprc_option *opt);
+
+/*!
+ * @brief  启动指标导出线程，在本地TCP端口或unix socket上以Prometheus文本格式输出统计
+ */
+int arpc_metrics_start(const struct aprc_option *opt);
+
+/*!
+ * @brief  停止指标导出线程，关闭监听
+ */
+void arpc_metrics_stop(void);
+
 struct arpc_common_msg {
 	QUEUE 						q;
 	uint32_t					magic;
 	enum	arpc_msg_type		type;
-	struct arpc_cond 			cond;				
+	struct arpc_completion		comp;				/* 发送/回复完成通知 */
 	const struct arpc_connection*conn;
 	struct xio_msg				xio_msg;
 	struct xio_msg				*tx_msg;
 	uint32_t 					retry_cnt;
     uint32_t                    flag;
 	enum  arpc_msg_status		status;
-	struct timeval 				now;
+	uint64_t					start_ns;			/* 提交或生成时刻(单调时钟)，用于时延统计 */
 	struct arpc_msg_attr		attr;
 	void 		                *usr_context;				/*! @brief 用户上下文 */
+	void						*tx_head_buf;				/*! @brief 描述符内的发送头部缓存，由对象缓存构造时指定 */
+	uint32_t					tx_head_buf_len;
+	uint64_t					tx_len;						/*! @brief 入发送环时计入连接tx_bytes的字节数 */
     char                        ex_data[0];
 };
 
@@ -337,7 +627,74 @@ int arpc_uri_get_proto(const char *uri, char *proto, int proto_len);
 const struct aprc_option *get_option();
 
 uint32_t arpc_thread_max_num();
+
+/*!
+ * @brief  本机有硬件加速的校验算法集合(csum.h)，未开启crc时为0，用于会话协商
+ */
+uint32_t arpc_csum_hw_mask();
+
+/*!
+ * @brief  服务端按客户端的加速集合为会话选定校验算法
+ */
+uint32_t arpc_csum_select(uint32_t peer_hw_mask);
+
+/* 消息压缩算法，在会话上协商 */
+enum arpc_zip_type {
+	ARPC_ZIP_NONE = 0,
+	ARPC_ZIP_LZ,					/* lz_codec.h */
+};
+#define ARPC_ZIP_BIT(type)	(1U << (type))
+
+/*!
+ * @brief  本机支持的压缩算法集合，未开启ARPC_E_CTRL_ZIP时为0，用于会话协商
+ */
+uint32_t arpc_zip_mask();
+
+/*!
+ * @brief  服务端按客户端支持的集合为会话选定压缩算法，任一端未开启时为ARPC_ZIP_NONE
+ */
+uint32_t arpc_zip_select(uint32_t peer_mask);
+
+/*!
+ * @brief  按全局配置填充计算线程池参数（伸缩范围、扩容时延阈值、缩容冷却、绑核回调）
+ */
+void arpc_work_pool_param(struct tp_param *param);
 uint32_t arpc_cpu_max_num();
+
+/*!
+ * @brief  为新的xio loop线程按绑核策略分配CPU
+ *
+ * @param[out] cpu 分配的CPU，不绑核时为-1
+ * @param[out] node 该CPU所在NUMA节点，不绑核时为-1
+ * @return  0 已分配；-1 未启用绑核
+ */
+int arpc_placement_pick(int *cpu, int *node);
+
+/*!
+ * @brief  当前线程作为xio loop线程绑定到cpu（NUMA策略下绑定到cpu所在节点）
+ */
+int arpc_placement_bind_loop(int cpu);
+
+/*!
+ * @brief  线程池工作线程启动回调（tp_param.thread_init）
+ */
+void arpc_placement_bind_worker(uint32_t thread_index, void *init_ctx);
+
+/*!
+ * @brief  loop结束后恢复为工作线程的绑定
+ */
+void arpc_placement_restore(void);
+
+/*!
+ * @brief  当前线程迁移到node节点，已在该节点时不做系统调用
+ */
+void arpc_placement_migrate(int node);
+
+/*!
+ * @brief  在NUMA节点上申请清零内存，node<0或单节点机器时退化为calloc
+ */
+void *arpc_numa_alloc(size_t size, int node);
+void arpc_numa_free(void *ptr, int node);
 int arpc_get_ipv4_addr(struct sockaddr_storage *src_addr, char *ip, uint32_t len, uint32_t *port);
 
 // others
@@ -347,10 +704,62 @@ int post_to_async_thread(struct arpc_thread_param *param);
 int create_xio_msg_usr_buf(struct xio_msg *msg, struct proc_header_func *ops, uint64_t iov_max_len, void *usr_ctx, struct arpc_msg_attr *attr);
 int destroy_xio_msg_usr_buf(struct xio_msg *msg, mem_free_cb_t free_cb, void *usr_ctx);
 
-int move_msg_xio2arpc(struct xio_vmsg *xio_msg, struct arpc_vmsg *msg, struct arpc_msg_attr *attr);
-void free_msg_xio2arpc(struct arpc_vmsg *msg, mem_free_cb_t free_cb, void *usr_ctx);
+/* 接收消息的rx_flags，由move_msg_xio2arpc给出，释放时原样传回 */
+#define ARPC_RX_FLAG_BORROW_HEAD	(1<<0)	/* head指向xio接收缓冲，随xio消息释放，不能晚于xio_release */
+#define ARPC_RX_FLAG_POOL			(1<<1)	/* vec(及拷贝的head)取自接收容器缓存 */
+#define ARPC_RX_FLAG_DEFER_CRC		(1<<2)	/* 仅作入参：不在loop线程校验，由调用者稍后执行arpc_rx_crc_verify */
+
+/*!
+ * @brief  本次接收允许的零拷贝方式
+ *
+ * @param[in] borrow_head 消息在回调期间不会被xio释放时为1
+ * @return  未开启ARPC_E_CTRL_RX_ZERO_COPY时返回0
+ */
+uint32_t arpc_rx_zero_copy_flags(int borrow_head);
+
+/* 接收压缩消息时解压输出的缓冲来源，与create_xio_msg_usr_buf使用同一组回调 */
+struct arpc_rx_zip_buf {
+	void* (*alloc_cb)(uint32_t size, void* usr_context);
+	int (*free_cb)(void* buf_ptr, void* usr_context);
+	void		*usr_ctx;
+	uint64_t	iov_max_len;
+};
 
-int convert_msg_arpc2xio(const struct arpc_vmsg *usr_msg, struct xio_vmsg *xio_msg, struct arpc_msg_attr *attr);
+/*!
+ * @brief  xio接收消息转为arpc消息
+ *
+ * 数据被压缩时在这里解压，msg->vec为解压后的数据，每段不超过zbuf->iov_max_len
+ *
+ * @param[in,out] rx_flags 入参为允许的零拷贝方式，出参为实际使用的方式；NULL表示全部拷贝
+ * @param[in] zbuf 解压输出的缓冲来源；NULL时压缩消息按数据错误丢弃
+ */
+int move_msg_xio2arpc(struct xio_vmsg *xio_msg, struct arpc_vmsg *msg, struct arpc_msg_attr *attr, uint32_t *rx_flags,
+					  const struct arpc_rx_zip_buf *zbuf);
+void free_msg_xio2arpc(struct arpc_vmsg *msg, mem_free_cb_t free_cb, void *usr_ctx, uint32_t rx_flags);
+
+/*!
+ * @brief  调用者劫持数据buf后，回收框架持有的vec/head容器
+ *
+ * 非零拷贝方式下vec/head与数据一起交给调用者，这里不做处理
+ */
+void release_msg_xio2arpc(struct arpc_vmsg *msg, uint32_t rx_flags);
+
+/*!
+ * @brief  校验推迟到工作线程的接收数据
+ *
+ * @param[in] csum_type 发送端所用算法(attr.csum_type)
+ * @param[in] expect_crc 发送端的校验值(attr.req_crc)，为0或本端未开启crc时直接通过
+ * @return  0 通过；-1 校验失败
+ */
+int arpc_rx_crc_verify(const struct arpc_vmsg *msg, uint32_t csum_type, uint64_t expect_crc);
+
+/*!
+ * @brief  arpc发送消息转为xio消息
+ *
+ * attr->zip_type为会话的压缩算法，数据足够长且压缩率达标时数据换成压缩帧，帧缓冲由free_msg_arpc2xio归还
+ */
+int convert_msg_arpc2xio(const struct arpc_vmsg *usr_msg, struct xio_vmsg *xio_msg, struct arpc_msg_attr *attr,
+						 void *head_buf, uint32_t head_buf_len);
 void free_msg_arpc2xio(struct xio_vmsg *xio_msg);
 
 #ifdef __cplusplus
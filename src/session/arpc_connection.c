@@ -24,18 +24,29 @@
 #include<fcntl.h>
 #include <sys/prctl.h>
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
 #include "arpc_connection.h"
+#include "arpc_request.h"
+#include "mpsc_ring.h"
+#include "slab_cache.h"
 
 #define WAIT_THREAD_RUNING_TIMEOUT (1000)
 
 #define ARPC_EVENT_BUF_MAX_LEN 	4
 
 #define ARPC_CONN_TX_MAX_DEPTH	  		500
-#define ARPC_MAX_TX_CNT_PER_WAKEUP		32
-#define COMM_MSG_GROW_STEP				64
+#define ARPC_CONN_TX_RING_SIZE			1024	//需大于ARPC_CONN_TX_MAX_DEPTH，留出并发生产者的余量
+#define COMM_MSG_SLAB_OBJ_NUM			64		//每个slab的消息描述符数
+#define COMM_MSG_MAG_SIZE				32		//每个线程magazine的容量
+#define COMM_MSG_REAP_INTERVAL_S		5		//连接空闲时回收描述符的最小间隔
+#define COMM_MSG_HEAD_RESERVE			(2 * sizeof(struct arpc_tlv) + sizeof(struct arpc_msg_attr))	//发送头部除用户头外的协议开销
+#define ARPC_CONN_LOAD_MSG_COST			4096	//选路时每个在途消息折算的字节数
 
 #define ARPC_CONN_EXIT_MAX_TIMES_MS	(2*1000)
+#define ARPC_CONN_DRAIN_CHECK_MS		10			//迁移后旧连接的排空检查周期
+#define ARPC_CONN_DRAIN_MAX_MS			(5*1000)	//旧连接排空超时，超时后剩余在途消息按链路断开处理
 
 #define ARPC_CONN_ATTR_TELL_LIVE  (1<<0)
 #define ARPC_CONN_ATTR_ADD_EVENT  (1<<1)
@@ -43,6 +54,8 @@
 #define ARPC_CONN_ATTR_EXIT       (1<<3)
 #define ARPC_CONN_ATTR_SET_EXIT   (1<<4)
 #define ARPC_CONN_EVENT_RUN   	  (1<<5)	//运行事件中
+#define ARPC_CONN_ATTR_MIG_CLOSE  (1<<6)	//迁移中的新连接已放弃，等待其断开
+#define ARPC_CONN_ATTR_DRAIN_CLOSE (1<<7)	//排空中的旧连接已发起断开
 
 #define CONN_CTX(ctx_name, obj, ret)\
 struct arpc_connection_ctx *ctx_name;\
@@ -104,15 +117,20 @@ struct arpc_connection_ctx {
 	struct arpc_rwlock 			rwlock;
 	int 						event_fd;
 	uint64_t					event_cnt;
-	uint64_t					tx_msg_num;
-	uint32_t					busy_msg;
-	struct arpc_mutex 			msg_lock;			/* 消息锁*/
-	QUEUE     					q_tx_msg;			/* 待发送队列*/							
-	QUEUE     					q_used_msg;			/* 被申请的队列*/
-	QUEUE     					q_req_msg;			/* 空闲队列*/
-	QUEUE     					q_ow_msg;
-	QUEUE     					q_rsp_msg;
+	uint32_t					busy_msg;			/* 被申请未归还的消息数，原子操作*/
+	uint64_t					tx_bytes;			/* 已入发送环未发出的字节数，原子操作*/
+	uint64_t					reap_ns;			/* 上次回收描述符缓存的时间，原子操作*/
+	struct mpsc_ring			tx_ring;			/* 待发送队列，无锁多生产者单消费者*/
+	int32_t						cpu;				/* loop线程绑定的CPU，-1不绑定*/
+	int32_t						numa_node;			/* 所在NUMA节点，-1未知*/
 	int64_t						conn_timeout_ms;					
+	uint64_t					redirect;			/* 迁移提示，高32位为入口序号+1，低32位为入口数；服务端待捎带，客户端待执行*/
+	struct xio_connection		*mig_con;			/* 客户端迁移中新建的连接，建立后替换xio_con*/
+	struct xio_connection		*drain_con;			/* 客户端迁移后排空中的旧连接*/
+	uint32_t					xio_idx;			/* 客户端xio_con的conn_idx，入口为conn_idx % 入口数*/
+	uint32_t					mig_idx;
+	int							drain_fd;			/* 旧连接排空检查的定时器，-1未启用*/
+	uint64_t					drain_start_ns;
 };
 
 static void check_session_active(struct arpc_connection_ctx *ctx);
@@ -120,20 +138,43 @@ static int  arpc_client_run_loop(void * thread_ctx);
 static int  arpc_add_event_to_conn(struct arpc_connection *con);
 static int  arpc_del_event_to_conn(struct arpc_connection *con);
 static void arpc_tx_event_callback(struct arpc_connection *usr_conn);
-static struct arpc_common_msg *arpc_create_common_msg(uint32_t ex_data_size);
-static int arpc_destroy_common_msg(struct arpc_common_msg *msg);
+static slab_cache_t arpc_get_msg_cache(enum arpc_msg_type type);
+static int arpc_reclaim_conn_msg(struct arpc_connection *con);
+static void arpc_conn_migrate_start(struct arpc_connection *con);
+static void arpc_conn_migrate_abort(struct arpc_connection *con);
+static void arpc_conn_drain_stop(struct arpc_connection *con);
+
+static void *arpc_conn_ring_alloc(size_t bytes, void *usr_ctx)
+{
+	return arpc_numa_alloc(bytes, ((struct arpc_connection_ctx *)usr_ctx)->numa_node);
+}
+
+static void arpc_conn_ring_free(void *slot, void *usr_ctx)
+{
+	arpc_numa_free(slot, ((struct arpc_connection_ctx *)usr_ctx)->numa_node);
+}
 
 struct arpc_connection *arpc_create_connection(const struct arpc_connection_param *param)
 {
 	int ret = 0;
 	int flags;
+	int cpu = -1;
+	int node = -1;
 	struct arpc_connection *con = NULL;
 	struct arpc_connection_ctx *ctx = NULL;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE(!param, NULL, "arpc_connection_param is null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE(!param->session, NULL, "session is null.");
+
+	// 客户端连接自带loop线程，在此分配CPU；服务端连接跑在work的loop上，沿用work的位置
+	if (param->type == ARPC_CON_TYPE_CLIENT) {
+		(void)arpc_placement_pick(&cpu, &node);
+	}else{
+		cpu = param->cpu;
+		node = param->numa_node;
+	}
 	/* handle*/
-	con = (struct arpc_connection *)arpc_mem_alloc(sizeof(struct arpc_connection) + sizeof(struct arpc_connection_ctx), NULL);
+	con = (struct arpc_connection *)arpc_numa_alloc(sizeof(struct arpc_connection) + sizeof(struct arpc_connection_ctx), node);
 	if (!con) {
 		ARPC_LOG_ERROR( "malloc error, exit ");
 		return NULL;
@@ -143,6 +184,9 @@ struct arpc_connection *arpc_create_connection(const struct arpc_connection_para
 	QUEUE_INIT(&con->q);
 
 	ctx = (struct arpc_connection_ctx*)con->ctx;
+	ctx->cpu = cpu;
+	ctx->numa_node = node;
+	ctx->drain_fd = -1;
 
 	ret = arpc_cond_init(&ctx->cond); 
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_buf, "arpc_cond_init fail.");
@@ -150,18 +194,11 @@ struct arpc_connection *arpc_create_connection(const struct arpc_connection_para
 	ret = arpc_rwlock_init(&ctx->rwlock); 
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_buf, "arpc_rwlock_init fail.");
 
-	ret = arpc_mutex_init(&ctx->msg_lock); 
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_buf, "arpc_mutex_init fail.");
-
 	ctx->event_fd = eventfd(0, EFD_NONBLOCK);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ctx->event_fd == -1, free_cond, "eventfd init fail.");
 
-	QUEUE_INIT(&ctx->q_tx_msg);
-	QUEUE_INIT(&ctx->q_used_msg);
-
-	QUEUE_INIT(&ctx->q_req_msg);
-	QUEUE_INIT(&ctx->q_rsp_msg);
-	QUEUE_INIT(&ctx->q_ow_msg);
+	ret = mpsc_ring_init_ex(&ctx->tx_ring, ARPC_CONN_TX_RING_SIZE, arpc_conn_ring_alloc, arpc_conn_ring_free, ctx);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, close_fd, "mpsc_ring_init fail.");
 
 	ctx->magic = ARPC_CONN_MAGIC;
 	ctx->usr_ctx = param->usr_ctx;
@@ -181,18 +218,18 @@ struct arpc_connection *arpc_create_connection(const struct arpc_connection_para
 	ctx->xio_con = param->xio_con;
 	
 	return con;
+close_fd:
+	close(ctx->event_fd);
 free_cond:
 	arpc_cond_destroy(&ctx->cond);
 free_buf:
-	SAFE_FREE_MEM(con);
+	arpc_numa_free(con, node);
 	return NULL;
 }
 
 int arpc_destroy_connection(struct arpc_connection *con)
 {
 	int ret;
-	QUEUE* iter;
-	struct arpc_common_msg *msg;
 	CONN_CTX(ctx, con, ARPC_ERROR);
 
 	ret = arpc_cond_lock(&ctx->cond);
@@ -224,52 +261,10 @@ int arpc_destroy_connection(struct arpc_connection *con)
 		close(ctx->event_fd);
 	}
 
-	// 清理空闲消息
-	arpc_mutex_lock(&ctx->msg_lock);
-	while(!QUEUE_EMPTY(&ctx->q_req_msg)){
-		iter = QUEUE_HEAD(&ctx->q_req_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		QUEUE_REMOVE(iter);
-		ret = arpc_destroy_common_msg(msg);
-		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_connection fail.");
-	}
-
-	while(!QUEUE_EMPTY(&ctx->q_rsp_msg)){
-		iter = QUEUE_HEAD(&ctx->q_rsp_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		QUEUE_REMOVE(iter);
-		ret = arpc_destroy_common_msg(msg);
-		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_connection fail.");
-	}
-
-	while(!QUEUE_EMPTY(&ctx->q_ow_msg)){
-		iter = QUEUE_HEAD(&ctx->q_ow_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		QUEUE_REMOVE(iter);
-		ret = arpc_destroy_common_msg(msg);
-		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_connection fail.");
-	}
-
-	// 清理使用中的消息
-	while(!QUEUE_EMPTY(&ctx->q_used_msg)){
-		iter = QUEUE_HEAD(&ctx->q_used_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		QUEUE_REMOVE(iter);
-		ret = arpc_destroy_common_msg(msg);
-		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_connection fail.");
-	}
-
-	// 清理发送中的消息
-	while(!QUEUE_EMPTY(&ctx->q_tx_msg)){
-		iter = QUEUE_HEAD(&ctx->q_tx_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		QUEUE_REMOVE(iter);
-		ret = arpc_destroy_common_msg(msg);
-		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_connection fail.");
-	}
-	arpc_mutex_unlock(&ctx->msg_lock);
-	arpc_mutex_destroy(&ctx->msg_lock);
-
+	// 回收未归还的消息(发送环只保存指针)，空闲描述符在全局缓存中，由其按工作集回收
+	ret = arpc_reclaim_conn_msg(con);
+	LOG_ERROR_IF_VAL_TRUE(ret, "arpc_reclaim_conn_msg fail.");
+	mpsc_ring_destroy(&ctx->tx_ring);
 
 	ctx->magic = 0;
 	arpc_rwlock_unlock(&ctx->rwlock);
@@ -278,48 +273,13 @@ int arpc_destroy_connection(struct arpc_connection *con)
 	arpc_cond_unlock(&ctx->cond);
 	ret = arpc_cond_destroy(&ctx->cond); 
 	LOG_ERROR_IF_VAL_TRUE(ret, "arpc_cond_destroy fail.");
-	SAFE_FREE_MEM(con);
+	arpc_numa_free(con, ctx->numa_node);
 	return 0;
 unlock:
 	arpc_cond_unlock(&ctx->cond);
 	return ARPC_ERROR;
 }
 
-static struct arpc_common_msg *arpc_create_common_msg(uint32_t ex_data_size)
-{
-	struct arpc_common_msg *req_msg = NULL;
-	int ret;
-
-	req_msg = (struct arpc_common_msg*)arpc_mem_alloc(sizeof(struct arpc_common_msg) + ex_data_size,NULL);
-	LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, NULL, "arpc_mem_alloc arpc_msg fail.");
-	memset(req_msg, 0, sizeof(struct arpc_common_msg) + ex_data_size);
-	ret = arpc_cond_init(&req_msg->cond); 
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, error, "arpc_cond_init for new msg fail.");
-	req_msg->flag = 0;
-	QUEUE_INIT(&req_msg->q);
-	req_msg->magic = ARPC_COM_MSG_MAGIC;
-	req_msg->status = ARPC_MSG_STATUS_IDLE;
-	return req_msg;
-error:
-	SAFE_FREE_MEM(req_msg);
-	return NULL;
-}
-
-
-static int arpc_destroy_common_msg(struct arpc_common_msg *msg)
-{
-	int ret;
-	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ARPC_ERROR, "msg is null.");
-	ret = arpc_cond_lock(&msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock null.");
-	msg->status = ARPC_MSG_STATUS_FREE;
-	arpc_cond_notify(&msg->cond);
-	arpc_cond_unlock(&msg->cond);
-	arpc_cond_destroy(&msg->cond);
-	SAFE_FREE_MEM(msg);
-	return 0;
-}
-
 int arpc_client_connect(struct arpc_connection *con, int64_t timeout_ms)
 {
 	int ret;
@@ -334,7 +294,7 @@ int arpc_client_connect(struct arpc_connection *con, int64_t timeout_ms)
 	thread.stop = NULL;
 	thread.usr_ctx = (void*)con;
 
-	thread_handle = tp_post_one_work(ctx->session->threadpool, &thread, WORK_DONE_AUTO_FREE);
+	thread_handle = tp_post_one_work(ctx->session->loop_pool, &thread, WORK_DONE_AUTO_FREE);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!thread_handle, unlock, "tp_post_one_work fail.");
 
 	ret = arpc_cond_wait_timeout(&ctx->cond, timeout_ms);
@@ -444,9 +404,14 @@ int arpc_client_reconnect(struct arpc_connection *con)
 	(void)memset(&xio_con_param, 0, sizeof(struct xio_connection_params));
 	xio_con_param.session			= ctx->session->xio_s;
 	xio_con_param.ctx				= ctx->xio_con_ctx;
-	xio_con_param.conn_idx			= con->id;
+	xio_con_param.conn_idx			= ARPC_CONN_XIO_IDX(con->id);	// 与首次建链一致，服务端按它预留的入口
 	xio_con_param.conn_user_context	= con;
 	SET_FLAG(ctx->flags, ARPC_CONN_ATTR_REBUILD);
+	ctx->xio_idx = xio_con_param.conn_idx;
+	ctx->mig_con = NULL;		// 随旧xio session一起释放
+	ctx->drain_con = NULL;
+	ctx->redirect = 0;
+	arpc_conn_drain_stop(con);
 	ctx->xio_con = xio_connect(&xio_con_param);
 	LOG_ERROR_IF_VAL_TRUE(!ctx->xio_con, "xio_connect fail.");
 	if(ctx->xio_con_ctx){
@@ -508,8 +473,9 @@ static int arpc_connect_init(struct arpc_connection *con)
 	(void)memset(&ctx_params, 0, sizeof(struct xio_context_params));
 	ctx_params.max_inline_xio_data = ctx->msg_data_max_len;
 	ctx_params.max_inline_xio_hdr = ctx->msg_head_max_len;
+	ctx_params.loop_tick = &arpc_loop_tick;
 
-	ctx->xio_con_ctx = xio_context_create(&ctx_params, 0, (con->id + 1));
+	ctx->xio_con_ctx = xio_context_create(&ctx_params, 0, (ctx->cpu >= 0)? ctx->cpu : (con->id + 1));
 	LOG_THEN_RETURN_VAL_IF_TRUE(!ctx->xio_con_ctx, ARPC_ERROR, "xio_context_create fail.");
 
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!ctx->session, free_xio_ctx, "session is null.");
@@ -518,8 +484,9 @@ static int arpc_connect_init(struct arpc_connection *con)
 	(void)memset(&xio_con_param, 0, sizeof(struct xio_connection_params));
 	xio_con_param.session			= ctx->session->xio_s;
 	xio_con_param.ctx				= ctx->xio_con_ctx;
-	xio_con_param.conn_idx			= con->id + 1;
+	xio_con_param.conn_idx			= ARPC_CONN_XIO_IDX(con->id);
 	xio_con_param.conn_user_context	= con;
+	ctx->xio_idx = xio_con_param.conn_idx;
 
 	ctx->xio_con = xio_connect(&xio_con_param);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!ctx->xio_con, free_xio_ctx, "xio_connect fail.");
@@ -535,7 +502,6 @@ free_xio_ctx:
 static int arpc_client_run_loop(void * thread_ctx)
 {
 	struct arpc_connection *con = (struct arpc_connection *)thread_ctx;
-	//cpu_set_t		cpuset;
 	int ret;
 	char thread_name[16+1] ={0};
 	int64_t time_out_ms = XIO_INFINITE;
@@ -551,9 +517,8 @@ static int arpc_client_run_loop(void * thread_ctx)
 	ret = arpc_connect_init(con);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, exit_thread, "arpc_connect_init fail.");
 
-	/*CPU_ZERO(&cpuset);
-	CPU_SET((con->id + 1)%(arpc_cpu_max_num()), &cpuset);
-	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);*/
+	ret = arpc_placement_bind_loop(ctx->cpu);
+	LOG_ERROR_IF_VAL_TRUE(ret, "conn[%u] bind cpu[%d] fail.", con->id, ctx->cpu);
 
 	snprintf(thread_name, sizeof(thread_name), "arpc_conn_%d", con->id);
 	prctl(PR_SET_NAME, thread_name);
@@ -575,6 +540,7 @@ static int arpc_client_run_loop(void * thread_ctx)
 		LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock con cond fail.");
 
 		if (IS_SET(ctx->flags, ARPC_CONN_ATTR_EXIT)) {
+			arpc_conn_migrate_abort(con);
 			if (ctx->xio_con) {
 				xio_disconnect(ctx->xio_con);
 				ctx->xio_con = NULL;
@@ -590,6 +556,9 @@ static int arpc_client_run_loop(void * thread_ctx)
 
 exit_thread:
 	ctx->status = ARPC_CON_STA_EXIT;
+	arpc_conn_drain_stop(con);
+	ctx->mig_con = NULL;
+	ctx->drain_con = NULL;
 	if (ctx->xio_con_ctx) {
 		xio_context_destroy(ctx->xio_con_ctx);
 		ctx->xio_con_ctx = NULL;
@@ -597,6 +566,7 @@ exit_thread:
 	ctx->flags = 0;
 	SET_FLAG(ctx->flags, ARPC_CONN_ATTR_TELL_LIVE);
 	prctl(PR_SET_NAME, "share_thread");
+	arpc_placement_restore();
 	arpc_cond_notify(&ctx->cond);
 	ARPC_LOG_NOTICE("xio connection[%u] on thread[%lu] exit now.", con->id,  pthread_self());
 	arpc_cond_unlock(&ctx->cond);
@@ -631,6 +601,7 @@ static void arpc_conn_event_callback(int fd, int events, void *data)
 	{
 	case ARPC_CON_STA_CLEANUP:
 		ARPC_LOG_NOTICE("conn status[%d] to disconnect", ctx->status);
+		arpc_conn_migrate_abort(con);
 		if (ctx->xio_con) {
 			ret = xio_disconnect(ctx->xio_con);
 			if (ret) {
@@ -639,6 +610,9 @@ static void arpc_conn_event_callback(int fd, int events, void *data)
 		}
 		break;
 	case ARPC_CON_STA_RUN_ACTIVE:
+		if (ctx->redirect && ctx->type == ARPC_CON_TYPE_CLIENT) {
+			arpc_conn_migrate_start(con);
+		}
 		arpc_tx_event_callback(con);//发送事件
 		break;
 	default:
@@ -647,75 +621,87 @@ static void arpc_conn_event_callback(int fd, int events, void *data)
 	}
 	return;
 }
-static void arpc_tx_event_callback(struct arpc_connection *usr_conn)
+static int arpc_tx_one_msg(struct arpc_connection *usr_conn, struct arpc_common_msg *msg)
 {
-	int ret;
-	QUEUE* iter;
-	int retry = 0;
-	struct arpc_common_msg *msg;
-	int max_tx_send = ARPC_MAX_TX_CNT_PER_WAKEUP; //每次唤醒最多发送消息数，避免阻塞太长
-	CONN_CTX(con, usr_conn, ;);
+	int ret = ARPC_ERROR;
+	int retry;
+	CONN_CTX(con, usr_conn, ARPC_ERROR);
 
-	while(1){
-		arpc_mutex_lock(&con->msg_lock);
-		if(QUEUE_EMPTY(&con->q_tx_msg) || max_tx_send < 0){
-			con->tx_msg_num = 0;
-			arpc_mutex_unlock(&con->msg_lock);
-			break;
-		}
-		iter = QUEUE_HEAD(&con->q_tx_msg);
-		msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		if(msg->magic != ARPC_COM_MSG_MAGIC){
-			ARPC_LOG_ERROR("unkown msg");
-			QUEUE_REMOVE(iter);
-			QUEUE_INIT(iter);
-			con->tx_msg_num--;
-			arpc_mutex_unlock(&con->msg_lock);
-			continue;
-		}
-		arpc_mutex_unlock(&con->msg_lock);
-		ARPC_LOG_TRACE("xio send msg on client, msg type:%d", msg->type);
-		arpc_cond_lock(&msg->cond);
+	ARPC_LOG_TRACE("xio send msg on client, msg type:%d", msg->type);
+	MSG_TRACE(msg->attr.trace_id, MSG_TRACE_XIO_SEND, msg->type, usr_conn->id, 0);	// 回复和单向消息发出后即可能被回收
+	for (retry = 0; retry <= 3; retry++) {
 		switch (msg->type)
 		{
 			case ARPC_MSG_TYPE_REQ:
+				arpc_stat_lat(&usr_conn->stats, ARPC_STAT_LAT_REQ_QUEUE, msg->start_ns);
 				ret = xio_send_request(con->xio_con, msg->tx_msg);
-				statistics_per_time(&msg->now, &usr_conn->tx_req_cmit, 3);
 				break;
 			case ARPC_MSG_TYPE_RSP:
+				arpc_stat_lat(&usr_conn->stats, ARPC_STAT_LAT_RSP_QUEUE, msg->start_ns);
 				ret = xio_send_response(msg->tx_msg);
-				arpc_cond_notify(&msg->cond);
-				statistics_per_time(&msg->now, &usr_conn->tx_rsp_cmit, 3);
+				(void)arpc_complete(&msg->comp);
 				break;
 			case ARPC_MSG_TYPE_OW:
-				ret = xio_send_msg(con->xio_con, msg->tx_msg);
-				arpc_cond_notify(&msg->cond);
-				statistics_per_time(&msg->now, &usr_conn->tx_ow_cmit, 3);
+				arpc_stat_lat(&usr_conn->stats, ARPC_STAT_LAT_OW_QUEUE, msg->start_ns);
+				ret = xio_send_msg(con->xio_con, msg->tx_msg);	// 发送完成回调里再唤醒同步发送者
 				break;
 			default:
 				ret = ARPC_ERROR;
 				ARPC_LOG_ERROR("unkown msg type[%d]", msg->type);
 				break;
 		}
-		arpc_cond_unlock(&msg->cond);
-		ARPC_LOG_TRACE("xio send msg end, msg type:%d", msg->type);
-		if(ret){
-			ARPC_LOG_ERROR("send msg[%d] fail, errno code[%u], err msg[%s].", msg->type, xio_errno(), xio_strerror(xio_errno()));
-			if(retry < 3){
-				ARPC_LOG_ERROR("retry cnt[%u], retry later.", msg->retry_cnt);
-				retry++;
+		if (!ret) {
+			break;
+		}
+		ARPC_LOG_ERROR("send msg[%d] fail, errno code[%u], err msg[%s], retry cnt[%d].", 
+						msg->type, xio_errno(), xio_strerror(xio_errno()), retry);
+	}
+	if (ret && msg->type == ARPC_MSG_TYPE_OW) {
+		(void)arpc_oneway_send_complete(msg);	// xio不会再回调，就地回收
+	}
+	ARPC_LOG_TRACE("xio send msg end, msg type:%d", msg->type);
+	return ret;
+}
+
+// 在xio loop线程内执行，是发送环唯一的消费者
+static void arpc_tx_event_callback(struct arpc_connection *usr_conn)
+{
+	int ret;
+	uint64_t tx_cnt;
+	enum arpc_msg_status status;
+	struct arpc_common_msg *msg;
+	CONN_CTX(con, usr_conn, ;);
+
+	for(;;){
+		tx_cnt = 0;
+		while ((msg = (struct arpc_common_msg *)mpsc_ring_pop(&con->tx_ring)) != NULL) {
+			tx_cnt++;
+			if(msg->magic != ARPC_COM_MSG_MAGIC){
+				ARPC_LOG_ERROR("unkown msg");
 				continue;
 			}
+			__atomic_sub_fetch(&con->tx_bytes, msg->tx_len, __ATOMIC_RELAXED);
+			status = ARPC_MSG_STATUS_TX;
+			if (!__atomic_compare_exchange_n(&msg->status, &status, ARPC_MSG_STATUS_USED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				// 出环前已被归还，发送内容可能已释放，不再发送
+				if (status == ARPC_MSG_STATUS_TX_PUT) {
+					__atomic_store_n(&msg->status, ARPC_MSG_STATUS_USED, __ATOMIC_RELEASE);
+					put_common_msg(msg);
+				}
+				continue;
+			}
+			usr_conn->stats.tx_bytes += msg->tx_len;
+			(void)arpc_tx_one_msg(usr_conn, msg);
+		}
+		if (mpsc_ring_consumed(&con->tx_ring, tx_cnt) <= 0) {
+			break;
+		}
+		if (!tx_cnt) {
+			// 生产者已占位但尚未写完，不在loop内自旋，重新敲门铃稍后再取
+			ret = eventfd_write(con->event_fd, 1);
+			LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, con->event_fd);
+			break;
 		}
-		retry = 0;
-		arpc_mutex_lock(&con->msg_lock);
-		QUEUE_REMOVE(&msg->q);
-		QUEUE_INIT(&msg->q);
-		msg->status = ARPC_MSG_STATUS_USED;
-		QUEUE_INSERT_TAIL(&con->q_used_msg, &msg->q);
-		if(con->tx_msg_num > 0) con->tx_msg_num--;
-		arpc_mutex_unlock(&con->msg_lock);
-		max_tx_send--;
 	}
 
 	return;
@@ -748,6 +734,216 @@ static int  arpc_del_event_to_conn(struct arpc_connection *con)
 	return 0;
 }
 
+void arpc_connection_set_redirect(struct arpc_connection *conn, uint32_t slot, uint32_t num)
+{
+	CONN_CTX(ctx, conn, ;);
+	__atomic_store_n(&ctx->redirect, ((uint64_t)(slot + 1) << 32) | num, __ATOMIC_RELAXED);
+}
+
+// 在loop线程内执行，提示由发送事件处理，不在xio接收回调里建链
+void arpc_client_redirect(struct arpc_connection *conn, uint32_t slot, uint32_t num)
+{
+	int ret;
+	CONN_CTX(ctx, conn, ;);
+
+	if (ctx->type != ARPC_CON_TYPE_CLIENT || !num || slot >= num) {
+		return;
+	}
+	if (ctx->redirect || ctx->mig_con || ctx->drain_con || (ctx->xio_idx % num) == slot) {
+		return;
+	}
+	ctx->redirect = ((uint64_t)(slot + 1) << 32) | num;
+	ret = eventfd_write(ctx->event_fd, 1);
+	LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, ctx->event_fd);
+}
+
+/*!
+ * @brief  按服务端提示迁移连接：先在同一loop上连向目标入口，建立后切换发送，旧连接排空在途消息后再断开
+ *
+ * xio按conn_idx % 入口数选择入口，取大于当前值且落在目标入口上的conn_idx
+ */
+static void arpc_conn_migrate_start(struct arpc_connection *con)
+{
+	int ret;
+	uint32_t slot, num, idx;
+	struct xio_connection_params xio_con_param;
+	CONN_CTX(ctx, con, ;);
+
+	ret = arpc_cond_lock(&ctx->cond);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ;, "arpc_cond_lock conn[%u][%p] fail.", con->id, con);
+	slot = (uint32_t)(ctx->redirect >> 32) - 1;
+	num = (uint32_t)ctx->redirect;
+	ctx->redirect = 0;
+	if (!ctx->xio_con || ctx->mig_con || ctx->drain_con || ctx->status != ARPC_CON_STA_RUN_ACTIVE) {
+		goto unlock;
+	}
+	idx = ctx->xio_idx - (ctx->xio_idx % num) + slot;
+	if (idx <= ctx->xio_idx) {
+		idx += num;
+	}
+	if (idx > UINT16_MAX) {
+		idx = (slot) ? slot : num;		// xio按16位保存，0表示自动分配
+	}
+	(void)memset(&xio_con_param, 0, sizeof(struct xio_connection_params));
+	xio_con_param.session			= ctx->session->xio_s;
+	xio_con_param.ctx				= ctx->xio_con_ctx;
+	xio_con_param.conn_idx			= idx;
+	xio_con_param.conn_user_context	= con;
+	xio_con_param.share_ctx			= 1;		// 新旧连接同在本loop上，直到旧连接排空
+	ctx->mig_con = xio_connect(&xio_con_param);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!ctx->mig_con, unlock, "conn[%u] migrate xio_connect fail.", con->id);
+	ctx->mig_idx = idx;
+	CLR_FLAG(ctx->flags, ARPC_CONN_ATTR_MIG_CLOSE);
+	ARPC_LOG_NOTICE("conn[%u] migrate from conn_idx[%u] to [%u], portal[%u/%u].", con->id, ctx->xio_idx, idx, slot, num);
+unlock:
+	arpc_cond_unlock(&ctx->cond);
+}
+
+// 连接退出或被关闭时，迁移中的新连接和排空中的旧连接一并断开，断开完成由xio事件回收
+static void arpc_conn_migrate_abort(struct arpc_connection *con)
+{
+	CONN_CTX(ctx, con, ;);
+
+	ctx->redirect = 0;
+	if (ctx->mig_con && !IS_SET(ctx->flags, ARPC_CONN_ATTR_MIG_CLOSE)) {
+		SET_FLAG(ctx->flags, ARPC_CONN_ATTR_MIG_CLOSE);
+		xio_disconnect(ctx->mig_con);
+	}
+	if (ctx->drain_con && !IS_SET(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE)) {
+		SET_FLAG(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE);
+		xio_disconnect(ctx->drain_con);
+	}
+	arpc_conn_drain_stop(con);
+}
+
+static void arpc_conn_drain_stop(struct arpc_connection *con)
+{
+	CONN_CTX(ctx, con, ;);
+
+	if (ctx->drain_fd < 0) {
+		return;
+	}
+	if (ctx->xio_con_ctx) {
+		(void)xio_context_del_ev_handler(ctx->xio_con_ctx, ctx->drain_fd);
+	}
+	close(ctx->drain_fd);
+	ctx->drain_fd = -1;
+}
+
+// 旧连接上已无排队、在途或待回复的消息时断开，超时则强制断开
+static void arpc_conn_drain_callback(int fd, int events, void *data)
+{
+	struct arpc_connection *con = (struct arpc_connection *)data;
+	int ret;
+	int idle = 0;
+	int len = sizeof(int);
+	uint64_t expire;
+	CONN_CTX(ctx, con, ;);
+
+	(void)read(fd, &expire, sizeof(expire));
+	ret = arpc_cond_lock(&ctx->cond);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ;, "arpc_cond_lock conn[%u][%p] fail.", con->id, con);
+	if (!ctx->drain_con || IS_SET(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE)) {
+		arpc_conn_drain_stop(con);
+		goto unlock;
+	}
+	ret = xio_connection_ioctl(ctx->drain_con, XIO_CONNECTION_IDLE, &idle, &len);
+	if (!ret && !idle && arpc_clock_coarse_ns() < ctx->drain_start_ns + ARPC_CONN_DRAIN_MAX_MS * 1000000ULL) {
+		goto unlock;
+	}
+	if (idle) {
+		ARPC_LOG_NOTICE("conn[%u] old connection drained in %lu us.", con->id, (arpc_clock_ns() - ctx->drain_start_ns) / 1000);
+	}else{
+		ARPC_LOG_ERROR("conn[%u] old connection drain timeout, disconnect it anyway.", con->id);
+	}
+	SET_FLAG(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE);
+	xio_disconnect(ctx->drain_con);
+	arpc_conn_drain_stop(con);
+unlock:
+	arpc_cond_unlock(&ctx->cond);
+}
+
+static int arpc_conn_drain_start(struct arpc_connection *con)
+{
+	int ret;
+	struct itimerspec its;
+	CONN_CTX(ctx, con, ARPC_ERROR);
+
+	ctx->drain_start_ns = arpc_clock_ns();
+	ctx->drain_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ctx->drain_fd < 0, ARPC_ERROR, "timerfd_create fail, errno[%d].", errno);
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_nsec = ARPC_CONN_DRAIN_CHECK_MS * 1000000L;
+	its.it_interval = its.it_value;
+	ret = timerfd_settime(ctx->drain_fd, 0, &its, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, close_fd, "timerfd_settime fail, errno[%d].", errno);
+	ret = xio_context_add_ev_handler(ctx->xio_con_ctx, ctx->drain_fd, XIO_POLLIN, arpc_conn_drain_callback, con);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, close_fd, "xio_context_add_ev_handler fail.");
+	return 0;
+close_fd:
+	close(ctx->drain_fd);
+	ctx->drain_fd = -1;
+	return ARPC_ERROR;
+}
+
+int arpc_client_migrate_event(struct arpc_connection *con, struct xio_connection *xio_con, enum xio_session_event event)
+{
+	int ret;
+	int handled = 0;
+	struct xio_connection *destroy = NULL;
+	CONN_CTX(ctx, con, 0);
+
+	ret = arpc_cond_lock(&ctx->cond);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, 0, "arpc_cond_lock conn[%u][%p] fail.", con->id, con);
+	if (xio_con && xio_con == ctx->mig_con) {
+		handled = 1;
+		switch (event) {
+			case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+				if (IS_SET(ctx->flags, ARPC_CONN_ATTR_MIG_CLOSE)) {
+					break;
+				}
+				if (!ctx->xio_con || ctx->status != ARPC_CON_STA_RUN_ACTIVE ||
+					IS_SET(ctx->flags, ARPC_CONN_ATTR_EXIT|ARPC_CONN_ATTR_SET_EXIT)) {
+					SET_FLAG(ctx->flags, ARPC_CONN_ATTR_MIG_CLOSE);	// 原连接已失效，放弃迁移
+					xio_disconnect(xio_con);
+					break;
+				}
+				// 之后的发送走新连接，旧连接上的回复仍由本连接处理
+				ctx->drain_con = ctx->xio_con;
+				ctx->xio_con = xio_con;
+				ctx->mig_con = NULL;
+				ARPC_LOG_NOTICE("conn[%u] migrated, conn_idx[%u] -> [%u].", con->id, ctx->xio_idx, ctx->mig_idx);
+				ctx->xio_idx = ctx->mig_idx;
+				CLR_FLAG(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE);
+				if (arpc_conn_drain_start(con)) {
+					SET_FLAG(ctx->flags, ARPC_CONN_ATTR_DRAIN_CLOSE);
+					xio_disconnect(ctx->drain_con);
+				}
+				break;
+			case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+				ARPC_LOG_NOTICE("conn[%u] migrate connection teardown.", con->id);
+				ctx->mig_con = NULL;
+				destroy = xio_con;
+				break;
+			default:
+				ARPC_LOG_NOTICE("conn[%u] migrate connection event[%s].", con->id, xio_session_event_str(event));
+				break;
+		}
+	}else if (xio_con && xio_con == ctx->drain_con) {
+		handled = 1;
+		if (event == XIO_SESSION_CONNECTION_TEARDOWN_EVENT) {
+			ctx->drain_con = NULL;
+			arpc_conn_drain_stop(con);
+			destroy = xio_con;
+		}
+	}
+	arpc_cond_unlock(&ctx->cond);
+	if (destroy) {
+		xio_connection_destroy(destroy);
+	}
+	return handled;
+}
+
 int check_xio_msg_valid(const struct arpc_connection *conn, const struct xio_vmsg *pmsg)
 {
 	uint32_t iov_depth = 0;
@@ -842,55 +1038,130 @@ static void check_session_active(struct arpc_connection_ctx *ctx)
 }
 
 
+static int arpc_connection_wait_tx_depth(const struct arpc_connection *conn)
+{
+	int ret;
+	uint64_t depth;
+	CONN_CTX(ctx, conn, ARPC_ERROR);
+
+	ret = arpc_cond_lock(&ctx->cond);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock conn[%u][%p] fail.", conn->id, conn);
+	depth = mpsc_ring_depth(&ctx->tx_ring);
+	while((depth > ARPC_CONN_TX_MAX_DEPTH) && (ctx->status == ARPC_CON_STA_RUN_ACTIVE)){
+		ARPC_LOG_NOTICE("con is busy, tx depth[%lu] wait release,", depth);
+		ret = arpc_cond_wait_timeout(&ctx->cond, 1 + 2*depth);
+		LOG_ERROR_IF_VAL_TRUE(ret, "conn[%u][%p], xio con[%p] wait timeout to coninue.", conn->id, conn, ctx->xio_con);
+		depth = mpsc_ring_depth(&ctx->tx_ring);
+	}
+	ret = (ctx->status == ARPC_CON_STA_RUN_ACTIVE)? ARPC_SUCCESS : ARPC_ERROR;
+	arpc_cond_unlock(&ctx->cond);
+	return ret;
+}
+
+// 多线程并发安全，正常路径不加锁
 int arpc_connection_async_send(const struct arpc_connection *conn, struct arpc_common_msg  *msg)
 {
 	int ret;
-	eventfd_t event_val = 0;
+	int doorbell = 0;
+	uint64_t bytes;
 	CONN_CTX(ctx, conn, ARPC_ERROR);
 	
 	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ARPC_ERROR, "arpc_conn_ow_msg null.");
 
 	ARPC_LOG_TRACE("arpc commit tx msg, msg type:%d", msg->type);
 
-	ret = arpc_cond_lock(&ctx->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock conn[%u][%p] fail.", conn->id, conn);
-
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((ctx->status != ARPC_CON_STA_RUN_ACTIVE), unlock, 
+	LOG_THEN_RETURN_VAL_IF_TRUE((__atomic_load_n(&ctx->status, __ATOMIC_ACQUIRE) != ARPC_CON_STA_RUN_ACTIVE), ARPC_ERROR, 
 									"conn[%u] status[%d] not active", conn->id, ctx->status);
-	SET_FLAG(ctx->flags, ARPC_CONN_ATTR_TELL_LIVE);
+	if (!IS_SET(__atomic_load_n(&ctx->flags, __ATOMIC_RELAXED), ARPC_CONN_ATTR_TELL_LIVE)) {
+		__atomic_or_fetch(&ctx->flags, ARPC_CONN_ATTR_TELL_LIVE, __ATOMIC_RELAXED);
+	}
 	ret = check_xio_msg_valid(conn, &msg->tx_msg->out);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "check msg invalid.");
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "check msg invalid.");
 
-	while((ctx->tx_msg_num > ARPC_CONN_TX_MAX_DEPTH) && (ctx->status == ARPC_CON_STA_RUN_ACTIVE)){
-		ARPC_LOG_NOTICE("con is busy, tx_msg_num[%lu] wait release,", ctx->tx_msg_num);
-		ret = arpc_cond_wait_timeout(&ctx->cond, 1 + 2*ctx->tx_msg_num);
-		LOG_ERROR_IF_VAL_TRUE(ret, "conn[%u][%p], xio con[%p] wait timeout to coninue.", conn->id, conn, ctx->xio_con);
-		if (ret){
-			continue;
+	msg->status = ARPC_MSG_STATUS_TX;
+	bytes = arpc_tx_msg_bytes(&msg->tx_msg->out);
+	msg->tx_len = bytes;
+	__atomic_add_fetch(&ctx->tx_bytes, bytes, __ATOMIC_RELAXED);	//先计数，保证消费者扣减时不会下溢
+	MSG_TRACE(msg->attr.trace_id, MSG_TRACE_ENQUEUE, msg->type, conn->id, (uint32_t)bytes);
+	for(;;){
+		if (mpsc_ring_depth(&ctx->tx_ring) > ARPC_CONN_TX_MAX_DEPTH) {
+			ret = arpc_connection_wait_tx_depth(conn);
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, fail, "connoection invalid, send msg[%d] fail.", msg->type);
 		}
-		ret = 0;
-		break;
+		if (!mpsc_ring_push(&ctx->tx_ring, msg, &doorbell)) {
+			break;
+		}
+		ARPC_LOG_NOTICE("conn[%u] tx ring full, wait release.", conn->id);
+		arpc_usleep(10);
 	}
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "connoection invalid, send msg[%d] fail.", msg->type);
-
-	arpc_mutex_lock(&ctx->msg_lock);
-	QUEUE_REMOVE(&msg->q);
-	QUEUE_INIT(&msg->q);
-	msg->status = ARPC_MSG_STATUS_TX;
-	QUEUE_INSERT_TAIL(&ctx->q_tx_msg, &msg->q);
-	ctx->tx_msg_num++;
-
-	ret = eventfd_write(ctx->event_fd, 1);//触发发送事件
-	LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, ctx->event_fd);
 
-	arpc_mutex_unlock(&ctx->msg_lock);
+	if (doorbell) {
+		ret = eventfd_write(ctx->event_fd, 1);//队列由空变为非空才触发发送事件
+		LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, ctx->event_fd);
+	}
+	return 0;
+fail:
+	__atomic_sub_fetch(&ctx->tx_bytes, bytes, __ATOMIC_RELAXED);
+	msg->status = ARPC_MSG_STATUS_USED;
+	return ARPC_ERROR;
+}
 
-	arpc_cond_unlock(&ctx->cond);
+uint32_t arpc_connection_async_send_batch(const struct arpc_connection *conn, struct arpc_common_msg **msgs, uint32_t num)
+{
+	int ret;
+	int doorbell;
+	int ring = 0;
+	uint32_t i;
+	uint64_t bytes;
+	struct arpc_common_msg *msg;
+	CONN_CTX(ctx, conn, 0);
 
-	return ret;
-unlock:
-	arpc_cond_unlock(&ctx->cond);
-	return ARPC_ERROR;
+	LOG_THEN_RETURN_VAL_IF_TRUE((!msgs || !num), 0, "msgs null.");
+	LOG_THEN_RETURN_VAL_IF_TRUE((__atomic_load_n(&ctx->status, __ATOMIC_ACQUIRE) != ARPC_CON_STA_RUN_ACTIVE), 0, 
+									"conn[%u] status[%d] not active", conn->id, ctx->status);
+	if (!IS_SET(__atomic_load_n(&ctx->flags, __ATOMIC_RELAXED), ARPC_CONN_ATTR_TELL_LIVE)) {
+		__atomic_or_fetch(&ctx->flags, ARPC_CONN_ATTR_TELL_LIVE, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < num; i++) {
+		msg = msgs[i];
+		ret = check_xio_msg_valid(conn, &msg->tx_msg->out);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, end, "check msg invalid.");
+
+		msg->status = ARPC_MSG_STATUS_TX;
+		bytes = arpc_tx_msg_bytes(&msg->tx_msg->out);
+		msg->tx_len = bytes;
+		__atomic_add_fetch(&ctx->tx_bytes, bytes, __ATOMIC_RELAXED);	//先计数，保证消费者扣减时不会下溢
+		for(;;){
+			if (mpsc_ring_depth(&ctx->tx_ring) > ARPC_CONN_TX_MAX_DEPTH) {
+				if (ring) {
+					// 等待消费前必须先唤醒loop，否则环永远不会被取走
+					ret = eventfd_write(ctx->event_fd, 1);
+					LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, ctx->event_fd);
+					ring = 0;
+				}
+				ret = arpc_connection_wait_tx_depth(conn);
+				if (ret) {
+					ARPC_LOG_ERROR("connoection invalid, send msg[%d] fail.", msg->type);
+					__atomic_sub_fetch(&ctx->tx_bytes, bytes, __ATOMIC_RELAXED);
+					msg->status = ARPC_MSG_STATUS_USED;
+					goto end;
+				}
+			}
+			doorbell = 0;
+			if (!mpsc_ring_push(&ctx->tx_ring, msg, &doorbell)) {
+				ring |= doorbell;
+				break;
+			}
+			ARPC_LOG_NOTICE("conn[%u] tx ring full, wait release.", conn->id);
+			arpc_usleep(10);
+		}
+	}
+end:
+	if (ring) {
+		ret = eventfd_write(ctx->event_fd, 1);//队列由空变为非空才触发发送事件
+		LOG_ERROR_IF_VAL_TRUE(ret < 0, "ret[%d], write fd[%d] fail", ret, ctx->event_fd);
+	}
+	return i;
 }
 
 int arpc_check_connection_valid(struct arpc_connection *conn, enum  arpc_msg_type msg_type)
@@ -907,21 +1178,62 @@ int arpc_check_connection_valid(struct arpc_connection *conn, enum  arpc_msg_typ
 		return ARPC_ERROR;
 	}
 
-	if ((ctx->tx_msg_num > ARPC_CONN_TX_MAX_DEPTH) || (ctx->status != ARPC_CON_STA_RUN_ACTIVE)) {
-		ARPC_LOG_ERROR("conn[%u], tx num[%lu], status[%d], io_type[%d]", conn->id, ctx->tx_msg_num, ctx->status, ctx->io_type);
+	if ((mpsc_ring_depth(&ctx->tx_ring) > ARPC_CONN_TX_MAX_DEPTH) || (ctx->status != ARPC_CON_STA_RUN_ACTIVE)) {
+		ARPC_LOG_ERROR("conn[%u], tx num[%lu], status[%d], io_type[%d]", conn->id, mpsc_ring_depth(&ctx->tx_ring), ctx->status, ctx->io_type);
 		ret = ARPC_ERROR;
 	}
 	arpc_cond_unlock(&ctx->cond);
 	return ret;
 }
 
+// 无锁，只做原子读，供会话选路使用
+int arpc_connection_get_load(const struct arpc_connection *conn, enum  arpc_msg_type msg_type, uint64_t *load)
+{
+	CONN_CTX(ctx, conn, ARPC_ERROR);
+
+	if (__atomic_load_n(&ctx->status, __ATOMIC_ACQUIRE) != ARPC_CON_STA_RUN_ACTIVE) {
+		return ARPC_ERROR;
+	}
+	if ((msg_type == ARPC_MSG_TYPE_OW) && (__atomic_load_n(&ctx->io_type, __ATOMIC_RELAXED) == ARPC_IO_TYPE_IN)) {
+		return ARPC_ERROR;
+	}
+	if (mpsc_ring_depth(&ctx->tx_ring) > ARPC_CONN_TX_MAX_DEPTH) {
+		return ARPC_ERROR;
+	}
+	if (load) {
+		*load = (uint64_t)__atomic_load_n(&ctx->busy_msg, __ATOMIC_RELAXED) * ARPC_CONN_LOAD_MSG_COST
+				+ __atomic_load_n(&ctx->tx_bytes, __ATOMIC_RELAXED);
+	}
+	return ARPC_SUCCESS;
+}
+
+void arpc_connection_stat_fill(const struct arpc_connection *conn, uint32_t session_index, struct arpc_stat_shm_conn *out)
+{
+	const struct arpc_stat_set *set;
+	CONN_CTX(ctx, conn, );
+
+	set = &conn->stats;
+	out->session = session_index;
+	out->id = conn->id;
+	out->status = __atomic_load_n(&ctx->status, __ATOMIC_RELAXED);
+	out->inflight = __atomic_load_n(&ctx->busy_msg, __ATOMIC_RELAXED);
+	out->tx_queue = mpsc_ring_depth(&ctx->tx_ring);
+	out->tx_pending_bytes = __atomic_load_n(&ctx->tx_bytes, __ATOMIC_RELAXED);
+	out->tx_msg = __atomic_load_n(&set->tx_req, __ATOMIC_RELAXED) + __atomic_load_n(&set->tx_rsp, __ATOMIC_RELAXED)
+				+ __atomic_load_n(&set->tx_ow, __ATOMIC_RELAXED);
+	out->rx_msg = __atomic_load_n(&set->rx_req, __ATOMIC_RELAXED) + __atomic_load_n(&set->rx_rsp, __ATOMIC_RELAXED)
+				+ __atomic_load_n(&set->rx_ow, __ATOMIC_RELAXED);
+	out->tx_bytes = __atomic_load_n(&set->tx_bytes, __ATOMIC_RELAXED);
+	out->rx_bytes = __atomic_load_n(&set->rx_bytes, __ATOMIC_RELAXED);
+}
+
 int set_connection_io_type(struct arpc_connection *conn, enum arpc_io_type type)
 {
 	int ret = 0;
 	CONN_CTX(ctx, conn, ARPC_ERROR);
 	ret = arpc_cond_lock(&ctx->cond);
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock conn[%u][%p] fail.", conn->id, conn);
-	ctx->io_type = type;
+	__atomic_store_n(&ctx->io_type, type, __ATOMIC_RELEASE);
 	arpc_cond_unlock(&ctx->cond);
 	return 0;
 }
@@ -967,6 +1279,18 @@ enum arpc_connection_type arpc_get_conn_type(struct arpc_connection *con)
 	return ctx->type;
 }
 
+int arpc_get_conn_numa_node(const struct arpc_connection *con)
+{
+	CONN_CTX(ctx, con, -1);
+	return ctx->numa_node;
+}
+
+struct xio_context *arpc_get_conn_xio_ctx(const struct arpc_connection *con)
+{
+	CONN_CTX(ctx, con, NULL);
+	return ctx->xio_con_ctx;
+}
+
 void *arpc_get_conn_threadpool(struct arpc_connection *con)
 {
 	CONN_CTX(ctx, con, NULL);
@@ -976,125 +1300,296 @@ void *arpc_get_conn_threadpool(struct arpc_connection *con)
 	return NULL;
 }
 
-static inline int alloc_common_msg(QUEUE* iter, uint32_t size, enum  arpc_msg_type type)
+// 客户端建链回调里可能更新，发送时无锁读取
+static inline uint32_t arpc_conn_csum_type(struct arpc_connection_ctx *ctx)
 {
+	return ctx->session ? __atomic_load_n(&ctx->session->csum_type, __ATOMIC_RELAXED) : 0;
+}
+
+static inline uint32_t arpc_conn_zip_type(struct arpc_connection_ctx *ctx)
+{
+	return ctx->session ? __atomic_load_n(&ctx->session->zip_type, __ATOMIC_RELAXED) : 0;
+}
+
+static pthread_once_t g_msg_cache_once = PTHREAD_ONCE_INIT;
+static slab_cache_t g_msg_cache[ARPC_MSG_TYPE_OW + 1];
+static uint32_t g_msg_head_cap;	// 描述符内发送头部缓存的容量，缓存为进程级，按全局头部上限预留
+
+// 会话头部上限不超过预留容量时，发送头部都能放进描述符
+static inline uint32_t arpc_conn_head_buf_len(struct arpc_connection_ctx *ctx)
+{
+	uint32_t len = ctx->msg_head_max_len + COMM_MSG_HEAD_RESERVE;
+	return (len < g_msg_head_cap)? len : g_msg_head_cap;
+}
+
+static int arpc_common_msg_ctor(void *obj, void *usr_ctx)
+{
+	struct arpc_common_msg *msg = (struct arpc_common_msg *)obj;
+	uint32_t head_offset = (uint32_t)(uintptr_t)usr_ctx;
+	arpc_completion_init(&msg->comp);
+	msg->flag = 0;
+	QUEUE_INIT(&msg->q);
+	msg->magic = ARPC_COM_MSG_MAGIC;
+	msg->status = ARPC_MSG_STATUS_IDLE;
+	msg->tx_head_buf = (char *)obj + head_offset;
+	msg->tx_head_buf_len = g_msg_head_cap;
+	return 0;
+}
+
+static void arpc_common_msg_dtor(void *obj, void *usr_ctx)
+{
+	struct arpc_common_msg *msg = (struct arpc_common_msg *)obj;
+	msg->magic = 0;
+	msg->status = ARPC_MSG_STATUS_FREE;
+}
+
+static void arpc_msg_cache_init(void)
+{
+	struct slab_cache_param param;
+	const char *name[] = {"arpc_req_msg", "arpc_rsp_msg", "arpc_ow_msg"};
+	uint32_t ex_size[] = {sizeof(struct arpc_request_handle), sizeof(struct arpc_rsp_handle), sizeof(struct arpc_oneway_handle)};
+	uint32_t head_offset;
 	int i;
-	struct arpc_common_msg *req_msg = NULL;
-	if(QUEUE_EMPTY(iter)) {
-		for (i = 0; i < COMM_MSG_GROW_STEP; i++) {
-			req_msg = arpc_create_common_msg(size);
-			LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, -1, "req_msg arpc_create_common_msg fail.");
-			req_msg->type = type;
-			QUEUE_INIT(&req_msg->q);
-			QUEUE_INSERT_TAIL(iter, &req_msg->q);
+
+	g_msg_head_cap = get_option()->msg_head_max_len + COMM_MSG_HEAD_RESERVE;
+	for (i = ARPC_MSG_TYPE_REQ; i <= ARPC_MSG_TYPE_OW; i++) {
+		memset(&param, 0, sizeof(param));
+		param.name = name[i];
+		// 描述符尾部预留发送头部空间，发送路径不再为头部申请内存
+		head_offset = (sizeof(struct arpc_common_msg) + ex_size[i] + 7) & ~7U;
+		param.obj_size = head_offset + g_msg_head_cap;
+		param.slab_obj_num = COMM_MSG_SLAB_OBJ_NUM;
+		param.mag_size = COMM_MSG_MAG_SIZE;
+		param.reap_interval_s = COMM_MSG_REAP_INTERVAL_S;
+		param.ctor = &arpc_common_msg_ctor;
+		param.dtor = &arpc_common_msg_dtor;
+		param.usr_ctx = (void *)(uintptr_t)head_offset;
+		g_msg_cache[i] = slab_cache_create(&param);
+		LOG_ERROR_IF_VAL_TRUE(!g_msg_cache[i], "slab_cache_create for %s fail.", name[i]);
+	}
+}
+
+// 描述符缓存为进程级，线程退出时其magazine自动归还
+static slab_cache_t arpc_get_msg_cache(enum arpc_msg_type type)
+{
+	if (type > ARPC_MSG_TYPE_OW) {
+		return NULL;
+	}
+	pthread_once(&g_msg_cache_once, &arpc_msg_cache_init);
+	return g_msg_cache[type];
+}
+
+// 连接空闲时回收描述符缓存，按COMM_MSG_REAP_INTERVAL_S限频，避免每次空闲都去碰全局缓存
+// 各线程粗粒度时间可能略早于他人记下的时间，按加法比较不会回绕
+static int arpc_conn_reap_due(struct arpc_connection_ctx *ctx)
+{
+	uint64_t now_ns = arpc_clock_coarse_ns();
+	uint64_t last_ns = __atomic_load_n(&ctx->reap_ns, __ATOMIC_RELAXED);
+
+	if (last_ns && now_ns < last_ns + COMM_MSG_REAP_INTERVAL_S * 1000000000ULL) {
+		return 0;
+	}
+	return __atomic_compare_exchange_n(&ctx->reap_ns, &last_ns, now_ns, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int arpc_match_conn_msg(void *obj, void *arg)
+{
+	struct arpc_common_msg *msg = (struct arpc_common_msg *)obj;
+	if (msg->conn != arg || msg->status == ARPC_MSG_STATUS_IDLE) {
+		return 0;
+	}
+	// 仍在等待的调用者按超时处理，不唤醒；完成队列的请求投递失败事件
+	if (msg->type == ARPC_MSG_TYPE_REQ) {
+		(void)arpc_request_reclaim(msg);
+	}
+	__atomic_store_n(&msg->status, ARPC_MSG_STATUS_IDLE, __ATOMIC_RELEASE);
+	msg->conn = NULL;
+	return 1;
+}
+
+static int arpc_reclaim_conn_msg(struct arpc_connection *con)
+{
+	int i;
+	int cnt = 0;
+	int reap;
+	uint32_t busy;
+	slab_cache_t cache;
+	CONN_CTX(ctx, con, ARPC_ERROR);
+
+	busy = __atomic_load_n(&ctx->busy_msg, __ATOMIC_ACQUIRE);
+	reap = arpc_conn_reap_due(ctx);
+	for (i = ARPC_MSG_TYPE_REQ; i <= ARPC_MSG_TYPE_OW; i++) {
+		cache = arpc_get_msg_cache((enum arpc_msg_type)i);
+		if (!cache) {
+			continue;
+		}
+		if (busy) {
+			cnt += slab_cache_reclaim(cache, &arpc_match_conn_msg, con);
+		}
+		if (reap) {
+			(void)slab_cache_reap(cache, (uint64_t)time(NULL));
 		}
 	}
+	if (busy) {
+		ARPC_LOG_NOTICE("conn[%u] reclaim msg num[%d], busy[%u].", con->id, cnt, busy);
+	}
+	ctx->busy_msg = 0;
+	ctx->tx_bytes = 0;
 	return 0;
 }
 
 struct arpc_common_msg *get_common_msg(const struct arpc_connection *conn, enum  arpc_msg_type type)
 {
-	int ret;
-	QUEUE* iter = NULL;
-	int i;
+	slab_cache_t cache;
 	struct arpc_common_msg *req_msg = NULL;
+	uint64_t redirect;
 	CONN_CTX(ctx, conn, NULL);
 
-	arpc_mutex_lock(&ctx->msg_lock);
+	cache = arpc_get_msg_cache(type);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, NULL, "msg cache for type[%d] is null.", type);
+	req_msg = (struct arpc_common_msg *)slab_cache_alloc(cache);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, NULL, "alloc common msg for type[%d] fail.", type);
+
 	switch (type)
 	{
 	case ARPC_MSG_TYPE_REQ:
-		((struct arpc_connection *)conn)->tx_req_count++;
-		ret = alloc_common_msg(&ctx->q_req_msg, sizeof(struct arpc_request_handle), type);
-		if (ret) {
-			ARPC_LOG_ERROR("alloc_common_msg for req fail.");
-			break;
-		}
-		iter = QUEUE_HEAD(&ctx->q_req_msg);
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_req, 1, __ATOMIC_RELAXED);
 		break;
 	case ARPC_MSG_TYPE_RSP:
-		((struct arpc_connection *)conn)->tx_rsp_count++;
-		ret = alloc_common_msg(&ctx->q_rsp_msg, sizeof(struct arpc_rsp_handle), type);
-		if (ret) {
-			ARPC_LOG_ERROR("alloc_common_msg for rsp fail.");
-			break;
-		}
-		iter = QUEUE_HEAD(&ctx->q_rsp_msg);
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_rsp, 1, __ATOMIC_RELAXED);
 		break;
 	case ARPC_MSG_TYPE_OW:
-		((struct arpc_connection *)conn)->tx_ow_count++;
-		ret = alloc_common_msg(&ctx->q_ow_msg, sizeof(struct arpc_oneway_handle), type);
-		if (ret) {
-			ARPC_LOG_ERROR("alloc_common_msg for ow fail.");
-			break;
-		}
-		iter = QUEUE_HEAD(&ctx->q_ow_msg);
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_ow, 1, __ATOMIC_RELAXED);
 		break;
 	default:
-		ret = -1;
 		break;
 	}
-	if (!ret){
-		QUEUE_REMOVE(iter);
-		QUEUE_INIT(iter);
-		req_msg = QUEUE_DATA(iter, struct arpc_common_msg, q);
-		req_msg->status = ARPC_MSG_STATUS_USED;
-		req_msg->conn = conn;
-		QUEUE_INSERT_TAIL(&ctx->q_used_msg, &req_msg->q);
-		ctx->busy_msg++;
-	}
-	arpc_mutex_unlock(&ctx->msg_lock);
-	if (req_msg) {
-		memset(&req_msg->xio_msg, 0, sizeof(struct xio_msg));
+	req_msg->type = type;
+	req_msg->status = ARPC_MSG_STATUS_USED;
+	req_msg->conn = conn;
+	req_msg->attr.csum_type = arpc_conn_csum_type(ctx);
+	req_msg->attr.zip_type = arpc_conn_zip_type(ctx);
+	req_msg->attr.trace_id = 0;
+	req_msg->attr.redirect_slot = 0;
+	req_msg->attr.redirect_num = 0;
+	// 服务端待迁移的提示只捎带一次
+	if (type == ARPC_MSG_TYPE_RSP && __atomic_load_n(&ctx->redirect, __ATOMIC_RELAXED)) {
+		redirect = __atomic_exchange_n(&ctx->redirect, 0, __ATOMIC_RELAXED);
+		req_msg->attr.redirect_slot = (uint32_t)(redirect >> 32);
+		req_msg->attr.redirect_num = (uint32_t)redirect;
 	}
+	req_msg->start_ns = arpc_clock_ns();
+	req_msg->tx_head_buf_len = arpc_conn_head_buf_len(ctx);
+	arpc_completion_reset(&req_msg->comp);
+	__atomic_add_fetch(&ctx->busy_msg, 1, __ATOMIC_RELAXED);
+	memset(&req_msg->xio_msg, 0, sizeof(struct xio_msg));
 	
 	return req_msg;
 }
 
+uint32_t get_common_msg_bulk(const struct arpc_connection *conn, enum  arpc_msg_type type,
+							struct arpc_common_msg **msgs, uint32_t num)
+{
+	slab_cache_t cache;
+	uint32_t i;
+	uint64_t start_ns = arpc_clock_ns();	// 整批共用一个申请时间
+	CONN_CTX(ctx, conn, 0);
+
+	cache = arpc_get_msg_cache(type);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cache, 0, "msg cache for type[%d] is null.", type);
+	for (i = 0; i < num; i++) {
+		msgs[i] = (struct arpc_common_msg *)slab_cache_alloc(cache);	// 本线程magazine内无锁
+		if (!msgs[i]) {
+			ARPC_LOG_ERROR("alloc common msg for type[%d] fail, got[%u].", type, i);
+			break;
+		}
+		msgs[i]->type = type;
+		msgs[i]->status = ARPC_MSG_STATUS_USED;
+		msgs[i]->conn = conn;
+		msgs[i]->attr.csum_type = arpc_conn_csum_type(ctx);
+		msgs[i]->attr.zip_type = arpc_conn_zip_type(ctx);
+		msgs[i]->attr.trace_id = 0;
+		msgs[i]->attr.redirect_slot = 0;
+		msgs[i]->attr.redirect_num = 0;
+		msgs[i]->start_ns = start_ns;
+		msgs[i]->tx_head_buf_len = arpc_conn_head_buf_len(ctx);
+		arpc_completion_reset(&msgs[i]->comp);
+		memset(&msgs[i]->xio_msg, 0, sizeof(struct xio_msg));
+	}
+	if (!i) {
+		return 0;
+	}
+	switch (type)
+	{
+	case ARPC_MSG_TYPE_REQ:
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_req, i, __ATOMIC_RELAXED);
+		break;
+	case ARPC_MSG_TYPE_RSP:
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_rsp, i, __ATOMIC_RELAXED);
+		break;
+	case ARPC_MSG_TYPE_OW:
+		__atomic_add_fetch(&((struct arpc_connection *)conn)->stats.tx_ow, i, __ATOMIC_RELAXED);
+		break;
+	default:
+		break;
+	}
+	__atomic_add_fetch(&ctx->busy_msg, i, __ATOMIC_RELAXED);
+	return i;
+}
+
 void put_common_msg(struct arpc_common_msg *msg)
 {
 	struct arpc_connection *conn;
 	struct arpc_connection_ctx *ctx;
-	int ret;
+	slab_cache_t cache;
+	enum arpc_msg_status status;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ;, "msg  is null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE(!msg->conn, ;, "msg  is null.");
-	ret = arpc_cond_lock(&msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ;, "arpc_cond_lock msg fail.");
-	if (msg->status == ARPC_MSG_STATUS_IDLE) {
-		arpc_cond_unlock(&msg->cond);
-		return;
+	status = __atomic_load_n(&msg->status, __ATOMIC_ACQUIRE);
+	for (;;) {
+		if (status == ARPC_MSG_STATUS_USED) {
+			if (__atomic_compare_exchange_n(&msg->status, &status, ARPC_MSG_STATUS_IDLE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+			continue;
+		}
+		if (status == ARPC_MSG_STATUS_TX) {
+			// 还在发送环中，标记后由发送线程出环时回收
+			if (__atomic_compare_exchange_n(&msg->status, &status, ARPC_MSG_STATUS_TX_PUT, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				return;
+			}
+			continue;
+		}
+		LOG_ERROR_IF_VAL_TRUE(status != ARPC_MSG_STATUS_IDLE, "msg[%p] status[%d] can't put.", msg, status);
+		return;	// 已被回收
 	}
-	assert(msg->status == ARPC_MSG_STATUS_USED);
-	msg->status = ARPC_MSG_STATUS_IDLE;
 	msg->retry_cnt = 0;
 	msg->flag = 0;
 	msg->xio_msg.flags = 0;
-	arpc_cond_unlock(&msg->cond);
 	conn = (struct arpc_connection *)msg->conn;
 	ctx = (struct arpc_connection_ctx *)(conn->ctx);
-	arpc_mutex_lock(&ctx->msg_lock);
-	QUEUE_REMOVE(&msg->q);
-	QUEUE_INIT(&msg->q);
 	switch (msg->type)
 	{
 	case ARPC_MSG_TYPE_REQ:
-		statistics_per_time(&msg->now, &conn->tx_req, 3);
-		QUEUE_INSERT_TAIL(&ctx->q_req_msg, &msg->q);
+		arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_REQ, msg->start_ns);
 		break;
 	case ARPC_MSG_TYPE_RSP:
-		statistics_per_time(&msg->now, &conn->tx_rsp, 3);
-		QUEUE_INSERT_TAIL(&ctx->q_rsp_msg, &msg->q);
+		arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_RSP, msg->start_ns);
 		break;
 	case ARPC_MSG_TYPE_OW:
-		statistics_per_time(&msg->now, &conn->tx_ow, 3);
-		QUEUE_INSERT_TAIL(&ctx->q_ow_msg, &msg->q);
-		break;
+		break;	// 在发送完成回调中统计
 	default:
 		ARPC_LOG_ERROR("unkown type");
 		break;
 	}
-	ctx->busy_msg--;
-	arpc_mutex_unlock(&ctx->msg_lock);
+	cache = arpc_get_msg_cache(msg->type);
+	msg->conn = NULL;
+	slab_cache_free(cache, msg);
+
+	// 连接空闲时，让缓存把超出工作集的描述符还给系统
+	if (!__atomic_sub_fetch(&ctx->busy_msg, 1, __ATOMIC_RELAXED) && arpc_conn_reap_due(ctx)) {
+		(void)slab_cache_reap(cache, (uint64_t)time(NULL));
+	}
 	return;
-}
\ No newline at end of file
+}
@@ -57,27 +57,13 @@ enum arpc_io_type{
 struct arpc_connection {
 	QUEUE 						q;
 	uint32_t					id;
-	uint64_t					tx_ow_count;
-	uint64_t					tx_req_count;
-	uint64_t					tx_rsp_count;
-	uint64_t					rx_ow_count;
-	uint64_t					rx_req_count;
-	uint64_t					rx_rsp_count;
-	struct timeval 				tx_interval;
-	struct statistics_data		tx_ow;
-	struct statistics_data		tx_req;
-	struct statistics_data		tx_rsp;
-	struct statistics_data		tx_req_cmit;
-	struct statistics_data		tx_ow_cmit;
-	struct statistics_data		tx_rsp_cmit;
-	struct timeval 				rx_interval;
-	struct timeval 				rx_now;
-	struct statistics_data		rx_ow;
-	struct statistics_data		rx_req;
-	struct statistics_data		rx_rsp;
-	struct statistics_data		rx_ow_send;
-	struct statistics_data		rx_req_send;
-	struct statistics_data		rx_rsp_send;
+	uint64_t					rx_start_ns;		/* 当前接收消息的头部到达时刻，只在loop线程访问 */
+	struct arpc_stat_set		stats;				/* 接收与发送提交只由loop线程更新，描述符回收可在任意线程 */
+	uint64_t					load_bytes;			/* 服务端：上次负载采样时的累计收发字节，只在守护线程访问 */
+	uint64_t					load_score;			/* 服务端：最近采样周期的负载，在途消息折算后加字节速率 */
+	uint64_t					load_rsp;			/* 服务端：上次负载采样时的累计回复数 */
+	uint32_t					rsp_active;			/* 服务端：最近采样周期内发过回复，迁移提示只能捎带在回复上 */
+	uint32_t					redirected;			/* 服务端：已提示过客户端迁移，不再重复选中 */
 
 	char						ctx[0];
 };
@@ -93,6 +79,8 @@ struct arpc_connection_param {
 	struct xio_connection		*xio_con;
 	struct xio_context			*xio_con_ctx;
 	int64_t					timeout_ms;
+	int32_t					cpu;				/* 服务端连接所在loop的CPU，客户端连接自行分配 */
+	int32_t					numa_node;			/* 服务端连接所在loop的NUMA节点 */
 	void					*usr_ctx;
 };
 
@@ -116,6 +104,8 @@ uint32_t arpc_get_max_iov_len(struct arpc_connection *con);
 enum arpc_connection_type arpc_get_conn_type(struct arpc_connection *con);
 struct arpc_session_handle *arpc_get_conn_session(struct arpc_connection *con);
 void *arpc_get_conn_threadpool(struct arpc_connection *con);
+int arpc_get_conn_numa_node(const struct arpc_connection *con);
+struct xio_context *arpc_get_conn_xio_ctx(const struct arpc_connection *con);
 
 int arpc_lock_connection(struct arpc_connection *con);
 int arpc_unlock_connection(struct arpc_connection *con);
@@ -123,13 +113,92 @@ int arpc_unlock_connection(struct arpc_connection *con);
 int set_connection_io_type(struct arpc_connection *conn, enum arpc_io_type type);
 int arpc_check_connection_valid(struct arpc_connection *conn, enum  arpc_msg_type msg_type);
 
+/*!
+ * @brief  无锁获取连接负载（在途消息数折算 + 待发送字节数）
+ *
+ * @param[in] conn
+ * @param[in] msg_type 待发送的消息类型
+ * @param[out] load 负载值，越小越空闲
+ * @return  0 连接可用；-1 连接不可用（未激活、接收专用或发送环已满）
+ */
+int arpc_connection_get_load(const struct arpc_connection *conn, enum  arpc_msg_type msg_type, uint64_t *load);
+
+/*!
+ * @brief  填写连接的统计明细，只做原子读，供发布线程调用
+ *
+ * @param[in] conn
+ * @param[in] session_index 所属session在槽位内的序号
+ * @param[out] out 明细
+ */
+void arpc_connection_stat_fill(const struct arpc_connection *conn, uint32_t session_index, struct arpc_stat_shm_conn *out);
+
+/*!
+ * @brief  服务端：请客户端把该连接迁到入口slot对应的工作线程，提示随该连接的下一个回复带给客户端
+ *
+ * @param[in] conn 服务端连接
+ * @param[in] slot 目标入口序号
+ * @param[in] num 该session的入口总数
+ */
+void arpc_connection_set_redirect(struct arpc_connection *conn, uint32_t slot, uint32_t num);
+
+/*!
+ * @brief  客户端：收到回复中的迁移提示，在loop线程内调用，迁移由发送事件异步发起
+ *
+ * @param[in] conn 客户端连接
+ * @param[in] slot 目标入口序号
+ * @param[in] num 入口总数
+ */
+void arpc_client_redirect(struct arpc_connection *conn, uint32_t slot, uint32_t num);
+
+/*!
+ * @brief  客户端：处理迁移中新建连接或排空中旧连接的xio事件
+ *
+ * @param[in] con 客户端连接
+ * @param[in] xio_con 事件所属的xio连接
+ * @param[in] event 事件
+ * @return  1 事件已处理；0 事件属于当前连接，按原流程处理
+ */
+int arpc_client_migrate_event(struct arpc_connection *con, struct xio_connection *xio_con, enum xio_session_event event);
+
+// 消息交给传输层的字节数，含头部
+static inline uint64_t arpc_tx_msg_bytes(struct xio_vmsg *pmsg)
+{
+	uint32_t i;
+	uint32_t nents = vmsg_sglist_nents(pmsg);
+	struct xio_iovec_ex *sglist = vmsg_sglist(pmsg);
+	uint64_t bytes = pmsg->header.iov_len;
+
+	for (i = 0; sglist && i < nents; i++) {
+		bytes += sglist[i].iov_len;
+	}
+	return bytes;
+}
+
 int arpc_connection_async_send(const struct arpc_connection *conn, struct arpc_common_msg  *msg);
+
+/*!
+ * @brief  批量提交到发送环，整批只敲一次门铃
+ *
+ * @param[in] conn
+ * @param[in] msgs 待发送描述符
+ * @param[in] num 描述符个数
+ * @return  按顺序成功入队的个数，遇到失败即停止，之后的描述符由调用者回收
+ */
+uint32_t arpc_connection_async_send_batch(const struct arpc_connection *conn, struct arpc_common_msg **msgs, uint32_t num);
 int arpc_connection_send_comp_notify(const struct arpc_connection *conn, struct arpc_common_msg *msg);
 
 int check_xio_msg_valid(const struct arpc_connection *conn, const struct xio_vmsg *pmsg);
 int keep_conn_heartbeat(const struct arpc_connection *conn);
 
 struct arpc_common_msg *get_common_msg(const struct arpc_connection *conn, enum  arpc_msg_type type);
+
+/*!
+ * @brief  批量申请消息描述符，连接计数只更新一次
+ *
+ * @return  申请到的个数
+ */
+uint32_t get_common_msg_bulk(const struct arpc_connection *conn, enum  arpc_msg_type type,
+							struct arpc_common_msg **msgs, uint32_t num);
 void put_common_msg(struct arpc_common_msg *msg);
 
 #ifdef __cplusplus
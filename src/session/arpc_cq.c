@@ -0,0 +1,189 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file arpc_cq.c
+* \brief 异步请求完成队列
+* 
+* 包含..
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none 
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "mpsc_ring.h"
+#include "arpc_com.h"
+#include "arpc_message.h"
+#include "arpc_cq.h"
+
+#define ARPC_CQ_MIN_DEPTH		16
+#define ARPC_CQ_MAX_DEPTH		(64*1024)
+#define ARPC_CQ_SPIN_CNT		256		/* 无事件时睡眠前的自旋次数 */
+
+struct arpc_cq {
+	struct mpsc_ring	ring;				/* 元素为完成的struct arpc_msg */
+	uint32_t			depth;
+	uint32_t			inflight;			/* 已提交未收取的请求数，原子操作 */
+	uint32_t			seq;				/* 投递序号，futex等待字 */
+	uint32_t			waiters;
+};
+
+arpc_cq_t arpc_cq_create(uint32_t depth)
+{
+	struct arpc_cq *cq;
+	int ret;
+
+	depth = (depth < ARPC_CQ_MIN_DEPTH)? ARPC_CQ_MIN_DEPTH : depth;
+	depth = (depth > ARPC_CQ_MAX_DEPTH)? ARPC_CQ_MAX_DEPTH : depth;
+
+	cq = (struct arpc_cq *)arpc_mem_alloc(sizeof(struct arpc_cq), NULL);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!cq, NULL, "arpc_mem_alloc arpc_cq fail.");
+	memset(cq, 0, sizeof(struct arpc_cq));
+
+	ret = mpsc_ring_init(&cq->ring, depth);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_cq, "mpsc_ring_init fail.");
+	cq->depth = (uint32_t)cq->ring.size;	// 环大小即在途上限，投递不会失败
+	return (arpc_cq_t)cq;
+
+free_cq:
+	arpc_mem_free(cq, NULL);
+	return NULL;
+}
+
+int arpc_cq_destroy(arpc_cq_t *fd)
+{
+	struct arpc_cq *cq;
+	LOG_THEN_RETURN_VAL_IF_TRUE(!fd || !(*fd), ARPC_ERROR, "cq is null.");
+
+	cq = (struct arpc_cq *)(*fd);
+	if (__atomic_load_n(&cq->inflight, __ATOMIC_ACQUIRE)) {
+		ARPC_LOG_ERROR("cq[%p] still has %u request inflight or unpolled.", cq, cq->inflight);
+		return ARPC_ERROR;
+	}
+	mpsc_ring_destroy(&cq->ring);
+	arpc_mem_free(cq, NULL);
+	*fd = NULL;
+	return ARPC_SUCCESS;
+}
+
+int arpc_cq_reserve(struct arpc_cq *cq)
+{
+	uint32_t cur = __atomic_load_n(&cq->inflight, __ATOMIC_RELAXED);
+	do {
+		if (cur >= cq->depth) {
+			return ARPC_ERROR;
+		}
+	} while (!__atomic_compare_exchange_n(&cq->inflight, &cur, cur + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	return ARPC_SUCCESS;
+}
+
+void arpc_cq_unreserve(struct arpc_cq *cq)
+{
+	__atomic_sub_fetch(&cq->inflight, 1, __ATOMIC_RELEASE);
+}
+
+// 在xio loop线程内执行
+void arpc_cq_complete(struct arpc_cq *cq, struct arpc_msg *msg)
+{
+	int doorbell = 0;
+
+	if (mpsc_ring_push(&cq->ring, msg, &doorbell)) {
+		ARPC_LOG_ERROR("cq[%p] overflow, inflight[%u], drop msg[%p].", cq, cq->inflight, msg);	// 预占保证不会发生
+		return;
+	}
+	__atomic_add_fetch(&cq->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&cq->waiters, __ATOMIC_SEQ_CST)) {
+		syscall(SYS_futex, &cq->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+static uint32_t cq_harvest(struct arpc_cq *cq, struct arpc_cq_event *events, uint32_t max)
+{
+	uint32_t cnt = 0;
+	struct arpc_msg *msg;
+	struct arpc_msg_ex *ex_msg;
+
+	while (cnt < max && (msg = (struct arpc_msg *)mpsc_ring_pop(&cq->ring)) != NULL) {
+		ex_msg = (struct arpc_msg_ex *)msg->handle;
+		if (arpc_msg_rx_verify(msg) && !ex_msg->cq_status) {
+			ex_msg->cq_status = -ENODATA;	// 回复在取结果时校验
+		}
+		events[cnt].tag = ex_msg->cq_tag;
+		events[cnt].msg = msg;
+		events[cnt].status = ex_msg->cq_status;
+		ex_msg->cq = NULL;
+		ex_msg->cq_tag = NULL;
+		cnt++;
+	}
+	if (cnt) {
+		(void)mpsc_ring_consumed(&cq->ring, cnt);
+		__atomic_sub_fetch(&cq->inflight, cnt, __ATOMIC_RELEASE);
+	}
+	return cnt;
+}
+
+int arpc_cq_poll(arpc_cq_t fd, struct arpc_cq_event *events, uint32_t max, int32_t timeout_ms)
+{
+	struct arpc_cq *cq = (struct arpc_cq *)fd;
+	struct timespec rel;
+	uint64_t deadline_ns = 0;
+	uint32_t cnt;
+	uint32_t seq;
+	int64_t left_ns;
+	int spin;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!cq || !events || !max), ARPC_ERROR, "cq or events null, exit.");
+
+	cnt = cq_harvest(cq, events, max);
+	if (cnt || !timeout_ms) {
+		return (int)cnt;
+	}
+
+	for (spin = 0; spin < ARPC_CQ_SPIN_CNT && arpc_cpu_max_num() > 1; spin++) {
+		ARPC_CPU_RELAX();
+		cnt = cq_harvest(cq, events, max);
+		if (cnt) {
+			return (int)cnt;
+		}
+	}
+
+	if (timeout_ms > 0) {
+		deadline_ns = fast_clock_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	}
+	for (;;) {
+		seq = __atomic_load_n(&cq->seq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&cq->waiters, 1, __ATOMIC_SEQ_CST);
+		cnt = cq_harvest(cq, events, max);
+		if (cnt) {
+			__atomic_sub_fetch(&cq->waiters, 1, __ATOMIC_RELAXED);
+			return (int)cnt;
+		}
+		if (timeout_ms > 0) {
+			left_ns = (int64_t)(deadline_ns - fast_clock_ns());
+			if (left_ns <= 0) {
+				__atomic_sub_fetch(&cq->waiters, 1, __ATOMIC_RELAXED);
+				return 0;
+			}
+			rel.tv_sec = left_ns / 1000000000L;
+			rel.tv_nsec = left_ns % 1000000000L;
+			syscall(SYS_futex, &cq->seq, FUTEX_WAIT_PRIVATE, seq, &rel, NULL, 0);
+		}else{
+			syscall(SYS_futex, &cq->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+		}
+		__atomic_sub_fetch(&cq->waiters, 1, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file arpc_cq.h
+* \brief 异步请求完成队列
+* 
+* 回复由xio loop线程投递到无锁环形队列，调用者线程批量收取；
+* 在途请求数在提交时预占，保证投递时队列不会满。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none 
+*/
+
+#ifndef _ARPC_CQ_H
+#define _ARPC_CQ_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "arpc_com.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct arpc_cq;
+
+/*!
+ * @brief  预占一个在途请求名额
+ *
+ * @return  0 成功；-1 在途请求已满
+ */
+int arpc_cq_reserve(struct arpc_cq *cq);
+
+/*!
+ * @brief  归还预占的名额（提交失败时）
+ */
+void arpc_cq_unreserve(struct arpc_cq *cq);
+
+/*!
+ * @brief  投递完成事件，事件的tag与状态已写入msg的私有数据
+ */
+void arpc_cq_complete(struct arpc_cq *cq, struct arpc_msg *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_ARPC_CQ_H */
@@ -78,7 +78,7 @@ int arpc_delete_msg(struct arpc_msg **msg)
 	
 	free_msg = *msg;
 	ex_msg = (struct arpc_msg_ex*)free_msg->handle;
-	if (IS_SET(ex_msg->flags, XIO_MSG_REQ)) {
+	if (IS_SET(ex_msg->flags, XIO_MSG_REQ) || ex_msg->cq) {
 		ARPC_LOG_ERROR("can't delete msg that be do request.");
 		return -1;
 	}
@@ -106,7 +106,7 @@ int arpc_reset_msg(struct arpc_msg *msg)
 	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ARPC_ERROR, "msg is null.");
 
 	ex_msg = (struct arpc_msg_ex*)msg->handle;
-	if (IS_SET(ex_msg->flags, XIO_MSG_REQ)) {
+	if (IS_SET(ex_msg->flags, XIO_MSG_REQ) || ex_msg->cq) {
 		ARPC_LOG_ERROR("can't reset msg that be do request.");
 		return -1;
 	}
@@ -127,6 +127,26 @@ int arpc_reset_msg(struct arpc_msg *msg)
 	return 0;
 }
 
+int arpc_msg_rx_verify(struct arpc_msg *msg)
+{
+	struct arpc_msg_ex *ex_msg;
+	uint64_t crc;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ARPC_ERROR, "msg is null.");
+	ex_msg = (struct arpc_msg_ex*)msg->handle;
+	crc = ex_msg->rx_crc;
+	ex_msg->rx_crc = 0;
+	if (!crc || IS_SET(ex_msg->flags, XIO_MSG_ERROR_DISCARD_DATA)) {
+		return 0;
+	}
+	if (!arpc_rx_crc_verify(&msg->receive, ex_msg->rx_csum_type, crc)) {
+		return 0;
+	}
+	SET_FLAG(ex_msg->flags, XIO_MSG_ERROR_DISCARD_DATA);
+	free_receive_msg_buf(msg);
+	return ARPC_ERROR;
+}
+
 static int free_receive_msg_buf(struct arpc_msg *msg)
 {
 	struct arpc_msg_ex *ex_msg;
@@ -135,8 +155,9 @@ static int free_receive_msg_buf(struct arpc_msg *msg)
 	LOG_THEN_RETURN_VAL_IF_TRUE(!msg, ARPC_ERROR, "msg is null.");
 	ex_msg = (struct arpc_msg_ex*)msg->handle;
 	if(IS_SET(ex_msg->flags, XIO_RSP_IOV_ALLOC_BUF)){
-		free_msg_xio2arpc(&msg->receive, ex_msg->free_cb, ex_msg->usr_context);
+		free_msg_xio2arpc(&msg->receive, ex_msg->free_cb, ex_msg->usr_context, ex_msg->rx_flags);
 		CLR_FLAG(ex_msg->flags, XIO_RSP_IOV_ALLOC_BUF);
+		ex_msg->rx_flags = 0;
 	}
 	
 	return 0;
@@ -32,6 +32,8 @@
 extern "C" {
 #endif
 
+struct arpc_cq;
+
 struct arpc_msg_ex {
     struct xio_msg				*x_rsp_msg;
     struct arpc_msg             *msg;
@@ -40,8 +42,22 @@ struct arpc_msg_ex {
 	void 		                *usr_context;				/*! @brief 用户上下文 */
     uint32_t                    flags;
     uint64_t                    iov_max_len;
+    uint32_t                    rx_flags;                   /* receive的零拷贝方式 */
+    uint32_t                    rx_csum_type;               /* 推迟到取结果线程的校验，rx_crc为0表示无需校验 */
+    uint64_t                    rx_crc;
+    struct arpc_cq              *cq;                        /* 通过完成队列提交时非空 */
+    void                        *cq_tag;
+    int32_t                     cq_status;
+    uint64_t                    trace_id;                   /* 本次请求的追踪id，0未采样 */
 };
 
+/*!
+ * @brief  在取回复结果的线程上校验推迟的crc，失败则释放接收数据并标记丢弃
+ *
+ * @return  0 通过或无需校验；-1 校验失败
+ */
+int arpc_msg_rx_verify(struct arpc_msg *msg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,569 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file arpc_metrics.c
+* \brief 内嵌Prometheus指标导出
+*
+* 在127.0.0.1的TCP端口或unix socket上监听，每次抓取时从统计区槽位取序号锁快照渲染为文本格式(0.0.4)。
+* 导出线程以SCHED_IDLE(失败时nice 19)运行，不持有发布线程与session的锁，抓取快慢不影响收发。
+* 速率由Prometheus对计数做rate()得到；时延直方图按2的幂折叠为le桶，单位秒。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "arpc_com.h"
+
+#define METRICS_POLL_MS			200
+#define METRICS_IO_TIMEOUT_S	1
+#define METRICS_REQ_MAX_LEN		4096
+#define METRICS_BUF_INIT_LEN	(64*1024)
+#define METRICS_LE_MIN_BIT		10			/* 1.024us */
+#define METRICS_LE_MAX_BIT		LAT_HIST_MAX_BIT	/* 约68.7s */
+
+struct metrics_buf {
+	char						*data;
+	size_t						len;
+	size_t						cap;
+	int32_t						fail;			/* 扩容失败，本次抓取返回500 */
+};
+
+struct metrics_ctx {
+	pthread_mutex_t				lock;
+	pthread_t					thread;
+	int32_t						running;
+	int32_t						stop;
+	int							listen_fd;
+	char						path[ARPC_METRICS_PATH_MAX_LEN];	/* 非空表示unix socket，停止时删除 */
+	struct arpc_stat_shm_slot	*snap;			/* 各槽位快照，导出线程独占 */
+	uint8_t						valid[ARPC_STAT_SHM_SLOT_NUM];
+	struct metrics_buf			out;
+};
+
+static struct metrics_ctx g_metrics = {
+	.lock		= PTHREAD_MUTEX_INITIALIZER,
+	.listen_fd	= -1,
+};
+
+static const char *g_stage_name[ARPC_STAT_LAT_MAX] = {
+	"req", "req_queue", "rsp", "rsp_queue", "oneway", "oneway_queue",
+	"rx_req", "rx_rsp", "rx_oneway", "rx_req_wire", "rx_rsp_wire", "rx_oneway_wire",
+};
+
+enum metrics_slot_field {
+	METRICS_SLOT_CONN_NUM = 0,
+	METRICS_SLOT_INFLIGHT,
+	METRICS_SLOT_TP_THREAD,
+	METRICS_SLOT_TP_IDLE,
+	METRICS_SLOT_TP_WAIT,
+};
+
+enum metrics_conn_field {
+	METRICS_CONN_INFLIGHT = 0,
+	METRICS_CONN_TX_QUEUE,
+	METRICS_CONN_TX_PENDING,
+	METRICS_CONN_STATUS,
+};
+
+static void metrics_printf(struct metrics_buf *buf, const char *fmt, ...)
+{
+	va_list ap;
+	char *data;
+	size_t cap;
+	int len;
+
+	if (buf->fail) {
+		return;
+	}
+	va_start(ap, fmt);
+	len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+	va_end(ap);
+	if (len < 0) {
+		buf->fail = 1;
+		return;
+	}
+	if ((size_t)len < buf->cap - buf->len) {
+		buf->len += len;
+		return;
+	}
+	for (cap = buf->cap * 2; cap - buf->len <= (size_t)len; cap *= 2);
+	data = (char *)arpc_mem_alloc(cap, NULL);
+	if (!data) {
+		ARPC_LOG_ERROR("arpc_mem_alloc metrics buf[%lu] fail.", cap);
+		buf->fail = 1;
+		return;
+	}
+	memcpy(data, buf->data, buf->len);
+	arpc_mem_free(buf->data, NULL);
+	buf->data = data;
+	buf->cap = cap;
+	va_start(ap, fmt);
+	buf->len += vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+	va_end(ap);
+}
+
+// 标签值转义：反斜杠、双引号与换行
+static void metrics_escape(const char *in, char *out, size_t out_len)
+{
+	size_t j = 0;
+
+	for (; *in && j + 2 < out_len; in++) {
+		if (*in == '\\' || *in == '"') {
+			out[j++] = '\\';
+			out[j++] = *in;
+		} else if (*in == '\n') {
+			out[j++] = '\\';
+			out[j++] = 'n';
+		} else {
+			out[j++] = *in;
+		}
+	}
+	out[j] = '\0';
+}
+
+static void metrics_family(struct metrics_buf *buf, const char *name, const char *type, const char *help)
+{
+	metrics_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metrics_labels(const struct arpc_stat_shm_slot *slot, uint32_t index, char *out, size_t out_len)
+{
+	char name[ARPC_STAT_SHM_NAME_LEN * 2];
+
+	metrics_escape(slot->name, name, sizeof(name));
+	snprintf(out, out_len, "role=\"%s\",slot=\"%u\",name=\"%s\"",
+			(slot->type == ARPC_STAT_SHM_SERVER) ? "server" : "client", index, name);
+}
+
+static uint64_t metrics_slot_value(const struct arpc_stat_shm_data *data, enum metrics_slot_field field)
+{
+	switch (field) {
+	case METRICS_SLOT_CONN_NUM:
+		return data->conn_num;
+	case METRICS_SLOT_INFLIGHT:
+		return data->inflight;
+	case METRICS_SLOT_TP_THREAD:
+		return data->tp_thread;
+	case METRICS_SLOT_TP_IDLE:
+		return data->tp_idle;
+	case METRICS_SLOT_TP_WAIT:
+		return data->tp_wait;
+	default:
+		return 0;
+	}
+}
+
+static uint64_t metrics_conn_value(const struct arpc_stat_shm_conn *conn, enum metrics_conn_field field)
+{
+	switch (field) {
+	case METRICS_CONN_INFLIGHT:
+		return conn->inflight;
+	case METRICS_CONN_TX_QUEUE:
+		return conn->tx_queue;
+	case METRICS_CONN_TX_PENDING:
+		return conn->tx_pending_bytes;
+	case METRICS_CONN_STATUS:
+		return conn->status;
+	default:
+		return 0;
+	}
+}
+
+static void render_slot_gauge(struct metrics_buf *buf, const char *name, const char *help, enum metrics_slot_field field)
+{
+	char labels[256];
+	uint32_t i;
+
+	metrics_family(buf, name, "gauge", help);
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		metrics_printf(buf, "%s{%s} %" PRIu64 "\n", name, labels, metrics_slot_value(&g_metrics.snap[i].data, field));
+	}
+}
+
+static void render_conn_gauge(struct metrics_buf *buf, const char *name, const char *help, enum metrics_conn_field field)
+{
+	const struct arpc_stat_shm_conn *conn;
+	char labels[256];
+	uint32_t i, j;
+
+	metrics_family(buf, name, "gauge", help);
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		for (j = 0; j < g_metrics.snap[i].data.conn_export && j < ARPC_STAT_SHM_CONN_NUM; j++) {
+			conn = &g_metrics.snap[i].data.conn[j];
+			metrics_printf(buf, "%s{%s,session=\"%u\",conn=\"%u\"} %" PRIu64 "\n",
+							name, labels, conn->session, conn->id, metrics_conn_value(conn, field));
+		}
+	}
+}
+
+static void render_counters(struct metrics_buf *buf)
+{
+	const struct arpc_stat_set *set;
+	char labels[256];
+	uint32_t i;
+
+	metrics_family(buf, "arpc_messages_total", "counter", "Messages sent and received.");
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		set = &g_metrics.snap[i].data.set;
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"tx\",kind=\"req\"} %" PRIu64 "\n", labels, set->tx_req);
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"tx\",kind=\"rsp\"} %" PRIu64 "\n", labels, set->tx_rsp);
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"tx\",kind=\"oneway\"} %" PRIu64 "\n", labels, set->tx_ow);
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"rx\",kind=\"req\"} %" PRIu64 "\n", labels, set->rx_req);
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"rx\",kind=\"rsp\"} %" PRIu64 "\n", labels, set->rx_rsp);
+		metrics_printf(buf, "arpc_messages_total{%s,direction=\"rx\",kind=\"oneway\"} %" PRIu64 "\n", labels, set->rx_ow);
+	}
+	metrics_family(buf, "arpc_bytes_total", "counter", "Bytes handed to and received from the transport, headers included.");
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		set = &g_metrics.snap[i].data.set;
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		metrics_printf(buf, "arpc_bytes_total{%s,direction=\"tx\"} %" PRIu64 "\n", labels, set->tx_bytes);
+		metrics_printf(buf, "arpc_bytes_total{%s,direction=\"rx\"} %" PRIu64 "\n", labels, set->rx_bytes);
+	}
+}
+
+static void render_conn_counter(struct metrics_buf *buf, const char *name, const char *help, int bytes)
+{
+	const struct arpc_stat_shm_conn *conn;
+	char labels[256];
+	uint32_t i, j;
+
+	metrics_family(buf, name, "counter", help);
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		for (j = 0; j < g_metrics.snap[i].data.conn_export && j < ARPC_STAT_SHM_CONN_NUM; j++) {
+			conn = &g_metrics.snap[i].data.conn[j];
+			metrics_printf(buf, "%s{%s,session=\"%u\",conn=\"%u\",direction=\"tx\"} %" PRIu64 "\n",
+							name, labels, conn->session, conn->id, bytes ? conn->tx_bytes : conn->tx_msg);
+			metrics_printf(buf, "%s{%s,session=\"%u\",conn=\"%u\",direction=\"rx\"} %" PRIu64 "\n",
+							name, labels, conn->session, conn->id, bytes ? conn->rx_bytes : conn->rx_msg);
+		}
+	}
+}
+
+// 子桶按2的幂区间折叠：小于2^bit的样本落在下标(bit-2)*8之前；+Inf与_count都取桶之和，保证单调一致
+static void render_hist(struct metrics_buf *buf, const char *labels, const char *stage, const struct lat_hist *h)
+{
+	uint64_t cum = 0;
+	uint32_t idx = 0;
+	uint32_t end;
+	uint32_t bit;
+
+	for (bit = METRICS_LE_MIN_BIT; bit <= METRICS_LE_MAX_BIT; bit++) {
+		end = (bit - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB_NUM;
+		for (; idx < end && idx < LAT_HIST_BUCKETS; idx++) {
+			cum += h->bucket[idx];
+		}
+		metrics_printf(buf, "arpc_latency_seconds_bucket{%s,stage=\"%s\",le=\"%.12g\"} %" PRIu64 "\n",
+						labels, stage, (double)(1ULL << bit) / 1e9, cum);
+	}
+	for (; idx < LAT_HIST_BUCKETS; idx++) {
+		cum += h->bucket[idx];
+	}
+	metrics_printf(buf, "arpc_latency_seconds_bucket{%s,stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", labels, stage, cum);
+	metrics_printf(buf, "arpc_latency_seconds_sum{%s,stage=\"%s\"} %.9f\n", labels, stage, (double)h->sum_ns / 1e9);
+	metrics_printf(buf, "arpc_latency_seconds_count{%s,stage=\"%s\"} %" PRIu64 "\n", labels, stage, cum);
+}
+
+static void render_latency(struct metrics_buf *buf)
+{
+	const struct lat_hist *h;
+	char labels[256];
+	uint32_t i, t;
+
+	metrics_family(buf, "arpc_latency_seconds", "histogram",
+					"Latency by stage: *_queue is wait before the transport, req/rsp/oneway is service time, *_wire is one-way network time.");
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_metrics.valid[i]) {
+			continue;
+		}
+		metrics_labels(&g_metrics.snap[i], i, labels, sizeof(labels));
+		for (t = 0; t < ARPC_STAT_LAT_MAX; t++) {
+			h = &g_metrics.snap[i].data.set.lat[t];
+			if (!h->count) {
+				continue;
+			}
+			render_hist(buf, labels, g_stage_name[t], h);
+		}
+	}
+}
+
+static void metrics_render(struct metrics_buf *buf)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		g_metrics.valid[i] = (!arpc_stat_shm_snapshot(i, &g_metrics.snap[i]) &&
+								g_metrics.snap[i].type != ARPC_STAT_SHM_FREE);
+	}
+	buf->len = 0;
+	buf->fail = 0;
+	buf->data[0] = '\0';
+	render_slot_gauge(buf, "arpc_connections", "Connections of the session or server.", METRICS_SLOT_CONN_NUM);
+	render_slot_gauge(buf, "arpc_inflight_messages", "Message descriptors allocated and not yet released.", METRICS_SLOT_INFLIGHT);
+	render_slot_gauge(buf, "arpc_threadpool_threads", "Worker threads of the message thread pool.", METRICS_SLOT_TP_THREAD);
+	render_slot_gauge(buf, "arpc_threadpool_idle_threads", "Idle worker threads of the message thread pool.", METRICS_SLOT_TP_IDLE);
+	render_slot_gauge(buf, "arpc_threadpool_queue_depth", "Tasks posted to the message thread pool and not started.", METRICS_SLOT_TP_WAIT);
+	render_counters(buf);
+	render_conn_counter(buf, "arpc_conn_messages_total", "Messages sent and received per connection.", 0);
+	render_conn_counter(buf, "arpc_conn_bytes_total", "Bytes sent and received per connection.", 1);
+	render_conn_gauge(buf, "arpc_conn_inflight_messages", "Message descriptors in flight on the connection.", METRICS_CONN_INFLIGHT);
+	render_conn_gauge(buf, "arpc_conn_tx_queue_depth", "Messages waiting in the connection send ring.", METRICS_CONN_TX_QUEUE);
+	render_conn_gauge(buf, "arpc_conn_tx_pending_bytes", "Bytes waiting in the connection send ring.", METRICS_CONN_TX_PENDING);
+	render_conn_gauge(buf, "arpc_conn_status", "Connection status, 2 means active.", METRICS_CONN_STATUS);
+	render_latency(buf);
+}
+
+static int metrics_send_all(int fd, const char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = send(fd, data, len, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return ARPC_ERROR;
+		}
+		data += ret;
+		len -= ret;
+	}
+	return ARPC_SUCCESS;
+}
+
+static void metrics_reply(int fd, const char *status, const char *body, size_t body_len)
+{
+	char head[256];
+	int len;
+
+	len = snprintf(head, sizeof(head), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+					"Content-Length: %lu\r\nConnection: close\r\n\r\n", status, body_len);
+	if (metrics_send_all(fd, head, len)) {
+		return;
+	}
+	(void)metrics_send_all(fd, body, body_len);
+}
+
+static void metrics_serve(int fd)
+{
+	struct timeval tv = {.tv_sec = METRICS_IO_TIMEOUT_S, .tv_usec = 0};
+	char req[METRICS_REQ_MAX_LEN];
+	size_t len = 0;
+	ssize_t ret;
+	char *path;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	while (len < sizeof(req) - 1) {
+		ret = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		len += ret;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) {
+			break;
+		}
+	}
+	req[len] = '\0';
+	if (strncmp(req, "GET ", 4)) {
+		metrics_reply(fd, "405 Method Not Allowed", "only GET is supported\n", strlen("only GET is supported\n"));
+		return;
+	}
+	path = req + 4;
+	path[strcspn(path, " ?\r\n")] = '\0';
+	if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+		metrics_reply(fd, "404 Not Found", "try /metrics\n", strlen("try /metrics\n"));
+		return;
+	}
+	metrics_render(&g_metrics.out);
+	if (g_metrics.out.fail) {
+		metrics_reply(fd, "500 Internal Server Error", "render fail\n", strlen("render fail\n"));
+		return;
+	}
+	metrics_reply(fd, "200 OK", g_metrics.out.data, g_metrics.out.len);
+}
+
+static void *metrics_thread(void *arg)
+{
+	struct sched_param sp = {.sched_priority = 0};
+	struct pollfd pfd;
+	int fd;
+
+	prctl(PR_SET_NAME, "arpc_metrics");
+	if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp)) {
+		(void)setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+	}
+	pfd.fd = g_metrics.listen_fd;
+	pfd.events = POLLIN;
+	while (!__atomic_load_n(&g_metrics.stop, __ATOMIC_ACQUIRE)) {
+		pfd.revents = 0;
+		if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) {
+			continue;
+		}
+		fd = accept4(g_metrics.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			continue;
+		}
+		metrics_serve(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+static int metrics_listen(const struct aprc_option *opt)
+{
+	struct sockaddr_un un;
+	struct sockaddr_in in;
+	int on = 1;
+	int fd;
+
+	if (opt->metrics_path[0]) {
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		LOG_THEN_RETURN_VAL_IF_TRUE(fd < 0, ARPC_ERROR, "metrics socket fail, errno[%d].", errno);
+		memset(&un, 0, sizeof(un));
+		un.sun_family = AF_UNIX;
+		snprintf(un.sun_path, sizeof(un.sun_path), "%s", opt->metrics_path);
+		unlink(un.sun_path);		// 上次异常退出留下的socket文件
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(bind(fd, (struct sockaddr *)&un, sizeof(un)), close_fd,
+									"metrics bind[%s] fail, errno[%d].", un.sun_path, errno);
+		snprintf(g_metrics.path, sizeof(g_metrics.path), "%s", un.sun_path);
+	} else {
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		LOG_THEN_RETURN_VAL_IF_TRUE(fd < 0, ARPC_ERROR, "metrics socket fail, errno[%d].", errno);
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		memset(&in, 0, sizeof(in));
+		in.sin_family = AF_INET;
+		in.sin_port = htons((uint16_t)opt->metrics_port);
+		in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(bind(fd, (struct sockaddr *)&in, sizeof(in)), close_fd,
+									"metrics bind[127.0.0.1:%u] fail, errno[%d].", opt->metrics_port, errno);
+		g_metrics.path[0] = '\0';
+	}
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(listen(fd, 16), unlink_path, "metrics listen fail, errno[%d].", errno);
+	g_metrics.listen_fd = fd;
+	return ARPC_SUCCESS;
+
+unlink_path:
+	if (g_metrics.path[0]) {
+		unlink(g_metrics.path);
+		g_metrics.path[0] = '\0';
+	}
+close_fd:
+	close(fd);
+	return ARPC_ERROR;
+}
+
+int arpc_metrics_enabled(const struct aprc_option *opt)
+{
+	return opt && (opt->metrics_port || opt->metrics_path[0]);
+}
+
+int arpc_metrics_start(const struct aprc_option *opt)
+{
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!arpc_metrics_enabled(opt), ARPC_ERROR, "metrics address not set.");
+	pthread_mutex_lock(&g_metrics.lock);
+	if (g_metrics.running) {
+		pthread_mutex_unlock(&g_metrics.lock);
+		return ARPC_SUCCESS;
+	}
+	g_metrics.snap = (struct arpc_stat_shm_slot *)arpc_mem_alloc(ARPC_STAT_SHM_SLOT_NUM * sizeof(struct arpc_stat_shm_slot), NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!g_metrics.snap, unlock, "arpc_mem_alloc metrics snapshot fail.");
+	g_metrics.out.data = (char *)arpc_mem_alloc(METRICS_BUF_INIT_LEN, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!g_metrics.out.data, free_snap, "arpc_mem_alloc metrics buf fail.");
+	g_metrics.out.cap = METRICS_BUF_INIT_LEN;
+	g_metrics.out.len = 0;
+
+	ret = metrics_listen(opt);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_buf, "metrics_listen fail.");
+	g_metrics.stop = 0;
+	ret = pthread_create(&g_metrics.thread, NULL, &metrics_thread, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, close_listen, "create metrics thread fail, ret[%d].", ret);
+	g_metrics.running = 1;
+	pthread_mutex_unlock(&g_metrics.lock);
+	if (opt->metrics_path[0]) {
+		ARPC_LOG_NOTICE("metrics exported on unix socket[%s].", opt->metrics_path);
+	} else {
+		ARPC_LOG_NOTICE("metrics exported on http://127.0.0.1:%u/metrics.", opt->metrics_port);
+	}
+	return ARPC_SUCCESS;
+
+close_listen:
+	close(g_metrics.listen_fd);
+	g_metrics.listen_fd = -1;
+	if (g_metrics.path[0]) {
+		unlink(g_metrics.path);
+	}
+free_buf:
+	arpc_mem_free(g_metrics.out.data, NULL);
+	g_metrics.out.data = NULL;
+free_snap:
+	arpc_mem_free(g_metrics.snap, NULL);
+	g_metrics.snap = NULL;
+unlock:
+	pthread_mutex_unlock(&g_metrics.lock);
+	return ARPC_ERROR;
+}
+
+void arpc_metrics_stop(void)
+{
+	pthread_mutex_lock(&g_metrics.lock);
+	if (!g_metrics.running) {
+		pthread_mutex_unlock(&g_metrics.lock);
+		return;
+	}
+	__atomic_store_n(&g_metrics.stop, 1, __ATOMIC_RELEASE);
+	pthread_join(g_metrics.thread, NULL);
+	g_metrics.running = 0;
+	close(g_metrics.listen_fd);
+	g_metrics.listen_fd = -1;
+	if (g_metrics.path[0]) {
+		unlink(g_metrics.path);
+		g_metrics.path[0] = '\0';
+	}
+	arpc_mem_free(g_metrics.out.data, NULL);
+	g_metrics.out.data = NULL;
+	arpc_mem_free(g_metrics.snap, NULL);
+	g_metrics.snap = NULL;
+	pthread_mutex_unlock(&g_metrics.lock);
+}
@@ -35,7 +35,6 @@ int process_oneway_header(struct arpc_connection *con, struct xio_msg *msg)
 	struct proc_header_func head_ops;
 	struct arpc_msg_attr msg_attr = {0};
 	int ret;
-	struct timeval 		tx_time;
 	struct oneway_ops *ops;
 
 	ops = &(arpc_get_ops(con)->oneway_ops);
@@ -45,9 +44,8 @@ int process_oneway_header(struct arpc_connection *con, struct xio_msg *msg)
 	head_ops.proc_head_cb = ops->proc_head_cb;
 	ARPC_LOG_TRACE("get oneway msg head");
 	ret = create_xio_msg_usr_buf(msg, &head_ops, arpc_get_max_iov_len(con), arpc_get_ops_ctx(con), &msg_attr);
-	tx_time.tv_sec = msg_attr.tx_sec;
-	tx_time.tv_usec = msg_attr.tx_usec;
-	statistics_per_time(&tx_time, &con->rx_ow_send, 5);
+	MSG_TRACE(msg_attr.trace_id, MSG_TRACE_RX_HEAD, ARPC_MSG_TYPE_OW, con->id, 0);
+	arpc_stat_wire(&con->stats, ARPC_STAT_LAT_RX_OW_WIRE, &msg_attr, con->rx_start_ns);
 	if(arpc_get_conn_type(con) == ARPC_CON_TYPE_SERVER && msg_attr.conn_id >= ARPC_CONN_ID_OFFSET && con->id != msg_attr.conn_id){
 		ARPC_LOG_NOTICE("server session modify conn id from[%u] to [%u]", con->id, msg_attr.conn_id);
 		con->id = msg_attr.conn_id;
@@ -65,6 +63,10 @@ int process_oneway_data(struct arpc_connection *con, struct xio_msg *req, int la
 	struct arpc_thread_param 	*async_param;
 	struct oneway_ops 			*ops;
 	void 						*ops_ctx;
+	uint32_t					rx_flags = 0;
+	int							is_sync;
+	struct arpc_msg_attr		attr = {0};
+	struct arpc_rx_zip_buf		zbuf;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE((!req), ARPC_ERROR, "req null.");
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(IS_SET(req->usr_flags, XIO_MSG_ERROR_DISCARD_DATA), free_data, "dicard data.");
@@ -73,21 +75,35 @@ int process_oneway_data(struct arpc_connection *con, struct xio_msg *req, int la
 
 	ops = &(arpc_get_ops(con)->oneway_ops);
 	ops_ctx = arpc_get_ops_ctx(con);
+	zbuf.alloc_cb = ops->alloc_cb;
+	zbuf.free_cb = ops->free_cb;
+	zbuf.usr_ctx = ops_ctx;
+	zbuf.iov_max_len = arpc_get_max_iov_len(con);
 
 	ARPC_LOG_TRACE("get oneway msg data");
-	ret = move_msg_xio2arpc(&req->in, &rev_iov, NULL);
+	is_sync = (IS_SET(req->usr_flags, METHOD_ARPC_PROC_SYNC) && ops->proc_data_cb);
+	rx_flags = arpc_rx_zero_copy_flags(is_sync);	// 异步处理时xio消息在投递后即释放，head需拷贝
+	if (!is_sync) {
+		rx_flags |= ARPC_RX_FLAG_DEFER_CRC;			// 异步处理时由工作线程校验，loop线程只做分发
+	}
+	ret = move_msg_xio2arpc(&req->in, &rev_iov, &attr, &rx_flags, &zbuf);
 	LOG_THEN_RETURN_VAL_IF_TRUE((ret), ARPC_ERROR, "move_msg_xio2arpc fail.");
+	MSG_TRACE(attr.trace_id, MSG_TRACE_RX_DATA, ARPC_MSG_TYPE_OW, con->id, (uint32_t)rev_iov.total_data);
 
 	ret = destroy_xio_msg_usr_buf(req, ops->free_cb, ops_ctx);
 	LOG_THEN_RETURN_VAL_IF_TRUE((ret), ARPC_ERROR, "destroy_xio_msg_usr_buf fail.");
-	if (IS_SET(req->usr_flags, METHOD_ARPC_PROC_SYNC) && ops->proc_data_cb) {
+	if (is_sync) {
 		ARPC_LOG_TRACE("process rx oneway msg with sync.");
+		MSG_TRACE(attr.trace_id, MSG_TRACE_PROC_BEGIN, ARPC_MSG_TYPE_OW, con->id, 0);
 		ret = ops->proc_data_cb(&rev_iov, &flags, ops_ctx);
+		MSG_TRACE(attr.trace_id, MSG_TRACE_PROC_END, ARPC_MSG_TYPE_OW, con->id, (uint32_t)ret);
 		ARPC_LOG_TRACE("process rx oneway msg finished with sync, flag[0x%x].", flags);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_data, "proc_data_cb  return fail.");
 
 		if(!IS_SET(flags, METHOD_CALLER_HIJACK_RX_DATA)){
-			free_msg_xio2arpc(&rev_iov, ops->free_cb, ops_ctx);
+			free_msg_xio2arpc(&rev_iov, ops->free_cb, ops_ctx, rx_flags);
+		}else{
+			release_msg_xio2arpc(&rev_iov, rx_flags);
 		}
 	}else {
 		ARPC_LOG_DEBUG("set proc_async_cb data.");
@@ -101,6 +117,7 @@ int process_oneway_data(struct arpc_connection *con, struct xio_msg *req, int la
 
 		memset(async_param, 0, sizeof(struct arpc_thread_param));
 		async_param->threadpool = arpc_get_conn_threadpool(con);
+		async_param->numa_node = arpc_get_conn_numa_node(con);
 		async_param->ops.alloc_cb = ops->alloc_cb;
 		async_param->ops.free_cb = ops->free_cb;
 		async_param->ops.proc_async_cb = NULL;
@@ -109,9 +126,15 @@ int process_oneway_data(struct arpc_connection *con, struct xio_msg *req, int la
 		async_param->rsp_ctx = NULL;
 		async_param->req_msg = NULL;
 		async_param->rev_iov = rev_iov;
+		async_param->rx_flags = rx_flags;
+		async_param->rx_csum_type = attr.csum_type;
+		async_param->rx_crc = attr.req_crc;
 		async_param->usr_ctx = ops_ctx;
 		async_param->loop = oneway_msg_async_deal;
+		async_param->trace_id = attr.trace_id;
+		async_param->conn_id = con->id;
 
+		MSG_TRACE(attr.trace_id, MSG_TRACE_DISPATCH, ARPC_MSG_TYPE_OW, con->id, 0);
 		ret = post_to_async_thread(async_param);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_data, "post_to_async_thread fail.");
 	}
@@ -120,7 +143,7 @@ int process_oneway_data(struct arpc_connection *con, struct xio_msg *req, int la
 	return 0;
 
 free_data:
-	free_msg_xio2arpc(&rev_iov, ops->free_cb, ops_ctx);
+	free_msg_xio2arpc(&rev_iov, ops->free_cb, ops_ctx, rx_flags);
 	xio_release_msg(req);// 同步释放资源
 	return -1;
 }
@@ -134,14 +157,22 @@ static int oneway_msg_async_deal(void *usr_ctx)
 	LOG_THEN_RETURN_VAL_IF_TRUE(!async, ARPC_ERROR, "async null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE(!async->ops.proc_oneway_async_cb, ARPC_ERROR, "proc_async_cb null.");
 
-	ARPC_LOG_TRACE("process rx oneway msg with async.");
-	ret = async->ops.proc_oneway_async_cb(&async->rev_iov, &flags, async->usr_ctx);
-	ARPC_LOG_TRACE("process rx oneway msg finished with async, flag[0x%x].", flags);
-
-	LOG_ERROR_IF_VAL_TRUE(ret, "proc_oneway_async_cb error.");
+	ret = arpc_rx_crc_verify(&async->rev_iov, async->rx_csum_type, async->rx_crc);
+	if (ret) {
+		ARPC_LOG_ERROR("oneway crc verify fail, drop data.");
+	}else{
+		ARPC_LOG_TRACE("process rx oneway msg with async.");
+		MSG_TRACE(async->trace_id, MSG_TRACE_PROC_BEGIN, ARPC_MSG_TYPE_OW, async->conn_id, 0);
+		ret = async->ops.proc_oneway_async_cb(&async->rev_iov, &flags, async->usr_ctx);
+		MSG_TRACE(async->trace_id, MSG_TRACE_PROC_END, ARPC_MSG_TYPE_OW, async->conn_id, (uint32_t)ret);
+		ARPC_LOG_TRACE("process rx oneway msg finished with async, flag[0x%x].", flags);
+		LOG_ERROR_IF_VAL_TRUE(ret, "proc_oneway_async_cb error.");
+	}
 	if (!IS_SET(flags, METHOD_CALLER_HIJACK_RX_DATA)){
 		ARPC_LOG_DEBUG("free_msg_xio2arpc data.");
-		free_msg_xio2arpc(&async->rev_iov, async->ops.free_cb, async->usr_ctx);
+		free_msg_xio2arpc(&async->rev_iov, async->ops.free_cb, async->usr_ctx, async->rx_flags);
+	}else{
+		release_msg_xio2arpc(&async->rev_iov, async->rx_flags);
 	}
 	// free
 	SAFE_FREE_MEM(async->rev_iov.head);
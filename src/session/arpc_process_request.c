@@ -35,7 +35,6 @@ int process_request_header(struct arpc_connection *con, struct xio_msg *msg)
 	struct request_ops *ops;
 	int ret;
 	struct arpc_msg_attr msg_attr = {0};
-	struct timeval 		tx_time;
 
 	ops = &(arpc_get_ops(con)->req_ops);
 	head_ops.alloc_cb = ops->alloc_cb;
@@ -43,14 +42,13 @@ int process_request_header(struct arpc_connection *con, struct xio_msg *msg)
 	head_ops.proc_head_cb = ops->proc_head_cb;
 
 	ret = create_xio_msg_usr_buf(msg, &head_ops, arpc_get_max_iov_len(con), arpc_get_ops_ctx(con), &msg_attr);
+	MSG_TRACE(msg_attr.trace_id, MSG_TRACE_RX_HEAD, ARPC_MSG_TYPE_REQ, con->id, 0);
 
-	tx_time.tv_sec = msg_attr.tx_sec;
-	tx_time.tv_usec = msg_attr.tx_usec;
 	if(arpc_get_conn_type(con) == ARPC_CON_TYPE_SERVER && msg_attr.conn_id >= ARPC_CONN_ID_OFFSET && con->id != msg_attr.conn_id){
 		ARPC_LOG_NOTICE("server session modify conn id from[%u] to [%u]", con->id, msg_attr.conn_id);
 		con->id = msg_attr.conn_id;
 	}
-	statistics_per_time(&tx_time, &con->rx_req_send, 5);
+	arpc_stat_wire(&con->stats, ARPC_STAT_LAT_RX_REQ_WIRE, &msg_attr, con->rx_start_ns);
 
 	return ret;
 }
@@ -68,18 +66,30 @@ int process_request_data(struct arpc_connection *con, struct xio_msg *req, int l
 	struct arpc_msg_attr	attr = {0};
 	struct request_ops *ops;
 	void *usr_ctx;
-	struct timeval 		tx_time;
+	uint32_t			rx_flags;
+	int					is_sync;
+	struct arpc_rx_zip_buf	zbuf;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE((!req), ARPC_ERROR, "req null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!con), ARPC_ERROR, "con null.");
 
 	ops = &(arpc_get_ops(con)->req_ops);
 	usr_ctx = arpc_get_ops_ctx(con);
+	zbuf.alloc_cb = ops->alloc_cb;
+	zbuf.free_cb = ops->free_cb;
+	zbuf.usr_ctx = usr_ctx;
+	zbuf.iov_max_len = arpc_get_max_iov_len(con);
 
 	memset(&rev_iov, 0, sizeof(struct arpc_vmsg));
 	
-	ret = move_msg_xio2arpc(&req->in, &rev_iov, &attr);
+	is_sync = (IS_SET(req->usr_flags, METHOD_ARPC_PROC_SYNC) && ops->proc_data_cb);
+	rx_flags = arpc_rx_zero_copy_flags(1);	// 请求在回复发出前不会被xio释放
+	if (!is_sync) {
+		rx_flags |= ARPC_RX_FLAG_DEFER_CRC;	// 异步处理时由工作线程校验，loop线程只做分发
+	}
+	ret = move_msg_xio2arpc(&req->in, &rev_iov, &attr, &rx_flags, &zbuf);
 	LOG_THEN_RETURN_VAL_IF_TRUE((ret), ARPC_ERROR, "move_msg_xio2arpc fail.");
+	MSG_TRACE(attr.trace_id, MSG_TRACE_RX_DATA, ARPC_MSG_TYPE_REQ, con->id, (uint32_t)rev_iov.total_data);
 
 	ret = destroy_xio_msg_usr_buf(req, ops->free_cb, usr_ctx);
 	LOG_THEN_RETURN_VAL_IF_TRUE((ret), ARPC_ERROR, "destroy_xio_msg_usr_buf fail.");
@@ -90,17 +100,22 @@ int process_request_data(struct arpc_connection *con, struct xio_msg *req, int l
 	rsp_fd_ex->x_rsp_msg = req;//保存回复的结构体
 	rsp_msg->attr.rsp_crc = attr.req_crc;//请求保存在回复体里
 	rsp_msg->attr.req_crc = 0;
+	rsp_msg->attr.trace_id = attr.trace_id;
 	memset(&usr_rsp_param, 0, sizeof(struct arpc_rsp));
 	usr_rsp_param.rsp_fd = (void *)rsp_msg;
 
-	if(IS_SET(req->usr_flags, METHOD_ARPC_PROC_SYNC) && ops->proc_data_cb){
+	if(is_sync){
 		ARPC_LOG_TRACE("process rx request msg with async.");
+		MSG_TRACE(attr.trace_id, MSG_TRACE_PROC_BEGIN, ARPC_MSG_TYPE_REQ, con->id, 0);
 		ret = ops->proc_data_cb(&rev_iov, &usr_rsp_param, usr_ctx);
+		MSG_TRACE(attr.trace_id, MSG_TRACE_PROC_END, ARPC_MSG_TYPE_REQ, con->id, (uint32_t)ret);
 		ARPC_LOG_TRACE("process rx request msg end with async.");
 
 		LOG_ERROR_IF_VAL_TRUE(ret, "proc_data_cb that define for user is error.");
 		if (!IS_SET(usr_rsp_param.flags, METHOD_CALLER_HIJACK_RX_DATA)) {
-			free_msg_xio2arpc(&rev_iov, ops->free_cb, usr_ctx);
+			free_msg_xio2arpc(&rev_iov, ops->free_cb, usr_ctx, rx_flags);
+		}else{
+			release_msg_xio2arpc(&rev_iov, rx_flags);
 		}
 
 		if (!IS_SET(usr_rsp_param.flags, METHOD_CALLER_ASYNC)) {
@@ -118,6 +133,7 @@ int process_request_data(struct arpc_connection *con, struct xio_msg *req, int l
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!async_param, free_user_buf, "async_param is null, can't do async.");
 		memset(async_param, 0, sizeof(struct arpc_thread_param));
 		async_param->threadpool = arpc_get_conn_threadpool(con);
+		async_param->numa_node = arpc_get_conn_numa_node(con);
 		async_param->ops.alloc_cb = ops->alloc_cb;
 		async_param->ops.free_cb = ops->free_cb;
 		async_param->ops.proc_async_cb = ops->proc_async_cb;
@@ -125,10 +141,16 @@ int process_request_data(struct arpc_connection *con, struct xio_msg *req, int l
 		async_param->ops.proc_oneway_async_cb = NULL;
 		async_param->rsp_ctx = rsp_msg;
 		async_param->rev_iov = rev_iov;
+		async_param->rx_flags = rx_flags;
+		async_param->rx_csum_type = attr.csum_type;
+		async_param->rx_crc = attr.req_crc;
 		async_param->req_msg = NULL;
 		async_param->usr_ctx = usr_ctx;
 		async_param->loop = &request_msg_async_deal;
+		async_param->trace_id = attr.trace_id;
+		async_param->conn_id = con->id;
 
+		MSG_TRACE(attr.trace_id, MSG_TRACE_DISPATCH, ARPC_MSG_TYPE_REQ, con->id, 0);
 		ret = post_to_async_thread(async_param);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_user_buf, "post_to_async_thread fail, can't do async.");
 	}else{
@@ -138,19 +160,18 @@ int process_request_data(struct arpc_connection *con, struct xio_msg *req, int l
 
 	return 0;
 free_user_buf:
-	free_msg_xio2arpc(&rev_iov, ops->free_cb, usr_ctx);
+	free_msg_xio2arpc(&rev_iov, ops->free_cb, usr_ctx, rx_flags);
 
 do_respone:	
 	/* 框架内回复，则不需要通知模式，也不需要加锁 */
 	ARPC_LOG_TRACE("do respone request msg.");
-	gettimeofday(&tx_time, NULL);	// 线程安全
-
-	rsp_msg->attr.tx_sec= tx_time.tv_sec;
-	rsp_msg->attr.tx_usec= tx_time.tv_usec;
+	rsp_msg->attr.tx_ns = fast_clock_wall_ns();
 	rsp_msg->attr.conn_id = con->id;
 
 	ret = arpc_init_response(rsp_msg);
 	LOG_ERROR_IF_VAL_TRUE(ret, "arpc_init_response fail.");
+	MSG_TRACE(rsp_msg->attr.trace_id, MSG_TRACE_XIO_SEND, ARPC_MSG_TYPE_RSP, con->id, 0);
+	con->stats.tx_bytes += arpc_tx_msg_bytes(&rsp_msg->tx_msg->out);
 	ret = xio_send_response(rsp_msg->tx_msg);
 	LOG_ERROR_IF_VAL_TRUE(ret, "xio_send_response fail.");
 
@@ -164,7 +185,7 @@ static int request_msg_async_deal(void *usr_ctx)
 	int ret;
 	struct arpc_common_msg *rsp_msg;
 	struct arpc_rsp_handle	*rsp_fd_ex;
-	struct timeval 		tx_time;
+	uint32_t			seq;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE(!async, ARPC_ERROR, "async null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE(!async->ops.proc_async_cb, ARPC_ERROR, "request proc_async_cb null.");
@@ -174,15 +195,24 @@ static int request_msg_async_deal(void *usr_ctx)
 	memset(&rsp, 0, sizeof (struct arpc_rsp));						
 	rsp.rsp_fd = (void*)rsp_msg;
 
-	ARPC_LOG_TRACE("process request msg with async.");
-	ret = async->ops.proc_async_cb(&async->rev_iov, &rsp, async->usr_ctx);
-	ARPC_LOG_TRACE("process request msg with end async.");
-
-	LOG_ERROR_IF_VAL_TRUE(ret, "proc_async_cb of request error.");
+	ret = arpc_rx_crc_verify(&async->rev_iov, async->rx_csum_type, async->rx_crc);
+	if (ret) {
+		// 校验失败不交给调用者，回复空消息避免请求方一直等待
+		ARPC_LOG_ERROR("request crc verify fail, drop data and reply empty.");
+	}else{
+		ARPC_LOG_TRACE("process request msg with async.");
+		MSG_TRACE(async->trace_id, MSG_TRACE_PROC_BEGIN, ARPC_MSG_TYPE_REQ, async->conn_id, 0);
+		ret = async->ops.proc_async_cb(&async->rev_iov, &rsp, async->usr_ctx);
+		MSG_TRACE(async->trace_id, MSG_TRACE_PROC_END, ARPC_MSG_TYPE_REQ, async->conn_id, (uint32_t)ret);
+		ARPC_LOG_TRACE("process request msg with end async.");
+		LOG_ERROR_IF_VAL_TRUE(ret, "proc_async_cb of request error.");
+	}
 
 	if (!IS_SET(rsp.flags, METHOD_CALLER_HIJACK_RX_DATA)) {
-		free_msg_xio2arpc(&async->rev_iov, async->ops.free_cb, async->usr_ctx);
+		free_msg_xio2arpc(&async->rev_iov, async->ops.free_cb, async->usr_ctx, async->rx_flags);
 		async->rev_iov.vec = NULL;
+	}else{
+		release_msg_xio2arpc(&async->rev_iov, async->rx_flags);
 	}
 
 	rsp_fd_ex = (struct arpc_rsp_handle*)rsp_msg->ex_data;
@@ -191,20 +221,17 @@ static int request_msg_async_deal(void *usr_ctx)
 	rsp_fd_ex->release_rsp_cb = async->ops.release_rsp_cb;
 
 	if (!IS_SET(rsp.flags, METHOD_CALLER_ASYNC)) {
-		gettimeofday(&tx_time, NULL);	// 线程安全
-		arpc_cond_lock(&rsp_msg->cond);
-		rsp_msg->attr.tx_sec= tx_time.tv_sec;
-		rsp_msg->attr.tx_usec= tx_time.tv_usec;
+		seq = arpc_completion_seq(&rsp_msg->comp);
+		rsp_msg->attr.tx_ns = fast_clock_wall_ns();
 		ret = arpc_init_response(rsp_msg);
 		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_init_response fail.");
 		ret = arpc_connection_async_send(rsp_msg->conn, rsp_msg);
 		if(!ret) {
-			ret = arpc_cond_wait_timeout(&rsp_msg->cond, SEND_RSP_END_MAX_TIME_MS); // 默认等待
+			ret = arpc_completion_wait(&rsp_msg->comp, seq, SEND_RSP_END_MAX_TIME_MS, (arpc_cpu_max_num() > 1)); // 默认等待
 			LOG_ERROR_IF_VAL_TRUE(ret, "rsp send timeout fail, conn[%u], msg[%p].", rsp_msg->conn->id, rsp_msg);
 		}else{
 			ARPC_LOG_ERROR("arpc_connection_async_send fail, conn[%u], msg[%p].", rsp_msg->conn->id, rsp_msg);
 		}
-		arpc_cond_unlock(&rsp_msg->cond);
 	}
 	SAFE_FREE_MEM(async->rev_iov.head);
 	SAFE_FREE_MEM(async);
@@ -27,7 +27,6 @@ int process_rsp_header(struct arpc_connection *con, struct xio_msg *rsp)
 	struct proc_header_func head_ops;
 	int ret;
 	struct arpc_msg_attr msg_attr = {0};
-	struct timeval 		tx_time;
 	struct arpc_msg_ex *ex_msg;
 	struct arpc_common_msg *req_msg = (struct arpc_common_msg *)rsp->user_context;
 
@@ -35,15 +34,10 @@ int process_rsp_header(struct arpc_connection *con, struct xio_msg *rsp)
 	LOG_THEN_RETURN_VAL_IF_TRUE((!con), ARPC_ERROR, "con null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((req_msg->magic != ARPC_COM_MSG_MAGIC), ARPC_ERROR, "magic[%x] not match.", req_msg->magic);
 
-	ret = arpc_cond_lock(&req_msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "rsp copmlete cond lock fail, maybe release.");
-
-	if (IS_SET(req_msg->flag, XIO_MSG_ERROR_DISCARD_DATA)) {
+	if (arpc_completion_abandoned(&req_msg->comp)) {
 		ARPC_LOG_ERROR("msg error. discard it");
-		arpc_cond_unlock(&req_msg->cond);
 		return ARPC_ERROR;
 	}
-	arpc_cond_unlock(&req_msg->cond);
 
 	ex_msg = ((struct arpc_request_handle *)req_msg->ex_data)->msg_ex;
 	head_ops.alloc_cb = ex_msg->alloc_cb;
@@ -55,44 +49,68 @@ int process_rsp_header(struct arpc_connection *con, struct xio_msg *rsp)
 		ret = create_xio_msg_usr_buf(rsp, &head_ops, arpc_get_max_iov_len(con), ex_msg, &msg_attr);//申请资源
 	}
 	
+	MSG_TRACE(req_msg->attr.trace_id, MSG_TRACE_RX_HEAD, ARPC_MSG_TYPE_RSP, con->id, 0);
 	if (!ret){
 		SET_FLAG(ex_msg->flags, XIO_RSP_IOV_ALLOC_BUF);
-		tx_time.tv_sec = msg_attr.tx_sec;
-		tx_time.tv_usec = msg_attr.tx_usec;
-		statistics_per_time(&tx_time, &con->rx_rsp_send, 5);
+		arpc_stat_wire(&con->stats, ARPC_STAT_LAT_RX_RSP_WIRE, &msg_attr, con->rx_start_ns);
 	}
 	return ret;
 }
 
+static void process_rsp_release(struct arpc_connection *con, struct xio_msg *rsp)
+{
+	int ret;
+
+	ret = xio_release_response(rsp);
+	if (ret) {
+		__atomic_add_fetch(&con->stats.rx_release_err, 1, __ATOMIC_RELAXED);
+		ARPC_LOG_ERROR("xio_release_response fail, %s.", xio_strerror(xio_errno()));
+	}
+}
+
 int process_rsp_data(struct arpc_connection *con, struct xio_msg *rsp, int last_in_rxq)
 {
 	int ret;
 	struct arpc_msg_attr attr = {0};
 	struct arpc_msg_ex *ex_msg = NULL;
 	struct arpc_common_msg *req_msg = (struct arpc_common_msg *)rsp->user_context;
+	struct arpc_rx_zip_buf zbuf;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE((!req_msg), ARPC_ERROR, "req_msg null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!con), ARPC_ERROR, "con null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((req_msg->magic != ARPC_COM_MSG_MAGIC), ARPC_ERROR, "magic[%x] not match.", req_msg->magic);
 
-	if (!IS_SET(req_msg->flag, XIO_MSG_ERROR_DISCARD_DATA)) {
-		ex_msg = ((struct arpc_request_handle *)req_msg->ex_data)->msg_ex;
-	}
-
 	//通知数据发送完成
 	ret = arpc_connection_send_comp_notify(con, req_msg);
 	LOG_ERROR_IF_VAL_TRUE(ret, "arpc_connection_send_comp_notify fail.");
 
-	ret = arpc_cond_lock(&req_msg->cond);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, xio_free, "rsp copmlete cond lock fail, maybe release.");
-	if (ret && !IS_SET(req_msg->flag, XIO_MSG_ERROR_DISCARD_DATA)) {
-		ex_msg = ((struct arpc_request_handle *)req_msg->ex_data)->msg_ex;
+	// 认领后请求方不会再超时放弃，可以安全写入其接收缓冲
+	if (arpc_completion_claim(&req_msg->comp) == ARPC_COMP_ABANDONED) {
+		ARPC_LOG_ERROR("requester timeout already, discard rsp and release msg.");
+		process_rsp_release(con, rsp);	// rsp在描述符内，归还描述符前先还给xio
+		free_msg_arpc2xio(&req_msg->xio_msg.out);
+		put_common_msg(req_msg);
+		return 0;
 	}
-	arpc_cond_unlock(&req_msg->cond);
-	
+	ex_msg = ((struct arpc_request_handle *)req_msg->ex_data)->msg_ex;
+
 	if (ex_msg) {
-		ret = move_msg_xio2arpc(&rsp->in, &ex_msg->msg->receive, &attr);
+		ex_msg->rx_flags = arpc_rx_zero_copy_flags(0);	// 回复在返回前即被释放，head需拷贝
+		if (!ex_msg->msg->proc_rsp_cb) {
+			ex_msg->rx_flags |= ARPC_RX_FLAG_DEFER_CRC;	// 同步等待与完成队列由取结果的线程校验
+		}
+		zbuf.alloc_cb = ex_msg->alloc_cb;
+		zbuf.free_cb = ex_msg->free_cb;
+		zbuf.usr_ctx = ex_msg->usr_context;
+		zbuf.iov_max_len = ex_msg->iov_max_len ? ex_msg->iov_max_len : arpc_get_max_iov_len(con);
+		ret = move_msg_xio2arpc(&rsp->in, &ex_msg->msg->receive, &attr, &ex_msg->rx_flags, &zbuf);
 		LOG_ERROR_IF_VAL_TRUE(ret, "conver_msg_xio_to_arpc fail");
+		MSG_TRACE(req_msg->attr.trace_id, MSG_TRACE_RX_DATA, ARPC_MSG_TYPE_RSP, con->id, (uint32_t)ex_msg->msg->receive.total_data);
+		ex_msg->rx_csum_type = attr.csum_type;
+		ex_msg->rx_crc = (ex_msg->msg->proc_rsp_cb) ? 0 : attr.req_crc;
+		if (attr.redirect_slot) {
+			arpc_client_redirect(con, attr.redirect_slot - 1, attr.redirect_num);
+		}
 
 		ret = destroy_xio_msg_usr_buf(rsp, ex_msg->free_cb, ex_msg->usr_context);
 		LOG_ERROR_IF_VAL_TRUE((ret), "destroy_xio_msg_usr_buf fail.");
@@ -105,16 +123,20 @@ int process_rsp_data(struct arpc_connection *con, struct xio_msg *rsp, int last_
 			ARPC_LOG_ERROR("crc fail fail, request crc:0x%lx, but rsp it:0x%lx.",
 							req_msg->attr.req_crc,
 							attr.rsp_crc);
-			free_msg_xio2arpc(&ex_msg->msg->receive, ex_msg->free_cb, ex_msg->usr_context);
+			free_msg_xio2arpc(&ex_msg->msg->receive, ex_msg->free_cb, ex_msg->usr_context, ex_msg->rx_flags);
+			ex_msg->rx_flags = 0;
 		}
 
+		MSG_TRACE(req_msg->attr.trace_id, MSG_TRACE_RSP_DONE, ARPC_MSG_TYPE_RSP, con->id, 0);
+	}
+	// rsp就是描述符内的xio_msg，完成后描述符归请求方，可能立即被归还复用，须先还给xio
+	process_rsp_release(con, rsp);
+	if (ex_msg) {
 		ret =  arpc_request_rsp_complete(req_msg);
 		LOG_ERROR_IF_VAL_TRUE(ret, "arpc_request_rsp_complete fail");
+	}else{
+		arpc_completion_done(&req_msg->comp);
 	}
-xio_free:
-	ret = xio_release_response(rsp);
-	LOG_ERROR_IF_VAL_TRUE(ret, "xio_release_response fail");
-
 	return 0;
 }
 
@@ -294,16 +294,67 @@ int32_t unpack_new_session(const uint8_t *buffer, const uint32_t bufflen, struct
 	return index;
 }
 
+int32_t pack_new_session_ext(const struct arpc_proto_new_session_ext *proto, uint8_t *buffer, uint32_t bufflen)
+{
+	int32_t index = 0;
+	LOG_THEN_RETURN_VAL_IF_TRUE(bufflen < sizeof(struct arpc_proto_new_session_ext), ARPC_ERROR, "buf invalid.");
+	index += arpc_write_uint32(proto->csum_mask, index, buffer);
+	index += arpc_write_uint32(proto->zip_mask, index, buffer);
+	index += arpc_write_uint32(proto->conn_base, index, buffer);
+	index += arpc_write_uint32(proto->conn_num, index, buffer);
+	return index;
+}
+int32_t unpack_new_session_ext(const uint8_t *buffer, const uint32_t bufflen, struct arpc_proto_new_session_ext *proto)
+{
+	int32_t index = 0;
+	// 后续版本只在尾部追加字段
+	if(index + 4 > bufflen)return index;
+	index += arpc_read_uint32(&proto->csum_mask, index, buffer);
+
+	if(index + 4 > bufflen)return index;
+	index += arpc_read_uint32(&proto->zip_mask, index, buffer);
+
+	if(index + 8 > bufflen)return index;
+	index += arpc_read_uint32(&proto->conn_base, index, buffer);
+	index += arpc_read_uint32(&proto->conn_num, index, buffer);
+	return index;
+}
+
+int32_t pack_new_session_rsp(const struct arpc_proto_new_session_rsp *proto, uint8_t *buffer, uint32_t bufflen)
+{
+	int32_t index = 0;
+	LOG_THEN_RETURN_VAL_IF_TRUE(bufflen < sizeof(struct arpc_proto_new_session_rsp), ARPC_ERROR, "buf invalid.");
+	index += arpc_write_uint32(proto->csum_type, index, buffer);
+	index += arpc_write_uint32(proto->zip_type, index, buffer);
+	return index;
+}
+int32_t unpack_new_session_rsp(const uint8_t *buffer, const uint32_t bufflen, struct arpc_proto_new_session_rsp *proto)
+{
+	int32_t index = 0;
+	if(index + 4 > bufflen)return index;
+	index += arpc_read_uint32(&proto->csum_type, index, buffer);
+
+	if(index + 4 > bufflen)return index;
+	index += arpc_read_uint32(&proto->zip_type, index, buffer);
+	return index;
+}
+
 int32_t pack_msg_attr(const struct arpc_msg_attr *proto, uint8_t *buffer, uint32_t bufflen)
 {
 	int32_t index = 0;
 	LOG_THEN_RETURN_VAL_IF_TRUE(bufflen < sizeof(struct arpc_msg_attr), ARPC_ERROR, "buf invalid.");
 	index += arpc_write_uint64(proto->req_crc, index, buffer);
 	index += arpc_write_uint64(proto->rsp_crc, index, buffer);
-	index += arpc_write_uint64(proto->tx_sec, index, buffer);
-	index += arpc_write_uint64(proto->tx_usec, index, buffer);
+	index += arpc_write_uint64(proto->tx_ns, index, buffer);
 	index += arpc_write_uint32(proto->iovec_num, index, buffer);
 	index += arpc_write_uint32(proto->conn_id, index, buffer);
+	index += arpc_write_uint32(proto->csum_type, index, buffer);
+	index += arpc_write_uint32(proto->zip_type, index, buffer);
+	index += arpc_write_uint32(proto->zip_raw_len, index, buffer);
+	index += arpc_write_uint32(proto->zip_blk_len, index, buffer);
+	index += arpc_write_uint64(proto->trace_id, index, buffer);
+	index += arpc_write_uint32(proto->redirect_slot, index, buffer);
+	index += arpc_write_uint32(proto->redirect_num, index, buffer);
 	return index;
 }
 int32_t unpack_msg_attr(const uint8_t *buffer, const uint32_t bufflen, struct arpc_msg_attr *proto)
@@ -316,10 +367,7 @@ int32_t unpack_msg_attr(const uint8_t *buffer, const uint32_t bufflen, struct ar
 	index += arpc_read_uint64(&proto->rsp_crc, index, buffer);
 
 	if(index + 8 > bufflen)return index;
-	index += arpc_read_uint64(&proto->tx_sec, index, buffer);
-
-	if(index + 8 > bufflen)return index;
-	index += arpc_read_uint64(&proto->tx_usec, index, buffer);
+	index += arpc_read_uint64(&proto->tx_ns, index, buffer);
 
 	if(index + 4 > bufflen)return index;
 	index += arpc_read_uint32(&proto->iovec_num, index, buffer);
@@ -327,6 +375,39 @@ int32_t unpack_msg_attr(const uint8_t *buffer, const uint32_t bufflen, struct ar
 	if(index + 4 > bufflen)return index;
 	index += arpc_read_uint32(&proto->conn_id, index, buffer);
 
+	if(index + 4 > bufflen)return index;
+	index += arpc_read_uint32(&proto->csum_type, index, buffer);
+
+	// 三个压缩字段同时出现
+	if(index + 12 > bufflen)return index;
+	index += arpc_read_uint32(&proto->zip_type, index, buffer);
+	index += arpc_read_uint32(&proto->zip_raw_len, index, buffer);
+	index += arpc_read_uint32(&proto->zip_blk_len, index, buffer);
+
+	if(index + 8 > bufflen)return index;
+	index += arpc_read_uint64(&proto->trace_id, index, buffer);
+
+	if(index + 8 > bufflen)return index;
+	index += arpc_read_uint32(&proto->redirect_slot, index, buffer);
+	index += arpc_read_uint32(&proto->redirect_num, index, buffer);
+
+	return index;
+}
+
+int32_t pack_zip_frame(const struct arpc_zip_frame *proto, uint8_t *buffer, uint32_t bufflen)
+{
+	int32_t index = 0;
+	LOG_THEN_RETURN_VAL_IF_TRUE(bufflen < sizeof(struct arpc_zip_frame), ARPC_ERROR, "buf invalid.");
+	index += arpc_write_uint32(proto->raw_len, index, buffer);
+	index += arpc_write_uint32(proto->zip_len, index, buffer);
+	return index;
+}
+int32_t unpack_zip_frame(const uint8_t *buffer, const uint32_t bufflen, struct arpc_zip_frame *proto)
+{
+	int32_t index = 0;
+	LOG_THEN_RETURN_VAL_IF_TRUE(bufflen < sizeof(struct arpc_zip_frame), ARPC_ERROR, "buf invalid.");
+	index += arpc_read_uint32(&proto->raw_len, index, buffer);
+	index += arpc_read_uint32(&proto->zip_len, index, buffer);
 	return index;
 }
 
@@ -71,6 +71,8 @@ typedef enum arpc_proto{
 	ARPC_PROTO_NEW_SESSION_PRIVATE,
 	ARPC_PROTO_MSG_INTER_HEAD,
 	ARPC_PROTO_MSG_USER_HEAD,
+	ARPC_PROTO_NEW_SESSION_RSP,
+	ARPC_PROTO_NEW_SESSION_EXT,
 }arpc_proto_t;
 
 PACKED_MEMORY(struct arpc_proto_new_session
@@ -83,19 +85,56 @@ PACKED_MEMORY(struct arpc_proto_new_session
 int32_t pack_new_session(const struct arpc_proto_new_session *proto, uint8_t *buffer, uint32_t bufflen);
 int32_t unpack_new_session(const uint8_t *buffer, const uint32_t bufflen, struct arpc_proto_new_session *proto);
 
+/* 紧跟在ARPC_PROTO_NEW_SESSION之后的可选TLV，旧版本服务端只读第一个TLV，不受影响 */
+PACKED_MEMORY(struct arpc_proto_new_session_ext
+{
+	uint32_t csum_mask;		/* 客户端有硬件加速的校验算法集合 */
+	uint32_t zip_mask;		/* 客户端支持的压缩算法集合，未开启压缩为0 */
+	uint32_t conn_base;		/* 第一条连接的xio conn_idx，服务端据此排列工作线程入口 */
+	uint32_t conn_num;		/* 客户端的连接数 */
+});
+
+int32_t pack_new_session_ext(const struct arpc_proto_new_session_ext *proto, uint8_t *buffer, uint32_t bufflen);
+int32_t unpack_new_session_ext(const uint8_t *buffer, const uint32_t bufflen, struct arpc_proto_new_session_ext *proto);
+
+PACKED_MEMORY(struct arpc_proto_new_session_rsp
+{
+	uint32_t csum_type;		/* 服务端为会话选定的校验算法 */
+	uint32_t zip_type;		/* 服务端为会话选定的压缩算法，0不压缩 */
+});
+
+int32_t pack_new_session_rsp(const struct arpc_proto_new_session_rsp *proto, uint8_t *buffer, uint32_t bufflen);
+int32_t unpack_new_session_rsp(const uint8_t *buffer, const uint32_t bufflen, struct arpc_proto_new_session_rsp *proto);
+
 PACKED_MEMORY(struct arpc_msg_attr
 {
 	uint64_t req_crc;
 	uint64_t rsp_crc;
-	uint64_t tx_sec;
-	uint64_t tx_usec;
+	uint64_t tx_ns;			/* 发送时刻，墙上时间纳秒，0表示未填 */
 	uint32_t iovec_num;
 	uint32_t conn_id;
+	uint32_t csum_type;		/* 发送端计算req_crc所用算法 */
+	uint32_t zip_type;		/* 数据压缩算法，0表示数据原样发送 */
+	uint32_t zip_raw_len;	/* 压缩前数据总长，req_crc按压缩前数据计算 */
+	uint32_t zip_blk_len;	/* 压缩分块的原始长度，最后一块可以更短 */
+	uint64_t trace_id;		/* 链路追踪id，0表示未采样；回复原样带回请求的id */
+	uint32_t redirect_slot;	/* 服务端建议客户端把本连接迁往的入口序号+1，0表示不迁移 */
+	uint32_t redirect_num;	/* 服务端给该session的入口总数 */
 });
 
 int32_t pack_msg_attr(const struct arpc_msg_attr *proto, uint8_t *buffer, uint32_t bufflen);
 int32_t unpack_msg_attr(const uint8_t *buffer, const uint32_t bufflen, struct arpc_msg_attr *proto);
 
+/* 压缩数据由若干帧顺序组成，每帧为帧头加一块数据；zip_len等于raw_len时该块未压缩 */
+PACKED_MEMORY(struct arpc_zip_frame
+{
+	uint32_t raw_len;
+	uint32_t zip_len;
+});
+
+int32_t pack_zip_frame(const struct arpc_zip_frame *proto, uint8_t *buffer, uint32_t bufflen);
+int32_t unpack_zip_frame(const uint8_t *buffer, const uint32_t bufflen, struct arpc_zip_frame *proto);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,42 +22,58 @@
 #include "arpc_com.h"
 #include "arpc_request.h"
 #include "arpc_message.h"
+#include "arpc_cq.h"
 
 #define SEND_ONEWAY_END_MAX_TIME (2*1000)
 #define DO_REQUEST_RSP_MAX_TIME  (5*1000)
+#define SUBMIT_REQUEST_CONN_MAX_TIME (2*1000)
+#define SEND_ONEWAY_BATCH_CHUNK  64
+
+struct oneway_batch {
+	struct arpc_completion	comp;
+	uint32_t				remain;		/* 未完成的消息数，另加提交者持有的1个 */
+	uint32_t				refs;		/* 完成方与同步等待方各持1个，最后释放者回收 */
+	uint32_t				num;		/* 成功提交的消息数 */
+	struct arpc_vmsg		**send;
+	clean_sendv_cb_t		clean_send;
+	void					*send_ctx;
+};
 
 /**
- * 发送一个请求消息
- * @param[in] fd ,a session handle
+ * 提交一个请求消息到发送队列
+ * @param[in] session_ctx ,a session handle
  * @param[in] msg ,a data that will send
+ * @param[out] out_msg ,提交成功时的请求描述符
+ * @param[out] out_seq ,提交前的完成序号，用于同步等待
  * @return receive .0,表示发送成功，小于0则失败
  */
-int arpc_do_request(const arpc_session_handle_t fd, struct arpc_msg *msg, int32_t timeout_ms)
+static int request_submit(struct arpc_session_handle *session_ctx, struct arpc_msg *msg, int32_t timeout_ms,
+							struct arpc_common_msg **out_msg, uint32_t *out_seq)
 {
-	struct arpc_session_handle *session_ctx = (struct arpc_session_handle *)fd;
 	struct xio_msg 	*req = NULL;
 	int ret = ARPC_ERROR;
 	struct arpc_common_msg *req_msg = NULL;
-	struct arpc_msg *rev_msg;
 	uint32_t send_cnt;
 	struct arpc_connection *con = NULL;
 	struct arpc_msg_ex *ex_msg;
 	struct arpc_request_handle *req_fd;
-	struct timeval now;
+	uint64_t trace_id = msg_trace_new_id();
+	uint64_t start_ns = arpc_clock_ns();	// 含等待空闲连接的时间
+	uint64_t tx_ns = fast_clock_to_wall(start_ns);
+	uint32_t grace;
 
-	LOG_THEN_RETURN_VAL_IF_TRUE((!session_ctx || !msg ), ARPC_ERROR, "arpc_session_handle_t fd null, exit.");
-
-	gettimeofday(&now, NULL);	// 线程安全
+	MSG_TRACE(trace_id, MSG_TRACE_REQ_BEGIN, ARPC_MSG_TYPE_REQ, 0, 0);
 
-	ret = session_get_idle_conn(session_ctx, &con, ARPC_MSG_TYPE_REQ, timeout_ms);
+	ret = session_get_idle_conn(session_ctx, &con, ARPC_MSG_TYPE_REQ, timeout_ms, &grace);
 	LOG_THEN_RETURN_VAL_IF_TRUE(!con, ARPC_ERROR,"session_get_idle_conn fail");
+	MSG_TRACE(trace_id, MSG_TRACE_GET_CONN, ARPC_MSG_TYPE_REQ, con->id, 0);
 
 	req_msg = get_common_msg(con, ARPC_MSG_TYPE_REQ);
-	LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, ARPC_ERROR,"get_common_msg");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!req_msg, put_conn, "get_common_msg");
 
-	req_msg->now = now;
-	req_msg->attr.tx_sec= now.tv_sec;
-	req_msg->attr.tx_usec= now.tv_usec;
+	req_msg->attr.trace_id = trace_id;
+	req_msg->start_ns = start_ns;
+	req_msg->attr.tx_ns = tx_ns;
 	req_msg->attr.conn_id = con->id;
 	req_msg->attr.iovec_num = con->id;
 	req_fd = (struct arpc_request_handle*)req_msg->ex_data;
@@ -66,17 +82,20 @@ int arpc_do_request(const arpc_session_handle_t fd, struct arpc_msg *msg, int32_
 	req_fd->msg_ex = (struct arpc_msg_ex *)msg->handle;
 
 	ex_msg = req_fd->msg_ex;
+	ex_msg->rx_crc = 0;
+	ex_msg->trace_id = trace_id;
 	req = &req_msg->xio_msg;
 	req_msg->tx_msg = req;
 
 	req->in.sgl_type		= XIO_SGL_TYPE_IOV_PTR;
-	ret = convert_msg_arpc2xio(&msg->send, &req->out, &req_msg->attr);
+	ret = convert_msg_arpc2xio(&msg->send, &req->out, &req_msg->attr,
+							   req_msg->tx_head_buf, req_msg->tx_head_buf_len);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_common_msg, "convert xio msg fail.");
 	req->user_context = req_msg;
-	ex_msg = (struct arpc_msg_ex *)msg->handle;
 
 	send_cnt = 0;
-	arpc_cond_lock(&req_msg->cond);
+	*out_seq = arpc_completion_seq(&req_msg->comp);
+	MSG_SET_REQ(ex_msg->flags);
 	while(send_cnt < 1) {
 		send_cnt++;
 		ret = arpc_connection_async_send(con, req_msg);
@@ -89,77 +108,194 @@ int arpc_do_request(const arpc_session_handle_t fd, struct arpc_msg *msg, int32_
 		break;
 	}
 
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "session[%p] do requet send msg fail.", session_ctx);
-	MSG_SET_REQ(ex_msg->flags);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, clr_req, "session[%p] do requet send msg fail.", session_ctx);
+	session_put_conn(session_ctx, grace);
+	*out_msg = req_msg;
+	return 0;
+clr_req:
+	MSG_CLR_REQ(ex_msg->flags);
+free_common_msg:
+	free_msg_arpc2xio(&req->out);
+	put_common_msg(req_msg);	//un lock
+	session_put_conn(session_ctx, grace);
+	return (-ENETUNREACH);	
+put_conn:
+	session_put_conn(session_ctx, grace);
+	return ARPC_ERROR;
+}
+
+/**
+ * 发送一个请求消息
+ * @param[in] fd ,a session handle
+ * @param[in] msg ,a data that will send
+ * @return receive .0,表示发送成功，小于0则失败
+ */
+int arpc_do_request(const arpc_session_handle_t fd, struct arpc_msg *msg, int32_t timeout_ms)
+{
+	struct arpc_session_handle *session_ctx = (struct arpc_session_handle *)fd;
+	int ret = ARPC_ERROR;
+	struct arpc_common_msg *req_msg = NULL;
+	struct arpc_msg_ex *ex_msg;
+	uint32_t seq;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!session_ctx || !msg ), ARPC_ERROR, "arpc_session_handle_t fd null, exit.");
+
+	ex_msg = (struct arpc_msg_ex *)msg->handle;
+	LOG_THEN_RETURN_VAL_IF_TRUE(ex_msg->cq, ARPC_ERROR, "msg is submitted to cq[%p] already.", ex_msg->cq);
+
+	ret = request_submit(session_ctx, msg, timeout_ms, &req_msg, &seq);
+	if (ret) {
+		return ret;
+	}
 	if (!msg->proc_rsp_cb){
 		if (timeout_ms > 0)
-			ret = arpc_cond_wait_timeout(&req_msg->cond, timeout_ms + 500);//至少500ms起步
+			ret = arpc_completion_wait(&req_msg->comp, seq, timeout_ms + 500, (arpc_cpu_max_num() > 1));//至少500ms起步
 		else
-			ret = arpc_cond_wait_timeout(&req_msg->cond, DO_REQUEST_RSP_MAX_TIME); // 默认等待
-		if (!ret){
+			ret = arpc_completion_wait(&req_msg->comp, seq, DO_REQUEST_RSP_MAX_TIME, (arpc_cpu_max_num() > 1)); // 默认等待
+		if (ret && !arpc_completion_abandon(&req_msg->comp, seq)){
+			// 放弃等待，描述符由回复路径回收
+			ARPC_LOG_ERROR("wait msg rx respone of request fail.");
 			ex_msg->x_rsp_msg = NULL;
 			MSG_CLR_REQ(ex_msg->flags);
-			arpc_cond_unlock(&req_msg->cond);
-			free_msg_arpc2xio(&req->out);
-			put_common_msg(req_msg);
-		}else{
-			ARPC_LOG_ERROR("wait msg rx respone of request fail.");// todo 内存回收
-			ex_msg->x_rsp_msg = NULL;
-			MSG_CLR_REQ(ex_msg->flags);
-			SET_FLAG(req_msg->flag, XIO_MSG_ERROR_DISCARD_DATA);
-			arpc_cond_unlock(&req_msg->cond);
 			return (-ETIMEDOUT);
 		}
-	}else{
-		arpc_cond_unlock(&req_msg->cond);
+		ex_msg->x_rsp_msg = NULL;
+		MSG_CLR_REQ(ex_msg->flags);
+		free_msg_arpc2xio(&req_msg->xio_msg.out);
+		put_common_msg(req_msg);
+		(void)arpc_msg_rx_verify(msg);	// 在调用者线程校验回复，失败则标记丢弃
+		MSG_TRACE(ex_msg->trace_id, MSG_TRACE_REQ_END, ARPC_MSG_TYPE_REQ, 0, 0);
 	}
 	if (IS_SET(ex_msg->flags, XIO_MSG_ERROR_DISCARD_DATA)){
 		return (-ENODATA);
 	}
 	return 0;
-unlock:
-	arpc_cond_unlock(&req_msg->cond);
-free_common_msg:
-	free_msg_arpc2xio(&req->out);
-	put_common_msg(req_msg);	//un lock
-	return (-ENETUNREACH);	
+}
+
+/**
+ * 通过完成队列异步发送一个请求消息
+ * @param[in] fd ,a session handle
+ * @param[in] msg ,a data that will send
+ * @param[in] cq ,完成队列
+ * @param[in] tag ,用户标识
+ * @return receive .0,表示发送成功，小于0则失败
+ */
+int arpc_submit_request(const arpc_session_handle_t fd, struct arpc_msg *msg, arpc_cq_t cq, void *tag)
+{
+	struct arpc_session_handle *session_ctx = (struct arpc_session_handle *)fd;
+	struct arpc_common_msg *req_msg = NULL;
+	struct arpc_msg_ex *ex_msg;
+	uint32_t seq;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!session_ctx || !msg || !cq), ARPC_ERROR, "session, msg or cq null, exit.");
+
+	ex_msg = (struct arpc_msg_ex *)msg->handle;
+	LOG_THEN_RETURN_VAL_IF_TRUE(IS_SET(ex_msg->flags, XIO_MSG_REQ) || ex_msg->cq, ARPC_ERROR, "msg is requesting already.");
+	if (arpc_cq_reserve((struct arpc_cq *)cq)) {
+		return (-EAGAIN);
+	}
+	// 回复可能在提交返回前到达，先挂上完成队列
+	CLR_FLAG(ex_msg->flags, XIO_MSG_ERROR_DISCARD_DATA);
+	ex_msg->cq_tag = tag;
+	ex_msg->cq_status = 0;
+	ex_msg->cq = (struct arpc_cq *)cq;
+	ret = request_submit(session_ctx, msg, SUBMIT_REQUEST_CONN_MAX_TIME, &req_msg, &seq);
+	if (ret) {
+		ex_msg->cq = NULL;
+		ex_msg->cq_tag = NULL;
+		arpc_cq_unreserve((struct arpc_cq *)cq);
+		return ret;
+	}
+	return 0;
 }
 
 /**
  * 释放request消息,必须在回调内执行
- * @param[in] oneway_msg ,a session handle
+ * 回复的xio_msg位于描述符内，本函数会归还描述符或交给等待方，调用者须先xio_release_response，返回后不能再访问回复
+ * @param[in] req_msg ,已认领的请求描述符
  * @return receive .0,表示发送成功，小于0则失败
  */
 int arpc_request_rsp_complete(struct arpc_common_msg *req_msg)
 {
-	int ret;
 	struct arpc_request_handle *req_msg_ex;
-	struct xio_iovec_ex *sglist;
+	struct arpc_cq *cq;
+	struct arpc_msg *msg;
 	LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, ARPC_ERROR, "req_msg null, fail.");
 
-	ret = arpc_cond_lock(&req_msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "rsp copmlete cond lock fail, maybe release.");
+	// 调用者需已通过arpc_completion_claim认领
 	req_msg_ex = (struct arpc_request_handle *)req_msg->ex_data;
 	SET_FLAG(req_msg_ex->msg_ex->flags, XIO_MSG_RSP);
 	MSG_CLR_REQ(req_msg_ex->msg_ex->flags);
-	if (req_msg_ex->msg && req_msg_ex->msg->proc_rsp_cb){
+	if (req_msg_ex->msg_ex->cq) {
+		cq = req_msg_ex->msg_ex->cq;
+		if (IS_SET(req_msg_ex->msg_ex->flags, XIO_MSG_ERROR_DISCARD_DATA) && !req_msg_ex->msg_ex->cq_status){
+			req_msg_ex->msg_ex->cq_status = -ENODATA;
+		}
+		// req_msg_ex位于描述符内，归还前先取出
+		msg = req_msg_ex->msg;
+		free_msg_arpc2xio(&req_msg->xio_msg.out);
+		put_common_msg(req_msg);	//un lock
+		arpc_cq_complete(cq, msg);	// 投递后msg归调用者
+	}else if (req_msg_ex->msg && req_msg_ex->msg->proc_rsp_cb){
 		if (IS_SET(req_msg_ex->msg_ex->flags, XIO_MSG_ERROR_DISCARD_DATA)){
 			req_msg_ex->msg->proc_rsp_cb(NULL, req_msg_ex->msg->receive_ctx);
 		}else{
 			req_msg_ex->msg->proc_rsp_cb(&req_msg_ex->msg->receive, req_msg_ex->msg->receive_ctx);
 		}
-		arpc_cond_unlock(&req_msg->cond);
 		free_msg_arpc2xio(&req_msg->xio_msg.out);
 		put_common_msg(req_msg);	//un lock
 	}else{
-		arpc_cond_notify(&req_msg->cond);
-		arpc_cond_unlock(&req_msg->cond);
+		arpc_completion_done(&req_msg->comp);
 	}
 	ARPC_LOG_DEBUG("request get rsp complete.");
 	return 0;
 }
 
 
+/**
+ * 请求发送失败或链路清空未得到回复，在xio loop线程内执行
+ * @param[in] req_msg ,请求描述符
+ * @param[in] status ,投递到完成队列的状态
+ * @return receive .0,表示成功，小于0则失败
+ */
+int arpc_request_fail(struct arpc_common_msg *req_msg, int32_t status)
+{
+	REQUEST_USR_EX_CTX(msg_ex, req_msg);
+
+	if (arpc_completion_claim(&req_msg->comp) == ARPC_COMP_ABANDONED) {
+		free_msg_arpc2xio(&req_msg->xio_msg.out);
+		put_common_msg(req_msg);
+		return 0;
+	}
+	SET_FLAG(msg_ex->flags, XIO_MSG_ERROR_DISCARD_DATA);
+	msg_ex->cq_status = status;
+	return arpc_request_rsp_complete(req_msg);
+}
+
+/**
+ * 链路销毁时强制回收仍在途的请求，描述符由缓存直接回收，这里只通知完成队列
+ * @param[in] req_msg ,请求描述符
+ * @return receive .1,表示已通知完成队列，0则未处理
+ */
+int arpc_request_reclaim(struct arpc_common_msg *req_msg)
+{
+	struct arpc_cq *cq;
+	REQUEST_USR_EX_CTX(msg_ex, req_msg);
+
+	if (!msg_ex || !msg_ex->cq || arpc_completion_claim(&req_msg->comp) == ARPC_COMP_ABANDONED) {
+		return 0;
+	}
+	cq = msg_ex->cq;
+	SET_FLAG(msg_ex->flags, XIO_MSG_RSP);
+	SET_FLAG(msg_ex->flags, XIO_MSG_ERROR_DISCARD_DATA);
+	MSG_CLR_REQ(msg_ex->flags);
+	msg_ex->cq_status = -ECONNRESET;
+	free_msg_arpc2xio(&req_msg->xio_msg.out);
+	arpc_cq_complete(cq, ((struct arpc_request_handle *)req_msg->ex_data)->msg);
+	return 1;
+}
+
 /**
  * 发送一个单向消息（接收方无需回复）
  * @param[in] fd ,a session handle
@@ -175,23 +311,30 @@ int arpc_send_oneway_msg(const arpc_session_handle_t fd, struct arpc_vmsg *send,
 	struct arpc_oneway_handle *ow_msg;
 	uint32_t send_cnt = 0;
 	struct arpc_connection *con = NULL;
-	struct timeval now;
+	uint32_t seq;
+	uint64_t trace_id;
+	uint64_t start_ns;
+	uint64_t tx_ns;
+	uint32_t grace;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE((!session_ctx), ARPC_ERROR, "arpc_session_handle_t fd null, exit.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!send ), ARPC_ERROR, " send null, exit.");
 
-	gettimeofday(&now, NULL);	// 线程安全
+	start_ns = arpc_clock_ns();
+	tx_ns = fast_clock_to_wall(start_ns);
+	trace_id = msg_trace_new_id();
+	MSG_TRACE(trace_id, MSG_TRACE_REQ_BEGIN, ARPC_MSG_TYPE_OW, 0, 0);
 
-	ret = session_get_idle_conn(session_ctx, &con, ARPC_MSG_TYPE_OW, SEND_ONEWAY_END_MAX_TIME);
+	ret = session_get_idle_conn(session_ctx, &con, ARPC_MSG_TYPE_OW, SEND_ONEWAY_END_MAX_TIME, &grace);
 	LOG_THEN_RETURN_VAL_IF_TRUE(!con, ARPC_ERROR,"session_get_idle_conn fail");
-
+	MSG_TRACE(trace_id, MSG_TRACE_GET_CONN, ARPC_MSG_TYPE_OW, con->id, 0);
 
 	req_msg = get_common_msg(con, ARPC_MSG_TYPE_OW);
-	LOG_THEN_RETURN_VAL_IF_TRUE(!req_msg, ARPC_ERROR,"get_common_msg");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!req_msg, put_conn, "get_common_msg");
 
-	req_msg->now = now;
-	req_msg->attr.tx_sec= now.tv_sec;
-	req_msg->attr.tx_usec= now.tv_usec;
+	req_msg->attr.trace_id = trace_id;
+	req_msg->start_ns = start_ns;
+	req_msg->attr.tx_ns = tx_ns;
 	req_msg->attr.conn_id = con->id;
 	ow_msg = (struct arpc_oneway_handle*)req_msg->ex_data;
 	ow_msg->send = send;
@@ -201,13 +344,14 @@ int arpc_send_oneway_msg(const arpc_session_handle_t fd, struct arpc_vmsg *send,
 	req_msg->tx_msg = req;
 	req_msg->type = ARPC_MSG_TYPE_OW;
 
-	ret = convert_msg_arpc2xio(send, &req->out, &req_msg->attr);
+	ret = convert_msg_arpc2xio(send, &req->out, &req_msg->attr,
+							   req_msg->tx_head_buf, req_msg->tx_head_buf_len);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_common_msg, "convert xio msg fail.");
 	req->user_context = req_msg;
 	/*if (!ow_msg->clean_send_cb){
 		req->flags |= XIO_MSG_FLAG_IMM_SEND_COMP;
 	}*/
-	arpc_cond_lock(&req_msg->cond);
+	seq = arpc_completion_seq(&req_msg->comp);
 	while(send_cnt < 1) {
 		send_cnt++;
 		ret = arpc_connection_async_send(con, req_msg);
@@ -219,26 +363,161 @@ int arpc_send_oneway_msg(const arpc_session_handle_t fd, struct arpc_vmsg *send,
 		break;
 	}
 
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "session send msg fail.");
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_common_msg, "session send msg fail.");
+	session_put_conn(session_ctx, grace);
 	if (!ow_msg->clean_send_cb){
-		ret = arpc_cond_wait_timeout(&req_msg->cond, SEND_ONEWAY_END_MAX_TIME); // 默认等待
-		arpc_cond_unlock(&req_msg->cond);
-		free_msg_arpc2xio(&req->out);
+		ret = arpc_completion_wait(&req_msg->comp, seq, SEND_ONEWAY_END_MAX_TIME, (arpc_cpu_max_num() > 1)); // 默认等待
+		if (ret && arpc_completion_abandon(&req_msg->comp, seq)){
+			ret = 0;
+		}
 		if (ret){
-			ARPC_LOG_ERROR("wait oneway msg send complete timeout fail, msg keep."); // TODO 释放超时的资源
+			ARPC_LOG_ERROR("wait oneway msg send complete timeout fail, msg reclaim by send complete.");
+			return ret;
 		}
-	}else{
-		arpc_cond_unlock(&req_msg->cond);
+		free_msg_arpc2xio(&req->out);
+		put_common_msg(req_msg);
 	}
 	return ret;
-unlock:
-	arpc_cond_unlock(&req_msg->cond);
 free_common_msg:
 	free_msg_arpc2xio(&req->out);
 	put_common_msg(req_msg);	//un lock
+put_conn:
+	session_put_conn(session_ctx, grace);
 	return ARPC_ERROR;
 }
 
+static void oneway_batch_unref(struct oneway_batch *batch)
+{
+	if (!__atomic_sub_fetch(&batch->refs, 1, __ATOMIC_ACQ_REL)) {
+		arpc_mem_free(batch, NULL);
+	}
+}
+
+static void oneway_batch_put(struct oneway_batch *batch, uint32_t cnt)
+{
+	if (__atomic_sub_fetch(&batch->remain, cnt, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+	if (batch->clean_send) {
+		batch->clean_send(batch->send, batch->num, batch->send_ctx);
+	} else {
+		(void)arpc_complete(&batch->comp);
+	}
+	oneway_batch_unref(batch);
+}
+
+static int oneway_batch_msg_done(struct arpc_vmsg *send, void *send_ctx)
+{
+	oneway_batch_put((struct oneway_batch *)send_ctx, 1);
+	return 0;
+}
+
+/**
+ * 批量发送单向消息
+ * @param[in] fd ,a session handle
+ * @param[in] send ,消息数组
+ * @param[in] num ,消息个数
+ * @return receive .成功提交的消息数，小于0则失败
+ */
+int arpc_send_oneway_msgv(const arpc_session_handle_t fd, struct arpc_vmsg **send, uint32_t num,
+						clean_sendv_cb_t clean_send, void *send_ctx)
+{
+	struct arpc_session_handle *session_ctx = (struct arpc_session_handle *)fd;
+	struct arpc_common_msg *msgs[SEND_ONEWAY_BATCH_CHUNK];
+	struct arpc_oneway_handle *ow_msg;
+	struct arpc_connection *con = NULL;
+	struct oneway_batch *batch;
+	uint64_t start_ns;
+	uint64_t tx_ns;
+	uint32_t seq;
+	uint32_t sent = 0;
+	uint32_t cnt;
+	uint32_t got;
+	uint32_t ready;
+	uint32_t pushed;
+	uint32_t i;
+	uint32_t grace;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!session_ctx), ARPC_ERROR, "arpc_session_handle_t fd null, exit.");
+	LOG_THEN_RETURN_VAL_IF_TRUE((!send || !num), ARPC_ERROR, " send null, exit.");
+
+	start_ns = arpc_clock_ns();	// 整批共用一个提交时间
+	tx_ns = fast_clock_to_wall(start_ns);
+
+	ret = session_get_idle_conn(session_ctx, &con, ARPC_MSG_TYPE_OW, SEND_ONEWAY_END_MAX_TIME, &grace);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!con, ARPC_ERROR,"session_get_idle_conn fail");
+
+	batch = (struct oneway_batch *)arpc_mem_alloc(sizeof(struct oneway_batch), NULL);
+	if (!batch) {
+		session_put_conn(session_ctx, grace);
+		ARPC_LOG_ERROR("arpc_mem_alloc oneway_batch fail.");
+		return ARPC_ERROR;
+	}
+	arpc_completion_init(&batch->comp);
+	batch->remain = num + 1;
+	batch->refs = clean_send ? 1 : 2;
+	batch->num = 0;
+	batch->send = send;
+	batch->clean_send = clean_send;
+	batch->send_ctx = send_ctx;
+	seq = arpc_completion_seq(&batch->comp);
+
+	while (sent < num) {
+		cnt = (num - sent > SEND_ONEWAY_BATCH_CHUNK) ? SEND_ONEWAY_BATCH_CHUNK : (num - sent);
+		got = get_common_msg_bulk(con, ARPC_MSG_TYPE_OW, msgs, cnt);
+		if (!got) {
+			ARPC_LOG_ERROR("get_common_msg_bulk fail, sent[%u].", sent);
+			break;
+		}
+		for (ready = 0; ready < got; ready++) {
+			msgs[ready]->start_ns = start_ns;
+			msgs[ready]->attr.tx_ns = tx_ns;
+			msgs[ready]->attr.conn_id = con->id;
+			ow_msg = (struct arpc_oneway_handle*)msgs[ready]->ex_data;
+			ow_msg->send = send[sent + ready];
+			ow_msg->clean_send_cb = &oneway_batch_msg_done;
+			ow_msg->send_ctx = batch;
+			msgs[ready]->tx_msg = &msgs[ready]->xio_msg;
+			msgs[ready]->xio_msg.user_context = msgs[ready];
+			ret = convert_msg_arpc2xio(send[sent + ready], &msgs[ready]->xio_msg.out, &msgs[ready]->attr,
+									   msgs[ready]->tx_head_buf, msgs[ready]->tx_head_buf_len);
+			if (ret) {
+				ARPC_LOG_ERROR("convert xio msg[%u] fail.", sent + ready);
+				break;
+			}
+		}
+		pushed = ready ? arpc_connection_async_send_batch(con, msgs, ready) : 0;
+		for (i = pushed; i < got; i++) {
+			free_msg_arpc2xio(&msgs[i]->xio_msg.out);
+			put_common_msg(msgs[i]);	//un lock
+		}
+		sent += pushed;
+		if (pushed < got) {
+			ARPC_LOG_ERROR("session[%p] send batch stop at[%u], total[%u].", session_ctx, sent, num);
+			break;
+		}
+	}
+	session_put_conn(session_ctx, grace);
+
+	if (!sent) {
+		arpc_mem_free(batch, NULL);
+		return ARPC_ERROR;
+	}
+	batch->num = sent;
+	oneway_batch_put(batch, num - sent + 1);	// 未提交的与提交者自身的计数
+	if (clean_send) {
+		return (int)sent;
+	}
+	ret = arpc_completion_wait(&batch->comp, seq, SEND_ONEWAY_END_MAX_TIME, (arpc_cpu_max_num() > 1));
+	oneway_batch_unref(batch);
+	if (ret) {
+		ARPC_LOG_ERROR("wait oneway batch send complete timeout fail, msg keep.");
+		return ARPC_ERROR;
+	}
+	return (int)sent;
+}
+
 /**
  * 释放发送一个单向消息
  * @param[in] oneway_msg ,a session handle
@@ -246,20 +525,20 @@ free_common_msg:
  */
 int arpc_oneway_send_complete(struct arpc_common_msg *ow_msg)
 {
-	int ret;
 	struct arpc_oneway_handle *ow_msg_ex;
 	LOG_THEN_RETURN_VAL_IF_TRUE(!ow_msg, ARPC_ERROR, "ow_msg null, fail.");
-	ret = arpc_cond_lock(&ow_msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "send copmlete cond lock fail, maybe release.");
 	ow_msg_ex = (struct arpc_oneway_handle *)ow_msg->ex_data;
 
 	if (ow_msg_ex->clean_send_cb){
 		ow_msg_ex->clean_send_cb(ow_msg_ex->send, ow_msg_ex->send_ctx);
-		arpc_cond_unlock(&ow_msg->cond);
 		free_msg_arpc2xio(&ow_msg->xio_msg.out);
 		put_common_msg(ow_msg);	//un lock
-	}else{
-		arpc_cond_unlock(&ow_msg->cond);
+	} else if (arpc_completion_claim(&ow_msg->comp) == ARPC_COMP_ABANDONED) {
+		// 同步发送者已超时放弃，由这里回收
+		free_msg_arpc2xio(&ow_msg->xio_msg.out);
+		put_common_msg(ow_msg);
+	} else {
+		arpc_completion_done(&ow_msg->comp);	// 同步发送者负责回收
 	}
 	ARPC_LOG_DEBUG("send end complete.");
 	return 0;
@@ -42,7 +42,10 @@ _usr_msg_ex = ((struct arpc_request_handle *)_com_msg->ex_data)->msg_ex;
 struct arpc_msg_ex *_usr_msg_ex;\
 _usr_msg_ex = ((struct arpc_request_handle *)_com_msg->ex_data)->msg_ex;
 
+// 调用前须已认领并归还xio回复，返回后描述符可能已被复用
 int arpc_request_rsp_complete(struct arpc_common_msg *req_msg);
+int arpc_request_fail(struct arpc_common_msg *req_msg, int32_t status);
+int arpc_request_reclaim(struct arpc_common_msg *req_msg);
 int arpc_oneway_send_complete(struct arpc_common_msg *ow_msg);
 
 #ifdef __cplusplus
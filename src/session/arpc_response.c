@@ -40,37 +40,30 @@ int arpc_do_response(arpc_rsp_handle_t *rsp_fd, struct arpc_vmsg *rsp_iov, rsp_c
 	struct arpc_common_msg *rsp_msg;
 	struct arpc_rsp_handle *rsp_fd_ex;
 	int ret;
-	struct timeval now;
+	uint32_t seq;
 	LOG_THEN_RETURN_VAL_IF_TRUE((!rsp_fd), ARPC_ERROR, "rsp_fd is null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!rsp_iov), ARPC_ERROR, "rsp_iov is null.");
 	LOG_THEN_RETURN_VAL_IF_TRUE((!release_rsp_cb), ARPC_ERROR, "rsp_iov is null.");
 
-	gettimeofday(&now, NULL);	// 线程安全
 	rsp_msg = (struct arpc_common_msg *)(*rsp_fd);
 	
-	ret = arpc_cond_lock(&rsp_msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock msg fail, maybe free...");
-	rsp_msg->now = now;
-	rsp_msg->attr.tx_sec= now.tv_sec;
-	rsp_msg->attr.tx_usec= now.tv_usec;
+	LOG_THEN_RETURN_VAL_IF_TRUE((!rsp_msg), ARPC_ERROR, "rsp_msg is null.");
+	seq = arpc_completion_seq(&rsp_msg->comp);
+	rsp_msg->attr.tx_ns = fast_clock_wall_ns();
 	rsp_msg->attr.conn_id = rsp_msg->conn->id;
 	rsp_fd_ex = (struct arpc_rsp_handle*)rsp_msg->ex_data;
 	rsp_fd_ex->release_rsp_cb = release_rsp_cb;
 	rsp_fd_ex->rsp_usr_iov = rsp_iov;
 	rsp_fd_ex->rsp_usr_ctx = rsp_cb_ctx;
 	ret = arpc_init_response(rsp_msg);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "arpc_init_response fail.");
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_init_response fail.");
 
 	ret = arpc_connection_async_send(rsp_msg->conn, rsp_msg);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, unlock, "arpc_session_send_response fail.");
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_session_send_response fail.");
 
-	ret = arpc_cond_wait_timeout(&rsp_msg->cond, SEND_RSP_END_MAX_TIME_MS); // 默认等待
-	arpc_cond_unlock(&rsp_msg->cond);
+	ret = arpc_completion_wait(&rsp_msg->comp, seq, SEND_RSP_END_MAX_TIME_MS, (arpc_cpu_max_num() > 1)); // 默认等待
 	*rsp_fd = NULL;
 	return ret;
-unlock:
-	arpc_cond_unlock(&rsp_msg->cond);
-	return -1;
 }
 
 int arpc_init_response(struct arpc_common_msg *rsp_msg)
@@ -91,7 +84,8 @@ int arpc_init_response(struct arpc_common_msg *rsp_msg)
 	
 	if(rsp_iov && rsp_iov->head && rsp_iov->head_len){
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!rsp_fd_ex->release_rsp_cb, rsp_default, "release_rsp_cb is null ,can't send user rsp data.");
-		ret = convert_msg_arpc2xio(rsp_iov, &xio_rsp_msg->out, &rsp_msg->attr);
+		ret = convert_msg_arpc2xio(rsp_iov, &xio_rsp_msg->out, &rsp_msg->attr,
+								   rsp_msg->tx_head_buf, rsp_msg->tx_head_buf_len);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, rsp_default, "convert_msg_arpc2xio fail.");
 		SET_FLAG(xio_rsp_msg->usr_flags, XIO_MSG_FLAG_ALLOC_IOV_MEM);
 		goto rsp;
@@ -113,23 +107,18 @@ rsp:
 // 注意必须在同步回调线程里执行
 int arpc_send_response_complete(struct arpc_common_msg *rsp_msg)
 {
-	int ret;
 	struct arpc_rsp_handle *rsp_fd_ex;
 	struct xio_msg  	*xio_rsp_msg;
 	LOG_THEN_RETURN_VAL_IF_TRUE(!rsp_msg, ARPC_ERROR, "rsp_msg IS NULL");
 
-	ret = arpc_cond_lock(&rsp_msg->cond);
-	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_cond_lock fail.");
-
 	rsp_fd_ex = (struct arpc_rsp_handle*)rsp_msg->ex_data;
 	if (rsp_fd_ex->release_rsp_cb && rsp_fd_ex->rsp_usr_iov) {
 		rsp_fd_ex->release_rsp_cb(rsp_fd_ex->rsp_usr_iov, rsp_fd_ex->rsp_usr_ctx);
 	}
 	xio_rsp_msg = &rsp_msg->xio_msg;
-	if(IS_SET(xio_rsp_msg->usr_flags, XIO_MSG_FLAG_ALLOC_IOV_MEM) && xio_rsp_msg->out.pdata_iov.sglist){
+	if(IS_SET(xio_rsp_msg->usr_flags, XIO_MSG_FLAG_ALLOC_IOV_MEM)){
 		free_msg_arpc2xio(&xio_rsp_msg->out);
 	}
-	ret = arpc_cond_unlock(&rsp_msg->cond);
 	put_common_msg(rsp_msg);
 
 	return 0;
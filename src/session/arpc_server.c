@@ -33,16 +33,26 @@
 
 #define WAIT_THREAD_RUNING_TIMEOUT (1000)
 
+#define ARPC_SERVER_LOAD_SAMPLE_MS	1000		//工作线程负载采样周期
+#define ARPC_SERVER_STATUS_TICKS	15			//状态打印间隔，单位为采样周期
+#define ARPC_WORK_LOAD_CONN_COST	(64*1024)	//放置时每条连接折算的字节数
+#define ARPC_WORK_LOAD_MSG_COST		4096		//放置时每个在途消息折算的字节数
+#define ARPC_SERVER_REBALANCE_WAIT	5			//一次迁移后等待生效的采样周期数
+#define ARPC_WORK_REBALANCE_MIN_LOAD	(1024*1024)	//最忙work低于该负载时不迁移
+
 struct arpc_new_session_ctx{
 	void *new_session_usr_ctx;
 	struct arpc_server_handle *server;
 	void *server_usr_ctx;
+	uint32_t portal_num;			/* 给客户端的入口数 */
+	uint32_t *work_slot;			/* 按work序号索引的入口序号，ARPC_E_ACCEPT_PORTAL方式才有 */
 };
 
 static char *alloc_new_work_uri(struct arpc_server_work* work, const char *req_uri, uint16_t uri_len);
 
 static int server_session_event(struct xio_session *session, struct xio_session_event_data *event_data, void *session_context);
 static int server_on_new_session(struct xio_session *session,struct xio_new_session_req *req, void *server_context);
+static int work_on_new_session(struct xio_session *session,struct xio_new_session_req *req, void *work_context);
 
 static struct arpc_server_work *arpc_create_work();
 static int arpc_destroy_work(struct arpc_server_work* work);
@@ -51,6 +61,12 @@ static void destroy_work_handle(QUEUE* work_q);
 static void destroy_session_handle(QUEUE* session_q);
 static int xio_server_work_run(void * ctx);
 static void xio_server_work_stop(void * ctx);
+static void server_stat_collect(void *obj, struct arpc_stat_shm_data *data);
+static void server_work_load_sample(struct arpc_server_handle *server);
+static struct arpc_server_work *server_find_work(struct arpc_server_handle *server, struct xio_context *ctx);
+static char **server_place_session(struct arpc_server_handle *server, const char *req_uri,
+									uint32_t conn_base, uint32_t conn_num, uint32_t *work_slot, uint32_t *uri_num);
+static void server_work_rebalance(struct arpc_server_handle *server);
 
 static struct xio_session_ops x_server_ops = {
 	.on_session_event			=  &server_session_event,
@@ -63,6 +79,18 @@ static struct xio_session_ops x_server_ops = {
 	.on_msg_error				=  &message_error
 };
 
+// 工作线程的xio server上下文是work，握手请求转交所属server处理
+static struct xio_session_ops x_work_ops = {
+	.on_session_event			=  &server_session_event,
+	.on_new_session				=  &work_on_new_session,
+	.rev_msg_data_alloc_buf		=  &msg_head_process,
+	.on_msg						=  &msg_data_process,
+	.on_msg_delivered			=  &msg_delivered,
+	.on_msg_send_complete		=  &response_send_complete,
+	.on_ow_msg_send_complete	=  &oneway_send_complete,
+	.on_msg_error				=  &message_error
+};
+
 #define SERVER_STATUS_SHOW "\n ### server:%p    work-num:%u    online-session:%u    ### \n"
 
 static int arpc_server_deamon(void *thread_ctx)
@@ -73,16 +101,23 @@ static int arpc_server_deamon(void *thread_ctx)
 	int ret;
 	char thread_name[16+1] ={0};
 	struct arpc_session_handle *session;
+	uint32_t tick = 0;
 	prctl(PR_SET_NAME, "server_deamon");
 
 	ret = arpc_cond_lock(&server->cond);
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "arpc_cond_lock server[%p] fail", server);
 
 	while(!server->is_stop){
-		arpc_cond_wait_timeout(&server->cond, 15*1000);
+		arpc_cond_wait_timeout(&server->cond, ARPC_SERVER_LOAD_SAMPLE_MS);
 		if (server->is_stop) {
 			break;
 		}
+		server_work_load_sample(server);
+		server_work_rebalance(server);
+		if (++tick < ARPC_SERVER_STATUS_TICKS) {
+			continue;
+		}
+		tick = 0;
 		arpc_update_log_status();
 		ret = arpc_mutex_lock(&server->lock);
 		if(ret) {
@@ -115,6 +150,8 @@ arpc_server_t arpc_server_create(const struct arpc_server_param *param)
 	uint32_t work_num = 0;
 	struct tp_param pool_param;
 	struct tp_thread_work thread;
+	void *thread_pool;
+	void *loop_pool;
 	/* handle*/
 	server = arpc_create_server(0);
 	LOG_THEN_RETURN_VAL_IF_TRUE(!server, NULL, "arpc_create_server fail");
@@ -144,15 +181,29 @@ arpc_server_t arpc_server_create(const struct arpc_server_param *param)
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, error_1, "arpc_create_server fail");
 
 	work_num = (param->work_num > 2)? param->work_num:2; // 默认只有1个主线程,2个工作线程
-
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((param->accept_mode >= ARPC_E_ACCEPT_MAX), error_1, "accept_mode[%u] invalid.", param->accept_mode);
+	server->accept_mode = param->accept_mode;
+	server->steer_num = (server->accept_mode == ARPC_E_ACCEPT_REUSEPORT_CPU) ? work_num : 0;
+	server->placement = param->placement;
+	server->rebalance_pct = param->rebalance_pct;
+
+	// loop线程各自绑核，不走工作线程的绑核回调
+	memset(&pool_param, 0, sizeof(struct tp_param));
 	pool_param.cpu_max_num = 16;
-	pool_param.thread_max_num = work_num*3 + 2 + 1;//							
+	pool_param.name = ARPC_LOOP_THREAD_NAME;
+	pool_param.thread_max_num = work_num + ARPC_LOOP_THREAD_EXTRA_NUM;
+	server->loop_pool = tp_create_thread_pool(&pool_param);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!server->loop_pool, error_1, "tp_create_thread_pool loop null.");
+
+	arpc_work_pool_param(&pool_param);
 	server->threadpool = tp_create_thread_pool(&pool_param);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!server->threadpool, error_1, "tp_create_thread_pool null.");
 
 	for (i = 0; i < work_num; i++) {
-		con_param.ipv4.port++; // 端口递增
-		work_handle = arpc_create_xio_server_work(&con_param, server, &x_server_ops, i);
+		if (server->accept_mode == ARPC_E_ACCEPT_PORTAL) {
+			con_param.ipv4.port++; // 端口递增
+		}
+		work_handle = arpc_create_xio_server_work(&con_param, server, &x_work_ops, i);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!work_handle, error_1, "arpc_create_xio_server_work fail.");
 		ret = server_insert_work(server, work_handle);
 		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, error_2, "insert_queue fail.");
@@ -162,19 +213,24 @@ arpc_server_t arpc_server_create(const struct arpc_server_param *param)
 	server->server_ctx = xio_context_create(NULL, 0, 0);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!server->server_ctx, error_2, "xio_context_create fail");
 
-	server->server = xio_bind(server->server_ctx, &x_server_ops, server->uri, NULL, 0, server);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!server->server_ctx, error_3, "xio_context_create fail");
+	// SO_REUSEPORT方式由工作线程直接握手，主线程只保留空的loop供arpc_server_loop阻塞
+	if (server->accept_mode == ARPC_E_ACCEPT_PORTAL) {
+		server->server = xio_bind(server->server_ctx, &x_server_ops, server->uri, NULL, 0, server);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!server->server_ctx, error_3, "xio_context_create fail");
+	}
 
 	server->usr_context = param->default_ops_usr_ctx;
 
 	ARPC_LOG_NOTICE("ARPC version[%s].", arpc_version());
-	ARPC_LOG_NOTICE("Create main server[%p] success, work server num[%u].", server, server->work_num);
+	ARPC_LOG_NOTICE("Create main server[%p] success, work server num[%u], accept mode[%u].", 
+					server, server->work_num, server->accept_mode);
 
 	thread.loop = &arpc_server_deamon;
 	thread.stop = NULL;
 	thread.usr_ctx = (void*)server;
 
-	tp_post_one_work(server->threadpool, &thread, WORK_DONE_AUTO_FREE);
+	tp_post_one_work(server->loop_pool, &thread, WORK_DONE_AUTO_FREE);
+	server->stat_slot = arpc_stat_shm_register(ARPC_STAT_SHM_SERVER, server->uri, &server_stat_collect, server);
 
 	return (arpc_server_t)server;
 
@@ -187,8 +243,15 @@ error_2:
 		arpc_destroy_xio_server_work(work_handle);
 	work_handle = NULL;
 error_1:
-	if (server)
+	if (server) {
+		thread_pool = server->threadpool;
+		loop_pool = server->loop_pool;
 		arpc_destroy_server(server);
+		if (loop_pool)
+			tp_destroy_thread_pool(&loop_pool);
+		if (thread_pool)
+			tp_destroy_thread_pool(&thread_pool);
+	}
 	ARPC_LOG_NOTICE( "some error, destroy server, exit.");
 	return NULL;
 }
@@ -197,6 +260,7 @@ int arpc_server_destroy(arpc_server_t *fd)
 {
 	struct arpc_server_handle *server = NULL;
 	void *thread_pool;
+	void *loop_pool;
 	LOG_THEN_RETURN_VAL_IF_TRUE(!fd, -1, "arpc_create_server fail");
 	server = (struct arpc_server_handle *)(*fd);
 	server->is_stop = 1;
@@ -207,9 +271,11 @@ int arpc_server_destroy(arpc_server_t *fd)
 		xio_unbind(server->server);
 	server->server = NULL;
 	thread_pool = server->threadpool;
+	loop_pool = server->loop_pool;
 	if (server)
 		arpc_destroy_server(server);
 	ARPC_LOG_NOTICE( "destroy server success, exit.");
+	tp_destroy_thread_pool(&loop_pool);		// 先停loop，不再产生新的异步任务
 	tp_destroy_thread_pool(&thread_pool);
 	*fd = NULL;
 	return ARPC_SUCCESS;
@@ -255,6 +321,7 @@ static int server_session_event(struct xio_session *session, struct xio_session_
 	struct arpc_server_work *work;
 	struct arpc_new_session_ctx *session_ctx;
 	struct arpc_connection_param param;
+	uint32_t reserved;
 	SESSION_CTX(session_fd, session_context);
 
 	ARPC_LOG_TRACE("##### session event:%d ,%s. reason: %s.",event_data->event,
@@ -276,8 +343,14 @@ static int server_session_event(struct xio_session *session, struct xio_session_
 			param.type = ARPC_CON_TYPE_SERVER;
 			param.xio_con = event_data->conn;
 			param.timeout_ms = XIO_INFINITE;
+			param.cpu = work->cpu;
+			param.numa_node = work->numa_node;
 			con = arpc_create_connection(&param);
 			LOG_THEN_RETURN_VAL_IF_TRUE(!con, -1, "arpc_create_connection fail.");
+			__atomic_add_fetch(&work->conn_num, 1, __ATOMIC_RELAXED);
+			reserved = __atomic_load_n(&work->conn_reserved, __ATOMIC_RELAXED);
+			while (reserved && !__atomic_compare_exchange_n(&work->conn_reserved, &reserved, reserved - 1,
+															0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
 			memset(&attr, 0, sizeof(struct xio_connection_attr));
 			attr.user_context = con;
@@ -299,7 +372,14 @@ static int server_session_event(struct xio_session *session, struct xio_session_
 				ARPC_LOG_NOTICE("##### connection[%u][%p] teardown.", con->id, con);
 				ret = session_remove_con(session_fd, con);
 				LOG_ERROR_IF_VAL_TRUE(ret, "session_remove_con fail.");
+				work = server_find_work(session_ctx->server, arpc_get_conn_xio_ctx(con));
+				if (work) {
+					__atomic_sub_fetch(&work->conn_num, 1, __ATOMIC_RELAXED);
+					__atomic_add_fetch(&work->bytes_retired, __atomic_load_n(&con->stats.tx_bytes, __ATOMIC_RELAXED)
+										+ __atomic_load_n(&con->stats.rx_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+				}
 				arpc_set_disconnect_status(con);
+				session_conn_synchronize(session_fd);	// 断链状态已唤醒等待发送的线程
 				arpc_destroy_connection(con);
 			}else{
 				ARPC_LOG_TRACE("connection[%p] is main thread, need tear down.", event_data->conn);
@@ -316,6 +396,7 @@ static int server_session_event(struct xio_session *session, struct xio_session_
 															session_fd->usr_context);
 				LOG_ERROR_IF_VAL_TRUE(ret, "user session_teardown fail.");
 			}
+			SAFE_FREE_MEM(session_ctx->work_slot);
 			ret = arpc_destroy_session(session_fd, 0);
 			LOG_ERROR_IF_VAL_TRUE(ret, "arpc_destroy_session fail.");
 			xio_session_destroy(session);
@@ -343,10 +424,13 @@ static int server_on_new_session(struct xio_session *session,struct xio_new_sess
 	uint64_t req_len = 0;
 	arpc_proto_t tlv_type = 0;
 	struct arpc_proto_new_session new_req = {0};
+	struct arpc_proto_new_session_ext new_ext = {0};
+	struct arpc_proto_new_session_rsp new_rsp = {0};
+	int32_t index;
+	uint8_t *accept_data = NULL;
+	uint32_t accept_len = 0;
 	uint32_t i;
-	QUEUE* work_q;
 	uint32_t work_num = 0;
-	struct arpc_server_work *work_handle;
 	char req_uri[256] = {0};
 	struct arpc_server_handle *server_fd = (struct arpc_server_handle *)server_context;
 
@@ -373,11 +457,18 @@ static int server_on_new_session(struct xio_session *session,struct xio_new_sess
 	arpc_get_ipv4_addr(&req->src_addr, ipv4->ipv4.ip, IPV4_MAX_LEN, &ipv4->ipv4.port);
 
 	if (req->private_data) {
-		arpc_read_tlv(&tlv_type, &req_len, &req_addr, req->private_data);
+		index = arpc_read_tlv(&tlv_type, &req_len, &req_addr, req->private_data);
 		assert(tlv_type == ARPC_PROTO_NEW_SESSION);
 		assert(req_len == sizeof(struct arpc_proto_new_session));
 		unpack_new_session(req_addr, sizeof(struct arpc_proto_new_session), &new_req);
 		ARPC_LOG_NOTICE("max_iov_len[%u], data max:%lu.", new_req.max_iov_len, new_req.max_data_len);
+		// 旧版本客户端不带扩展TLV，扩展字段保持0
+		if (index > 0 && index + sizeof(struct arpc_tlv) <= req->private_data_len) {
+			arpc_read_tlv(&tlv_type, &req_len, &req_addr, (uint8_t *)req->private_data + index);
+			if (tlv_type == ARPC_PROTO_NEW_SESSION_EXT && index + sizeof(struct arpc_tlv) + req_len <= req->private_data_len) {
+				unpack_new_session_ext(req_addr, req_len, &new_ext);
+			}
+		}
 	}
 
 	client.client_data.data = NULL;//todo
@@ -408,6 +499,21 @@ static int server_on_new_session(struct xio_session *session,struct xio_new_sess
 	new_session->msg_data_max_len = (new_req.max_data_len)?new_req.max_data_len:server_fd->msg_data_max_len;
 	new_session->msg_head_max_len = (new_req.max_head_len)?new_req.max_head_len:server_fd->msg_head_max_len;
 	new_session->msg_iov_max_len = (new_req.max_iov_len)?new_req.max_iov_len:server_fd->msg_iov_max_len;
+	new_session->csum_type = arpc_csum_select(new_ext.csum_mask);
+	new_session->zip_type = arpc_zip_select(new_ext.zip_mask);
+
+	// 协商结果放在accept私有数据头部，用户回复数据紧随其后
+	new_rsp.csum_type = new_session->csum_type;
+	new_rsp.zip_type = new_session->zip_type;
+	accept_len = sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session_rsp);
+	accept_len += (param.rsp_data) ? param.rsp_data_len : 0;
+	accept_data = arpc_mem_alloc(accept_len, NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!accept_data, reject, "arpc_mem_alloc fail.");
+	arpc_write_tlv(ARPC_PROTO_NEW_SESSION_RSP, sizeof(struct arpc_proto_new_session_rsp), accept_data);
+	pack_new_session_rsp(&new_rsp, accept_data + sizeof(struct arpc_tlv), sizeof(struct arpc_proto_new_session_rsp));
+	if (param.rsp_data) {
+		memcpy(accept_data + sizeof(struct arpc_tlv) + sizeof(struct arpc_proto_new_session_rsp), param.rsp_data, param.rsp_data_len);
+	}
 	attr.ses_ops = NULL;
 	attr.uri = NULL;
 	attr.user_context = (void*)new_session;
@@ -415,33 +521,28 @@ static int server_on_new_session(struct xio_session *session,struct xio_new_sess
 	ret = xio_modify_session(session, &attr, XIO_SESSION_ATTR_USER_CTX);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((ret != ARPC_SUCCESS), reject, "xio_modify_session fail.");
 	new_session->status = ARPC_SES_STA_ACTIVE;
-	if(server_fd->work_num) {
-		uri_vec = arpc_mem_alloc(server_fd->work_num * sizeof(char *), NULL);
-		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!uri_vec, reject, "arpc_mem_alloc fail.");
-		work_num = 0;
-		QUEUE_FOREACH_VAL(&server_fd->q_work, work_q, 
-		{
-			if (work_num < server_fd->work_num) { 
-				work_handle = QUEUE_DATA(work_q, struct arpc_server_work, q);
-				uri_vec[work_num] = alloc_new_work_uri(work_handle, req_uri, strlen(req_uri));
-				if (uri_vec[work_num]) {
-				   ARPC_LOG_NOTICE("work uri:%s.", uri_vec[work_num]);
-				   work_num++;
-				}
-				continue;
-			}
-			break;
-		});
-		xio_accept(session, (const char **)uri_vec, work_num, param.rsp_data, param.rsp_data_len); 
+	if(server_fd->work_num && server_fd->accept_mode == ARPC_E_ACCEPT_PORTAL) {
+		new_session_ctx->work_slot = arpc_mem_alloc(server_fd->work_num * sizeof(uint32_t), NULL);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!new_session_ctx->work_slot, reject, "arpc_mem_alloc fail.");
+		// 旧版本客户端不带连接信息，按其固定的连接编号估算
+		uri_vec = server_place_session(server_fd, req_uri,
+									(new_ext.conn_num) ? new_ext.conn_base : ARPC_CONN_XIO_IDX(ARPC_CONN_ID_OFFSET),
+									(new_ext.conn_num) ? new_ext.conn_num : 2, new_session_ctx->work_slot, &work_num);
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!uri_vec, reject, "server_place_session fail.");
+		new_session_ctx->portal_num = work_num;
+		xio_accept(session, (const char **)uri_vec, work_num, accept_data, accept_len); 
 		for (i = 0; i < work_num; i++) {
 			arpc_mem_free(uri_vec[i], NULL);
 		}
 		arpc_mem_free(uri_vec, NULL);
 		uri_vec = NULL;
 	}else{
-		xio_accept(session, NULL, 0, param.rsp_data, param.rsp_data_len); 
+		// 握手连接即成为数据连接，其余连接仍连同一端口，由内核在工作线程间分配
+		xio_accept(session, NULL, 0, accept_data, accept_len); 
 	}
+	SAFE_FREE_MEM(accept_data);
 	new_session->threadpool = server_fd->threadpool;
+	new_session->loop_pool = server_fd->loop_pool;
 	ret = server_insert_session(server_fd, new_session);
 	LOG_ERROR_IF_VAL_TRUE(ret, "server_insert_session fail.");
 	server_fd->new_session_end((arpc_session_handle_t)new_session, &param, server_fd->usr_context);
@@ -449,6 +550,9 @@ static int server_on_new_session(struct xio_session *session,struct xio_new_sess
 	ARPC_LOG_NOTICE("create new session[%p] success, client[%s:%u].", new_session, ipv4->ipv4.ip, ipv4->ipv4.port);
 	return 0;
 reject:
+	SAFE_FREE_MEM(accept_data);
+	if (new_session_ctx)
+		SAFE_FREE_MEM(new_session_ctx->work_slot);
 	if(new_session)
 		arpc_destroy_session(new_session, 0);
 	new_session = NULL;
@@ -457,6 +561,14 @@ reject:
 	return -1;
 }
 
+static int work_on_new_session(struct xio_session *session,struct xio_new_session_req *req, void *work_context)
+{
+	struct arpc_server_work *work = (struct arpc_server_work *)work_context;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!work || work->magic != ARPC_WROK_MAGIC || !work->server), -1, "invalid work context.");
+	return server_on_new_session(session, req, work->server);
+}
+
 // server
 struct arpc_server_handle *arpc_create_server(uint32_t ex_ctx_size)
 {
@@ -480,6 +592,8 @@ struct arpc_server_handle *arpc_create_server(uint32_t ex_ctx_size)
 	QUEUE_INIT(&svr->q_work);
 	svr->iov_max_len = IOV_DEFAULT_MAX_LEN;
 	svr->threadpool = NULL;
+	svr->loop_pool = NULL;
+	svr->stat_slot = -1;
 	return svr;
 free_mutex:
 	arpc_mutex_destroy(&svr->lock);
@@ -494,6 +608,8 @@ int arpc_destroy_server(struct arpc_server_handle* svr)
 	QUEUE* q;
 
 	LOG_THEN_RETURN_VAL_IF_TRUE(!svr, -1, "svr null.");
+	arpc_stat_shm_unregister(svr->stat_slot);
+	svr->stat_slot = -1;
 
 	ret = arpc_mutex_lock(&svr->lock); /* 锁 */
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "arpc_mutex_lock fail.");
@@ -537,12 +653,18 @@ struct arpc_server_work *arpc_create_xio_server_work(const struct arpc_con_info
 	work = arpc_create_work();
 	LOG_THEN_RETURN_VAL_IF_TRUE(!work, NULL, "arpc_create_work fail.");
 	work->affinity = index + 1;
+	work->index = index;
+	work->server = server;
+	(void)arpc_placement_pick(&work->cpu, &work->numa_node);
 
 	(void)memset(&ctx_params, 0, sizeof(struct xio_context_params));
 	ctx_params.max_inline_xio_data = server->msg_data_max_len;
 	ctx_params.max_inline_xio_hdr = server->msg_head_max_len;
+	ctx_params.reuse_port = (server->accept_mode != ARPC_E_ACCEPT_PORTAL);
+	ctx_params.reuse_port_steer_num = server->steer_num;
+	ctx_params.loop_tick = &arpc_loop_tick;
 
-	work->work_ctx = xio_context_create(&ctx_params, 0, work->affinity);
+	work->work_ctx = xio_context_create(&ctx_params, 0, (work->cpu >= 0)? work->cpu : work->affinity);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!work->work_ctx, free_work, "xio_context_create fail.");
 
 	ret = get_uri(con_param, work->uri, URI_MAX_LEN);
@@ -551,13 +673,14 @@ struct arpc_server_work *arpc_create_xio_server_work(const struct arpc_con_info
 	ARPC_LOG_NOTICE("set uri[%s] on work[%u].", work->uri, index);
 
 	work->work = xio_bind(work->work_ctx, work_ops, work->uri, NULL, 0, work);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!work->work, free_xio_work, "xio_bind uri[%s] fail.", work->uri);
 
 	ret = arpc_cond_lock(&work->cond);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_xio_work, "arpc_cond_lock fail.");
 	thread.loop = &xio_server_work_run;
 	thread.stop = &xio_server_work_stop;
 	thread.usr_ctx = (void*)work;
-	work->thread_handle = tp_post_one_work(server->threadpool, &thread, WORK_DONE_AUTO_FREE);
+	work->thread_handle = tp_post_one_work(server->loop_pool, &thread, WORK_DONE_AUTO_FREE);
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!work->thread_handle, free_cond, "tp_post_one_work fail.");
 
 	ret = arpc_cond_wait_timeout(&work->cond, WAIT_THREAD_RUNING_TIMEOUT);
@@ -643,10 +766,395 @@ int server_remove_session(struct arpc_server_handle *server, struct arpc_session
 	QUEUE_REMOVE(&session->q);
 	QUEUE_INIT(&session->q);
 	server->session_num--;
+	if (!arpc_cond_lock(&session->cond)) {
+		session_stat_merge(session, &server->stats_retired);
+		arpc_cond_unlock(&session->cond);
+	}
 	arpc_mutex_unlock(&server->lock);
 	return 0;
 }
 
+static int server_stat_merge(struct arpc_server_handle *server, struct arpc_stat_shm_data *data)
+{
+	struct arpc_session_handle *session;
+	QUEUE* iter;
+	uint32_t index = 0;
+	int ret;
+
+	ret = arpc_mutex_lock(&server->lock);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_mutex_lock server[%p] fail.", server);
+	arpc_stat_merge(&data->set, &server->stats_retired);
+	QUEUE_FOREACH_VAL(&server->q_session, iter,
+	{
+		session = QUEUE_DATA(iter, struct arpc_session_handle, q);
+		if (arpc_cond_lock(&session->cond)) {
+			continue;
+		}
+		session_stat_fill(session, index++, data);
+		arpc_cond_unlock(&session->cond);
+	});
+	arpc_mutex_unlock(&server->lock);
+	return ARPC_SUCCESS;
+}
+
+static void server_stat_collect(void *obj, struct arpc_stat_shm_data *data)
+{
+	struct arpc_server_handle *server = (struct arpc_server_handle *)obj;
+
+	server_stat_merge(server, data);
+	data->tp_thread = tp_get_pool_thread_num(server->threadpool);
+	data->tp_idle = tp_get_pool_idle_num(server->threadpool);
+	data->tp_wait = tp_get_pool_wait_num(server->threadpool);
+}
+
+static struct arpc_server_work *server_find_work(struct arpc_server_handle *server, struct xio_context *ctx)
+{
+	QUEUE* iter;
+	struct arpc_server_work *work;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE(!ctx, NULL, "xio context null.");
+	QUEUE_FOREACH_VAL(&server->q_work, iter,
+	{
+		work = QUEUE_DATA(iter, struct arpc_server_work, q);
+		if (work->work_ctx == ctx) {
+			return work;
+		}
+	});
+	return NULL;
+}
+
+// 守护线程周期调用：汇总各work上连接的在途消息数和累计收发字节，算出本周期的字节速率；
+// 连接预留只需撑到连接建立，每周期清零
+static void server_work_load_sample(struct arpc_server_handle *server)
+{
+	struct arpc_session_handle *session;
+	struct arpc_server_work *work;
+	struct arpc_connection *con;
+	struct arpc_stat_shm_conn entry;
+	QUEUE *iter, *con_iter;
+	uint64_t now = fast_clock_ns();
+	uint64_t elapsed_ms = (now - server->load_sample_ns) / 1000000;
+	uint64_t rate;
+	uint64_t bytes;
+	uint64_t rsp;
+
+	if (arpc_mutex_lock(&server->lock)) {
+		return;
+	}
+	QUEUE_FOREACH_VAL(&server->q_work, iter,
+	{
+		work = QUEUE_DATA(iter, struct arpc_server_work, q);
+		work->sample_bytes = __atomic_load_n(&work->bytes_retired, __ATOMIC_RELAXED);
+		work->sample_inflight = 0;
+	});
+	QUEUE_FOREACH_VAL(&server->q_session, iter,
+	{
+		session = QUEUE_DATA(iter, struct arpc_session_handle, q);
+		if (arpc_cond_lock(&session->cond)) {
+			continue;
+		}
+		QUEUE_FOREACH_VAL(&session->q_con, con_iter,
+		{
+			con = QUEUE_DATA(con_iter, struct arpc_connection, q);
+			work = server_find_work(server, arpc_get_conn_xio_ctx(con));
+			if (!work) {
+				continue;
+			}
+			arpc_connection_stat_fill(con, 0, &entry);
+			bytes = entry.tx_bytes + entry.rx_bytes;
+			work->sample_bytes += bytes;
+			work->sample_inflight += entry.inflight;
+			// 连接的负载口径与work一致，供迁移时挑选；首次采样没有基准，只计在途消息
+			con->load_score = (uint64_t)entry.inflight * ARPC_WORK_LOAD_MSG_COST;
+			if (con->load_bytes && elapsed_ms && bytes > con->load_bytes) {
+				con->load_score += (bytes - con->load_bytes) * 1000 / elapsed_ms;
+			}
+			con->load_bytes = bytes;
+			rsp = __atomic_load_n(&con->stats.tx_rsp, __ATOMIC_RELAXED);
+			con->rsp_active = (rsp != con->load_rsp);
+			con->load_rsp = rsp;
+		});
+		arpc_cond_unlock(&session->cond);
+	});
+	arpc_mutex_unlock(&server->lock);
+
+	QUEUE_FOREACH_VAL(&server->q_work, iter,
+	{
+		work = QUEUE_DATA(iter, struct arpc_server_work, q);
+		// 连接移出session到计入bytes_retired之间采样会少算一段，少算时速率按0，基准不回退
+		rate = 0;
+		if (server->load_sample_ns && elapsed_ms && work->sample_bytes > work->bytes_last) {
+			rate = (work->sample_bytes - work->bytes_last) * 1000 / elapsed_ms;
+		}
+		if (work->sample_bytes > work->bytes_last) {
+			work->bytes_last = work->sample_bytes;
+		}
+		__atomic_store_n(&work->bytes_rate, rate, __ATOMIC_RELAXED);
+		__atomic_store_n(&work->inflight, work->sample_inflight, __ATOMIC_RELAXED);
+		__atomic_store_n(&work->conn_reserved, 0, __ATOMIC_RELAXED);
+	});
+	server->load_sample_ns = now;
+}
+
+static uint64_t work_load_score(const struct arpc_work_load *load)
+{
+	return (uint64_t)load->conn_num * ARPC_WORK_LOAD_CONN_COST + load->inflight * ARPC_WORK_LOAD_MSG_COST + load->bytes_rate;
+}
+
+// 迁移只看实际流量，空闲连接不占用loop
+static uint64_t work_traffic_load(const struct arpc_server_work *work)
+{
+	return __atomic_load_n(&work->inflight, __ATOMIC_RELAXED) * ARPC_WORK_LOAD_MSG_COST
+			+ __atomic_load_n(&work->bytes_rate, __ATOMIC_RELAXED);
+}
+
+/*!
+ * @brief  守护线程在负载采样后调用，最忙work的负载超出均值rebalance_pct时，提示其上的一条连接迁往最闲的work
+ *
+ * 迁出的连接负载须小于两者之差，取最接近差值一半的一条，迁移后两者都低于原最忙值；
+ * 每次只迁一条，等待ARPC_SERVER_REBALANCE_WAIT个采样周期生效后再判断
+ *
+ * @param[in] server
+ */
+static void server_work_rebalance(struct arpc_server_handle *server)
+{
+	struct arpc_server_work *work;
+	struct arpc_server_work *hot = NULL;
+	struct arpc_server_work *cold = NULL;
+	struct arpc_session_handle *session;
+	struct arpc_session_handle *best_session = NULL;
+	struct arpc_new_session_ctx *session_ctx;
+	struct arpc_connection *con;
+	struct arpc_connection *best = NULL;
+	QUEUE *iter, *con_iter;
+	uint64_t load, gap, dist;
+	uint64_t hot_load = 0;
+	uint64_t cold_load = 0;
+	uint64_t total = 0;
+	uint64_t best_dist = UINT64_MAX;
+	uint32_t num = 0;
+
+	if (!server->rebalance_pct || server->accept_mode != ARPC_E_ACCEPT_PORTAL) {
+		return;
+	}
+	if (server->rebalance_wait) {
+		server->rebalance_wait--;
+		return;
+	}
+	QUEUE_FOREACH_VAL(&server->q_work, iter,
+	{
+		work = QUEUE_DATA(iter, struct arpc_server_work, q);
+		load = work_traffic_load(work);
+		total += load;
+		num++;
+		if (!hot || load > hot_load) {
+			hot = work;
+			hot_load = load;
+		}
+		if (!cold || load < cold_load) {
+			cold = work;
+			cold_load = load;
+		}
+	});
+	if (num < 2 || hot == cold || hot_load < ARPC_WORK_REBALANCE_MIN_LOAD ||
+		hot_load * 100 * num <= total * (100 + server->rebalance_pct)) {
+		return;
+	}
+	gap = hot_load - cold_load;
+
+	if (arpc_mutex_lock(&server->lock)) {
+		return;
+	}
+	QUEUE_FOREACH_VAL(&server->q_session, iter,
+	{
+		session = QUEUE_DATA(iter, struct arpc_session_handle, q);
+		session_ctx = (struct arpc_new_session_ctx *)session->ex_ctx;
+		if (!session_ctx->work_slot || cold->index >= server->work_num || arpc_cond_lock(&session->cond)) {
+			continue;
+		}
+		QUEUE_FOREACH_VAL(&session->q_con, con_iter,
+		{
+			con = QUEUE_DATA(con_iter, struct arpc_connection, q);
+			if (con->redirected || !con->rsp_active || !con->load_score || con->load_score >= gap ||
+				server_find_work(server, arpc_get_conn_xio_ctx(con)) != hot) {
+				continue;
+			}
+			dist = (2 * con->load_score > gap) ? 2 * con->load_score - gap : gap - 2 * con->load_score;
+			if (dist < best_dist) {
+				best_dist = dist;
+				best = con;
+				best_session = session;
+			}
+		});
+		arpc_cond_unlock(&session->cond);
+	});
+	// 挑选后连接可能已断开，在所属session锁内确认仍在再提示
+	if (best_session && !arpc_cond_lock(&best_session->cond)) {
+		session_ctx = (struct arpc_new_session_ctx *)best_session->ex_ctx;
+		QUEUE_FOREACH_VAL(&best_session->q_con, con_iter,
+		{
+			con = QUEUE_DATA(con_iter, struct arpc_connection, q);
+			if (con != best) {
+				continue;
+			}
+			con->redirected = 1;
+			arpc_connection_set_redirect(con, session_ctx->work_slot[cold->index], session_ctx->portal_num);
+			server->rebalance_wait = ARPC_SERVER_REBALANCE_WAIT;
+			ARPC_LOG_NOTICE("rebalance conn[%p] load[%lu] from work[%u] load[%lu] to work[%u] load[%lu], portal[%u].",
+							con, con->load_score, hot->index, hot_load, cold->index, cold_load,
+							session_ctx->work_slot[cold->index]);
+			break;
+		});
+		arpc_cond_unlock(&best_session->cond);
+	}
+	arpc_mutex_unlock(&server->lock);
+}
+
+// 默认策略：连接与在途消息折算成字节后与字节速率相加，越小越优先，相同时按序号
+static void server_default_placement(const struct arpc_work_load *works, uint32_t work_num, uint32_t *order)
+{
+	uint32_t i, j, tmp;
+
+	for (i = 0; i < work_num; i++) {
+		order[i] = i;
+	}
+	for (i = 1; i < work_num; i++) {
+		tmp = order[i];
+		for (j = i; j > 0 && work_load_score(&works[order[j - 1]]) > work_load_score(&works[tmp]); j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = tmp;
+	}
+}
+
+// 用户策略的输出须是0..num-1的一个排列
+static int server_check_order(const uint32_t *order, uint32_t num, uint8_t *seen)
+{
+	uint32_t i;
+
+	memset(seen, 0, num);
+	for (i = 0; i < num; i++) {
+		if (order[i] >= num || seen[order[i]]) {
+			return ARPC_ERROR;
+		}
+		seen[order[i]] = 1;
+	}
+	return ARPC_SUCCESS;
+}
+
+/*!
+ * @brief  为新session生成按负载排好的工作线程入口
+ *
+ * 客户端conn_idx为k的连接连向入口k % num，故第i条连接(conn_base + i)对应的入口放第i优先的work，
+ * 并给这些work预留连接数，避免同时到来的session都挑中同一个空闲work
+ *
+ * @param[in] server
+ * @param[in] req_uri 客户端请求的uri，取其中的协议和地址
+ * @param[in] conn_base 客户端第一条连接的conn_idx
+ * @param[in] conn_num 客户端连接数
+ * @param[out] work_slot 各work对应的入口序号，按work序号索引，至少work_num个
+ * @param[out] uri_num 入口个数
+ * @return  入口数组，由调用者逐个释放；NULL失败
+ */
+static char **server_place_session(struct arpc_server_handle *server, const char *req_uri,
+									uint32_t conn_base, uint32_t conn_num, uint32_t *work_slot, uint32_t *uri_num)
+{
+	struct arpc_server_work **works = NULL;
+	struct arpc_work_load *load = NULL;
+	uint32_t *order = NULL;
+	uint8_t *seen = NULL;
+	char **uri_vec = NULL;
+	QUEUE* iter;
+	uint32_t num = 0;
+	uint32_t i, slot;
+	int ret;
+
+	works = arpc_mem_alloc(server->work_num * sizeof(struct arpc_server_work *), NULL);
+	load = arpc_mem_alloc(server->work_num * sizeof(struct arpc_work_load), NULL);
+	order = arpc_mem_alloc(server->work_num * sizeof(uint32_t), NULL);
+	seen = arpc_mem_alloc(server->work_num, NULL);
+	uri_vec = arpc_mem_alloc(server->work_num * sizeof(char *), NULL);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE((!works || !load || !order || !seen || !uri_vec), error, "arpc_mem_alloc fail.");
+	memset(uri_vec, 0, server->work_num * sizeof(char *));
+
+	QUEUE_FOREACH_VAL(&server->q_work, iter,
+	{
+		if (num >= server->work_num) {
+			break;
+		}
+		works[num] = QUEUE_DATA(iter, struct arpc_server_work, q);
+		load[num].index = works[num]->index;
+		load[num].cpu = works[num]->cpu;
+		load[num].numa_node = works[num]->numa_node;
+		load[num].conn_num = __atomic_load_n(&works[num]->conn_num, __ATOMIC_RELAXED)
+							+ __atomic_load_n(&works[num]->conn_reserved, __ATOMIC_RELAXED);
+		load[num].inflight = __atomic_load_n(&works[num]->inflight, __ATOMIC_RELAXED);
+		load[num].bytes_rate = __atomic_load_n(&works[num]->bytes_rate, __ATOMIC_RELAXED);
+		num++;
+	});
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!num, error, "no work.");
+
+	ret = ARPC_ERROR;
+	if (server->placement) {
+		ret = server->placement(load, num, conn_num, order, server->usr_context);
+		ret = (ret) ? ret : server_check_order(order, num, seen);
+		LOG_ERROR_IF_VAL_TRUE(ret, "user placement fail, use default.");
+	}
+	if (ret) {
+		server_default_placement(load, num, order);
+	}
+
+	for (i = 0; i < num; i++) {
+		slot = (conn_base + i) % num;
+		uri_vec[slot] = alloc_new_work_uri(works[order[i]], req_uri, strlen(req_uri));
+		LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!uri_vec[slot], error, "alloc_new_work_uri fail.");
+		if (works[order[i]]->index < server->work_num) {
+			work_slot[works[order[i]]->index] = slot;
+		}
+		ARPC_LOG_NOTICE("work uri:%s, conn_idx[%u], load conn[%u] inflight[%lu] rate[%lu].", uri_vec[slot],
+						conn_base + i, load[order[i]].conn_num, load[order[i]].inflight, load[order[i]].bytes_rate);
+	}
+	for (i = 0; i < conn_num; i++) {
+		__atomic_add_fetch(&works[order[i % num]]->conn_reserved, 1, __ATOMIC_RELAXED);
+	}
+	arpc_mem_free(works, NULL);
+	arpc_mem_free(load, NULL);
+	arpc_mem_free(order, NULL);
+	arpc_mem_free(seen, NULL);
+	*uri_num = num;
+	return uri_vec;
+
+error:
+	for (i = 0; uri_vec && i < num; i++) {
+		SAFE_FREE_MEM(uri_vec[i]);
+	}
+	SAFE_FREE_MEM(uri_vec);
+	SAFE_FREE_MEM(seen);
+	SAFE_FREE_MEM(order);
+	SAFE_FREE_MEM(load);
+	SAFE_FREE_MEM(works);
+	return NULL;
+}
+
+int arpc_get_server_stats(const arpc_server_t fd, struct arpc_stats *stats)
+{
+	struct arpc_server_handle *server = (struct arpc_server_handle *)fd;
+	struct arpc_stat_shm_data *data;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!server || !stats), ARPC_ERROR, "server or stats null.");
+	data = (struct arpc_stat_shm_data *)arpc_mem_alloc(sizeof(struct arpc_stat_shm_data), NULL);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!data, ARPC_ERROR, "arpc_mem_alloc stat data fail.");
+	memset(data, 0, sizeof(struct arpc_stat_shm_data));
+
+	ret = server_stat_merge(server, data);
+	if (!ret) {
+		arpc_stat_export(&data->set, data->conn_num, stats);
+	}
+	arpc_mem_free(data, NULL);
+	return ret;
+}
+
 //server inter
 static struct arpc_server_work *arpc_create_work()
 {
@@ -707,7 +1215,6 @@ static void destroy_session_handle(QUEUE* session_q)
 static int xio_server_work_run(void * ctx)
 {
 	struct arpc_server_work *work = (struct arpc_server_work *)ctx;
-	//cpu_set_t		cpuset;
 	char thread_name[16+1] ={0};
 	LOG_THEN_RETURN_VAL_IF_TRUE(!work, ARPC_ERROR, "work null fail.");
 	ARPC_LOG_DEBUG("work run on the thread[%lu].", pthread_self());
@@ -717,9 +1224,9 @@ static int xio_server_work_run(void * ctx)
 	snprintf(thread_name, sizeof(thread_name), "arpc_work_%d", work->affinity);
 	prctl(PR_SET_NAME, thread_name);
 
-	/*CPU_ZERO(&cpuset);
-	CPU_SET((work->affinity)%(arpc_cpu_max_num()), &cpuset);
-	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);*/
+	if (arpc_placement_bind_loop(work->cpu)) {
+		ARPC_LOG_ERROR("work[%d] bind cpu[%d] fail.", work->affinity, work->cpu);
+	}
 
 	arpc_cond_notify(&work->cond);
 	arpc_cond_unlock(&work->cond);
@@ -736,6 +1243,7 @@ static int xio_server_work_run(void * ctx)
 		arpc_sleep(1);
 	}
 	ARPC_LOG_NOTICE("xio server work[%p] on thread[%lu] exit now.", work, pthread_self());
+	arpc_placement_restore();
 	arpc_cond_unlock(&work->cond);
 	return ARPC_SUCCESS;
 }
@@ -46,6 +46,8 @@ struct arpc_server_work{
 	QUEUE     	       q;
 	uint32_t		   magic;
 	int32_t			   affinity;				/* 绑定CPU */
+	int32_t			   cpu;						/* 按绑核策略分配的CPU，-1不绑定 */
+	int32_t			   numa_node;				/* 所在NUMA节点，-1未知 */
 	struct arpc_cond   cond;					/* 数据接收的条件变量*/
 	struct xio_server	*work;
 	struct xio_context	*work_ctx;			/* server thread 上下文 */
@@ -54,6 +56,16 @@ struct arpc_server_work{
 	enum arpc_work_status status;
 	uint32_t		msg_head_max_len;
 	uint64_t		msg_data_max_len;
+	struct arpc_server_handle *server;	/* 所属server */
+	uint32_t		index;					/* 工作线程序号 */
+	uint32_t		conn_num;				/* 当前连接数，原子操作 */
+	uint32_t		conn_reserved;			/* 已分配给新session、尚未建立的连接数，原子操作 */
+	uint64_t		bytes_retired;			/* 已断开连接的收发字节数，原子操作 */
+	uint64_t		bytes_last;				/* 上次采样的累计收发字节数，只在守护线程访问 */
+	uint64_t		bytes_rate;				/* 最近采样周期的收发字节速率，原子读写 */
+	uint64_t		inflight;				/* 最近采样的在途消息数，原子读写 */
+	uint64_t		sample_bytes;			/* 采样过程中的累加值，只在守护线程访问 */
+	uint64_t		sample_inflight;
 	char 	uri[URI_MAX_LEN];
 	char    ex_ctx[0];			/* exterd handle */
 };
@@ -61,7 +73,8 @@ struct arpc_server_work{
 struct arpc_server_handle{
 	QUEUE       q_work;
 	QUEUE       q_session;
-	void 		*threadpool;
+	void 		*threadpool;		/* 计算线程池：消息异步处理 */
+	void 		*loop_pool;			/* 事件循环线程池：work loop与守护线程 */
 	uint32_t 	work_num;
 	uint32_t	iov_max_len;
 	struct arpc_cond  cond;
@@ -79,6 +92,14 @@ struct arpc_server_handle{
 	uint32_t	msg_iov_max_len;
 	uint32_t		is_stop;
 	uint32_t 	session_num;
+	struct arpc_stat_set	stats_retired;	/* 已移除session的统计，lock锁内累加 */
+	int32_t		stat_slot;			/* 共享内存统计槽位，-1未发布 */
+	uint32_t	accept_mode;		/* enum arpc_accept_mode */
+	uint32_t	steer_num;			/* 按收包CPU分流的工作线程数，0不分流 */
+	uint64_t	load_sample_ns;		/* 上次负载采样时刻 */
+	int (*placement)(const struct arpc_work_load *, uint32_t, uint32_t, uint32_t *, void *);
+	uint32_t	rebalance_pct;		/* 负载超出均值的百分比阈值，0不迁移 */
+	uint32_t	rebalance_wait;		/* 距下次迁移判断还需等待的采样周期数，只在守护线程访问 */
 	char    ex_ctx[0];			/* exterd handle */
 };
 
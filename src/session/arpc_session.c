@@ -31,6 +31,8 @@
 #define ARPC_SESSION_RECONNECT_WAIT_TIME_S   (10)
 #define ARPC_SESSION_BUSY_WAIT_TIME_MS		(50)
 #define ARPC_SESSION_BUSY_RETRY_CNT			(3)
+#define ARPC_SESSION_WAKE_SLICE_MS			(10)	//无锁唤醒可能错过，按谓词等待的分片
+#define ARPC_SESSION_AFFINITY_LOAD_MAX		(128*4096)	//线程亲和时主连接负载超过该值视为饱和
 
 static int session_client_connect(struct arpc_session_handle *session, int64_t timeout_ms);
 
@@ -59,11 +61,13 @@ struct arpc_session_handle *arpc_create_session(enum arpc_session_type type, uin
 	QUEUE_INIT(&session->q);
 	QUEUE_INIT(&session->q_con);
 	session->threadpool = NULL;
+	session->loop_pool = NULL;
 	session->type = type;
 	session->is_close = 0;
 	session->status = ARPC_SES_STA_INIT;
 	session->conn_timeout_ms = XIO_INFINITE;
 	session->conn_num = 0;
+	session->stat_slot = -1;
 	return session;
 free_deamon:
 	arpc_cond_destroy(&session->deamon_cond);
@@ -87,6 +91,8 @@ int arpc_destroy_session(struct arpc_session_handle* session, int64_t timeout_ms
 	session->is_close = 1;
 	arpc_cond_notify_all(&session->cond);//通知释放资源
 	arpc_cond_unlock(&session->cond);
+	arpc_stat_shm_unregister(session->stat_slot);
+	session->stat_slot = -1;
 	arpc_usleep(10*1000);
 	ret = arpc_cond_lock(&session->cond); /* 锁 */
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "arpc_cond_lock session fail.");
@@ -111,7 +117,11 @@ int arpc_destroy_session(struct arpc_session_handle* session, int64_t timeout_ms
 		}
 	}
 	
-	// 释放con资源
+	// 释放con资源，先等无锁选路的线程放手
+	__atomic_store_n(&session->conn_arr_num, 0, __ATOMIC_RELEASE);
+	arpc_cond_unlock(&session->cond);
+	session_conn_synchronize(session);
+	arpc_cond_lock(&session->cond);
 	while(!QUEUE_EMPTY(&session->q_con)){
 		iter = QUEUE_HEAD(&session->q_con);
 		con = QUEUE_DATA(iter, struct arpc_connection, q);
@@ -196,12 +206,13 @@ int session_established_for_client(struct arpc_session_handle *session)
 	return 0;
 }
 
+// 在xio loop里调用，建链过程中session锁被session_client_connect持有，阻塞加锁会卡住本连接的loop，
+// xio也就无法接着建立后续连接；因此不加锁直接广播。等待者都按状态谓词分片限时等待，
+// 广播若恰好落在对方检查谓词与进入等待之间，最多晚一个分片看到新状态，不会丢失
 int session_notify_wakeup(struct arpc_session_handle *session)
 {
 	LOG_THEN_RETURN_VAL_IF_TRUE(!session, ARPC_ERROR, "session is null.");
-	arpc_cond_lock(&session->cond);
-	arpc_cond_notify(&session->cond);
-	arpc_cond_unlock(&session->cond);
+	arpc_cond_notify_all(&session->cond);
 	return 0;
 }
 
@@ -254,7 +265,7 @@ int session_rebuild_for_client(struct arpc_session_handle *session)
 	thread.stop = NULL;
 	thread.usr_ctx = (void*)session;
 
-	thread_handle = tp_post_one_work(session->threadpool, &thread, WORK_DONE_AUTO_FREE);
+	thread_handle = tp_post_one_work(session->loop_pool, &thread, WORK_DONE_AUTO_FREE);
 	LOG_THEN_RETURN_VAL_IF_TRUE(!thread_handle, ARPC_ERROR, "tp_post_one_work fail.");
 	return 0;
 }
@@ -320,6 +331,13 @@ int session_insert_con(struct arpc_session_handle *s, struct arpc_connection *co
 	arpc_unlock_connection(con);
 
 	s->conn_num++;
+	if (s->conn_arr_num < ARPC_SESSION_CONN_MAX_NUM) {
+		__atomic_store_n(&s->conn_arr[s->conn_arr_num], con, __ATOMIC_RELEASE);
+		__atomic_store_n(&s->conn_arr_num, s->conn_arr_num + 1, __ATOMIC_RELEASE);
+	}else{
+		ARPC_LOG_NOTICE("session[%p] conn num over[%u], conn[%u] only used by slow path.", 
+						s, ARPC_SESSION_CONN_MAX_NUM, con->id);
+	}
 	arpc_cond_notify(&s->cond);
 	arpc_cond_unlock(&s->cond);
 	return 0;
@@ -328,6 +346,8 @@ int session_insert_con(struct arpc_session_handle *s, struct arpc_connection *co
 int session_remove_con(struct arpc_session_handle *s, struct arpc_connection *con)
 {
 	int ret;
+	uint32_t i;
+	uint32_t last;
 	ret = arpc_cond_lock(&s->cond); /* 锁 */
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "arpc_cond_lock session[%p] fail.", s);
 
@@ -337,6 +357,18 @@ int session_remove_con(struct arpc_session_handle *s, struct arpc_connection *co
 	arpc_unlock_connection(con);
 
 	s->conn_num--;
+	arpc_stat_merge(&s->stats_retired, &con->stats);
+	for (i = 0; i < s->conn_arr_num; i++) {
+		if (s->conn_arr[i] != con) {
+			continue;
+		}
+		// 末尾元素填补空位，并发读者最多读到旧值或NULL
+		last = s->conn_arr_num - 1;
+		__atomic_store_n(&s->conn_arr[i], s->conn_arr[last], __ATOMIC_RELEASE);
+		__atomic_store_n(&s->conn_arr_num, last, __ATOMIC_RELEASE);
+		__atomic_store_n(&s->conn_arr[last], NULL, __ATOMIC_RELEASE);
+		break;
+	}
 	arpc_cond_notify(&s->cond);
 	arpc_cond_unlock(&s->cond);
 	return 0;
@@ -363,6 +395,9 @@ static int session_client_connect(struct arpc_session_handle *session, int64_t t
 	QUEUE* iter;
 	struct arpc_client_ctx *client_ctx;
 	struct arpc_connection *con = NULL;
+	uint64_t deadline_ns;
+	int64_t left_ns;
+	int64_t left_ms = ARPC_SESSION_WAKE_SLICE_MS;
 
 	client_ctx = (struct arpc_client_ctx *)session->ex_ctx;
 	session->xio_s = xio_session_create(&client_ctx->xio_param);
@@ -375,9 +410,17 @@ static int session_client_connect(struct arpc_session_handle *session, int64_t t
 		LOG_ERROR_IF_VAL_TRUE(ret, " client conn[%u] connect fail.", con->id);
 	});
 
-	ret = arpc_cond_wait_timeout(&session->cond, timeout_ms);
-	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_conn, 
+	// 建链成功置ACTIVE，失败时teardown清空xio_s；按谓词等待，不依赖某一次唤醒
+	deadline_ns = fast_clock_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	while (session->status != ARPC_SES_STA_ACTIVE && session->xio_s) {
+		if (timeout_ms >= 0) {
+			left_ns = (int64_t)(deadline_ns - fast_clock_ns());
+			LOG_THEN_GOTO_TAG_IF_VAL_TRUE(left_ns <= 0, free_conn, 
 								"wait session[%p] connect timeout, status[%d].", session, session->status);
+			left_ms = left_ns / 1000000 + 1;
+		}
+		arpc_cond_wait_timeout(&session->cond, (left_ms < ARPC_SESSION_WAKE_SLICE_MS)? left_ms : ARPC_SESSION_WAKE_SLICE_MS);
+	}
 
 	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(session->status != ARPC_SES_STA_ACTIVE, free_conn, 
 								"session[%p] connect fail, status[%d].", session, session->status);
@@ -401,8 +444,123 @@ free_conn:
 	return ARPC_ERROR;
 }
 
+static inline uint32_t session_thread_hash(void)
+{
+	static __thread uint32_t hash = 0;
+	if (!hash) {
+		hash = ((uint32_t)syscall(SYS_gettid) * 2654435761U) | 1;
+	}
+	return hash;
+}
+
+static inline uint32_t session_rand(void)
+{
+	static __thread uint32_t seed = 0;
+	if (!seed) {
+		seed = session_thread_hash();
+	}
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static inline uint32_t session_pick_enter(struct arpc_session_handle *session)
+{
+	uint32_t grace = __atomic_load_n(&session->pick_epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&session->pick_readers[grace], 1, __ATOMIC_SEQ_CST);
+	return grace;
+}
+
+void session_put_conn(struct arpc_session_handle *session, uint32_t grace)
+{
+	__atomic_sub_fetch(&session->pick_readers[grace & 1], 1, __ATOMIC_RELEASE);
+}
+
+// 两次翻转纪元：读到旧纪元但晚于第一次等待才计数的读者，由第二次等待覆盖
+void session_conn_synchronize(struct arpc_session_handle *session)
+{
+	uint32_t i;
+	uint32_t grace;
+
+	while (__atomic_exchange_n(&session->pick_sync, 1, __ATOMIC_ACQUIRE)) {
+		arpc_usleep(100);
+	}
+	for (i = 0; i < 2; i++) {
+		grace = __atomic_fetch_add(&session->pick_epoch, 1, __ATOMIC_SEQ_CST) & 1;
+		while (__atomic_load_n(&session->pick_readers[grace], __ATOMIC_SEQ_CST)) {
+			arpc_usleep(100);
+		}
+	}
+	__atomic_store_n(&session->pick_sync, 0, __ATOMIC_RELEASE);
+}
+
+// 无锁选路：随机取两条连接，选负载低者(power of two choices)
+static struct arpc_connection *session_pick_conn(struct arpc_session_handle *session, enum  arpc_msg_type msg_type)
+{
+	uint32_t num;
+	uint32_t i, j;
+	uint64_t load_a = 0;
+	uint64_t load_b = 0;
+	struct arpc_connection *a;
+	struct arpc_connection *b;
+
+	num = __atomic_load_n(&session->conn_arr_num, __ATOMIC_ACQUIRE);
+	if (!num) {
+		return NULL;
+	}
+	i = session_rand() % num;
+	a = __atomic_load_n(&session->conn_arr[i], __ATOMIC_ACQUIRE);
+	if (a && arpc_connection_get_load(a, msg_type, &load_a)) {
+		a = NULL;
+	}
+	if (num > 1) {
+		j = (i + 1 + session_rand() % (num - 1)) % num;
+		b = __atomic_load_n(&session->conn_arr[j], __ATOMIC_ACQUIRE);
+		if (b && !arpc_connection_get_load(b, msg_type, &load_b) && (!a || load_b < load_a)) {
+			a = b;
+		}
+	}
+	if (a) {
+		return a;
+	}
+
+	// 两个候选都不可用(断链/接收专用/拥塞)，顺序找一条可用的
+	for (j = 1; j < num; j++) {
+		b = __atomic_load_n(&session->conn_arr[(i + j) % num], __ATOMIC_ACQUIRE);
+		if (b && !arpc_connection_get_load(b, msg_type, NULL)) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+// 线程亲和选路：按线程id散列到主连接，主连接不可用或饱和时顺延，保证同一线程的消息尽量走同一条连接
+static struct arpc_connection *session_pick_home_conn(struct arpc_session_handle *session, enum  arpc_msg_type msg_type)
+{
+	uint32_t num;
+	uint32_t home;
+	uint32_t i;
+	uint64_t load;
+	struct arpc_connection *con;
+
+	num = __atomic_load_n(&session->conn_arr_num, __ATOMIC_ACQUIRE);
+	if (!num) {
+		return NULL;
+	}
+	home = (session_thread_hash() >> 16) % num;
+	for (i = 0; i < num; i++) {
+		con = __atomic_load_n(&session->conn_arr[(home + i) % num], __ATOMIC_ACQUIRE);
+		if (con && !arpc_connection_get_load(con, msg_type, &load) && load <= ARPC_SESSION_AFFINITY_LOAD_MAX) {
+			return con;
+		}
+	}
+	// 所有连接都饱和，退化为按负载选路
+	return session_pick_conn(session, msg_type);
+}
+
 int session_get_idle_conn(struct arpc_session_handle *session, struct arpc_connection **conn, 
-							enum  arpc_msg_type msg_type, int64_t timeout_ms)
+							enum  arpc_msg_type msg_type, int64_t timeout_ms, uint32_t *grace)
 {
 	int ret;
 	QUEUE* iter;
@@ -411,6 +569,24 @@ int session_get_idle_conn(struct arpc_session_handle *session, struct arpc_conne
 
 	LOG_THEN_RETURN_VAL_IF_TRUE(!session, ARPC_ERROR, "session is null.");
 
+	// 快速路径：会话正常时无锁选路，宽限期保证选中的连接不会被释放
+	*grace = session_pick_enter(session);
+	if (__atomic_load_n(&session->status, __ATOMIC_ACQUIRE) == ARPC_SES_STA_ACTIVE) {
+		if (IS_SET(session->flags, ARPC_SESSION_ATTR_THREAD_AFFINITY)) {
+			con = session_pick_home_conn(session, msg_type);
+		}else{
+			con = session_pick_conn(session, msg_type);
+		}
+		if (con) {
+			*conn = con;
+			return 0;
+		}
+	}
+	// 慢路径可能长时间等待，先退出宽限期，选中后在cond锁内重新进入
+	session_put_conn(session, *grace);
+
+	// 慢路径：需要重连或暂无可用连接时加锁等待
+
 	ret = arpc_mutex_lock(&session->lock);
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "arpc_mutex_lock session[%p] fail.", session);
 
@@ -451,6 +627,7 @@ int session_get_idle_conn(struct arpc_session_handle *session, struct arpc_conne
 			goto unlock;
 		}
 	}
+	*grace = session_pick_enter(session);
 	arpc_cond_unlock(&session->cond);
 	arpc_mutex_unlock(&session->lock);
 	*conn = con;
@@ -477,12 +654,15 @@ static inline const char *get_type_str(enum arpc_session_type type)
 
 #define SESSION_STATUS_SHOW_HEAD\
  "\n  ### session:%p   session type:%s  conn-num:%u  timeout-ms:%d  status:%d  data-max:%lu head-max:%u iov-max:%u ###\n"\
- "*conn-id     "\
- "*tx-req:cnt*2/cmit/send      *tx-rsp:cnt*2/cmit/send      *tx-ow:cnt*2/cmit/send       "\
- "*rx-req:cnt/rx  /cb          *rx-rsp:cnt/rx  /cb          *rx-ow:cnt/rx  /cb   \n"
+ "*conn-id  (us)  "\
+ "*tx-req:cnt/p50/p99           *tx-rsp:cnt/p50/p99           *tx-ow:cnt/p50/p99            "\
+ "*rx-req:cnt/p50/p99           *rx-rsp:cnt/p50/p99           *rx-ow:cnt/p50/p99   \n"
 
 #define SESSION_STATUS_SHOW\
- "%-4u  %8lu|%02lu.%06lu|%02lu.%06lu %8lu|%02lu.%06lu|%02lu.%06lu %8lu|%02lu.%06lu|%02lu.%06lu %8lu|%02lu.%06lu|%02lu.%06lu %8lu|%02lu.%06lu|%02lu.%06lu %8lu|%02lu.%06lu|%02lu.%06lu\n" 
+ "%-4u  %8lu|%9.1f|%9.1f %8lu|%9.1f|%9.1f %8lu|%9.1f|%9.1f %8lu|%9.1f|%9.1f %8lu|%9.1f|%9.1f %8lu|%9.1f|%9.1f\n" 
+
+#define SESSION_STATUS_LAT(con, type)\
+ lat_hist_percentile(&(con)->stats.lat[type], 5000) / 1000.0, lat_hist_percentile(&(con)->stats.lat[type], 9900) / 1000.0
 
 void print_session_status(struct arpc_session_handle *session, struct timeval *now)
 {
@@ -513,12 +693,12 @@ void print_session_status(struct arpc_session_handle *session, struct timeval *n
 		con = QUEUE_DATA(iter, struct arpc_connection, q);
 		ARPC_LOG_STATUS(SESSION_STATUS_SHOW, 
 						con->id,
-						con->tx_req_count, con->tx_req_cmit.ave.tv_sec, con->tx_req_cmit.ave.tv_usec, con->tx_req.ave.tv_sec, con->tx_req.ave.tv_usec,
-						con->tx_rsp_count, con->tx_rsp_cmit.ave.tv_sec, con->tx_rsp_cmit.ave.tv_usec, con->tx_rsp.ave.tv_sec, con->tx_rsp.ave.tv_usec,
-						con->tx_ow_count, con->tx_ow_cmit.ave.tv_sec, con->tx_ow_cmit.ave.tv_usec, con->tx_ow.ave.tv_sec, con->tx_ow.ave.tv_usec,
-						con->rx_req_count, con->rx_req_send.ave.tv_sec, con->rx_req_send.ave.tv_usec, con->rx_req.ave.tv_sec, con->rx_req.ave.tv_usec,
-						con->rx_rsp_count, con->rx_rsp_send.ave.tv_sec, con->rx_rsp_send.ave.tv_usec, con->rx_rsp.ave.tv_sec, con->rx_rsp.ave.tv_usec,
-						con->rx_ow_count, con->rx_ow_send.ave.tv_sec, con->rx_ow_send.ave.tv_usec, con->rx_ow.ave.tv_sec, con->rx_ow.ave.tv_usec);
+						con->stats.tx_req, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_REQ),
+						con->stats.tx_rsp, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_RSP),
+						con->stats.tx_ow, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_OW),
+						con->stats.rx_req, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_RX_REQ),
+						con->stats.rx_rsp, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_RX_RSP),
+						con->stats.rx_ow, SESSION_STATUS_LAT(con, ARPC_STAT_LAT_RX_OW));
 	});
 	ARPC_LOG_STATUS("-----------------------------------------------\n\n");
 	arpc_cond_unlock(&session->cond);
@@ -537,4 +717,113 @@ void arpc_session_info(const arpc_session_handle_t fd)
 	if(!fd)
 		return ;
 	print_session_status(((struct arpc_session_handle *)fd), NULL);
+}
+
+// 调用者持有session的cond锁
+void session_stat_merge(struct arpc_session_handle *session, struct arpc_stat_set *dst)
+{
+	QUEUE* iter;
+	struct arpc_connection *con;
+
+	arpc_stat_merge(dst, &session->stats_retired);
+	QUEUE_FOREACH_VAL(&session->q_con, iter,
+	{
+		con = QUEUE_DATA(iter, struct arpc_connection, q);
+		arpc_stat_merge(dst, &con->stats);
+	});
+}
+
+// 调用者持有session的cond锁
+void session_stat_fill(struct arpc_session_handle *session, uint32_t session_index, struct arpc_stat_shm_data *data)
+{
+	QUEUE* iter;
+	struct arpc_connection *con;
+	struct arpc_stat_shm_conn *entry;
+	struct arpc_stat_shm_conn overflow;
+
+	session_stat_merge(session, &data->set);
+	data->conn_num += session->conn_num;
+	QUEUE_FOREACH_VAL(&session->q_con, iter,
+	{
+		con = QUEUE_DATA(iter, struct arpc_connection, q);
+		// 明细放不下的连接仍计入在途总数
+		entry = (data->conn_export < ARPC_STAT_SHM_CONN_NUM) ? &data->conn[data->conn_export++] : &overflow;
+		arpc_connection_stat_fill(con, session_index, entry);
+		data->inflight += entry->inflight;
+	});
+}
+
+void session_stat_collect(void *obj, struct arpc_stat_shm_data *data)
+{
+	struct arpc_session_handle *session = (struct arpc_session_handle *)obj;
+
+	if (arpc_cond_lock(&session->cond)) {
+		return;
+	}
+	session_stat_fill(session, 0, data);
+	arpc_cond_unlock(&session->cond);
+	data->tp_thread = tp_get_pool_thread_num(session->threadpool);
+	data->tp_idle = tp_get_pool_idle_num(session->threadpool);
+	data->tp_wait = tp_get_pool_wait_num(session->threadpool);
+}
+
+int arpc_get_session_stats(const arpc_session_handle_t fd, struct arpc_stats *stats)
+{
+	struct arpc_session_handle *session = (struct arpc_session_handle *)fd;
+	struct arpc_stat_set *set;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!session || !stats), ARPC_ERROR, "session or stats null.");
+	set = (struct arpc_stat_set *)arpc_mem_alloc(sizeof(struct arpc_stat_set), NULL);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!set, ARPC_ERROR, "arpc_mem_alloc stat set fail.");
+	memset(set, 0, sizeof(struct arpc_stat_set));
+
+	ret = arpc_cond_lock(&session->cond);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_set, "arpc_cond_lock session[%p] fail.", session);
+	session_stat_merge(session, set);
+	arpc_stat_export(set, session->conn_num, stats);
+	arpc_cond_unlock(&session->cond);
+	arpc_mem_free(set, NULL);
+	return ARPC_SUCCESS;
+
+free_set:
+	arpc_mem_free(set, NULL);
+	return ARPC_ERROR;
+}
+
+int arpc_get_conn_stats(const arpc_session_handle_t fd, uint32_t index, struct arpc_stats *stats)
+{
+	struct arpc_session_handle *session = (struct arpc_session_handle *)fd;
+	struct arpc_stat_set *set;
+	struct arpc_connection *con = NULL;
+	QUEUE* iter;
+	uint32_t i = 0;
+	int ret;
+
+	LOG_THEN_RETURN_VAL_IF_TRUE((!session || !stats), ARPC_ERROR, "session or stats null.");
+	set = (struct arpc_stat_set *)arpc_mem_alloc(sizeof(struct arpc_stat_set), NULL);
+	LOG_THEN_RETURN_VAL_IF_TRUE(!set, ARPC_ERROR, "arpc_mem_alloc stat set fail.");
+	memset(set, 0, sizeof(struct arpc_stat_set));
+
+	ret = arpc_cond_lock(&session->cond);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(ret, free_set, "arpc_cond_lock session[%p] fail.", session);
+	QUEUE_FOREACH_VAL(&session->q_con, iter,
+	{
+		if (i++ == index) {
+			con = QUEUE_DATA(iter, struct arpc_connection, q);
+			break;
+		}
+	});
+	if (con) {
+		arpc_stat_merge(set, &con->stats);
+		arpc_stat_export(set, 1, stats);
+	}
+	arpc_cond_unlock(&session->cond);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(!con, free_set, "conn index[%u] over conn num[%u].", index, i);
+	arpc_mem_free(set, NULL);
+	return ARPC_SUCCESS;
+
+free_set:
+	arpc_mem_free(set, NULL);
+	return ARPC_ERROR;
 }
\ No newline at end of file
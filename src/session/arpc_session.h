@@ -38,6 +38,9 @@ extern "C" {
 struct arpc_session_handle *session_fd = (struct arpc_session_handle *)session_usr_ctx;
 
 #define ARPC_SESSION_ATTR_AUTO_DISCONNECT  (1<<15)
+#define ARPC_SESSION_ATTR_THREAD_AFFINITY  (1<<14)	/* 线程亲和选路 */
+
+#define ARPC_SESSION_CONN_MAX_NUM	64		/* 参与无锁选路的连接数上限，超出部分只在慢路径中使用 */
 
 enum arpc_session_type{
 	ARPC_SESSION_CLIENT = 0, //
@@ -60,7 +63,8 @@ struct arpc_session_handle{
 	uint32_t 	conn_num;
 	uint32_t 	reconnect_times;
 	uint64_t 	tx_total;
-	void 		*threadpool;
+	void 		*threadpool;		/* 计算线程池：消息异步处理 */
+	void 		*loop_pool;			/* 事件循环线程池：连接loop、守护及重连任务 */
 	enum arpc_session_type type;
 	struct xio_session *xio_s;
 	uint32_t 	is_close;
@@ -72,8 +76,17 @@ struct arpc_session_handle{
 	uint32_t	msg_head_max_len;
 	uint64_t	msg_data_max_len;
 	uint32_t	msg_iov_max_len;
+	uint32_t	csum_type;			/* 协商出的发送校验算法(enum csum_type)，客户端建链后更新 */
+	uint32_t	zip_type;			/* 协商出的压缩算法(enum arpc_zip_type)，客户端建链后更新 */
 	int32_t		conn_timeout_ms;
 	void 	*usr_context;			// 用户上下文
+	uint32_t	conn_arr_num;		/* 选路数组中的连接数，cond锁内修改，读取无锁 */
+	struct arpc_connection *conn_arr[ARPC_SESSION_CONN_MAX_NUM];	/* 选路数组 */
+	uint32_t	pick_epoch;			/* 选路宽限期纪元，最低位选择读者计数组 */
+	uint32_t	pick_readers[2];	/* 持有选路结果尚未提交完的线程数 */
+	uint32_t	pick_sync;			/* 宽限期等待者互斥 */
+	struct arpc_stat_set	stats_retired;	/* 已移除连接的统计，cond锁内累加 */
+	int32_t		stat_slot;			/* 共享内存统计槽位，-1未发布 */
 	char    ex_ctx[0];			/* exterd handle */
 };
 
@@ -91,11 +104,44 @@ int session_insert_con(struct arpc_session_handle *s, struct arpc_connection *co
 int session_remove_con(struct arpc_session_handle *s, struct arpc_connection *con);
 int session_move_con_tail(struct arpc_session_handle *s, struct arpc_connection *con);
 
+/*!
+ * @brief  选一条可用连接
+ *
+ * 成功时调用者进入选路宽限期，连接在session_put_conn前不会被释放，提交完消息后必须调用session_put_conn
+ *
+ * @param[out] grace ,宽限期读者组，传给session_put_conn
+ * @return  int; (<em>-1</em>: fail ; ( <em>0</em>: succeed
+ */
 int session_get_idle_conn(struct arpc_session_handle *session, struct arpc_connection **conn, 
-							enum  arpc_msg_type msg_type, int64_t timeout_ms);
+							enum  arpc_msg_type msg_type, int64_t timeout_ms, uint32_t *grace);
+void session_put_conn(struct arpc_session_handle *session, uint32_t grace);
+
+/*!
+ * @brief  等待宽限期结束：此前通过选路拿到连接的线程都已session_put_conn
+ *
+ * 连接从选路数组和队列摘除后、释放前调用，调用者不能持有session的cond锁
+ */
+void session_conn_synchronize(struct arpc_session_handle *session);
 
 void print_session_status(struct arpc_session_handle *session, struct timeval *now);
 
+/*!
+ * @brief  把session已移除连接与现有连接的统计累加到dst，调用者持有session的cond锁
+ */
+void session_stat_merge(struct arpc_session_handle *session, struct arpc_stat_set *dst);
+
+/*!
+ * @brief  把session的统计、连接数与连接明细累加到data，调用者持有session的cond锁
+ *
+ * @param[in] session_index session在槽位内的序号，写入连接明细
+ */
+void session_stat_fill(struct arpc_session_handle *session, uint32_t session_index, struct arpc_stat_shm_data *data);
+
+/*!
+ * @brief  统计发布的采集回调，obj为session
+ */
+void session_stat_collect(void *obj, struct arpc_stat_shm_data *data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,266 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file arpc_stat_shm.c
+* \brief 共享内存统计区发布
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "arpc_com.h"
+
+struct stat_shm_src {
+	arpc_stat_collect_cb		collect;
+	void						*obj;
+};
+
+struct stat_shm_ctx {
+	pthread_mutex_t				lock;			/* 槽位分配与发布互斥，注销返回后发布线程不再访问对象 */
+	pthread_cond_t				cond;
+	pthread_t					thread;
+	int32_t						running;
+	int32_t						stop;
+	size_t						size;
+	struct arpc_stat_shm_head	*head;
+	struct arpc_stat_shm_slot	*slots;
+	struct stat_shm_src			src[ARPC_STAT_SHM_SLOT_NUM];
+	struct arpc_stat_shm_data	tmp;			/* 采集用的临时区，lock锁内使用 */
+	char						path[128];
+};
+
+static struct stat_shm_ctx g_shm = {
+	.lock	= PTHREAD_MUTEX_INITIALIZER,
+	.cond	= PTHREAD_COND_INITIALIZER,
+};
+
+int arpc_stat_shm_enabled(void)
+{
+	const struct aprc_option *opt = get_option();
+
+	return IS_SET(opt->control, ARPC_E_CTRL_STAT_SHM) || arpc_metrics_enabled(opt);
+}
+
+// 只开了指标导出时不建文件，用匿名映射承载同样的槽位
+static int stat_shm_open(void)
+{
+	struct arpc_stat_shm_head *head;
+	struct timespec now;
+	size_t size = sizeof(struct arpc_stat_shm_head) + ARPC_STAT_SHM_SLOT_NUM * sizeof(struct arpc_stat_shm_slot);
+	int fd;
+
+	if (!IS_SET(get_option()->control, ARPC_E_CTRL_STAT_SHM)) {
+		g_shm.path[0] = '\0';
+		head = (struct arpc_stat_shm_head *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		LOG_THEN_RETURN_VAL_IF_TRUE(head == MAP_FAILED, ARPC_ERROR, "mmap anonymous stat region fail, errno[%d].", errno);
+		goto fill_head;
+	}
+	snprintf(g_shm.path, sizeof(g_shm.path), "%s/%s%d", ARPC_STAT_SHM_DIR, ARPC_STAT_SHM_PREFIX, (int)getpid());
+	fd = open(g_shm.path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	LOG_THEN_RETURN_VAL_IF_TRUE(fd < 0, ARPC_ERROR, "open stat shm[%s] fail, errno[%d].", g_shm.path, errno);
+	if (ftruncate(fd, (off_t)size)) {
+		ARPC_LOG_ERROR("ftruncate stat shm[%s] to[%lu] fail, errno[%d].", g_shm.path, size, errno);
+		goto close_fd;
+	}
+	head = (struct arpc_stat_shm_head *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(head == MAP_FAILED, close_fd, "mmap stat shm[%s] fail, errno[%d].", g_shm.path, errno);
+	close(fd);
+
+fill_head:
+	clock_gettime(CLOCK_REALTIME, &now);
+	head->version = ARPC_STAT_SHM_VERSION;
+	head->pid = (uint32_t)getpid();
+	head->slot_num = ARPC_STAT_SHM_SLOT_NUM;
+	head->slot_size = sizeof(struct arpc_stat_shm_slot);
+	head->interval_ms = ARPC_STAT_SHM_INTERVAL_MS;
+	head->start_sec = now.tv_sec;
+	__atomic_store_n(&head->magic, ARPC_STAT_SHM_MAGIC, __ATOMIC_RELEASE);	// 头部填完才可见
+
+	g_shm.head = head;
+	g_shm.size = size;
+	__atomic_store_n(&g_shm.slots, (struct arpc_stat_shm_slot *)(head + 1), __ATOMIC_RELEASE);
+	ARPC_LOG_NOTICE("stat shm[%s] created, slot[%u x %lu B].", g_shm.path[0] ? g_shm.path : "anonymous",
+					ARPC_STAT_SHM_SLOT_NUM, sizeof(struct arpc_stat_shm_slot));
+	return ARPC_SUCCESS;
+
+close_fd:
+	close(fd);
+	unlink(g_shm.path);
+	return ARPC_ERROR;
+}
+
+static void stat_shm_write(struct arpc_stat_shm_slot *slot, const struct arpc_stat_shm_data *data, uint64_t now)
+{
+	uint32_t seq = slot->seq;
+
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&slot->data, data, sizeof(struct arpc_stat_shm_data));
+	slot->update_ns = now;
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void stat_shm_publish(void)
+{
+	struct stat_shm_src *src;
+	uint64_t now = arpc_clock_ns();
+	uint32_t i;
+
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		src = &g_shm.src[i];
+		if (!src->collect) {
+			continue;
+		}
+		memset(&g_shm.tmp, 0, sizeof(struct arpc_stat_shm_data));
+		src->collect(src->obj, &g_shm.tmp);
+		stat_shm_write(&g_shm.slots[i], &g_shm.tmp, now);
+	}
+	__atomic_store_n(&g_shm.head->update_ns, now, __ATOMIC_RELEASE);
+}
+
+static void *stat_shm_thread(void *arg)
+{
+	struct timespec abstime;
+
+	prctl(PR_SET_NAME, "arpc_stat");
+	pthread_mutex_lock(&g_shm.lock);
+	while (!g_shm.stop) {
+		fast_clock_abstime(ARPC_STAT_SHM_INTERVAL_MS, &abstime);
+		pthread_cond_timedwait(&g_shm.cond, &g_shm.lock, &abstime);
+		if (g_shm.stop) {
+			break;
+		}
+		stat_shm_publish();
+	}
+	pthread_mutex_unlock(&g_shm.lock);
+	return NULL;
+}
+
+// 调用者持有g_shm.lock
+static int stat_shm_start(void)
+{
+	int ret;
+
+	if (g_shm.running) {
+		return ARPC_SUCCESS;
+	}
+	if (!g_shm.head) {
+		ret = stat_shm_open();
+		LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "stat_shm_open fail.");
+	}
+	g_shm.stop = 0;
+	ret = pthread_create(&g_shm.thread, NULL, &stat_shm_thread, NULL);
+	LOG_THEN_RETURN_VAL_IF_TRUE(ret, ARPC_ERROR, "create stat shm thread fail, ret[%d].", ret);
+	g_shm.running = 1;
+	return ARPC_SUCCESS;
+}
+
+int arpc_stat_shm_register(enum arpc_stat_shm_type type, const char *name, arpc_stat_collect_cb collect, void *obj)
+{
+	struct arpc_stat_shm_slot *slot;
+	int index = -1;
+	uint32_t i;
+
+	if (!arpc_stat_shm_enabled()) {
+		return -1;
+	}
+	LOG_THEN_RETURN_VAL_IF_TRUE((!collect || !obj), -1, "collect or obj null.");
+	pthread_mutex_lock(&g_shm.lock);
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(stat_shm_start(), unlock, "stat_shm_start fail.");
+	for (i = 0; i < ARPC_STAT_SHM_SLOT_NUM; i++) {
+		if (!g_shm.src[i].collect) {
+			break;
+		}
+	}
+	LOG_THEN_GOTO_TAG_IF_VAL_TRUE(i == ARPC_STAT_SHM_SLOT_NUM, unlock, "stat shm slot full, [%s] not published.", name);
+
+	// 槽位复用时先清空旧数据，读取方通过gen区分
+	slot = &g_shm.slots[i];
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(&slot->data, 0, sizeof(struct arpc_stat_shm_data));
+	memset(slot->name, 0, sizeof(slot->name));
+	strncpy(slot->name, name ? name : "", sizeof(slot->name) - 1);
+	slot->type = type;
+	slot->gen++;
+	slot->update_ns = arpc_clock_ns();
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+
+	g_shm.src[i].collect = collect;
+	g_shm.src[i].obj = obj;
+	index = (int)i;
+unlock:
+	pthread_mutex_unlock(&g_shm.lock);
+	return index;
+}
+
+void arpc_stat_shm_unregister(int index)
+{
+	struct arpc_stat_shm_slot *slot;
+
+	if (index < 0 || index >= ARPC_STAT_SHM_SLOT_NUM) {
+		return;
+	}
+	pthread_mutex_lock(&g_shm.lock);
+	if (g_shm.src[index].collect) {
+		// 注销前发布最后一次，外部工具能看到对象退出时的总数
+		memset(&g_shm.tmp, 0, sizeof(struct arpc_stat_shm_data));
+		slot = &g_shm.slots[index];
+		g_shm.src[index].collect(g_shm.src[index].obj, &g_shm.tmp);
+		stat_shm_write(slot, &g_shm.tmp, arpc_clock_ns());
+		__atomic_store_n(&slot->type, ARPC_STAT_SHM_FREE, __ATOMIC_RELEASE);
+		g_shm.src[index].collect = NULL;
+		g_shm.src[index].obj = NULL;
+	}
+	pthread_mutex_unlock(&g_shm.lock);
+}
+
+void arpc_stat_shm_stop(void)
+{
+	pthread_mutex_lock(&g_shm.lock);
+	if (!g_shm.running) {
+		pthread_mutex_unlock(&g_shm.lock);
+		return;
+	}
+	g_shm.stop = 1;
+	pthread_cond_signal(&g_shm.cond);
+	pthread_mutex_unlock(&g_shm.lock);
+	pthread_join(g_shm.thread, NULL);
+
+	pthread_mutex_lock(&g_shm.lock);
+	g_shm.running = 0;
+	memset(g_shm.src, 0, sizeof(g_shm.src));
+	if (g_shm.head) {
+		__atomic_store_n(&g_shm.slots, NULL, __ATOMIC_RELEASE);
+		munmap(g_shm.head, g_shm.size);
+		if (g_shm.path[0]) {
+			unlink(g_shm.path);
+		}
+		g_shm.head = NULL;
+	}
+	pthread_mutex_unlock(&g_shm.lock);
+}
+
+int arpc_stat_shm_snapshot(uint32_t index, struct arpc_stat_shm_slot *out)
+{
+	const struct arpc_stat_shm_slot *slots = __atomic_load_n(&g_shm.slots, __ATOMIC_ACQUIRE);
+
+	if (!slots || index >= ARPC_STAT_SHM_SLOT_NUM || !out) {
+		return ARPC_ERROR;
+	}
+	if (!__atomic_load_n(&slots[index].gen, __ATOMIC_RELAXED)) {
+		return ARPC_ERROR;
+	}
+	return arpc_stat_shm_read_slot(&slots[index], out) ? ARPC_ERROR : ARPC_SUCCESS;
+}
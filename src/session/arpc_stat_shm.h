@@ -0,0 +1,143 @@
+/*
+ * Copyright(C) 2020 Ruijie Network. All rights reserved.
+ */
+
+/*!
+* \file arpc_stat_shm.h
+* \brief 共享内存统计区
+*
+* 每个进程在/dev/shm下建一个文件，按槽位发布各session/server的计数与时延直方图。
+* 发布线程定期合并后写入，每个槽位用序号锁(seqlock)保护：写前序号变奇数，写完变偶数；
+* 外部进程只读映射，拷贝前后序号一致且为偶数即为完整快照，读取不加锁、不经过被观测进程。
+* 布局变化时增加版本号，读取方校验头部后再解析。进程内的指标导出同样从槽位快照渲染，不碰数据路径。
+*
+* \copyright 2020 Ruijie Network. All rights reserved.
+* \author hongchunhua@ruijie.com.cn
+* \version v1.0.0
+* \date 2020.08.05
+* \note none
+*/
+
+#ifndef _ARPC_STAT_SHM_H
+#define _ARPC_STAT_SHM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "lat_hist.h"
+#include "arpc_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARPC_STAT_SHM_MAGIC			0x41525053			/* "ARPS" */
+#define ARPC_STAT_SHM_VERSION		3
+#define ARPC_STAT_SHM_DIR			"/dev/shm"
+#define ARPC_STAT_SHM_PREFIX		"arpc_stat."		/* 文件名为前缀加pid */
+#define ARPC_STAT_SHM_SLOT_NUM		32
+#define ARPC_STAT_SHM_NAME_LEN		64
+#define ARPC_STAT_SHM_CONN_NUM		32					/* 每个槽位最多发布的连接明细数，超出只计入汇总 */
+#define ARPC_STAT_SHM_INTERVAL_MS	1000
+#define ARPC_STAT_SHM_READ_RETRY	64
+
+/* 计数与时延直方图，连接上各自累计；会话/服务端另存已断开连接的部分，读取时合并 */
+struct arpc_stat_set {
+	uint64_t					tx_req;
+	uint64_t					tx_rsp;
+	uint64_t					tx_ow;
+	uint64_t					rx_req;
+	uint64_t					rx_rsp;
+	uint64_t					rx_ow;
+	uint64_t					tx_bytes;
+	uint64_t					rx_bytes;
+	uint64_t					rx_release_err;
+	struct lat_hist				lat[ARPC_STAT_LAT_MAX];
+};
+
+enum arpc_stat_shm_type{
+	ARPC_STAT_SHM_FREE = 0,
+	ARPC_STAT_SHM_CLIENT,		/* 客户端session */
+	ARPC_STAT_SHM_SERVER,		/* 服务端，含其下全部session */
+};
+
+/* 单个连接的明细，计数为累计值，其余为发布时刻的瞬时值 */
+struct arpc_stat_shm_conn {
+	uint32_t					session;			/* 所属session在槽位内的序号，服务端槽位区分不同客户端 */
+	uint32_t					id;					/* 连接id */
+	uint32_t					status;				/* 连接状态 */
+	uint32_t					inflight;			/* 已申请未归还的消息数 */
+	uint64_t					tx_queue;			/* 发送环中待发送的消息数 */
+	uint64_t					tx_pending_bytes;	/* 已入发送环未发出的字节数 */
+	uint64_t					tx_msg;
+	uint64_t					rx_msg;
+	uint64_t					tx_bytes;
+	uint64_t					rx_bytes;
+};
+
+/* 槽位的发布内容，由对象的采集回调填写 */
+struct arpc_stat_shm_data {
+	uint32_t					conn_num;			/* 连接总数 */
+	uint32_t					conn_export;		/* conn中有效的明细数 */
+	uint32_t					tp_thread;			/* 工作线程池当前线程数 */
+	uint32_t					tp_idle;			/* 工作线程池空闲线程数 */
+	uint64_t					tp_wait;			/* 工作线程池已投递未开始执行的任务数 */
+	uint64_t					inflight;			/* 各连接在途消息数之和 */
+	struct arpc_stat_set		set;
+	struct arpc_stat_shm_conn	conn[ARPC_STAT_SHM_CONN_NUM];
+};
+
+struct arpc_stat_shm_head {
+	uint32_t					magic;
+	uint32_t					version;
+	uint32_t					pid;
+	uint32_t					slot_num;
+	uint32_t					slot_size;			/* sizeof(struct arpc_stat_shm_slot)，读取方校验 */
+	uint32_t					interval_ms;		/* 发布周期 */
+	uint64_t					start_sec;			/* 建立时的墙上时间 */
+	uint64_t					update_ns;			/* 最近一次发布的单调时钟，发布线程停止后不再变化 */
+};
+
+struct arpc_stat_shm_slot {
+	uint32_t					seq;				/* 奇数表示写入中 */
+	uint32_t					type;				/* enum arpc_stat_shm_type */
+	uint32_t					gen;				/* 槽位每次分配加1，读取方据此区分新旧对象 */
+	uint32_t					resv;
+	uint64_t					update_ns;			/* 本槽位最近一次发布的单调时钟 */
+	char						name[ARPC_STAT_SHM_NAME_LEN];
+	struct arpc_stat_shm_data	data;
+};
+
+/*!
+ * @brief  取槽位的一致快照，不加锁
+ *
+ * @param[in] slot 映射中的槽位
+ * @param[out] out 快照
+ * @return  0 成功；-1 多次重试仍在写入中（写方可能已异常退出）
+ */
+static inline int arpc_stat_shm_read_slot(const struct arpc_stat_shm_slot *slot, struct arpc_stat_shm_slot *out)
+{
+	uint32_t begin;
+	uint32_t retry;
+
+	for (retry = 0; retry < ARPC_STAT_SHM_READ_RETRY; retry++) {
+		begin = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (begin & 1) {
+			continue;
+		}
+		memcpy(out, slot, sizeof(struct arpc_stat_shm_slot));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == begin) {
+			out->seq = begin;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_ARPC_STAT_SHM_H */
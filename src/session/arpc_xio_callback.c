@@ -31,7 +31,7 @@ int msg_head_process(struct xio_session *session, struct xio_msg *msg, void *con
 	int ret = 0;
 	ARPC_CONN_CTX(conn, conn_context);
 	ARPC_LOG_TRACE("rx header, message type:%d, head len:%u, data len:%lu", msg->type, (uint32_t)msg->in.header.iov_len, msg->in.total_data_len);
-	gettimeofday(&conn->rx_now, NULL);	// 线程安全
+	conn->rx_start_ns = fast_clock_ns();
 	switch(msg->type) {
 		case XIO_MSG_TYPE_REQ:
 			ret = process_request_header(conn, msg);
@@ -53,6 +53,7 @@ int msg_data_process(struct xio_session *session,struct xio_msg *msg, int last_i
 {
 	int ret = 0;
 	struct arpc_session_handle *arpc_ses;
+	uint64_t bytes = msg->in.header.iov_len + msg->in.total_data_len;	// 处理过程中可能被释放，先取
 	ARPC_CONN_CTX(conn, conn_context);
 	ARPC_LOG_TRACE("rx data, msg type:%d, head len:%u, data len:%lu", msg->type, (uint32_t)msg->in.header.iov_len, msg->in.total_data_len);
 	ret = keep_conn_heartbeat(conn);
@@ -60,25 +61,26 @@ int msg_data_process(struct xio_session *session,struct xio_msg *msg, int last_i
 	ret = check_xio_msg_valid(conn, &msg->in);
 	LOG_THEN_RETURN_VAL_IF_TRUE(ret, -1, "check_xio_msg_valid fail.");
 
+	conn->stats.rx_bytes += bytes;
 	switch(msg->type) {
 		case XIO_MSG_TYPE_REQ:
-			conn->rx_req_count++;
+			conn->stats.rx_req++;
 			ret = process_request_data(conn, msg, last_in_rxq);
-			statistics_per_time(&conn->rx_now, &conn->rx_req, 5);
+			arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_RX_REQ, conn->rx_start_ns);
 			break;
 		case XIO_MSG_TYPE_RSP:
-			conn->rx_rsp_count++;
+			conn->stats.rx_rsp++;
 			ret = process_rsp_data(conn, msg, last_in_rxq);
-			statistics_per_time(&conn->rx_now, &conn->rx_rsp, 5);
+			arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_RX_RSP, conn->rx_start_ns);
 			break;
 		case XIO_MSG_TYPE_ONE_WAY:
-			conn->rx_ow_count++;
+			conn->stats.rx_ow++;
 			if (arpc_get_conn_type(conn) == ARPC_CON_TYPE_SERVER) {
 				ret = set_connection_io_type(conn, ARPC_IO_TYPE_IN);
 				LOG_ERROR_IF_VAL_TRUE(ret, "set_connection_rx_mode fail.");
 			}
 			ret = process_oneway_data(conn, msg, last_in_rxq);
-			statistics_per_time(&conn->rx_now, &conn->rx_ow, 5);
+			arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_RX_OW, conn->rx_start_ns);
 			break;
 		default:
 			break;
@@ -141,6 +143,7 @@ int oneway_send_complete(struct xio_session *session, struct xio_msg *msg, void
 
 	ARPC_LOG_TRACE("send oneway msg complete.");
 	com_msg = (struct arpc_common_msg *)(msg->user_context);
+	arpc_stat_lat(&conn->stats, ARPC_STAT_LAT_OW, com_msg->start_ns);
 
 	ret = arpc_connection_send_comp_notify(conn, com_msg);
 	LOG_ERROR_IF_VAL_TRUE(ret, "arpc_connection_send_comp_notify fail.");
@@ -167,6 +170,8 @@ int message_error(struct xio_session *session, enum xio_status error, enum xio_m
 				arpc_oneway_send_complete(com_msg);
 			}else if(rsp->type == XIO_MSG_TYPE_RSP) {
 				arpc_send_response_complete(com_msg);
+			}else if(rsp->type == XIO_MSG_TYPE_REQ && com_msg && com_msg->magic == ARPC_COM_MSG_MAGIC) {
+				arpc_request_fail(com_msg, -ECONNRESET);	// 请求未送达或链路清空，不会再有回复
 			}
 			break;
 		case XIO_MSG_DIRECTION_IN: